@@ -0,0 +1,354 @@
+#include "almacen.h"
+
+#include <QDir>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "discoio.h"
+#include "hash64.h"
+#include "paralelo.h"
+#include "raid.h"
+#include "simd.h"
+#include "snapshot.h"
+
+namespace {
+
+const long TAM_FRAGMENTO = 64L * 1024;
+const long FRAGMENTOS_POR_LOTE = 256;  // 16 MiB por lote
+const uint64_t SEMILLA_B = 0x9e3779b97f4a7c15ULL;
+const char MAGIC_IMAGEN[8] = {'P', '2', 'S', 'T', 'O', 'R', 'E', 0};
+
+struct CabeceraImagen {
+  char magic[8];
+  int version;
+  int archivos;
+};
+
+struct CabeceraArchivoImagen {
+  int rol;
+  int reservado;
+  long long tam;
+  long long fragmentos;
+};
+
+ClaveFragmento claveDe(const char* datos) {
+  if (esCero(datos, TAM_FRAGMENTO)) return {0, 0};
+  return {
+    hash64(datos, TAM_FRAGMENTO), hash64(datos, TAM_FRAGMENTO, SEMILLA_B)};
+}
+
+QString aHex(const ClaveFragmento& c) {
+  char txt[33];
+  snprintf(txt, sizeof(txt), "%016llx%016llx",
+    static_cast<unsigned long long>(c.a), static_cast<unsigned long long>(c.b));
+  return QString(txt);
+}
+
+bool desdeHex(const std::string& txt, ClaveFragmento& c) {
+  if (txt.size() != 32 ||
+      txt.find_first_not_of("0123456789abcdef") != std::string::npos)
+    return false;
+  c.a = strtoull(txt.substr(0, 16).c_str(), nullptr, 16);
+  c.b = strtoull(txt.substr(16).c_str(), nullptr, 16);
+  return true;
+}
+
+// Escribe aparte y renombra: el archivo final nunca queda a medias
+bool escribirAtomico(const QString& ruta, const char* datos, long n) {
+  QString tmp = ruta + ".tmp";
+  int fd = open(tmp.toStdString().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  bool ok = escribirCompleto(fd, 0, datos, n) && fdatasync(fd) == 0;
+  close(fd);
+  if (ok)
+    ok = rename(tmp.toStdString().c_str(), ruta.toStdString().c_str()) == 0;
+  if (!ok) unlink(tmp.toStdString().c_str());
+  return ok;
+}
+
+}  // namespace
+
+QString AlmacenFragmentos::abrir(
+  const QString& dir, bool exclusivo, AlmacenFragmentos& almacen) {
+  almacen.dir_ = dir;
+  almacen.refs_.clear();
+  almacen.cerrojo_.reset();
+  if (!QDir().mkpath(dir + "/fragmentos") || !QDir().mkpath(dir + "/imagenes"))
+    return "No se pudo crear el almacén en " + dir + ".";
+  almacen.cerrojo_ =
+    std::make_unique<CerrojoArchivo>(dir + "/referencias", exclusivo);
+  std::ifstream f((dir + "/referencias").toStdString());
+  std::string linea;
+  while (std::getline(f, linea)) {
+    std::istringstream ss(linea);
+    std::string hex;
+    long cantidad = 0;
+    ClaveFragmento c;
+    if (!(ss >> hex >> cantidad) || !desdeHex(hex, c) || cantidad <= 0)
+      return "Índice de referencias dañado en " + dir + ".";
+    almacen.refs_[c] = cantidad;
+  }
+  return QString();
+}
+
+QString AlmacenFragmentos::rutaFragmento(const ClaveFragmento& c) const {
+  QString hex = aHex(c);
+  return dir_ + "/fragmentos/" + hex.left(2) + "/" + hex;
+}
+
+QString AlmacenFragmentos::rutaImagen(const QString& nombre) const {
+  return dir_ + "/imagenes/" + nombre + ".idx";
+}
+
+bool AlmacenFragmentos::guardarReferencias() const {
+  std::ostringstream ss;
+  for (const auto& r : refs_)
+    ss << aHex(r.first).toStdString() << ' ' << r.second << '\n';
+  std::string txt = ss.str();
+  return escribirAtomico(dir_ + "/referencias", txt.data(),
+    static_cast<long>(txt.size()));
+}
+
+bool AlmacenFragmentos::leerImagen(
+  const QString& nombre, std::vector<ArchivoImagen>& archivos) const {
+  std::ifstream f(rutaImagen(nombre).toStdString(), std::ios::binary);
+  CabeceraImagen cab;
+  if (!f.read(reinterpret_cast<char*>(&cab), sizeof(cab)) ||
+      memcmp(cab.magic, MAGIC_IMAGEN, sizeof(MAGIC_IMAGEN)) != 0 ||
+      cab.archivos < 1)
+    return false;
+  archivos.clear();
+  for (int i = 0; i < cab.archivos; ++i) {
+    CabeceraArchivoImagen ca;
+    if (!f.read(reinterpret_cast<char*>(&ca), sizeof(ca)) || ca.tam < 0 ||
+        ca.fragmentos != (ca.tam + TAM_FRAGMENTO - 1) / TAM_FRAGMENTO)
+      return false;
+    ArchivoImagen a{ca.rol, ca.tam, {}};
+    a.claves.resize(static_cast<size_t>(ca.fragmentos));
+    auto bytes = a.claves.size() * sizeof(ClaveFragmento);
+    if (!f.read(reinterpret_cast<char*>(a.claves.data()),
+          static_cast<std::streamsize>(bytes)))
+      return false;
+    archivos.push_back(std::move(a));
+  }
+  return true;
+}
+
+bool AlmacenFragmentos::guardarImagen(
+  const QString& nombre, const std::vector<ArchivoImagen>& archivos) const {
+  std::string datos;
+  CabeceraImagen cab;
+  memset(&cab, 0, sizeof(cab));
+  memcpy(cab.magic, MAGIC_IMAGEN, sizeof(MAGIC_IMAGEN));
+  cab.version = 1;
+  cab.archivos = static_cast<int>(archivos.size());
+  datos.append(reinterpret_cast<const char*>(&cab), sizeof(cab));
+  for (const auto& a : archivos) {
+    CabeceraArchivoImagen ca{a.rol, 0, a.tam,
+      static_cast<long long>(a.claves.size())};
+    datos.append(reinterpret_cast<const char*>(&ca), sizeof(ca));
+    datos.append(reinterpret_cast<const char*>(a.claves.data()),
+      a.claves.size() * sizeof(ClaveFragmento));
+  }
+  return escribirAtomico(
+    rutaImagen(nombre), datos.data(), static_cast<long>(datos.size()));
+}
+
+void AlmacenFragmentos::ajustarReferencias(
+  const std::vector<ArchivoImagen>& archivos, int delta) {
+  for (const auto& a : archivos)
+    for (const auto& c : a.claves)
+      if (!c.esCeros()) refs_[c] += delta;
+  for (auto it = refs_.begin(); it != refs_.end();) {
+    if (it->second > 0) {
+      ++it;
+      continue;
+    }
+    unlink(rutaFragmento(it->first).toStdString().c_str());
+    it = refs_.erase(it);
+  }
+}
+
+QString AlmacenFragmentos::ingresarArchivo(const QString& ruta, int rol,
+  unsigned hilos, ArchivoImagen& arch, EstadisticasAlmacen& est) {
+  int fd = open(ruta.toStdString().c_str(), O_RDONLY);
+  if (fd < 0) return "No se pudo abrir " + ruta + ".";
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return "No se pudo leer el tamaño de " + ruta + ".";
+  }
+  arch.rol = rol;
+  arch.tam = st.st_size;
+  long total =
+    static_cast<long>((arch.tam + TAM_FRAGMENTO - 1) / TAM_FRAGMENTO);
+  arch.claves.assign(static_cast<size_t>(total), ClaveFragmento{0, 0});
+  est.bytesLogicos += arch.tam;
+
+  // Solo se leen los fragmentos que tocan extensiones con datos
+  std::vector<long> conDatos;
+  for (const Extension& e : extensionesDeDatos(fd, static_cast<long>(arch.tam)))
+    for (long f = e.inicio / TAM_FRAGMENTO;
+         f * TAM_FRAGMENTO < e.inicio + e.tam; ++f)
+      if (conDatos.empty() || conDatos.back() < f) conDatos.push_back(f);
+
+  std::vector<char> lote(
+    static_cast<size_t>(FRAGMENTOS_POR_LOTE * TAM_FRAGMENTO));
+  std::atomic<bool> fallo{false};
+  for (size_t i0 = 0; i0 < conDatos.size() && !fallo;
+       i0 += FRAGMENTOS_POR_LOTE) {
+    size_t n = std::min<size_t>(FRAGMENTOS_POR_LOTE, conDatos.size() - i0);
+    // Lectura y hash en paralelo
+    ejecutarEnParalelo(n, hilos, [&](size_t i) {
+      long f = conDatos[i0 + i];
+      char* datos = lote.data() + i * TAM_FRAGMENTO;
+      long len = std::min<long>(TAM_FRAGMENTO, arch.tam - f * TAM_FRAGMENTO);
+      memset(datos + len, 0, static_cast<size_t>(TAM_FRAGMENTO - len));
+      if (!leerCompleto(fd, f * TAM_FRAGMENTO, datos, len)) {
+        fallo = true;
+        return;
+      }
+      arch.claves[f] = claveDe(datos);
+    });
+    if (fallo) break;
+    // Los fragmentos que el almacén no tiene se escriben (también en
+    // paralelo); el registro con 0 referencias evita escribirlos dos veces
+    std::vector<size_t> nuevos;
+    for (size_t i = 0; i < n; ++i) {
+      const ClaveFragmento& c = arch.claves[conDatos[i0 + i]];
+      if (c.esCeros() || refs_.count(c)) continue;
+      refs_[c] = 0;
+      nuevos.push_back(i);
+    }
+    ejecutarEnParalelo(nuevos.size(), hilos, [&](size_t k) {
+      size_t i = nuevos[k];
+      QString destino = rutaFragmento(arch.claves[conDatos[i0 + i]]);
+      int barra = destino.lastIndexOf('/');
+      if (!QDir().mkpath(destino.left(barra)) ||
+          !escribirAtomico(
+            destino, lote.data() + i * TAM_FRAGMENTO, TAM_FRAGMENTO))
+        fallo = true;
+    });
+    est.nuevos += static_cast<long long>(nuevos.size());
+  }
+  close(fd);
+  return fallo ? "Error al copiar " + ruta + " al almacén." : QString();
+}
+
+QString AlmacenFragmentos::ingresar(const QString& path, const QString& nombre,
+  unsigned hilos, EstadisticasAlmacen& est) {
+  if (!nombreSnapshotValido(nombre))
+    return "Nombre de imagen inválido (letras, números, _ y -).";
+  QStringList archivos = archivosDeDisco(path);
+  for (const QString& a : archivos) {
+    if (!fileExists(a)) return "No existe " + a + ".";
+    if (tieneCapas(a))
+      return a + " tiene snapshots con capas delta; bórrelos antes.";
+  }
+  std::vector<ArchivoImagen> nueva(static_cast<size_t>(archivos.size()));
+  QString error;
+  for (int i = 0; i < archivos.size() && error.isEmpty(); ++i)
+    error = ingresarArchivo(archivos[i], i, hilos, nueva[i], est);
+  std::vector<ArchivoImagen> anterior;
+  bool habia = error.isEmpty() && leerImagen(nombre, anterior);
+  if (error.isEmpty() && !guardarImagen(nombre, nueva))
+    error = "No se pudo guardar la imagen " + nombre + ".";
+  if (!error.isEmpty()) {
+    // Descarta los fragmentos recién escritos (quedaron con 0 referencias)
+    ajustarReferencias({}, 0);
+    return error;
+  }
+  ajustarReferencias(nueva, 1);
+  if (habia) ajustarReferencias(anterior, -1);
+  if (!guardarReferencias()) return "No se pudo guardar el índice del almacén.";
+  return QString();
+}
+
+QString AlmacenFragmentos::extraer(
+  const QString& nombre, const QString& path, unsigned hilos) {
+  std::vector<ArchivoImagen> archivos;
+  if (!leerImagen(nombre, archivos))
+    return "No existe la imagen " + nombre + " en el almacén.";
+  for (const auto& a : archivos)
+    if (fileExists(rutaMiembro(path, a.rol)))
+      return "Ya existe " + rutaMiembro(path, a.rol) + ".";
+
+  QStringList creados;
+  QString error;
+  for (const auto& a : archivos) {
+    QString ruta = rutaMiembro(path, a.rol);
+    descartarSnapshots(ruta);
+    int fd = open(ruta.toStdString().c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(a.tam)) != 0) {
+      if (fd >= 0) close(fd);
+      error = "No se pudo crear " + ruta + ".";
+      break;
+    }
+    creados << ruta;
+    // Los fragmentos en ceros quedan como huecos del archivo disperso
+    std::atomic<bool> fallo{false};
+    ejecutarEnParalelo(a.claves.size(), hilos, [&](size_t f) {
+      const ClaveFragmento& c = a.claves[f];
+      if (c.esCeros() || fallo) return;
+      std::vector<char> datos(TAM_FRAGMENTO);
+      int fdFrag = open(rutaFragmento(c).toStdString().c_str(), O_RDONLY);
+      bool ok = fdFrag >= 0 &&
+                leerCompleto(fdFrag, 0, datos.data(), TAM_FRAGMENTO) &&
+                claveDe(datos.data()) == c;
+      if (fdFrag >= 0) close(fdFrag);
+      long pos = static_cast<long>(f) * TAM_FRAGMENTO;
+      long len = std::min<long>(TAM_FRAGMENTO, a.tam - pos);
+      if (!ok || !escribirCompleto(fd, pos, datos.data(), len)) fallo = true;
+    });
+    if (fallo || fdatasync(fd) != 0)
+      error = "Fragmento faltante o dañado al restaurar " + ruta + ".";
+    close(fd);
+    if (!error.isEmpty()) break;
+  }
+  if (!error.isEmpty())
+    for (const QString& r : creados) unlink(r.toStdString().c_str());
+  return error;
+}
+
+QString AlmacenFragmentos::borrar(const QString& nombre) {
+  std::vector<ArchivoImagen> archivos;
+  if (!leerImagen(nombre, archivos))
+    return "No existe la imagen " + nombre + " en el almacén.";
+  if (unlink(rutaImagen(nombre).toStdString().c_str()) != 0)
+    return "No se pudo borrar la imagen " + nombre + ".";
+  ajustarReferencias(archivos, -1);
+  if (!guardarReferencias()) return "No se pudo guardar el índice del almacén.";
+  return QString();
+}
+
+QStringList AlmacenFragmentos::imagenes() const {
+  QStringList nombres;
+  for (const QString& f : QDir(dir_ + "/imagenes")
+                            .entryList(QStringList() << "*.idx", QDir::Files,
+                              QDir::Name))
+    nombres << f.left(f.size() - 4);
+  return nombres;
+}
+
+QString AlmacenFragmentos::estadisticas(EstadisticasAlmacen& est) const {
+  for (const QString& nombre : imagenes()) {
+    std::vector<ArchivoImagen> archivos;
+    if (!leerImagen(nombre, archivos))
+      return "La imagen " + nombre + " está dañada.";
+    est.imagenes++;
+    for (const auto& a : archivos) {
+      est.bytesLogicos += a.tam;
+      for (const auto& c : a.claves)
+        if (!c.esCeros()) est.bytesReferenciados += TAM_FRAGMENTO;
+    }
+  }
+  est.fragmentos = static_cast<long long>(refs_.size());
+  est.bytesGuardados = est.fragmentos * TAM_FRAGMENTO;
+  return QString();
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "bloqueos.h"
+
+// Almacén de fragmentos direccionado por contenido (comando store). Los
+// archivos de cada disco se parten en fragmentos fijos de 64 KiB; cada
+// fragmento se guarda una sola vez, identificado por su hash de 128 bits,
+// sin importar cuántos discos o réplicas lo contengan:
+//   <almacen>/fragmentos/<xx>/<hash>  contenido de cada fragmento
+//   <almacen>/imagenes/<nombre>.idx   lista de hashes por archivo del disco
+//   <almacen>/referencias             "hash cantidad" por fragmento
+// Los fragmentos en ceros no se guardan. Un fragmento se borra cuando ya
+// ninguna imagen lo referencia.
+struct ClaveFragmento {
+  uint64_t a;
+  uint64_t b;
+  bool operator==(const ClaveFragmento& o) const {
+    return a == o.a && b == o.b;
+  }
+  bool esCeros() const { return a == 0 && b == 0; }
+};
+
+struct HashClave {
+  size_t operator()(const ClaveFragmento& c) const {
+    return static_cast<size_t>(c.a ^ (c.b * 0x9e3779b97f4a7c15ULL));
+  }
+};
+
+struct EstadisticasAlmacen {
+  int imagenes = 0;
+  long long bytesLogicos = 0;       // tamaño total de los archivos
+  long long bytesReferenciados = 0; // fragmentos con datos, con repeticiones
+  long long bytesGuardados = 0;     // fragmentos únicos en el almacén
+  long long fragmentos = 0;         // fragmentos únicos
+  long long nuevos = 0;             // fragmentos agregados (checkin)
+};
+
+class AlmacenFragmentos {
+ public:
+  // Carga el índice de referencias; el directorio se crea si no existe.
+  // Desde antes de leer el índice y hasta que se destruye el objeto (después
+  // de guardar las referencias) retiene un flock sobre referencias.lock:
+  // exclusivo para checkin y delete, compartido para el resto, así dos
+  // instancias no pierden referencias ni borran fragmentos en uso.
+  static QString abrir(
+    const QString& dir, bool exclusivo, AlmacenFragmentos& almacen);
+
+  // Guarda los archivos del disco (X.disk y su espejo, o los miembros del
+  // conjunto RAID) como la imagen nombre, reemplazándola si ya existía
+  QString ingresar(const QString& path, const QString& nombre, unsigned hilos,
+    EstadisticasAlmacen& est);
+  // Recrea los archivos de la imagen como el disco path
+  QString extraer(
+    const QString& nombre, const QString& path, unsigned hilos);
+  QString borrar(const QString& nombre);
+  QStringList imagenes() const;
+  QString estadisticas(EstadisticasAlmacen& est) const;
+
+ private:
+  struct ArchivoImagen {
+    int rol;  // 0 = X.disk, 1 = X_raid.disk, i >= 2 = miembro i
+    long long tam;
+    std::vector<ClaveFragmento> claves;
+  };
+
+  QString rutaFragmento(const ClaveFragmento& c) const;
+  QString rutaImagen(const QString& nombre) const;
+  QString ingresarArchivo(const QString& ruta, int rol, unsigned hilos,
+    ArchivoImagen& arch, EstadisticasAlmacen& est);
+  bool leerImagen(const QString& nombre, std::vector<ArchivoImagen>& archivos)
+    const;
+  bool guardarImagen(
+    const QString& nombre, const std::vector<ArchivoImagen>& archivos) const;
+  bool guardarReferencias() const;
+  // Suma delta a las referencias de cada fragmento de la imagen; los que
+  // quedan en cero se borran del disco
+  void ajustarReferencias(
+    const std::vector<ArchivoImagen>& archivos, int delta);
+
+  QString dir_;
+  std::unique_ptr<CerrojoArchivo> cerrojo_;
+  std::unordered_map<ClaveFragmento, long, HashClave> refs_;
+};
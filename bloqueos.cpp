@@ -0,0 +1,295 @@
+#include "bloqueos.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "cache.h"
+#include "dispositivo.h"
+#include "raid.h"
+
+struct ColaBloqueos {
+  struct Pedido {
+    uint64_t turno;
+    long inicio;
+    long fin;
+    bool exclusivo;
+  };
+
+  std::mutex mutex;
+  std::condition_variable cambio;
+  std::list<Pedido> pedidos;  // Concedidos y en espera, por turno
+  uint64_t siguiente = 0;
+  int usuarios = 0;  // Bloqueos vivos o por pedir; protegido por mutexColas
+};
+
+namespace {
+
+using Reloj = std::chrono::steady_clock;
+
+// Rango ficticio, más allá de cualquier dato, que representa los metadatos
+// de asignación del disco (tablas thin, índice comprimido, mapas de capas)
+const long INICIO_ASIGNACION = LONG_MAX - 1;
+
+std::mutex mutexColas;
+std::unordered_map<QString, std::shared_ptr<ColaBloqueos>> colas;
+
+bool chocan(const ColaBloqueos::Pedido& a, const ColaBloqueos::Pedido& b) {
+  return (a.exclusivo || b.exclusivo) && a.inicio < b.fin && b.inicio < a.fin;
+}
+
+void quitarPedido(ColaBloqueos& cola, uint64_t turno) {
+  for (auto it = cola.pedidos.begin(); it != cola.pedidos.end(); ++it)
+    if (it->turno == turno) {
+      cola.pedidos.erase(it);
+      break;
+    }
+}
+
+// Resultado de bloquear un archivo entre procesos
+enum class Archivo { Tomado, NoExiste, Ocupado, Fallo };
+
+// Bloquea los rangos del archivo con bloqueos OFD, un descriptor por rango
+// para que un rango propio no rebaje a otro (o flock si no hay OFD),
+// reintentando hasta el límite. Los bloqueos duran mientras los
+// descriptores agregados a fds estén abiertos. Con Fallo, motivo dice qué
+// impidió bloquear.
+Archivo bloquearArchivo(const QString& ruta,
+  const std::vector<ColaBloqueos::Pedido>& pedidos, Reloj::time_point limite,
+  std::vector<int>& fds, QString& motivo) {
+  std::string nombre = ruta.toStdString();
+  auto fallo = [&](const char* accion, int error) {
+    motivo = QString("no se pudo %1 %2: %3")
+               .arg(accion, ruta, QString(strerror(error)));
+    return Archivo::Fallo;
+  };
+  // Reintenta intentar() (0 o el errno) mientras el bloqueo esté tomado
+  // por otro, hasta agotar la espera
+  auto esperar = [&](const std::function<int()>& intentar) {
+    for (int espera = 1;; espera = std::min(espera * 2, 50)) {
+      int error = intentar();
+      if (error == 0) return Archivo::Tomado;
+      if (error != EAGAIN && error != EACCES && error != EWOULDBLOCK)
+        return fallo("bloquear", error);
+      if (Reloj::now() >= limite) return Archivo::Ocupado;
+      std::this_thread::sleep_for(std::chrono::milliseconds(espera));
+    }
+  };
+  // Un bloqueo de escritura necesita el archivo abierto para escribir
+  int fd = -1;
+  auto abrir = [&](bool exclusivo) {
+    fd = open(nombre.c_str(), (exclusivo ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if (fd >= 0) {
+      fds.push_back(fd);
+      return Archivo::Tomado;
+    }
+    if (errno == ENOENT) return Archivo::NoExiste;  // Miembro que falta
+    return fallo(exclusivo ? "abrir para escritura" : "abrir", errno);
+  };
+
+  bool conOfd = true;
+  for (const auto& pedido : pedidos) {
+    Archivo r = abrir(pedido.exclusivo);
+    if (r != Archivo::Tomado) return r;
+    struct flock fl = {};
+    fl.l_type = pedido.exclusivo ? F_WRLCK : F_RDLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = pedido.inicio;
+    // 0 = hasta el final y más allá
+    fl.l_len = pedido.fin == LONG_MAX ? 0 : pedido.fin - pedido.inicio;
+    r = esperar([&]() {
+      if (fcntl(fd, F_OFD_SETLK, &fl) == 0) return 0;
+      if (errno != EINVAL) return errno;
+      conOfd = false;
+      return 0;
+    });
+    if (!conOfd) break;
+    if (r != Archivo::Tomado) return r;
+  }
+  if (conOfd) return Archivo::Tomado;
+
+  // Con flock no hay rangos: un solo bloqueo por archivo, exclusivo si lo
+  // es algún rango. Las particiones del mismo disco quedan en serie, aun
+  // dentro de este proceso, pero dos escritores nunca creen tener el disco.
+  for (int abierto : fds) close(abierto);
+  fds.clear();
+  bool exclusivo = false;
+  for (const auto& pedido : pedidos) exclusivo = exclusivo || pedido.exclusivo;
+  Archivo r = abrir(exclusivo);
+  if (r != Archivo::Tomado) return r;
+  int op = exclusivo ? LOCK_EX : LOCK_SH;
+  return esperar([&]() { return flock(fd, op | LOCK_NB) == 0 ? 0 : errno; });
+}
+
+// Agranda los rangos para cubrir todo lo que una escritura en ellos puede
+// tocar además de sus bytes, y agrega el rango de los metadatos de
+// asignación si hace falta
+void ampliarPedidos(
+  const QString& path, std::vector<ColaBloqueos::Pedido>& pedidos) {
+  // RAID 5: escribir en una fila recalcula su paridad, que comparte con
+  // las demás unidades de la fila
+  CabeceraRaid cab;
+  if (leerCabeceraRaid(path, cab) && cab.nivel == 5) {
+    long porFila = static_cast<long>(cab.stripe) * (cab.miembros - 1);
+    for (auto& pedido : pedidos) {
+      pedido.inicio -= pedido.inicio % porFila;
+      if (pedido.fin != LONG_MAX)
+        pedido.fin = (pedido.fin + porFila - 1) / porFila * porFila;
+    }
+    // Un rango compartido dentro de uno exclusivo propio sobra: en otro
+    // descriptor chocaría con él
+    const auto& principal = pedidos.front();
+    if (principal.exclusivo)
+      pedidos.erase(std::remove_if(pedidos.begin() + 1, pedidos.end(),
+                      [&](const ColaBloqueos::Pedido& p) {
+                        return principal.inicio <= p.inicio &&
+                               p.fin <= principal.fin;
+                      }),
+        pedidos.end());
+  }
+  // Thin, comprimido o con capas: toda escritura puede asignar espacio al
+  // final del archivo y tocar tablas compartidas por todo el disco, así que
+  // los escritores de rangos distintos se excluyen por ese rango aparte.
+  // Los lectores no lo necesitan: lo ya asignado no se mueve bajo un rango
+  // ajeno.
+  const auto& principal = pedidos.front();
+  if (!principal.exclusivo || principal.fin == LONG_MAX) return;
+  if (asignacionCompartida(path))
+    pedidos.push_back({0, INICIO_ASIGNACION, LONG_MAX, true});
+}
+
+}  // namespace
+
+BloqueoDisco::BloqueoDisco(
+  const QString& path, Modo modo, long inicio, long tam, long tabla) {
+  tomar(path, modo, inicio, tam, tabla);
+}
+
+BloqueoDisco::BloqueoDisco(
+  const QString& a, Modo modoA, const QString& b, Modo modoB) {
+  if (a == b) {
+    tomar(a, modoA == EXCLUSIVO ? modoA : modoB, 0, -1);
+    return;
+  }
+  if (a < b) {
+    tomar(a, modoA, 0, -1);
+    if (tomado()) tomar(b, modoB, 0, -1);
+  } else {
+    tomar(b, modoB, 0, -1);
+    if (tomado()) tomar(a, modoA, 0, -1);
+  }
+}
+
+void BloqueoDisco::tomar(
+  const QString& path, Modo modo, long inicio, long tam, long tabla) {
+  auto limite = Reloj::now() + std::chrono::milliseconds(ESPERA_BLOQUEO_MS);
+  std::shared_ptr<ColaBloqueos> cola;
+  {
+    std::lock_guard<std::mutex> lock(mutexColas);
+    auto& c = colas[path];
+    if (!c) c = std::make_shared<ColaBloqueos>();
+    ++c->usuarios;
+    cola = c;
+  }
+  Tomado t{path, cola, {}, {}};
+  // El rango, la tabla y los metadatos de asignación entran juntos a la
+  // cola, en turnos seguidos
+  std::vector<ColaBloqueos::Pedido> propios{
+    {0, inicio, tam < 0 ? LONG_MAX : inicio + tam, modo == EXCLUSIVO}};
+  if (tabla > 0) propios.push_back({0, 0, tabla, false});
+  ampliarPedidos(path, propios);
+  {
+    std::unique_lock<std::mutex> lock(cola->mutex);
+    auto primero = cola->pedidos.end();
+    for (auto& pedido : propios) {
+      pedido.turno = cola->siguiente++;
+      auto it = cola->pedidos.insert(cola->pedidos.end(), pedido);
+      if (primero == cola->pedidos.end()) primero = it;
+      t.turnos.push_back(pedido.turno);
+    }
+    bool entra = cola->cambio.wait_until(lock, limite, [&]() {
+      for (auto it = cola->pedidos.begin(); it != primero; ++it)
+        for (const auto& pedido : propios)
+          if (chocan(*it, pedido)) return false;
+      return true;
+    });
+    if (!entra) {
+      lock.unlock();
+      soltar(t);
+      error_ = "El disco " + path +
+               " está ocupado por otro comando de esta sesión.";
+      return;
+    }
+  }
+  // Entre procesos: los archivos en orden fijo (principal, espejo o
+  // miembros), así dos instancias no se esperan en círculo
+  for (const QString& archivo : archivosDeDisco(path)) {
+    QString motivo;
+    Archivo r = bloquearArchivo(archivo, propios, limite, t.fds, motivo);
+    if (r == Archivo::Fallo) {
+      soltar(t);
+      error_ = QString("No se pudo coordinar el disco %1 con otros procesos "
+                       "(%2).")
+                 .arg(path, motivo);
+      return;
+    }
+    if (r == Archivo::Ocupado) {
+      soltar(t);
+      error_ = QString("El disco %1 está %2 por otro proceso; se esperó %3 "
+                       "s. Intente de nuevo cuando termine.")
+                 .arg(path)
+                 .arg(modo == EXCLUSIVO ? "en uso" : "siendo modificado")
+                 .arg(ESPERA_BLOQUEO_MS / 1000);
+      return;
+    }
+  }
+  // Lo cacheado de los rangos pudo cambiar en otro proceso mientras no
+  // estaban bloqueados
+  for (const auto& pedido : propios)
+    if (pedido.inicio != INICIO_ASIGNACION)
+      CacheBloques::global().revalidar(
+        path, pedido.inicio, pedido.fin == LONG_MAX ? -1 : pedido.fin);
+  tomados_.push_back(std::move(t));
+}
+
+void BloqueoDisco::soltar(Tomado& t) {
+  for (auto fd = t.fds.rbegin(); fd != t.fds.rend(); ++fd) close(*fd);
+  t.fds.clear();
+  {
+    std::lock_guard<std::mutex> lock(t.cola->mutex);
+    for (uint64_t turno : t.turnos) quitarPedido(*t.cola, turno);
+  }
+  t.cola->cambio.notify_all();
+  // La cola se olvida cuando nadie más la usa
+  std::lock_guard<std::mutex> lock(mutexColas);
+  if (--t.cola->usuarios == 0) colas.erase(t.path);
+}
+
+BloqueoDisco::~BloqueoDisco() {
+  for (auto t = tomados_.rbegin(); t != tomados_.rend(); ++t) soltar(*t);
+}
+
+// -------------------------- CerrojoArchivo --------------------------
+CerrojoArchivo::CerrojoArchivo(const QString& ruta, bool exclusivo) {
+  fd_ = open((ruta + ".lock").toStdString().c_str(),
+    O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd_ >= 0)
+    while (flock(fd_, exclusivo ? LOCK_EX : LOCK_SH) != 0 && errno == EINTR) {
+    }
+}
+
+CerrojoArchivo::~CerrojoArchivo() {
+  if (fd_ >= 0) close(fd_);
+}
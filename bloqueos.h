@@ -0,0 +1,87 @@
+#pragma once
+#include <QString>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct ColaBloqueos;
+
+// Bloqueo de lectura/escritura sobre un disco, o sobre un rango de bytes de
+// él, mientras dure el objeto. Los comandos que solo leen (rep, mount,
+// export, hash) toman bloqueos compartidos y los que modifican (fdisk,
+// rmdisk, snapshot, import) exclusivos, así que comandos sobre discos
+// distintos, o sobre particiones distintas del mismo disco, pueden correr en
+// paralelo desde varios hilos.
+//
+// Dentro del proceso cada disco tiene una cola por orden de llegada: un
+// pedido entra cuando no choca con ninguno anterior (concedido o en espera),
+// de modo que un exclusivo no espera para siempre detrás de lectores que
+// siguen llegando. Un mismo hilo no debe pedir dos veces el mismo disco.
+//
+// Un rango cubre también lo que sus escrituras comparten con otros: en RAID
+// 5 se agranda a filas de paridad completas, y en los discos thin,
+// comprimidos o con capas un rango exclusivo toma además, exclusivos, los
+// metadatos de asignación (dos escritores de ese disco no corren a la vez).
+//
+// Entre procesos (otras instancias o scripts sobre el mismo directorio) se
+// usan bloqueos OFD de fcntl sobre el mismo rango en cada archivo del disco:
+// el principal, su espejo _raid.disk o los miembros RAID, siempre en ese
+// orden. Los lectores de distintos procesos no se esperan entre sí. Si el
+// sistema de archivos no admite OFD se cae a flock, que bloquea el archivo
+// completo. Ninguna espera pasa de ESPERA_BLOQUEO_MS, y un archivo que no se
+// puede abrir o bloquear (salvo un miembro que falta) también deja el
+// bloqueo sin tomar; error() explica por qué.
+class BloqueoDisco {
+ public:
+  enum Modo { COMPARTIDO, EXCLUSIVO };
+  static constexpr int ESPERA_BLOQUEO_MS = 10000;
+
+  // Rango [inicio, inicio + tam) del disco; tam < 0 es el disco completo.
+  // Con tabla > 0 se pide además, compartido y en el mismo turno, el
+  // comienzo [0, tabla) donde está la tabla de particiones: así nadie la
+  // cambia mientras se usa la partición (nbd la retiene todo lo que sirve).
+  BloqueoDisco(const QString& path, Modo modo, long inicio = 0, long tam = -1,
+    long tabla = 0);
+  // Dos discos (origen y destino), tomados en orden de ruta para que dos
+  // comandos no se esperen en círculo
+  BloqueoDisco(
+    const QString& a, Modo modoA, const QString& b, Modo modoB);
+  ~BloqueoDisco();
+  BloqueoDisco(const BloqueoDisco&) = delete;
+  BloqueoDisco& operator=(const BloqueoDisco&) = delete;
+
+  bool tomado() const { return error_.isEmpty(); }
+  // Motivo por el que no se tomó, listo para mostrar
+  const QString& error() const { return error_; }
+
+ private:
+  struct Tomado {
+    QString path;
+    std::shared_ptr<ColaBloqueos> cola;
+    std::vector<uint64_t> turnos;
+    std::vector<int> fds;  // Archivos con bloqueo entre procesos
+  };
+
+  void tomar(
+    const QString& path, Modo modo, long inicio, long tam, long tabla = 0);
+  void soltar(Tomado& t);
+
+  std::vector<Tomado> tomados_;
+  QString error_;
+};
+
+// Bloqueo flock sobre ruta.lock mientras dure el objeto, para archivos
+// auxiliares que varias instancias leen y reescriben (estado de sesión,
+// caché de reportes, almacén de fragmentos): quien lo tiene exclusivo
+// termina sin que otra se meta en medio. Sin soporte de flock se sigue sin
+// bloqueo.
+class CerrojoArchivo {
+ public:
+  CerrojoArchivo(const QString& ruta, bool exclusivo);
+  ~CerrojoArchivo();
+  CerrojoArchivo(const CerrojoArchivo&) = delete;
+  CerrojoArchivo& operator=(const CerrojoArchivo&) = delete;
+
+ private:
+  int fd_;
+};
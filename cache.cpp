@@ -0,0 +1,642 @@
+#include "cache.h"
+
+#include <QtGlobal>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <map>
+#include <shared_mutex>
+
+namespace {
+
+// Accesos de más bloques que esto van directo al disco: los recorridos
+// completos (scrub, export, hash) no deben vaciar la caché de metadatos
+const long MAX_BLOQUES_CACHEADOS = 32;
+const long MAX_VENTANA = 64;  // Bloques de lectura anticipada
+
+// La caché lee y escribe el dispositivo interno sin su mutex, desde varios
+// hilos a la vez. Las lecturas concurrentes son seguras en todos los
+// dispositivos, pero no una escritura junto a ellas (capas de snapshot,
+// diario del espejo): las escrituras van de a una.
+class AccesoOrdenado : public Dispositivo {
+ public:
+  explicit AccesoOrdenado(std::unique_ptr<Dispositivo> interno)
+      : interno_(std::move(interno)) {}
+
+  bool leer(long pos, char* buf, long n) override {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return interno_->leer(pos, buf, n);
+  }
+  bool escribir(long pos, const char* buf, long n) override {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    return interno_->escribir(pos, buf, n);
+  }
+  bool sincronizar() override {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    return interno_->sincronizar();
+  }
+  long tamano() const override { return interno_->tamano(); }
+  bool degradado() const override { return interno_->degradado(); }
+
+ private:
+  std::unique_ptr<Dispositivo> interno_;
+  std::shared_mutex mutex_;
+};
+
+// Dispositivo interno de los escritores abiertos de cada disco
+struct EscritorAbierto {
+  std::weak_ptr<Dispositivo> interno;
+  QString aviso;
+};
+std::mutex mutexEscritores;
+std::map<QString, EscritorAbierto> escritoresAbiertos;
+
+}  // namespace
+
+CacheBloques& CacheBloques::global() {
+  static CacheBloques cache;
+  return cache;
+}
+
+QString CacheBloques::configurar(long capacidad, long tamBloque) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (tamBloque < 512 || tamBloque > 1024 * 1024 ||
+      (tamBloque & (tamBloque - 1)) != 0)
+    return "El bloque debe ser potencia de 2 entre 512 B y 1 MiB.";
+  if (capacidad < tamBloque) return "La caché debe tener al menos un bloque.";
+  for (const EstadoDisco& d : discos_) {
+    if (!d.escritores.empty()) return "Hay discos abiertos para escritura.";
+    for (const auto& par : d.bloques)
+      if (par.second.cargando) return "Hay lecturas en curso en la caché.";
+  }
+  for (size_t i = 0; i < discos_.size(); ++i)
+    descartar(static_cast<int>(i), 0, LONG_MAX, true);
+  capacidad_ = capacidad;
+  tamBloque_ = tamBloque;
+  return QString();
+}
+
+long CacheBloques::bloquesEnUso() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return enUso_;
+}
+
+EstadisticasCache CacheBloques::estadisticas() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void CacheBloques::reiniciarEstadisticas() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_ = EstadisticasCache();
+}
+
+bool CacheBloques::invalidar(const QString& path, long desde, long hasta) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  long primero = std::max(0L, desde) / tamBloque_;
+  long ultimo = hasta < 0 ? LONG_MAX : (hasta + tamBloque_ - 1) / tamBloque_;
+  bool completo = desde <= 0 && hasta < 0;
+  long quedan = 0;
+  for (size_t i = 0; i < discos_.size(); ++i) {
+    EstadoDisco& d = discos_[i];
+    if (d.path != path) continue;
+    if (!d.bloques.empty()) ++stats_.invalidaciones;
+    quedan += descartar(static_cast<int>(i), primero, ultimo, false);
+    if (completo) {
+      d.generacion = 0;
+      d.siguiente = -1;
+    }
+  }
+  cargado_.notify_all();
+  return quedan == 0;
+}
+
+void CacheBloques::revalidar(const QString& path, long desde, long hasta) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  long primero = std::max(0L, desde) / tamBloque_;
+  long ultimo = hasta < 0 ? LONG_MAX : (hasta + tamBloque_ - 1) / tamBloque_;
+  for (size_t i = 0; i < discos_.size(); ++i) {
+    EstadoDisco& d = discos_[i];
+    if (d.path != path || d.escritores.empty()) continue;
+    descartar(static_cast<int>(i), primero, ultimo, false);
+  }
+  cargado_.notify_all();
+}
+
+int CacheBloques::registrar(const QString& path, Dispositivo* escritor) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int i = 0;
+  while (i < static_cast<int>(discos_.size()) && discos_[i].path != path) ++i;
+  if (i == static_cast<int>(discos_.size())) {
+    discos_.emplace_back();
+    discos_.back().path = path;
+  }
+  EstadoDisco& d = discos_[i];
+  // Con un escritor abierto los archivos solo cambian a través de la caché.
+  // Sin escritores, lo sucio que quede es de un cierre que falló.
+  if (d.escritores.empty()) {
+    unsigned long long gen = generacionDisco(path);
+    if (gen != d.generacion) {
+      if (!d.bloques.empty()) ++stats_.invalidaciones;
+      descartar(i, 0, LONG_MAX, true);
+      d.generacion = gen;
+      d.siguiente = -1;
+      cargado_.notify_all();
+    }
+  }
+  if (escritor) d.escritores.push_back(escritor);
+  return i;
+}
+
+bool CacheBloques::cerrar(int disco, Dispositivo* interno) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  bool ok = bajarSucios(lock, disco, *interno, 0, LONG_MAX);
+  EstadoDisco& d = discos_[disco];
+  ok = ok && !d.fallo;
+  d.fallo = false;
+  // Solo esta apertura: otro DiscoEnCache puede compartir el interno
+  auto it = std::find(d.escritores.begin(), d.escritores.end(), interno);
+  if (it != d.escritores.end()) d.escritores.erase(it);
+  if (!ok) ++stats_.vaciadosFallidos;
+  return ok;
+}
+
+void CacheBloques::refrescar(int disco) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  EstadoDisco& d = discos_[disco];
+  if (d.escritores.empty()) d.generacion = generacionDisco(d.path);
+}
+
+CacheBloques::Entrada* CacheBloques::buscar(int disco, long bloque) {
+  auto& bloques = discos_[disco].bloques;
+  auto it = bloques.find(bloque);
+  if (it == bloques.end()) return nullptr;
+  uso_.splice(uso_.begin(), uso_, it->second.uso);
+  return &it->second;
+}
+
+void CacheBloques::quitar(int disco, std::map<long, Entrada>::iterator it) {
+  EstadoDisco& d = discos_[disco];
+  if (it->second.sucio) --d.sucios;
+  uso_.erase(it->second.uso);
+  d.bloques.erase(it);
+  --enUso_;
+}
+
+void CacheBloques::expulsar() {
+  // Desde el menos usado, saltando los sucios y los que se están cargando
+  auto it = uso_.end();
+  while (enUso_ >= capacidad_ / tamBloque_ && it != uso_.begin()) {
+    --it;
+    EstadoDisco& d = discos_[it->first];
+    auto e = d.bloques.find(it->second);
+    if (e->second.sucio || e->second.cargando) continue;
+    auto anterior = std::next(it);
+    quitar(it->first, e);
+    it = anterior;
+    ++stats_.expulsiones;
+  }
+}
+
+CacheBloques::Entrada* CacheBloques::insertar(
+  int disco, long bloque, std::vector<char> datos) {
+  expulsar();
+  uso_.emplace_front(disco, bloque);
+  Entrada& e = discos_[disco].bloques[bloque];
+  e.datos = std::move(datos);
+  e.sucio = false;
+  e.sucioDesde = e.sucioHasta = 0;
+  e.releer = false;
+  e.cargando = false;
+  e.version = ++versiones_;
+  e.uso = uso_.begin();
+  ++enUso_;
+  return &e;
+}
+
+long CacheBloques::descartar(
+  int disco, long desde, long hasta, bool conSucios) {
+  auto& bloques = discos_[disco].bloques;
+  long quedan = 0;
+  auto it = bloques.lower_bound(desde);
+  while (it != bloques.end() && it->first < hasta) {
+    auto sig = std::next(it);
+    // Una carga en curso también se quita: al volver no se inserta
+    Entrada& e = it->second;
+    if (e.sucio && !conSucios) {
+      ++quedan;
+      if (e.sucioHasta - e.sucioDesde < static_cast<long>(e.datos.size()))
+        e.releer = true;
+    } else {
+      quitar(disco, it);
+    }
+    it = sig;
+  }
+  return quedan;
+}
+
+void CacheBloques::marcarSucio(int disco, Entrada& e, long desde, long hasta) {
+  if (!e.sucio) {
+    ++discos_[disco].sucios;
+    e.sucio = true;
+    e.sucioDesde = desde;
+    e.sucioHasta = hasta;
+  } else {
+    // Lo que queda entre dos escrituras también se baja: ambas están en el
+    // rango bloqueado por el escritor, y lo de en medio también
+    e.sucioDesde = std::min(e.sucioDesde, desde);
+    e.sucioHasta = std::max(e.sucioHasta, hasta);
+  }
+  e.version = ++versiones_;
+}
+
+bool CacheBloques::releer(std::unique_lock<std::mutex>& lock, int disco,
+  Dispositivo& interno, long bloque) {
+  Entrada* e = buscar(disco, bloque);
+  if (!e) return true;
+  uint64_t version = e->version;
+  // Lo sucio se toma ahora: si se baja mientras se lee, lo leído puede ser
+  // el contenido viejo de esos bytes
+  long desde = e->sucio ? e->sucioDesde : 0;
+  long hasta = e->sucio ? e->sucioHasta : 0;
+  std::vector<char> datos(e->datos.size());
+  lock.unlock();
+  bool ok = interno.leer(
+    bloque * tamBloque_, datos.data(), static_cast<long>(datos.size()));
+  lock.lock();
+  if (!ok) return false;
+  auto& bloques = discos_[disco].bloques;
+  auto it = bloques.find(bloque);
+  if (it == bloques.end() || it->second.version != version) return true;
+  memcpy(datos.data() + desde, it->second.datos.data() + desde,
+    static_cast<size_t>(hasta - desde));
+  it->second.datos = std::move(datos);
+  it->second.releer = false;
+  return true;
+}
+
+CacheBloques::Entrada* CacheBloques::esperarCarga(
+  std::unique_lock<std::mutex>& lock, int disco, long bloque) {
+  Entrada* e = nullptr;
+  cargado_.wait(lock, [&]() {
+    auto& bloques = discos_[disco].bloques;
+    auto it = bloques.find(bloque);
+    e = it == bloques.end() ? nullptr : &it->second;
+    return !e || !e->cargando;
+  });
+  return e;
+}
+
+bool CacheBloques::bajarSucios(std::unique_lock<std::mutex>& lock,
+  int disco, Dispositivo& interno, long desde, long hasta) {
+  // Tramos de bytes sucios contiguos, copiados con la versión de cada
+  // bloque. Dos bloques seguidos se juntan solo si lo sucio del primero
+  // llega a su final y lo del segundo empieza en su comienzo.
+  struct Tramo {
+    long inicio;  // Posición en el disco
+    std::vector<char> datos;
+    std::vector<std::pair<long, uint64_t>> versiones;
+  };
+  // Un vaciado a la vez por disco: si dos se cruzaran, una versión vieja
+  // podría llegar al archivo después de la nueva que ya quedó limpia
+  cargado_.wait(lock, [&]() { return !discos_[disco].bajando; });
+  std::vector<Tramo> tramos;
+  auto& bloques = discos_[disco].bloques;
+  for (auto it = bloques.lower_bound(desde);
+       it != bloques.end() && it->first < hasta; ++it) {
+    const Entrada& e = it->second;
+    if (!e.sucio) continue;
+    long inicio = it->first * tamBloque_ + e.sucioDesde;
+    if (tramos.empty() ||
+        tramos.back().inicio + static_cast<long>(tramos.back().datos.size()) !=
+          inicio)
+      tramos.push_back({inicio, {}, {}});
+    Tramo& t = tramos.back();
+    t.datos.insert(t.datos.end(), e.datos.begin() + e.sucioDesde,
+      e.datos.begin() + e.sucioHasta);
+    t.versiones.emplace_back(it->first, e.version);
+  }
+  if (tramos.empty()) return true;
+
+  discos_[disco].bajando = true;
+  lock.unlock();
+  std::vector<bool> escritos;
+  for (const Tramo& t : tramos)
+    escritos.push_back(interno.escribir(
+      t.inicio, t.datos.data(), static_cast<long>(t.datos.size())));
+  lock.lock();
+
+  // Un bloque vuelto a escribir mientras tanto sigue sucio
+  EstadoDisco& d = discos_[disco];
+  d.bajando = false;
+  cargado_.notify_all();
+  bool ok = true;
+  for (size_t i = 0; i < tramos.size(); ++i) {
+    if (!escritos[i]) {
+      ok = false;
+      continue;
+    }
+    for (const auto& [bloque, version] : tramos[i].versiones) {
+      auto it = d.bloques.find(bloque);
+      if (it == d.bloques.end() || !it->second.sucio ||
+          it->second.version != version)
+        continue;
+      it->second.sucio = false;
+      it->second.sucioDesde = it->second.sucioHasta = 0;
+      --d.sucios;
+      ++stats_.diferidos;
+    }
+  }
+  return ok;
+}
+
+bool CacheBloques::leer(
+  int disco, Dispositivo& interno, long pos, char* buf, long n) {
+  long tam = interno.tamano();
+  if (pos < 0 || n < 0 || pos + n > tam) return false;
+  if (n == 0) return true;
+  std::unique_lock<std::mutex> lock(mutex_);
+  const long tb = tamBloque_;
+  long primero = pos / tb;
+  long ultimo = (pos + n - 1) / tb;
+  if (ultimo - primero + 1 > MAX_BLOQUES_CACHEADOS) {
+    // Lectura grande: directa. Lo sucio del rango no se baja (el lector no
+    // es dueño de esos bloques): se copia antes y se pone encima al final.
+    ++stats_.directos;
+    std::vector<std::pair<long, std::vector<char>>> sucios;
+    auto& bloques = discos_[disco].bloques;
+    for (auto it = bloques.lower_bound(primero);
+         it != bloques.end() && it->first <= ultimo; ++it) {
+      const Entrada& e = it->second;
+      if (e.sucio)
+        sucios.emplace_back(it->first * tb + e.sucioDesde,
+          std::vector<char>(e.datos.begin() + e.sucioDesde,
+            e.datos.begin() + e.sucioHasta));
+    }
+    lock.unlock();
+    if (!interno.leer(pos, buf, n)) return false;
+    for (const auto& [inicio, datos] : sucios) {
+      long desde = std::max(inicio, pos);
+      long hasta = std::min(inicio + static_cast<long>(datos.size()), pos + n);
+      if (hasta > desde)
+        memcpy(buf + (desde - pos), datos.data() + (desde - inicio),
+          static_cast<size_t>(hasta - desde));
+    }
+    return true;
+  }
+  {
+    EstadoDisco& d = discos_[disco];
+    // Lectura que continúa la anterior: la ventana anticipada crece
+    d.ventana = (pos == d.siguiente)
+                  ? std::min(std::max(2 * d.ventana, 4L), MAX_VENTANA)
+                  : 0;
+    d.siguiente = pos + n;
+  }
+  long totalBloques = (tam + tb - 1) / tb;
+  auto copiar = [&](long b, const char* datos, long len) {
+    long desde = std::max(b * tb, pos);
+    long hasta = std::min(b * tb + len, pos + n);
+    if (hasta > desde)
+      memcpy(buf + (desde - pos), datos + (desde - b * tb),
+        static_cast<size_t>(hasta - desde));
+  };
+  for (long b = primero; b <= ultimo;) {
+    if (Entrada* e = buscar(disco, b)) {
+      if (e->cargando) {
+        esperarCarga(lock, disco, b);
+        continue;  // Se vuelve a buscar: pudo haberse descartado
+      }
+      if (e->releer) {
+        if (!releer(lock, disco, interno, b)) return false;
+        continue;
+      }
+      ++stats_.aciertos;
+      copiar(b, e->datos.data(), static_cast<long>(e->datos.size()));
+      ++b;
+      continue;
+    }
+    // Bloques seguidos que faltan; si llegan al final del pedido se suma
+    // la lectura anticipada
+    EstadoDisco& d = discos_[disco];
+    long faltan = 1;
+    while (b + faltan <= ultimo && !d.bloques.count(b + faltan)) ++faltan;
+    long extra = (b + faltan > ultimo)
+                   ? std::min(d.ventana, totalBloques - (b + faltan))
+                   : 0;
+    // Se reservan marcados como cargando; un bloque anticipado que ya
+    // estaba (quizá sucio) no se pisa
+    std::vector<std::pair<long, uint64_t>> reservados;
+    for (long i = 0; i < faltan + extra; ++i) {
+      if (discos_[disco].bloques.count(b + i)) continue;
+      Entrada* e = insertar(disco, b + i, {});
+      e->cargando = true;
+      reservados.emplace_back(b + i, e->version);
+    }
+    long inicio = b * tb;
+    long len = std::min((faltan + extra) * tb, tam - inicio);
+    std::vector<char> tmp(static_cast<size_t>(len));
+    lock.unlock();
+    bool ok = interno.leer(inicio, tmp.data(), len);
+    lock.lock();
+
+    // Solo se llenan las reservas que siguen siendo las mismas (una
+    // invalidación pudo quitarlas mientras se leía)
+    auto& bloques = discos_[disco].bloques;
+    for (const auto& r : reservados) {
+      auto it = bloques.find(r.first);
+      if (it == bloques.end() || !it->second.cargando ||
+          it->second.version != r.second)
+        continue;
+      if (!ok) {
+        quitar(disco, it);
+        continue;
+      }
+      long desde = (r.first - b) * tb;
+      long lenB = std::min(tb, len - desde);
+      it->second.datos.assign(
+        tmp.begin() + desde, tmp.begin() + desde + lenB);
+      it->second.cargando = false;
+      if (r.first > ultimo) ++stats_.porAdelantado;
+    }
+    cargado_.notify_all();
+    if (!ok) return false;
+    stats_.fallos += faltan;
+    for (long i = 0; i < faltan; ++i)
+      copiar(b + i, tmp.data() + i * tb, std::min(tb, len - i * tb));
+    b += faltan;
+  }
+  return true;
+}
+
+bool CacheBloques::escribir(
+  int disco, Dispositivo& interno, long pos, const char* buf, long n) {
+  long tam = interno.tamano();
+  if (pos < 0 || n < 0 || pos + n > tam) return false;
+  if (n == 0) return true;
+  std::unique_lock<std::mutex> lock(mutex_);
+  const long tb = tamBloque_;
+  long primero = pos / tb;
+  long ultimo = (pos + n - 1) / tb;
+  if (ultimo - primero + 1 > MAX_BLOQUES_CACHEADOS) {
+    // Escritura grande: directa, después de bajar lo sucio del rango
+    ++stats_.directos;
+    if (!bajarSucios(lock, disco, interno, primero, ultimo + 1)) return false;
+    lock.unlock();
+    bool ok = interno.escribir(pos, buf, n);
+    lock.lock();
+    if (!ok) {
+      descartar(disco, primero, ultimo + 1, false);
+      cargado_.notify_all();
+      return false;
+    }
+    // Lo cacheado del rango pudo cargarse, o escribirse en otros bytes del
+    // bloque, mientras tanto: los cubiertos y limpios se quitan, el resto
+    // recibe los bytes nuevos y queda sucio para que caché y disco coincidan
+    auto& bloques = discos_[disco].bloques;
+    auto it = bloques.lower_bound(primero);
+    while (it != bloques.end() && it->first <= ultimo) {
+      auto sig = std::next(it);
+      Entrada& e = it->second;
+      long inicio = it->first * tb;
+      long lenB = static_cast<long>(e.datos.size());
+      long desde = std::max(inicio, pos);
+      long hasta = std::min(inicio + lenB, pos + n);
+      if (e.cargando || (!e.sucio && hasta - desde == lenB)) {
+        quitar(disco, it);
+      } else {
+        memcpy(e.datos.data() + (desde - inicio), buf + (desde - pos),
+          static_cast<size_t>(hasta - desde));
+        marcarSucio(disco, e, desde - inicio, hasta - inicio);
+      }
+      it = sig;
+    }
+    cargado_.notify_all();
+    return true;
+  }
+  for (long b = primero; b <= ultimo;) {
+    long inicio = b * tb;
+    long lenB = std::min(tb, tam - inicio);
+    long desde = std::max(inicio, pos);
+    long hasta = std::min(inicio + lenB, pos + n);
+    Entrada* e = buscar(disco, b);
+    if (e && e->cargando) {
+      esperarCarga(lock, disco, b);
+      continue;
+    }
+    if (e) {
+      ++stats_.aciertos;
+    } else if (hasta - desde == lenB) {
+      ++stats_.fallos;
+      e = insertar(disco, b, std::vector<char>(static_cast<size_t>(lenB)));
+    } else {
+      // Bloque escrito en parte: se completa con lo que hay en el disco,
+      // fuera del mutex
+      ++stats_.fallos;
+      Entrada* reserva = insertar(disco, b, {});
+      reserva->cargando = true;
+      uint64_t version = reserva->version;
+      std::vector<char> datos(static_cast<size_t>(lenB));
+      lock.unlock();
+      bool ok = interno.leer(inicio, datos.data(), lenB);
+      lock.lock();
+      auto& bloques = discos_[disco].bloques;
+      auto it = bloques.find(b);
+      bool propia = it != bloques.end() && it->second.cargando &&
+                    it->second.version == version;
+      if (propia && !ok) quitar(disco, it);
+      cargado_.notify_all();
+      if (!ok) return false;
+      if (!propia) continue;  // Se descartó mientras tanto: otra vuelta
+      it->second.datos = std::move(datos);
+      it->second.cargando = false;
+      e = &it->second;
+    }
+    memcpy(e->datos.data() + (desde - inicio), buf + (desde - pos),
+      static_cast<size_t>(hasta - desde));
+    marcarSucio(disco, *e, desde - inicio, hasta - inicio);
+    ++b;
+  }
+  cargado_.notify_all();
+
+  // Los sucios no se expulsan: pasada la mitad de la caché, el disco que
+  // los escribió los baja él mismo. Si falla se informa al sincronizar.
+  EstadoDisco& d = discos_[disco];
+  if (d.sucios > capacidad_ / tb / 2 &&
+      !bajarSucios(lock, disco, interno, 0, LONG_MAX))
+    discos_[disco].fallo = true;
+  return true;
+}
+
+bool CacheBloques::vaciar(int disco, Dispositivo& interno) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  bool ok = bajarSucios(lock, disco, interno, 0, LONG_MAX);
+  EstadoDisco& d = discos_[disco];
+  ok = ok && !d.fallo;
+  d.fallo = false;
+  return ok;
+}
+
+DiscoEnCache::DiscoEnCache(
+  const QString& path, std::unique_ptr<Dispositivo> interno, bool escritura)
+    : DiscoEnCache(path,
+        std::make_shared<AccesoOrdenado>(std::move(interno)), escritura) {}
+
+DiscoEnCache::DiscoEnCache(
+  const QString& path, std::shared_ptr<Dispositivo> interno, bool escritura)
+    : interno_(std::move(interno)), escritura_(escritura) {
+  disco_ = CacheBloques::global().registrar(
+    path, escritura ? interno_.get() : nullptr);
+}
+
+std::unique_ptr<DiscoEnCache> DiscoEnCache::abrirEscritura(const QString& path,
+  const std::function<std::unique_ptr<Dispositivo>(QString&)>& abrir,
+  QString& aviso) {
+  // La apertura se hace con el mutex tomado: dos escritores que llegan a la
+  // vez no deben abrir cada uno el suyo
+  std::lock_guard<std::mutex> lock(mutexEscritores);
+  EscritorAbierto& e = escritoresAbiertos[path];
+  std::shared_ptr<Dispositivo> interno = e.interno.lock();
+  if (!interno) {
+    e.aviso.clear();
+    auto disco = abrir(e.aviso);
+    if (!disco) {
+      aviso = e.aviso;
+      escritoresAbiertos.erase(path);
+      return nullptr;
+    }
+    interno = std::make_shared<AccesoOrdenado>(std::move(disco));
+    e.interno = interno;
+  }
+  aviso = e.aviso;
+  return std::unique_ptr<DiscoEnCache>(
+    new DiscoEnCache(path, std::move(interno), true));
+}
+
+DiscoEnCache::~DiscoEnCache() {
+  if (!escritura_) return;
+  CacheBloques& cache = CacheBloques::global();
+  // Quien necesita saber si sus datos llegaron llama a sincronizar() antes;
+  // aquí solo queda avisar y contarlo en cache -stats
+  if (!cache.cerrar(disco_, interno_.get()))
+    qWarning("No se pudieron escribir los bloques pendientes del disco al "
+             "cerrarlo.");
+  // El interno termina de replicar al cerrarse (si este era su último
+  // escritor); recién ahí los archivos tienen su generación definitiva
+  interno_.reset();
+  cache.refrescar(disco_);
+}
+
+bool DiscoEnCache::leer(long pos, char* buf, long n) {
+  return CacheBloques::global().leer(disco_, *interno_, pos, buf, n);
+}
+
+bool DiscoEnCache::escribir(long pos, const char* buf, long n) {
+  if (!escritura_) return interno_->escribir(pos, buf, n);
+  return CacheBloques::global().escribir(disco_, *interno_, pos, buf, n);
+}
+
+bool DiscoEnCache::sincronizar() {
+  bool ok = !escritura_ || CacheBloques::global().vaciar(disco_, *interno_);
+  return interno_->sincronizar() && ok;
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include <QString>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "dispositivo.h"
+
+// Contadores de la caché de bloques (cache -stats)
+struct EstadisticasCache {
+  long aciertos = 0;
+  long fallos = 0;
+  long porAdelantado = 0;  // Bloques leídos por lectura anticipada
+  long diferidos = 0;      // Bloques sucios escritos al vaciar
+  long expulsiones = 0;
+  long invalidaciones = 0; // Discos descartados (rmdisk o cambio externo)
+  long directos = 0;       // Accesos grandes que no pasan por la caché
+  long vaciadosFallidos = 0;  // Cierres que no pudieron bajar lo sucio
+};
+
+// Caché de bloques compartida por todos los discos abiertos con
+// abrirDiscoLectura/abrirDiscoEscritura. Expulsa el bloque limpio usado hace
+// más tiempo (LRU), lee por adelantado cuando detecta acceso secuencial y
+// difiere las escrituras hasta sincronizar o cerrar el disco, momento en que
+// se escriben en orden de posición.
+//
+// El mutex protege solo el índice y los contadores: ninguna lectura o
+// escritura de dispositivo se hace con él tomado. Un bloque que falta se
+// inserta marcado "cargando" y se llena al volver la lectura; quien lo pida
+// mientras tanto espera solo por ese bloque. Los bloques sucios no se
+// expulsan: cuando un disco acumula demasiados, el mismo disco que los
+// escribió los baja en su siguiente escritura.
+//
+// Los bloques limpios sobreviven entre comandos; al abrir un disco se
+// compara su generación con la guardada y, si el archivo cambió por otro
+// camino (scrub, convert, pimport...), se descartan. Mientras el disco tiene
+// escritores abiertos eso no sirve (sus propias escrituras cambian la
+// generación), y cada bloqueo de un rango lo revalida (revalidar()).
+class CacheBloques {
+ public:
+  static CacheBloques& global();
+
+  // Cambia capacidad y tamaño de bloque vaciando la caché. Falla si hay
+  // discos abiertos para escritura.
+  QString configurar(long capacidad, long tamBloque);
+  long capacidad() const { return capacidad_; }
+  long tamBloque() const { return tamBloque_; }
+  long bloquesEnUso();
+  EstadisticasCache estadisticas();
+  void reiniciarEstadisticas();
+  // Descarta los bloques limpios del disco en los bytes [desde, hasta)
+  // (hasta < 0: hasta el final), porque el archivo cambió por fuera de la
+  // caché. Los sucios nunca se descartan: son más nuevos que el archivo y
+  // los baja el disco que los escribió. Devuelve false si quedó alguno.
+  bool invalidar(const QString& path, long desde = 0, long hasta = -1);
+  // Se tomó un bloqueo sobre [desde, hasta) del disco (hasta < 0: hasta el
+  // final). Con escritores abiertos en este proceso la generación no se
+  // revisa al abrir, y otro proceso pudo escribir el rango mientras no
+  // estaba bloqueado: lo cacheado en él se descarta como en invalidar().
+  void revalidar(const QString& path, long desde, long hasta);
+
+ private:
+  friend class DiscoEnCache;
+
+  struct Entrada {
+    std::vector<char> datos;
+    bool sucio = false;
+    // Bytes del bloque escritos y no bajados, [sucioDesde, sucioHasta): al
+    // vaciar solo se escriben esos, así no se pisan los de una partición
+    // vecina que comparte el bloque
+    long sucioDesde = 0;
+    long sucioHasta = 0;
+    // Los bytes no sucios pudieron cambiar en el archivo: se vuelven a leer
+    // antes de usarlos
+    bool releer = false;
+    bool cargando = false;  // Leyéndose del disco, sin datos todavía
+    uint64_t version = 0;   // Cambia con cada carga o escritura
+    std::list<std::pair<int, long>>::iterator uso;
+  };
+  struct EstadoDisco {
+    QString path;
+    unsigned long long generacion = 0;
+    std::map<long, Entrada> bloques;
+    // Dispositivos internos abiertos para escribir, uno por DiscoEnCache
+    // (se repite si lo comparten)
+    std::vector<Dispositivo*> escritores;
+    long sucios = 0;      // Bloques sucios en la caché
+    long siguiente = -1;  // Posición que continuaría la última lectura
+    long ventana = 0;     // Bloques a leer por adelantado
+    bool fallo = false;   // Falló un vaciado hecho al escribir
+    bool bajando = false;  // Hay un vaciado escribiendo en el disco
+  };
+
+  CacheBloques() = default;
+  int registrar(const QString& path, Dispositivo* escritor);
+  // Vacía los bloques sucios y deja de contar una apertura de interno como
+  // escritor
+  bool cerrar(int disco, Dispositivo* interno);
+  // Toma la generación actual de los archivos (después de cerrarlos)
+  void refrescar(int disco);
+  bool leer(int disco, Dispositivo& interno, long pos, char* buf, long n);
+  bool escribir(int disco, Dispositivo& interno, long pos, const char* buf,
+    long n);
+  bool vaciar(int disco, Dispositivo& interno);
+
+  // Con mutex_ tomado
+  Entrada* buscar(int disco, long bloque);
+  Entrada* insertar(int disco, long bloque, std::vector<char> datos);
+  void expulsar();
+  void quitar(int disco, std::map<long, Entrada>::iterator it);
+  // Quita los bloques de [desde, hasta), incluidas las cargas en curso; los
+  // sucios solo si conSucios, y si no se marcan para releer lo que no está
+  // sucio. Devuelve cuántos sucios quedaron.
+  long descartar(int disco, long desde, long hasta, bool conSucios);
+  // Marca sucios los bytes [desde, hasta) del bloque
+  void marcarSucio(int disco, Entrada& e, long desde, long hasta);
+  // Vuelve a leer del disco los bytes no sucios del bloque b. Suelta el
+  // mutex mientras lee; si el bloque cambió entretanto no hace nada y quien
+  // llama lo vuelve a buscar.
+  bool releer(std::unique_lock<std::mutex>& lock, int disco,
+    Dispositivo& interno, long bloque);
+  // Espera a que el bloque termine de cargarse; nullptr si ya no está
+  Entrada* esperarCarga(
+    std::unique_lock<std::mutex>& lock, int disco, long bloque);
+  // Escribe los bloques sucios de [desde, hasta) con interno. Suelta el
+  // mutex mientras escribe; lo que cambió entretanto queda sucio.
+  bool bajarSucios(std::unique_lock<std::mutex>& lock, int disco,
+    Dispositivo& interno, long desde, long hasta);
+
+  std::mutex mutex_;
+  // Terminó la carga de algún bloque o un vaciado
+  std::condition_variable cargado_;
+  long capacidad_ = 16L * 1024 * 1024;
+  long tamBloque_ = 4096;
+  long enUso_ = 0;  // Bloques en la caché
+  uint64_t versiones_ = 0;
+  std::vector<EstadoDisco> discos_;
+  std::list<std::pair<int, long>> uso_;  // Más reciente al frente
+  EstadisticasCache stats_;
+};
+
+// Dispositivo que pasa por la caché compartida. Las escrituras quedan en la
+// caché hasta sincronizar() o hasta que se cierra el dispositivo.
+class DiscoEnCache : public Dispositivo {
+ public:
+  DiscoEnCache(const QString& path, std::unique_ptr<Dispositivo> interno,
+    bool escritura);
+  // Para escribir. Los escritores de un mismo disco en este proceso usan un
+  // solo dispositivo interno: si ya hay uno abierto, abrir no se llama y
+  // aviso es el de la primera apertura. Así el estado propio del formato
+  // (tablas thin, paridad RAID, diario del espejo) no queda duplicado, y el
+  // vaciado de bloques ajenos pasa por el mismo dispositivo que los escribió.
+  static std::unique_ptr<DiscoEnCache> abrirEscritura(const QString& path,
+    const std::function<std::unique_ptr<Dispositivo>(QString&)>& abrir,
+    QString& aviso);
+  ~DiscoEnCache() override;
+
+  bool leer(long pos, char* buf, long n) override;
+  bool escribir(long pos, const char* buf, long n) override;
+  bool sincronizar() override;
+  long tamano() const override { return interno_->tamano(); }
+  bool degradado() const override { return interno_->degradado(); }
+
+ private:
+  DiscoEnCache(
+    const QString& path, std::shared_ptr<Dispositivo> interno, bool escritura);
+
+  std::shared_ptr<Dispositivo> interno_;
+  bool escritura_;
+  int disco_;
+};
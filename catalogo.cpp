@@ -0,0 +1,136 @@
+#include "catalogo.h"
+
+#include <algorithm>
+#include <atomic>
+#include <set>
+
+#include "bloqueos.h"
+#include "discoio.h"
+#include "dispositivo.h"
+#include "estado.h"
+#include "paralelo.h"
+#include "raid.h"
+
+bool esArchivoSecundario(const QString& nombre) {
+  if (!nombre.endsWith(".disk")) return false;
+  QString base = nombre.left(nombre.length() - 5);
+  int pos = base.lastIndexOf("_raid");
+  if (pos <= 0) return false;
+  QString resto = base.mid(pos + 5);
+  for (QChar c : resto)
+    if (!c.isDigit()) return false;
+  return true;
+}
+
+QString describirResumen(const ResumenDisco& r) {
+  if (!r.error.isEmpty()) return "disco ilegible (" + r.error + ")";
+  const double MiB = 1024.0 * 1024.0;
+  QString logicas =
+    r.logicas > 0 ? QString(" (%1 lógicas)").arg(r.logicas) : QString();
+  return QString("%1, %2 part.%3, %4 MiB libres, espejo %5")
+    .arg(r.formato)
+    .arg(r.primarias + (r.extendida ? 1 : 0) + r.logicas)
+    .arg(logicas)
+    .arg(r.libre / MiB, 0, 'f', 1)
+    .arg(r.espejo);
+}
+
+CatalogoDiscos& CatalogoDiscos::global() {
+  static CatalogoDiscos catalogo;
+  return catalogo;
+}
+
+ResumenDisco CatalogoDiscos::resumir(
+  const QString& path, unsigned long long gen) {
+  // Solo la tabla: quien la cambia (fdisk) bloquea el disco entero, y así
+  // una partición servida por NBD no frena el resumen
+  BloqueoDisco bloqueo(path, BloqueoDisco::COMPARTIDO, 0, sizeof(MBR));
+  ResumenDisco r;
+  r.path = path;
+  r.generacion = gen;
+  if (!bloqueo.tomado()) {
+    // Sin generación válida: el siguiente escaneo lo vuelve a intentar
+    r.generacion = 0;
+    r.error = bloqueo.error();
+    return r;
+  }
+  CabeceraRaid cab;
+  bool raid = leerCabeceraRaid(path, cab);
+  r.formato = raid ? QString("raid%1").arg(cab.nivel) : formatoImagen(path);
+  QString aviso;
+  auto disco = abrirDiscoLectura(path, aviso);
+  if (!disco) {
+    r.error = aviso.isEmpty() ? QString("no se pudo abrir") : aviso;
+    return r;
+  }
+  TablaParticiones tabla;
+  if (!leerTabla(*disco, tabla)) {
+    r.error = "no se pudo leer el MBR";
+    return r;
+  }
+  r.error = validarMBR(tabla.mbr, disco->tamano());
+  if (!r.error.isEmpty()) return r;
+
+  r.tamano = tabla.mbr.size;
+  long usado = sizeof(MBR);
+  for (const Partition& p : tabla.mbr.parts) {
+    if (p.status != 1) continue;
+    usado += p.size;
+    r.particiones.emplace_back(QString::fromLatin1(p.name), p.type);
+    if (p.type == 'E') r.extendida = true;
+    else ++r.primarias;
+  }
+  for (const auto& par : tabla.ebrs) {
+    if (par.first.status != 1) continue;
+    r.particiones.emplace_back(QString::fromLatin1(par.first.name), 'L');
+    ++r.logicas;
+  }
+  r.libre = std::max(0L, r.tamano - usado);
+  if (disco->degradado()) r.espejo = "degradado";
+  else if (raid ? cab.nivel != 0 : fileExists(rutaRaid(path)))
+    r.espejo = "ok";
+  else r.espejo = "sin espejo";
+  return r;
+}
+
+std::vector<ResumenDisco> CatalogoDiscos::escanear(
+  const QDir& dir, unsigned hilos, long* releidos) {
+  std::vector<QString> paths;
+  for (const QString& nombre :
+       dir.entryList(QStringList{"*.disk"}, QDir::Files, QDir::Name))
+    if (!esArchivoSecundario(nombre))
+      paths.push_back(dir.absoluteFilePath(nombre));
+
+  // Cada disco cuesta unos stat si está en caché; si no, leer su tabla
+  std::vector<ResumenDisco> res(paths.size());
+  std::atomic<long> leidos{0};
+  ejecutarEnParalelo(paths.size(), hilos, [&](size_t i) {
+    unsigned long long gen = generacionDisco(paths[i]);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = resumenes_.find(paths[i]);
+      if (it != resumenes_.end() && it->second.generacion == gen) {
+        res[i] = it->second;
+        return;
+      }
+    }
+    res[i] = resumir(paths[i], gen);
+    leidos.fetch_add(1);
+    std::lock_guard<std::mutex> lock(mutex_);
+    resumenes_[paths[i]] = res[i];
+  });
+
+  // Se olvidan los discos del directorio que ya no están
+  std::set<QString> vistos(paths.begin(), paths.end());
+  QString prefijo = dir.absolutePath() + "/";
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = resumenes_.begin(); it != resumenes_.end();) {
+    if (it->first.startsWith(prefijo) &&
+        it->first.indexOf('/', prefijo.length()) < 0 &&
+        !vistos.count(it->first))
+      it = resumenes_.erase(it);
+    else ++it;
+  }
+  if (releidos) *releidos = leidos.load();
+  return res;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <QDir>
+#include <QString>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Resumen de un disco para catalog y ls -l, sacado de su MBR y sus EBRs
+struct ResumenDisco {
+  QString path;
+  unsigned long long generacion = 0;
+  QString error;    // Vacío si se pudo leer la tabla de particiones
+  QString formato;  // flat, thin, compressed o raid<nivel>
+  QString espejo;   // ok, degradado o sin espejo
+  long tamano = 0;  // El que indica el MBR
+  long libre = 0;   // Bytes fuera de toda partición primaria o extendida
+  int primarias = 0;
+  int logicas = 0;
+  bool extendida = false;
+  // Nombre y tipo (P, E o L) de cada partición usada
+  std::vector<std::pair<QString, char>> particiones;
+};
+
+// Catálogo de los discos de un directorio. Las tablas de particiones se leen
+// en paralelo y el resumen de cada disco se guarda en memoria con su
+// generación (inodo, tamaño y fecha de modificación de sus archivos): en un
+// nuevo escaneo solo se releen los discos que cambiaron.
+class CatalogoDiscos {
+ public:
+  static CatalogoDiscos& global();
+
+  // Discos del directorio ordenados por nombre, sin los espejos ni los
+  // demás miembros RAID. releidos cuenta los que no estaban en caché.
+  std::vector<ResumenDisco> escanear(
+    const QDir& dir, unsigned hilos, long* releidos = nullptr);
+
+ private:
+  static ResumenDisco resumir(const QString& path, unsigned long long gen);
+
+  std::mutex mutex_;
+  std::unordered_map<QString, ResumenDisco> resumenes_;
+};
+
+// Archivo de réplica o miembro de otro disco: X_raid.disk o X_raid<n>.disk
+bool esArchivoSecundario(const QString& nombre);
+// "3 part. (1 lógicas), 2.0 MiB libres, espejo ok" para ls -l
+QString describirResumen(const ResumenDisco& r);
@@ -0,0 +1,222 @@
+#include "comprimida.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "discoio.h"
+#include "paralelo.h"
+#include "simd.h"
+
+namespace {
+
+const char MAGIC_ZIP[8] = {'P', '2', 'Z', 'I', 'P', 0, 0, 0};
+const int BITS_CLUSTER = 16;  // 64 KiB
+const long OFF_INDICE = 4096;
+const size_t MAX_CACHE = 64;  // Clusters descomprimidos en memoria
+const long CLUSTERS_POR_LOTE = 64;
+const int NIVEL_ZLIB = 6;
+
+bool esCeros(const char* datos, long n) {
+  return esCero(datos, static_cast<size_t>(n));
+}
+
+// Comprime un cluster; si no se gana espacio se guarda tal cual
+QByteArray comprimir(const char* datos, long n, bool& crudo) {
+  QByteArray z =
+    qCompress(reinterpret_cast<const uchar*>(datos), n, NIVEL_ZLIB);
+  crudo = z.size() >= n;
+  return crudo ? QByteArray(datos, static_cast<int>(n)) : z;
+}
+
+}  // namespace
+
+bool esImagenComprimida(const QString& path) {
+  int fd = open(path.toStdString().c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  char magic[8];
+  bool ok = leerCompleto(fd, 0, magic, sizeof(magic)) &&
+            memcmp(magic, MAGIC_ZIP, sizeof(magic)) == 0;
+  close(fd);
+  return ok;
+}
+
+QString crearImagenComprimida(
+  Dispositivo& origen, const QString& path, unsigned hilos) {
+  CabeceraComprimida cab;
+  memset(&cab, 0, sizeof(cab));
+  memcpy(cab.magic, MAGIC_ZIP, sizeof(MAGIC_ZIP));
+  cab.version = 1;
+  cab.bitsCluster = BITS_CLUSTER;
+  cab.tamVirtual = origen.tamano();
+  cab.offIndice = OFF_INDICE;
+  long tamCluster = 1L << BITS_CLUSTER;
+  cab.clusters = (cab.tamVirtual + tamCluster - 1) / tamCluster;
+  std::vector<EntradaComprimida> indice(static_cast<size_t>(cab.clusters));
+  long tamIndice = static_cast<long>(indice.size() * sizeof(EntradaComprimida));
+  long fin = (OFF_INDICE + tamIndice + 4095) / 4096 * 4096;
+
+  int fd = open(path.toStdString().c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return "No se pudo crear " + path + ".";
+
+  // Por lote: leer, comprimir en paralelo y escribir en orden
+  std::vector<char> lote(static_cast<size_t>(CLUSTERS_POR_LOTE * tamCluster));
+  std::vector<QByteArray> comprimidos(CLUSTERS_POR_LOTE);
+  std::vector<char> crudos(CLUSTERS_POR_LOTE);
+  QString error;
+  for (long c0 = 0; c0 < cab.clusters && error.isEmpty();
+       c0 += CLUSTERS_POR_LOTE) {
+    long n = std::min<long>(CLUSTERS_POR_LOTE, cab.clusters - c0);
+    long inicio = c0 * tamCluster;
+    long bytes = std::min<long>(n * tamCluster, cab.tamVirtual - inicio);
+    // El último cluster se completa con ceros
+    std::fill(lote.begin() + bytes, lote.begin() + n * tamCluster, 0);
+    if (!origen.leer(inicio, lote.data(), bytes)) {
+      error = "Error al leer el disco de origen.";
+      break;
+    }
+    ejecutarEnParalelo(static_cast<size_t>(n), hilos, [&](size_t i) {
+      const char* datos = lote.data() + i * tamCluster;
+      bool crudo = false;
+      comprimidos[i] = esCeros(datos, tamCluster)
+                         ? QByteArray()
+                         : comprimir(datos, tamCluster, crudo);
+      crudos[i] = crudo;
+    });
+    for (long i = 0; i < n; ++i) {
+      EntradaComprimida& e = indice[c0 + i];
+      if (comprimidos[i].isEmpty()) continue;
+      e.off = fin;
+      e.tam = comprimidos[i].size();
+      e.crudo = crudos[i];
+      if (!escribirCompleto(fd, fin, comprimidos[i].constData(), e.tam)) {
+        error = "Error al escribir " + path + ".";
+        break;
+      }
+      fin += e.tam;
+    }
+  }
+  // La cabecera va al final: una imagen a medias no se reconoce como válida
+  if (error.isEmpty() &&
+      (!escribirCompleto(fd, OFF_INDICE,
+         reinterpret_cast<const char*>(indice.data()), tamIndice) ||
+        !escribirCompleto(
+          fd, 0, reinterpret_cast<const char*>(&cab), sizeof(cab)) ||
+        fdatasync(fd) != 0))
+    error = "Error al escribir el índice de " + path + ".";
+  close(fd);
+  if (!error.isEmpty()) unlink(path.toStdString().c_str());
+  return error;
+}
+
+std::unique_ptr<ImagenComprimida> ImagenComprimida::abrir(
+  const QString& path, bool escritura) {
+  std::unique_ptr<ImagenComprimida> img(new ImagenComprimida());
+  img->archivo_ = ArchivoDisco::abrir(path, escritura);
+  if (!img->archivo_) return nullptr;
+  CabeceraComprimida& c = img->cab_;
+  if (!img->archivo_->leer(0, reinterpret_cast<char*>(&c), sizeof(c)) ||
+      memcmp(c.magic, MAGIC_ZIP, sizeof(MAGIC_ZIP)) != 0 ||
+      c.bitsCluster < 12 || c.bitsCluster > 24 || c.clusters < 0)
+    return nullptr;
+  img->tamCluster_ = 1L << c.bitsCluster;
+  img->indice_.resize(static_cast<size_t>(c.clusters));
+  long tamIndice =
+    static_cast<long>(img->indice_.size() * sizeof(EntradaComprimida));
+  if (!img->archivo_->leer(static_cast<long>(c.offIndice),
+        reinterpret_cast<char*>(img->indice_.data()), tamIndice))
+    return nullptr;
+  img->fin_ = img->archivo_->tamano();
+  return img;
+}
+
+void ImagenComprimida::recordar(long c, const QByteArray& datos) {
+  if (cache_.count(c)) {
+    uso_.remove(c);
+  } else if (cache_.size() >= MAX_CACHE) {
+    cache_.erase(uso_.back());
+    uso_.pop_back();
+  }
+  cache_[c] = datos;
+  uso_.push_front(c);
+}
+
+const QByteArray* ImagenComprimida::cluster(long c) {
+  auto it = cache_.find(c);
+  if (it != cache_.end()) {
+    uso_.remove(c);
+    uso_.push_front(c);
+    return &it->second;
+  }
+  const EntradaComprimida& e = indice_[c];
+  QByteArray datos;
+  if (e.off == 0) {
+    datos = QByteArray(static_cast<int>(tamCluster_), '\0');
+  } else {
+    QByteArray guardado(e.tam, '\0');
+    if (!archivo_->leer(static_cast<long>(e.off), guardado.data(), e.tam))
+      return nullptr;
+    datos = e.crudo ? guardado : qUncompress(guardado);
+    if (datos.size() != tamCluster_) return nullptr;
+  }
+  recordar(c, datos);
+  return &cache_[c];
+}
+
+bool ImagenComprimida::guardarCluster(long c, const QByteArray& datos) {
+  EntradaComprimida e{0, 0, 0};
+  if (!esCeros(datos.constData(), tamCluster_)) {
+    bool crudo = false;
+    QByteArray z = comprimir(datos.constData(), tamCluster_, crudo);
+    e = {fin_, z.size(), crudo ? 1 : 0};
+    if (!archivo_->escribir(fin_, z.constData(), z.size())) return false;
+    fin_ += z.size();
+  }
+  long posEntrada = static_cast<long>(cab_.offIndice) +
+                    c * static_cast<long>(sizeof(EntradaComprimida));
+  if (!archivo_->escribir(
+        posEntrada, reinterpret_cast<const char*>(&e), sizeof(e)))
+    return false;
+  indice_[c] = e;
+  recordar(c, datos);
+  return true;
+}
+
+bool ImagenComprimida::leer(long pos, char* buf, long n) {
+  if (pos < 0 || n < 0 || pos + n > cab_.tamVirtual) return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (long p = pos; p < pos + n;) {
+    long c = p / tamCluster_;
+    long desde = p - c * tamCluster_;
+    long len = std::min(tamCluster_ - desde, pos + n - p);
+    if (indice_[c].off == 0) {
+      memset(buf + (p - pos), 0, static_cast<size_t>(len));
+    } else {
+      const QByteArray* datos = cluster(c);
+      if (!datos) return false;
+      memcpy(buf + (p - pos), datos->constData() + desde,
+        static_cast<size_t>(len));
+    }
+    p += len;
+  }
+  return true;
+}
+
+bool ImagenComprimida::escribir(long pos, const char* buf, long n) {
+  if (pos < 0 || n < 0 || pos + n > cab_.tamVirtual) return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (long p = pos; p < pos + n;) {
+    long c = p / tamCluster_;
+    long desde = p - c * tamCluster_;
+    long len = std::min(tamCluster_ - desde, pos + n - p);
+    const QByteArray* actual = cluster(c);
+    if (!actual) return false;
+    QByteArray datos = *actual;
+    memcpy(datos.data() + desde, buf + (p - pos), static_cast<size_t>(len));
+    if (!guardarCluster(c, datos)) return false;
+    p += len;
+  }
+  return true;
+}
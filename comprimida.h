@@ -0,0 +1,64 @@
+#pragma once
+#include <QByteArray>
+#include <QString>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "dispositivo.h"
+
+// Formato de imagen comprimida: clusters de tamaño fijo comprimidos por
+// separado con qCompress, más un índice para acceso aleatorio:
+//   [cabecera][índice: un EntradaComprimida por cluster][datos]
+// Los clusters en ceros no ocupan espacio. Reescribir un cluster agrega la
+// versión nueva al final; el espacio viejo se recupera con convert.
+struct CabeceraComprimida {
+  char magic[8];        // "P2ZIP"
+  int version;          // 1
+  int bitsCluster;      // log2 del tamaño de cluster
+  long long tamVirtual; // tamaño del disco que ve el MBR
+  long long offIndice;
+  long long clusters;
+};
+
+struct EntradaComprimida {
+  long long off;  // posición de los datos (0 si el cluster está en ceros)
+  int tam;        // bytes guardados
+  int crudo;      // 1 si se guardó sin comprimir (no se ganaba espacio)
+};
+
+bool esImagenComprimida(const QString& path);
+// Escribe en path una imagen comprimida con el contenido de origen. Los
+// clusters se comprimen en paralelo por lotes y se escriben en orden.
+QString crearImagenComprimida(
+  Dispositivo& origen, const QString& path, unsigned hilos);
+
+class ImagenComprimida : public Dispositivo {
+ public:
+  static std::unique_ptr<ImagenComprimida> abrir(
+    const QString& path, bool escritura);
+
+  bool leer(long pos, char* buf, long n) override;
+  bool escribir(long pos, const char* buf, long n) override;
+  bool sincronizar() override { return archivo_->sincronizar(); }
+  long tamano() const override { return cab_.tamVirtual; }
+
+ private:
+  ImagenComprimida() = default;
+  // Cluster c descomprimido; el puntero vale hasta la siguiente llamada
+  const QByteArray* cluster(long c);
+  bool guardarCluster(long c, const QByteArray& datos);
+  void recordar(long c, const QByteArray& datos);
+
+  std::unique_ptr<ArchivoDisco> archivo_;
+  CabeceraComprimida cab_{};
+  long tamCluster_ = 0;
+  long fin_ = 0;
+  std::vector<EntradaComprimida> indice_;
+  // Clusters descomprimidos recientes
+  std::unordered_map<long, QByteArray> cache_;
+  std::list<long> uso_;
+  std::mutex mutex_;
+};
@@ -0,0 +1,171 @@
+#include "discoio.h"
+
+#include <QFileInfo>
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+// -------------------- Acceso a los archivos de disco ---------------------
+bool fileExists(const QString& path) {
+  QFileInfo fi(path);
+  return fi.exists() && fi.isFile();
+}
+
+QString rutaRaid(const QString& path) {
+  int pos = path.lastIndexOf(".disk");
+  return path.left(pos) + "_raid.disk";
+}
+
+bool readMBR(Dispositivo& disco, MBR& out) {
+  return disco.leer(0, reinterpret_cast<char*>(&out), sizeof(MBR));
+}
+
+bool writeMBR(Dispositivo& disco, const MBR& mbr) {
+  return disco.escribir(0, reinterpret_cast<const char*>(&mbr), sizeof(MBR));
+}
+
+bool readEBRAt(Dispositivo& disco, long pos, EBR& out) {
+  if (pos < 0) return false;
+  return disco.leer(pos, reinterpret_cast<char*>(&out), sizeof(EBR));
+}
+
+bool writeEBRAt(Dispositivo& disco, long pos, const EBR& ebr) {
+  if (pos < 0) return false;
+  return disco.escribir(pos, reinterpret_cast<const char*>(&ebr), sizeof(EBR));
+}
+
+QString validarMBR(const MBR& mbr, long tamArchivo) {
+  if (mbr.size <= static_cast<int>(sizeof(MBR)))
+    return "tamaño de disco inválido";
+  if (tamArchivo >= 0 && mbr.size > tamArchivo)
+    return "el MBR indica más bytes que el archivo";
+  if (mbr.fit != 'B' && mbr.fit != 'F' && mbr.fit != 'W')
+    return "fit inválido";
+  for (const auto& p : mbr.parts) {
+    if (p.status != 1) continue;
+    if (p.type != 'P' && p.type != 'E')
+      return "tipo de partición inválido";
+    if (p.start < static_cast<int>(sizeof(MBR)) || p.size <= 0 ||
+        static_cast<long>(p.start) + p.size > mbr.size)
+      return "partición fuera de los límites del disco";
+  }
+  return QString();
+}
+
+// Encuentra y copia la partición extendida si existe, retorna true si existe
+bool obtenerExtendida(const MBR& mbr, Partition& extendida) {
+  for (const auto& p : mbr.parts) {
+    if (p.status == 1 && p.type == 'E') {
+      extendida = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Lee los EBRs activos en la partición extendida y devuelve pares (EBR, posEBR)
+std::vector<std::pair<EBR, long>> leerEBRsConPos(
+  Dispositivo& disco, const Partition& extendida) {
+  std::vector<std::pair<EBR, long>> lista;
+  long inicioExt = extendida.start;
+  long finExt = extendida.start + extendida.size;
+
+  // Posición del primer EBR es inicioExt
+  long pos = inicioExt;
+  // Tope seguro de iteraciones
+  // clang-format off
+  size_t maxIter = static_cast<size_t>(extendida.size / std::max(1, static_cast<int>(sizeof(EBR)))) + 10;
+  size_t iter = 0;
+  // clang-format on
+  while (pos >= inicioExt && pos + static_cast<long>(sizeof(EBR)) <= finExt &&
+         iter < maxIter) {
+    EBR ebr;
+    if (!readEBRAt(disco, pos, ebr)) break;
+    if (ebr.status == 1) lista.push_back({ebr, pos});
+
+    long nextPos = ebr.next;
+    // Si next es inválido o no avanza, intentar avanzar físicamente
+    if (nextPos <= pos || nextPos < inicioExt ||
+        nextPos + static_cast<long>(sizeof(EBR)) > finExt) {
+      // Si ebr.size > 0, intentar saltar al final de esta lógica
+      if (ebr.size > 0) {
+        long candidate = pos + static_cast<long>(sizeof(EBR)) + ebr.size;
+        if (candidate > pos &&
+            candidate + static_cast<long>(sizeof(EBR)) <= finExt) {
+          pos = candidate;
+        } else {
+          break;
+        }
+      } else break;  // No hay tamaño, ya no hay más EBRs
+    } else pos = nextPos;
+    iter++;
+  }
+  return lista;
+}
+
+// ------------------ E/S de bajo nivel (descriptores) ---------------------
+bool leerCompleto(int fd, long pos, char* buf, long n) {
+  while (n > 0) {
+    ssize_t r = pread(fd, buf, static_cast<size_t>(n), pos);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    buf += r;
+    pos += r;
+    n -= r;
+  }
+  return true;
+}
+
+bool escribirCompleto(int fd, long pos, const char* buf, long n) {
+  while (n > 0) {
+    ssize_t r = pwrite(fd, buf, static_cast<size_t>(n), pos);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    buf += r;
+    pos += r;
+    n -= r;
+  }
+  return true;
+}
+
+std::vector<Extension> extensionesDeDatos(int fd, long tam) {
+  std::vector<Extension> lista;
+#ifdef SEEK_DATA
+  long pos = 0;
+  while (pos < tam) {
+    off_t datos = lseek(fd, pos, SEEK_DATA);
+    if (datos < 0) {
+      if (errno == ENXIO) break;  // Solo quedan huecos hasta el final
+      // El sistema de archivos no soporta SEEK_DATA: todo son datos
+      return {{0, tam}};
+    }
+    off_t hueco = lseek(fd, datos, SEEK_HOLE);
+    if (hueco < 0 || hueco > tam) hueco = tam;
+    if (hueco > datos)
+      lista.push_back({datos, static_cast<long>(hueco - datos)});
+    pos = hueco;
+  }
+#else
+  if (tam > 0) lista.push_back({0, tam});
+#endif
+  return lista;
+}
+
+std::vector<Extension> unirExtensiones(
+  const std::vector<Extension>& a, const std::vector<Extension>& b) {
+  std::vector<Extension> todas = a;
+  todas.insert(todas.end(), b.begin(), b.end());
+  std::sort(todas.begin(), todas.end(),
+    [](const Extension& x, const Extension& y) { return x.inicio < y.inicio; });
+  std::vector<Extension> unidas;
+  for (const auto& e : todas) {
+    if (!unidas.empty() &&
+        e.inicio <= unidas.back().inicio + unidas.back().tam) {
+      long fin = std::max(unidas.back().inicio + unidas.back().tam,
+        e.inicio + e.tam);
+      unidas.back().tam = fin - unidas.back().inicio;
+    } else unidas.push_back(e);
+  }
+  return unidas;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <QString>
+#include <utility>
+#include <vector>
+
+#include "dispositivo.h"
+#include "estructuras.h"
+
+// Rango de bytes [inicio, inicio + tam) dentro de un archivo de disco
+struct Extension {
+  long inicio;
+  long tam;
+};
+
+// -------------------- Acceso a los archivos de disco ---------------------
+bool fileExists(const QString& path);
+// Ruta del espejo: "X.disk" -> "X_raid.disk"
+QString rutaRaid(const QString& path);
+
+bool readMBR(Dispositivo& disco, MBR& out);
+bool writeMBR(Dispositivo& disco, const MBR& mbr);
+bool readEBRAt(Dispositivo& disco, long pos, EBR& out);
+bool writeEBRAt(Dispositivo& disco, long pos, const EBR& ebr);
+// Revisa que el MBR sea coherente con el archivo. Devuelve el motivo del
+// fallo o una cadena vacía si es válido.
+QString validarMBR(const MBR& mbr, long tamArchivo);
+
+bool obtenerExtendida(const MBR& mbr, Partition& extendida);
+std::vector<std::pair<EBR, long>> leerEBRsConPos(
+  Dispositivo& disco, const Partition& extendida);
+
+// ------------------ E/S de bajo nivel (descriptores) ---------------------
+// Lee/escribe exactamente n bytes en la posición dada (reintenta lecturas
+// cortas). Devuelve false ante error o fin de archivo.
+bool leerCompleto(int fd, long pos, char* buf, long n);
+bool escribirCompleto(int fd, long pos, const char* buf, long n);
+// Extensiones con datos del archivo según SEEK_DATA/SEEK_HOLE. Si el sistema
+// de archivos no lo soporta devuelve el archivo completo como una extensión.
+std::vector<Extension> extensionesDeDatos(int fd, long tam);
+// Unión ordenada y fusionada de dos listas de extensiones
+std::vector<Extension> unirExtensiones(
+  const std::vector<Extension>& a, const std::vector<Extension>& b);
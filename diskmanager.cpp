@@ -1,109 +1,49 @@
 #include "diskmanager.h"
 
-#include <QColor>
+#include <QDateTime>
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFileInfo>
-#include <QPainter>
-#include <QPixmap>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <algorithm>
 #include <cstring>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <set>
 #include <vector>
 
-#include "diskmanager.h"
+#include "almacen.h"
+#include "bloqueos.h"
+#include "cache.h"
+#include "catalogo.h"
+#include "comprimida.h"
+#include "discoio.h"
+#include "estado.h"
+#include "merkle.h"
+#include "montajes.h"
+#include "nbd.h"
+#include "paralelo.h"
+#include "raid.h"
+#include "reporte.h"
+#include "respaldo.h"
+#include "scrub.h"
+#include "simd.h"
+#include "snapshot.h"
 #include "terminal.h"
+#include "thin.h"
+#include "transferencia.h"
+#include "uso.h"
 
 // ----------------------- Structs -------------------------
-struct Partition {
-  char status;    // 0 = libre, 1 = usada
-  char type;      // P, E
-  char fit;       // B, F, W
-  int start;      // byte donde inicia
-  int size;       // tamaño en bytes
-  char name[16];  // nombre
-};
-
-struct MBR {
-  int size;  // tamaño total del disco
-  char fit;  // BF, FF, WF
-  Partition parts[4];
-};
-
-struct EBR {
-  char status;
-  char fit;
-  int start;
-  int size;
-  int next;  // siguiente EBR (posición física)
-  char name[16];
-};
-
 struct Hueco {
   int inicio;
   int tam;
 };
 
-struct PartMontada {
-  QString name;
-  QString id;
-};
-
-struct DiscoMontado {
-  QString path;
-  char letra;
-  std::vector<PartMontada> parts;
-};
-
-struct PartitionInfo {  // para el reporte
-  QString name;         // "MBR", "LIBRE", "PRIMARIA", etc.
-  int start;
-  int size;
-  QString type;
-};
-
 // -------------------- Helpers internos ---------------------
-std::fstream openDiskForReadWrite(const QString& path) {
-  return std::fstream(
-    path.toStdString(), std::ios::in | std::ios::out | std::ios::binary);
-}
-
-std::fstream openDiskForRead(const QString& path) {
-  return std::fstream(path.toStdString(), std::ios::in | std::ios::binary);
-}
-
-bool readMBR(std::fstream& file, MBR& out) {
-  file.seekg(0);
-  file.read(reinterpret_cast<char*>(&out), sizeof(MBR));
-  return static_cast<bool>(file);
-}
-
-bool writeMBR(std::fstream& file, const MBR& mbr) {
-  file.seekp(0);
-  file.write(reinterpret_cast<const char*>(&mbr), sizeof(MBR));
-  file.flush();
-  return static_cast<bool>(file);
-}
-
-bool readEBRAt(std::fstream& file, long pos, EBR& out) {
-  if (pos < 0) return false;
-  file.seekg(pos);
-  file.read(reinterpret_cast<char*>(&out), sizeof(EBR));
-  return static_cast<bool>(file);
-}
-
-bool writeEBRAt(std::fstream& file, long pos, const EBR& ebr) {
-  if (pos < 0) return false;
-  file.seekp(pos);
-  file.write(reinterpret_cast<const char*>(&ebr), sizeof(EBR));
-  file.flush();
-  return static_cast<bool>(file);
-}
-
-bool fileExists(const QString& path) {
-  QFileInfo fi(path);
-  return fi.exists() && fi.isFile();
-}
-
 // Devuelve true si hay slot disponible
 bool haySlotDisponible(const MBR& mbr) {
   for (const auto& p : mbr.parts)
@@ -173,57 +113,6 @@ bool revisarNombreUnicoYExtendida(
   return true;
 }
 
-// Encuentra y copia la partición extendida si existe, retorna true si existe
-bool obtenerExtendida(const MBR& mbr, Partition& extendida) {
-  for (const auto& p : mbr.parts) {
-    if (p.status == 1 && p.type == 'E') {
-      extendida = p;
-      return true;
-    }
-  }
-  return false;
-}
-
-// Lee los EBRs activos en la partición extendida y devuelve pares (EBR, posEBR)
-std::vector<std::pair<EBR, long>> leerEBRsConPos(
-  std::fstream& file, const Partition& extendida) {
-  std::vector<std::pair<EBR, long>> lista;
-  long inicioExt = extendida.start;
-  long finExt = extendida.start + extendida.size;
-
-  // Posición del primer EBR es inicioExt
-  long pos = inicioExt;
-  // Tope seguro de iteraciones
-  // clang-format off
-  size_t maxIter = static_cast<size_t>(extendida.size / std::max(1, static_cast<int>(sizeof(EBR)))) + 10;
-  size_t iter = 0;
-  // clang-format on
-  while (pos >= inicioExt && pos + static_cast<long>(sizeof(EBR)) <= finExt &&
-         iter < maxIter) {
-    EBR ebr;
-    if (!readEBRAt(file, pos, ebr)) break;
-    if (ebr.status == 1) lista.push_back({ebr, pos});
-
-    long nextPos = ebr.next;
-    // Si next es inválido o no avanza, intentar avanzar físicamente
-    if (nextPos <= pos || nextPos < inicioExt ||
-        nextPos + static_cast<long>(sizeof(EBR)) > finExt) {
-      // Si ebr.size > 0, intentar saltar al final de esta lógica
-      if (ebr.size > 0) {
-        long candidate = pos + static_cast<long>(sizeof(EBR)) + ebr.size;
-        if (candidate > pos &&
-            candidate + static_cast<long>(sizeof(EBR)) <= finExt) {
-          pos = candidate;
-        } else {
-          break;
-        }
-      } else break;  // No hay tamaño, ya no hay más EBRs
-    } else pos = nextPos;
-    iter++;
-  }
-  return lista;
-}
-
 bool nombreLogicaDisponible(
   const std::vector<std::pair<EBR, long>>& ebrsPos, const QString& name) {
   for (const auto& p : ebrsPos) {
@@ -295,8 +184,22 @@ bool insertarParticionEnMBR(MBR& mbr, const QString& name, char type, char fit,
   return true;
 }
 
+// Baja las escrituras hechas sobre el disco (la caché las difiere hasta
+// aquí) y las aplica en el espejo o en los miembros del conjunto RAID.
+// Devuelve false, ya informado, si el cambio no llegó al principal; si solo
+// falló el espejo se avisa y el cambio cuenta como hecho.
+bool replicarCambios(Dispositivo& file, QPlainTextEdit* out) {
+  if (!file.sincronizar()) {
+    out->appendPlainText("Error: el cambio no se pudo escribir en el disco.");
+    return false;
+  }
+  if (file.degradado())
+    out->appendPlainText("Aviso: el cambio no se pudo replicar en el RAID.");
+  return true;
+}
+
 // Escribe nuevo EBR en posición posEBR y corrige enlaces prev/next que existan
-bool escribirNuevoEBRConEnlaces(std::fstream& file, const Partition& extendida,
+bool escribirNuevoEBRConEnlaces(Dispositivo& file, const Partition& extendida,
   const std::vector<std::pair<EBR, long>>& ebrsPos, long posEBR, long sizeBytes,
   char fit, const QString& name) {
   long inicioExt = extendida.start;
@@ -346,11 +249,18 @@ bool escribirNuevoEBRConEnlaces(std::fstream& file, const Partition& extendida,
 void DiskManager::mkdisk(
   const QStringList& args, QPlainTextEdit* out, const QDir& currentDir) {
   long sizeBytes = 0;
-  char fit = 'F';      // Primer ajuste por defecto
+  char fit = 0;        // Sin -fit=: primer ajuste (o el de la plantilla)
   QString unit = "m";  // Megabytes por defecto
   QString rawPath;
-
-  if (!mkdiskParams(args, sizeBytes, fit, rawPath, unit, out)) return;
+  int raidNivel = -1;  // Sin -raid=: disco más espejo _raid.disk
+  int miembros = 0;
+  long stripe = 64 * 1024;
+  QString formato = "flat";  // flat o thin
+  QString plantilla;         // -from=: clonar un disco ya preparado
+
+  if (!mkdiskParams(args, sizeBytes, fit, rawPath, unit, raidNivel, miembros,
+        stripe, formato, plantilla, out))
+    return;
   QDir base = currentDir;
   QString finalPath = base.absoluteFilePath(rawPath);
   QFileInfo info(finalPath);
@@ -361,74 +271,190 @@ void DiskManager::mkdisk(
       return;
     }
   }
-  QString raidPath;
-  int pos = finalPath.lastIndexOf(".disk");
-  raidPath = finalPath.left(pos) + "_raid.disk";
-  // Crear discos
-  {
-    std::fstream f(finalPath.toStdString(), std::ios::out | std::ios::binary);
-    if (!f.is_open()) {
-      out->appendPlainText("No se pudo crear el archivo.\n");
+  if (!plantilla.isEmpty()) {
+    QString origen = base.absoluteFilePath(plantilla);
+    BloqueoDisco bloqueo(
+      origen, BloqueoDisco::COMPARTIDO, finalPath, BloqueoDisco::EXCLUSIVO);
+    if (!bloqueo.tomado()) {
+      out->appendPlainText(bloqueo.error() + "\n");
       return;
     }
-    if (sizeBytes > 0) {
-      f.seekp(sizeBytes - 1);
-      f.write("\0", 1);
-    }
-    f.close();
+    mkdiskDesdePlantilla(origen, finalPath, fit, out);
+    return;
   }
-  {
-    std::fstream f(raidPath.toStdString(), std::ios::out | std::ios::binary);
-    if (!f.is_open()) {
-      out->appendPlainText("No se pudo crear el archivo RAID.\n");
-      return;
-    }
-    if (sizeBytes > 0) {
-      f.seekp(sizeBytes - 1);
-      f.write("\0", 1);
-    }
-    f.close();
+  // Nadie lee el disco mientras se crea
+  BloqueoDisco bloqueo(finalPath, BloqueoDisco::EXCLUSIVO);
+  if (!bloqueo.tomado()) {
+    out->appendPlainText(bloqueo.error() + "\n");
+    return;
   }
-  // Escribir MBR inicial
-  {
-    std::fstream file = openDiskForReadWrite(finalPath);
-    if (!file.is_open()) {
-      out->appendPlainText("No se pudo abrir el archivo para escribir MBR.\n");
+  if (fit == 0) fit = 'F';
+  // Conjunto RAID con cabecera: el tamaño pedido es el del disco lógico
+  if (raidNivel >= 0) {
+    QString error;
+    if (!crearConjuntoRaid(
+          finalPath, raidNivel, miembros, stripe, sizeBytes, error)) {
+      out->appendPlainText(error + "\n");
       return;
     }
+    QString aviso;
+    auto file = DiscoRaid::abrir(finalPath, true, aviso);
     MBR m;
     memset(&m, '\0', sizeof(MBR));
     m.size = static_cast<int>(sizeBytes);
     m.fit = fit;
-    if (!writeMBR(file, m)) {
+    if (!file || !writeMBR(*file, m)) {
       out->appendPlainText("Error al escribir MBR.\n");
       return;
     }
-    file.close();
+    out->appendPlainText(
+      "Disco creado con éxito (" + describirRaid(file->cabecera()) + ").\n");
+    return;
+  }
+  QString raidPath;
+  int pos = finalPath.lastIndexOf(".disk");
+  raidPath = finalPath.left(pos) + "_raid.disk";
+  // Un disco nuevo no hereda snapshots ni bloques de uno anterior con la
+  // misma ruta
+  descartarSnapshots(finalPath);
+  descartarSnapshots(raidPath);
+  CacheBloques::global().invalidar(finalPath);
+  // Crear discos
+  if (formato == "thin") {
+    for (const QString& ruta : {finalPath, raidPath}) {
+      QString error = crearImagenThin(ruta, sizeBytes);
+      if (!error.isEmpty()) {
+        out->appendPlainText(error + "\n");
+        return;
+      }
+    }
+  } else {
+    if (!createEmptyDisk(finalPath, sizeBytes, out)) return;
+    if (!createEmptyDisk(raidPath, sizeBytes, out)) return;
   }
+  // Escribir MBR inicial (se replica en el espejo)
   {
-    std::fstream file = openDiskForReadWrite(raidPath);
-    if (!file.is_open()) {
-      out->appendPlainText("No se pudo abrir RAID para escribir MBR.\n");
+    QString aviso;
+    auto file = abrirDiscoEscritura(finalPath, aviso);
+    if (!file) {
+      out->appendPlainText("No se pudo abrir el archivo para escribir MBR.\n");
       return;
     }
     MBR m;
     memset(&m, '\0', sizeof(MBR));
     m.size = static_cast<int>(sizeBytes);
     m.fit = fit;
-    if (!writeMBR(file, m)) {
+    if (!writeMBR(*file, m)) {
+      out->appendPlainText("Error al escribir MBR.\n");
+      return;
+    }
+    if (!file->sincronizar() || file->degradado()) {
       out->appendPlainText("Error al escribir MBR RAID.\n");
       return;
     }
-    file.close();
   }
-  out->appendPlainText("Disco creado con éxito.\n");
+  if (formato == "thin")
+    out->appendPlainText("Disco creado con éxito (thin).\n");
+  else out->appendPlainText("Disco creado con éxito.\n");
+}
+
+// Clona la plantilla con su espejo (o sus miembros RAID) archivo por
+// archivo, con reflink cuando el sistema de archivos lo permite. Los datos
+// no se reescriben: solo el ajuste del MBR, y solo si se indicó -fit.
+void DiskManager::mkdiskDesdePlantilla(const QString& plantilla,
+  const QString& path, char fit, QPlainTextEdit* out) {
+  if (!fileExists(plantilla)) {
+    out->appendPlainText("No existe la plantilla " + plantilla + ".\n");
+    return;
+  }
+  if (archivosDeDisco(plantilla).contains(path)) {
+    out->appendPlainText("El disco nuevo no puede ser la plantilla.\n");
+    return;
+  }
+  QStringList origenes = archivosDeDisco(plantilla);
+  for (const QString& origen : origenes) {
+    if (tieneCapas(origen)) {
+      out->appendPlainText(
+        "La plantilla tiene snapshots por capas; bórrelos antes.\n");
+      return;
+    }
+  }
+  {
+    QString aviso;
+    auto disco = abrirDiscoLectura(plantilla, aviso);
+    if (!disco) {
+      out->appendPlainText("La plantilla no es un disco válido.\n");
+      return;
+    }
+    if (disco->degradado()) {
+      out->appendPlainText(
+        "La plantilla está degradada; ejecute scrub antes de clonarla.\n");
+      return;
+    }
+  }
+  // Como mkdisk, reemplaza el disco que hubiera en la ruta
+  for (const QString& viejo : archivosDeDisco(path)) {
+    descartarSnapshots(viejo);
+    QFile::remove(viejo);
+  }
+  descartarArboles(path);
+  descartarReportes(path);
+  CacheBloques::global().invalidar(path);
+
+  QStringList creados;
+  MetodoCopia metodo = MetodoCopia::Reflink;
+  QString error;
+  for (int i = 0; i < origenes.size() && error.isEmpty(); ++i) {
+    QString destino = rutaMiembro(path, i);
+    MetodoCopia usado;
+    error = clonarArchivo(origenes[i], destino, usado);
+    if (!error.isEmpty()) break;
+    creados << destino;
+    if (static_cast<int>(usado) > static_cast<int>(metodo)) metodo = usado;
+  }
+  if (error.isEmpty() && fit != 0) {
+    QString aviso;
+    auto disco = abrirDiscoEscritura(path, aviso);
+    MBR m;
+    if (!disco || !readMBR(*disco, m)) {
+      error = "No se pudo leer el MBR del disco nuevo.";
+    } else {
+      m.fit = fit;
+      if (!writeMBR(*disco, m) || !disco->sincronizar() || disco->degradado())
+        error = "Error al escribir MBR.";
+    }
+  }
+  if (!error.isEmpty()) {
+    for (const QString& creado : creados) QFile::remove(creado);
+    out->appendPlainText(error + "\n");
+    return;
+  }
+  out->appendPlainText("Disco creado desde plantilla (" +
+                       QString(nombreMetodo(metodo)) + ").\n");
+}
+
+// Archivo plano (disperso) de sizeBytes bytes
+bool DiskManager::createEmptyDisk(
+  const QString& path, long sizeBytes, QPlainTextEdit* out) {
+  std::fstream f(path.toStdString(), std::ios::out | std::ios::binary);
+  if (!f.is_open()) {
+    out->appendPlainText("No se pudo crear el archivo " + path + ".\n");
+    return false;
+  }
+  if (sizeBytes > 0) {
+    f.seekp(sizeBytes - 1);
+    f.write("\0", 1);
+  }
+  f.close();
+  return true;
 }
 
 bool DiskManager::mkdiskParams(const QStringList& args, long& sizeBytes,
-  char& fit, QString& path, QString& unit, QPlainTextEdit* out) {
+  char& fit, QString& path, QString& unit, int& raidNivel, int& miembros,
+  long& stripe, QString& formato, QString& plantilla, QPlainTextEdit* out) {
   bool sizeFound = false;
   bool pathFound = false;
+  bool geometria = false;  // unit, raid, members, stripe o format
 
   // Recorrer la lista de argumentos buscando los argumentos requeridos
   for (const QString& arg : args) {
@@ -451,6 +477,7 @@ bool DiskManager::mkdiskParams(const QStringList& args, long& sizeBytes,
         return false;
       }
     } else if (lowerArg.startsWith("-unit=")) {
+      geometria = true;
       unit = arg.mid(6).toLower();
       if (unit != "k" && unit != "m") {
         out->appendPlainText("Unit inválido, use K o M.\n");
@@ -463,9 +490,49 @@ bool DiskManager::mkdiskParams(const QStringList& args, long& sizeBytes,
         out->appendPlainText("Extensión de disco inválida.\n");
         return false;
       }
+    } else if (lowerArg.startsWith("-raid=")) {
+      bool ok = false;
+      geometria = true;
+      raidNivel = arg.mid(6).toInt(&ok);
+      if (!ok) {
+        out->appendPlainText("Nivel RAID inválido (use 0, 1, 5 o 10).\n");
+        return false;
+      }
+    } else if (lowerArg.startsWith("-members=")) {
+      geometria = true;
+      miembros = arg.mid(9).toInt();
+    } else if (lowerArg.startsWith("-stripe=")) {
+      geometria = true;
+      stripe = arg.mid(8).toLong() * 1024;  // En KiB
+    } else if (lowerArg.startsWith("-format=")) {
+      geometria = true;
+      formato = lowerArg.mid(8);
+      if (formato != "flat" && formato != "thin") {
+        out->appendPlainText("Formato inválido (use flat o thin).\n");
+        return false;
+      }
+    } else if (lowerArg.startsWith("-from=")) {
+      plantilla = arg.mid(6);  // mantener mayúsculas
+      if (!plantilla.endsWith(".disk")) {
+        out->appendPlainText("Extensión de plantilla inválida.\n");
+        return false;
+      }
     }
   }
   // Validaciones
+  if (!plantilla.isEmpty()) {
+    // Tamaño, formato y geometría RAID salen de la plantilla
+    if (sizeFound || geometria) {
+      out->appendPlainText(
+        "Con from solo se admiten path y fit; el resto es de la plantilla.\n");
+      return false;
+    }
+    if (!pathFound) {
+      out->appendPlainText("Falta parámetro path.\n");
+      return false;
+    }
+    return true;
+  }
   if (!sizeFound) {
     out->appendPlainText("Falta parámetro size.\n");
     return false;
@@ -477,9 +544,59 @@ bool DiskManager::mkdiskParams(const QStringList& args, long& sizeBytes,
   // Convertir a bytes según unit
   if (unit == "k") sizeBytes *= 1024;
   else sizeBytes *= 1024 * 1024;
+  // Parámetros RAID
+  if (raidNivel >= 0 && formato != "flat") {
+    out->appendPlainText("Los conjuntos RAID solo usan el formato flat.\n");
+    return false;
+  }
+  if (raidNivel < 0) {
+    if (miembros != 0) {
+      out->appendPlainText("El parámetro members requiere raid.\n");
+      return false;
+    }
+    return true;
+  }
+  if (miembros == 0)
+    miembros = (raidNivel == 5) ? 3 : (raidNivel == 10) ? 4 : 2;
+  QString error = validarParametrosRaid(raidNivel, miembros, stripe);
+  if (!error.isEmpty()) {
+    out->appendPlainText(error + "\n");
+    return false;
+  }
   return true;  // Se encontraron los parámetros obligatorios
 }
 
+// Particiones servidas por NBD, por id de montaje
+static std::map<QString, std::unique_ptr<ServidorNbd>> servidoresNbd;
+
+// Detiene los servidores NBD de las particiones del disco
+void detenerServidoresNbd(const QString& path, QPlainTextEdit* out) {
+  for (auto it = servidoresNbd.begin(); it != servidoresNbd.end();) {
+    if (it->second->path() != path) {
+      ++it;
+      continue;
+    }
+    out->appendPlainText("Servidor NBD de " + it->first + " detenido.");
+    it = servidoresNbd.erase(it);
+  }
+}
+
+// true si una partición del disco (o la de ese id) se sirve por NBD, y lo
+// informa: el servidor la tiene bloqueada y esperarlo acabaría en timeout
+bool servidoPorNbd(
+  const QString& path, QPlainTextEdit* out, const QString& id = QString()) {
+  for (const auto& par : servidoresNbd) {
+    if (par.second->path() != path || (!id.isEmpty() && par.first != id))
+      continue;
+    out->appendPlainText(
+      QString("La partición %1 se está sirviendo por NBD; deténgala con "
+              "nbd -id=%1 -stop.\n")
+        .arg(par.first));
+    return true;
+  }
+  return false;
+}
+
 // RMDISK
 void DiskManager::rmdisk(const QStringList& args, QPlainTextEdit* out,
   const QDir& currentDir, Terminal* terminal) {
@@ -507,15 +624,38 @@ void DiskManager::rmdisk(const QStringList& args, QPlainTextEdit* out,
     delete file;
     return;
   }
+  // Los conjuntos -raid= se eliminan con todos sus miembros
+  QStringList otrosMiembros;
+  CabeceraRaid cab;
+  if (leerCabeceraRaid(finalPath, cab))
+    for (int i = 1; i < cab.miembros; ++i)
+      otrosMiembros << rutaMiembro(finalPath, i);
   terminal->esperandoConfirmacion = true;
   terminal->prompt = ">> ¿Seguro que desea eliminar el disco? Y/N: ";
 
   QObject::connect(
     terminal, &Terminal::confirmacionRecibida, terminal, [=](char r) mutable {
       if (r == 'y') {
-        if (!file->remove())
+        // Los servidores NBD del disco retienen sus particiones: se
+        // detienen antes de bloquearlo, como al desmontar
+        detenerServidoresNbd(finalPath, out);
+        // Se bloquea al confirmar: la pregunta no retiene el disco
+        BloqueoDisco bloqueo(finalPath, BloqueoDisco::EXCLUSIVO);
+        if (!bloqueo.tomado()) {
+          out->appendPlainText(bloqueo.error() + "\n");
+        } else if (!file->remove()) {
           out->appendPlainText("No se pudo eliminar el archivo.\n");
-        else out->appendPlainText("Disco eliminado con éxito.\n");
+        } else {
+          descartarSnapshots(finalPath);
+          descartarArboles(finalPath);
+          descartarReportes(finalPath);
+          CacheBloques::global().invalidar(finalPath);
+          for (const QString& m : otrosMiembros) {
+            QFile::remove(m);
+            descartarSnapshots(m);
+          }
+          out->appendPlainText("Disco eliminado con éxito.\n");
+        }
       } else if (r == 'n') {
         out->appendPlainText("Operación cancelada.\n");
       } else {
@@ -545,11 +685,17 @@ void DiskManager::fdisk(const QStringList& args, QPlainTextEdit* out,
     return;
   QDir base = currentDir;
   QString finalPath = base.absoluteFilePath(rawPath);
+  if (servidoPorNbd(finalPath, out)) return;
   if (!deleteMode.isEmpty()) {
     if (!deleteParticion(finalPath, name, out, terminal))
       out->appendPlainText("Error al eliminar la partición " + name + ".\n");
     return;
   }
+  BloqueoDisco bloqueo(finalPath, BloqueoDisco::EXCLUSIVO);
+  if (!bloqueo.tomado()) {
+    out->appendPlainText(bloqueo.error() + "\n");
+    return;
+  }
   if (addValue != 0) {
     if (addAParticion(finalPath, name, addValue, out))
       out->appendPlainText("Espacio modificado para " + name + ".\n");
@@ -686,57 +832,45 @@ bool DiskManager::fdiskParams(const QStringList& args, long& sizeBytes,
 
 // Crear partición genérica
 bool crearParticionGenerica(const QString& path, const QString& name, char type,
-  long sizeBytes, char fit, QPlainTextEdit* out, bool silencioso = false) {
-  std::fstream file = openDiskForReadWrite(path);
-  if (!file.is_open()) {
-    if (!silencioso) out->appendPlainText("No se pudo abrir el disco.");
+  long sizeBytes, char fit, QPlainTextEdit* out) {
+  QString aviso;
+  auto file = abrirDiscoEscritura(path, aviso);
+  if (!file) {
+    out->appendPlainText("No se pudo abrir el disco.");
     return false;
   }
   MBR mbr;
-  if (!readMBR(file, mbr)) {
-    if (!silencioso) out->appendPlainText("No se pudo leer MBR.");
-    file.close();
+  if (!readMBR(*file, mbr)) {
+    out->appendPlainText("No se pudo leer MBR.");
     return false;
   }
   if (!haySlotDisponible(mbr)) {
-    if (!silencioso)
-      out->appendPlainText("No hay slots de partición disponibles.");
-    file.close();
-    return false;
-  }
-  if (!revisarNombreUnicoYExtendida(mbr, name, type, out)) {
-    file.close();
+    out->appendPlainText("No hay slots de partición disponibles.");
     return false;
   }
+  if (!revisarNombreUnicoYExtendida(mbr, name, type, out)) return false;
   auto usadas = obtenerParticionesUsadasOrdenadas(mbr);
   auto huecos = calcularHuecos(usadas, mbr.size);
-  if (!silencioso) {
-    int maxHueco = 0;
-    for (const auto& h : huecos)
-      if (h.tam > maxHueco) maxHueco = h.tam;
-    out->appendPlainText(
-      "Espacio disponible: " + QString::number(maxHueco) + " Bytes");
-    out->appendPlainText(
-      "Espacio necesario : " + QString::number(sizeBytes) + " Bytes");
-    if (maxHueco < sizeBytes) {
-      out->appendPlainText("...\nNo hay espacio suficiente.");
-      file.close();
-      return false;
-    }
+  int maxHueco = 0;
+  for (const auto& h : huecos)
+    if (h.tam > maxHueco) maxHueco = h.tam;
+  out->appendPlainText(
+    "Espacio disponible: " + QString::number(maxHueco) + " Bytes");
+  out->appendPlainText(
+    "Espacio necesario : " + QString::number(sizeBytes) + " Bytes");
+  if (maxHueco < sizeBytes) {
+    out->appendPlainText("...\nNo hay espacio suficiente.");
+    return false;
   }
   Hueco elegido = elegirHueco(huecos, sizeBytes, fit);
   if (elegido.inicio == -1) {
-    if (!silencioso)
-      out->appendPlainText(
-        "...\nNo se encontró un hueco adecuado según el fit.");
-    file.close();
+    out->appendPlainText(
+      "...\nNo se encontró un hueco adecuado según el fit.");
     return false;
   }
   if (!insertarParticionEnMBR(
         mbr, name, type, fit, sizeBytes, elegido.inicio)) {
-    if (!silencioso)
-      out->appendPlainText("...\nNo hay slots de partición disponibles.");
-    file.close();
+    out->appendPlainText("...\nNo hay slots de partición disponibles.");
     return false;
   }
   // Si extendida, crear EBR inicial (inactivo)
@@ -748,59 +882,45 @@ bool crearParticionGenerica(const QString& path, const QString& name, char type,
     ebr.start = elegido.inicio;
     ebr.size = 0;
     ebr.next = -1;
-    file.seekp(elegido.inicio);
-    file.write(reinterpret_cast<char*>(&ebr), sizeof(EBR));
+    if (!writeEBRAt(*file, elegido.inicio, ebr)) return false;
   }
   // Guardar MBR
-  file.seekp(0);
-  file.write(reinterpret_cast<char*>(&mbr), sizeof(MBR));
-  file.flush();
-  file.close();
-  return true;
+  if (!writeMBR(*file, mbr)) return false;
+  return replicarCambios(*file, out);
 }
 
 bool DiskManager::crearPrimaria(const QString& path, const QString& name,
   long sizeBytes, char fit, QPlainTextEdit* out) {
-  QString raidPath;
-  int pos = path.lastIndexOf(".disk");
-  raidPath = path.left(pos) + "_raid.disk";
-  crearParticionGenerica(raidPath, name, 'P', sizeBytes, fit, out, true);
-  return crearParticionGenerica(path, name, 'P', sizeBytes, fit, out, false);
+  return crearParticionGenerica(path, name, 'P', sizeBytes, fit, out);
 }
 
 bool DiskManager::crearExtendida(const QString& path, const QString& name,
   long sizeBytes, char fit, QPlainTextEdit* out) {
-  QString raidPath;
-  int pos = path.lastIndexOf(".disk");
-  raidPath = path.left(pos) + "_raid.disk";
-  crearParticionGenerica(raidPath, name, 'E', sizeBytes, fit, out, true);
-  return crearParticionGenerica(path, name, 'E', sizeBytes, fit, out, false);
+  return crearParticionGenerica(path, name, 'E', sizeBytes, fit, out);
 }
 
 // Crear lógica
 bool DiskManager::crearLogica(const QString& path, const QString& name,
   long sizeBytes, char fitUser, QPlainTextEdit* out) {
-  std::fstream file = openDiskForReadWrite(path);
-  if (!file.is_open()) {
+  QString aviso;
+  auto file = abrirDiscoEscritura(path, aviso);
+  if (!file) {
     out->appendPlainText("No se pudo abrir el disco.");
     return false;
   }
   MBR mbr;
-  if (!readMBR(file, mbr)) {
+  if (!readMBR(*file, mbr)) {
     out->appendPlainText("No se pudo leer MBR.");
-    file.close();
     return false;
   }
   Partition extendida;
   if (!obtenerExtendida(mbr, extendida)) {
     out->appendPlainText("No existe una partición extendida.");
-    file.close();
     return false;
   }
-  auto ebrsPos = leerEBRsConPos(file, extendida);
+  auto ebrsPos = leerEBRsConPos(*file, extendida);
   if (!nombreLogicaDisponible(ebrsPos, name)) {
     out->appendPlainText("Ya existe una partición lógica con ese nombre.");
-    file.close();
     return false;
   }
   auto huecos = calcularHuecosEnExtendida(extendida, ebrsPos);
@@ -814,7 +934,6 @@ bool DiskManager::crearLogica(const QString& path, const QString& name,
   if (maxHueco < sizeBytes + static_cast<int>(sizeof(EBR))) {
     out->appendPlainText(
       "...\nNo hay espacio suficiente dentro de la extendida.");
-    file.close();
     return false;
   }
 
@@ -823,115 +942,34 @@ bool DiskManager::crearLogica(const QString& path, const QString& name,
   if (elegido.inicio == -1) {
     out->appendPlainText(
       "No se encontró un hueco adecuado dentro de la extendida.");
-    file.close();
     return false;
   }
   long posEBR = elegido.inicio;
 
   // Escribir nuevo EBR en disco principal
   if (!escribirNuevoEBRConEnlaces(
-        file, extendida, ebrsPos, posEBR, sizeBytes, extendida.fit, name)) {
+        *file, extendida, ebrsPos, posEBR, sizeBytes, extendida.fit, name)) {
     out->appendPlainText("Error al escribir EBR en disco principal.");
-    file.close();
-    return false;
-  }
-  // Escribir en RAID (mismo offset)
-  QString raidPath;
-  int p = path.lastIndexOf(".disk");
-  raidPath = path.left(p) + "_raid.disk";
-  std::fstream fileRaid = openDiskForReadWrite(raidPath);
-  if (!fileRaid.is_open()) {
-    out->appendPlainText("EBR creado en principal pero fallo al abrir RAID.");
-    file.close();
-    return false;
-  }
-  // Leer MBR RAID y extendida para validar posición
-  MBR mbrRaid;
-  if (!readMBR(fileRaid, mbrRaid)) {
-    out->appendPlainText(
-      "EBR creado en principal pero fallo al leer MBR RAID.");
-    fileRaid.close();
-    file.close();
-    return false;
-  }
-  Partition extRaid;
-  if (!obtenerExtendida(mbrRaid, extRaid)) {
-    out->appendPlainText(
-      "EBR creado en principal pero RAID no tiene extendida.");
-    fileRaid.close();
-    file.close();
-    return false;
-  }
-  auto ebrsPosRaid = leerEBRsConPos(fileRaid, extRaid);
-  if (!escribirNuevoEBRConEnlaces(
-        fileRaid, extRaid, ebrsPosRaid, posEBR, sizeBytes, extRaid.fit, name)) {
-    out->appendPlainText("EBR creado en principal pero fallo en RAID.");
-  }
-  fileRaid.close();
-  file.close();
-  return true;
-}
-
-// deleteParticionInterno (helper usado por deleteParticion)
-static bool deleteParticionInterno(const QString& path, const QString& name) {
-  std::fstream file = openDiskForReadWrite(path);
-  if (!file.is_open()) return false;
-  MBR mbr;
-  if (!readMBR(file, mbr)) {
-    file.close();
-    return false;
-  }
-  bool encontrada = false;
-  // buscar en MBR
-  for (auto& p : mbr.parts) {
-    if (p.status == 1 && name == QString::fromLatin1(p.name)) {
-      p.status = 0;
-      encontrada = true;
-      break;
-    }
-  }
-  // buscar en lógicas
-  if (!encontrada) {
-    Partition extendida;
-    if (obtenerExtendida(mbr, extendida)) {
-      auto ebrs = leerEBRsConPos(file, extendida);
-      for (const auto& [ebr, pos] : ebrs) {
-        if (ebr.status == 1 && name == QString::fromLatin1(ebr.name)) {
-          EBR mod = ebr;
-          mod.status = 0;
-          writeEBRAt(file, pos, mod);
-          encontrada = true;
-          break;
-        }
-      }
-    }
-  }
-  if (!encontrada) {
-    file.close();
     return false;
   }
-  // Guardar MBR
-  if (!writeMBR(file, mbr)) {
-    file.close();
-    return false;
-  }
-  file.close();
-  return true;
+  return replicarCambios(*file, out);
 }
 
 bool DiskManager::deleteParticion(const QString& path, const QString& name,
   QPlainTextEdit* out, Terminal* terminal) {
   // Abrir disco principal
-  // Nota: debe ser un puntero para poder usarse en la función lambda
-  std::fstream* file = new std::fstream(
-    path.toStdString(), std::ios::in | std::ios::out | std::ios::binary);
-  if (!file->is_open()) {
+  // Nota: puntero compartido para poder usarse en la función lambda
+  QString aviso;
+  std::shared_ptr<Dispositivo> file = abrirDiscoEscritura(path, aviso);
+  if (!file) {
     out->appendPlainText("No se pudo abrir el disco.");
-    delete file;
     return false;
   }
   MBR mbr;
-  file->read(reinterpret_cast<char*>(&mbr), sizeof(MBR));
+  if (!readMBR(*file, mbr)) {
+    out->appendPlainText("No se pudo leer MBR.");
+    return false;
+  }
   // Determinar tipo de partición
   char tipo = '\0';
   bool encontrada = false;
@@ -957,7 +995,6 @@ bool DiskManager::deleteParticion(const QString& path, const QString& name,
   }
   if (!encontrada) {
     out->appendPlainText("No se encontró la partición.");
-    file->close();
     return false;
   }
   // Confirmación de borrado
@@ -965,7 +1002,23 @@ bool DiskManager::deleteParticion(const QString& path, const QString& name,
   terminal->prompt = ">> ¿Seguro que desea eliminar la particion? Y/N: ";
   QObject::connect(
     terminal, &Terminal::confirmacionRecibida, terminal, [=](char r) mutable {
+      // Con el disco bloqueado se reabre y se relee la tabla: otro comando
+      // u otro proceso pudo cambiarla mientras se esperaba la confirmación
+      std::unique_ptr<BloqueoDisco> bloqueo;
       if (r == 'y') {
+        file.reset();
+        bloqueo =
+          std::make_unique<BloqueoDisco>(path, BloqueoDisco::EXCLUSIVO);
+        QString aviso;
+        if (bloqueo->tomado()) file = abrirDiscoEscritura(path, aviso);
+      }
+      if (bloqueo && !bloqueo->tomado()) {
+        out->appendPlainText(bloqueo->error() + "\n");
+      } else if (r == 'y' && (!file || !readMBR(*file, mbr))) {
+        out->appendPlainText("No se pudo abrir el disco.\n");
+      } else if (r == 'y') {
+        if (obtenerExtendida(mbr, extendida))
+          ebrsPos = leerEBRsConPos(*file, extendida);
         bool exito = false;
         // Eliminar primaria o extendida
         if (tipo == 'P' || tipo == 'E') {
@@ -999,15 +1052,10 @@ bool DiskManager::deleteParticion(const QString& path, const QString& name,
             }
           }
         }
-        // Guardar MBR actualizado
-        file->seekp(0);
-        file->write(reinterpret_cast<char*>(&mbr), sizeof(MBR));
-        file->close();
-        // Actualizar RAID sin imprimir nada
-        QString raidPath = path;
-        int p = raidPath.lastIndexOf(".disk");
-        raidPath = raidPath.left(p) + "_raid.disk";
-        deleteParticionInterno(raidPath, name);
+        // Guardar MBR actualizado y replicar en el RAID
+        if (!writeMBR(*file, mbr) || !replicarCambios(*file, out))
+          exito = false;
+        file.reset();
         if (exito) {
           QString msg = "Particion ";
           if (tipo == 'P') msg += "primaria";
@@ -1031,8 +1079,8 @@ bool DiskManager::deleteParticion(const QString& path, const QString& name,
 }
 
 // -------------- Add a Particion --------------
-bool modificarLogica(std::fstream& file, MBR& mbr, const QString& name,
-  long addBytes, const QString& raidPath, QPlainTextEdit* out) {
+bool modificarLogica(Dispositivo& file, MBR& mbr, const QString& name,
+  long addBytes, QPlainTextEdit* out) {
   // Localizar la Extendida
   Partition extendida;
   if (!obtenerExtendida(mbr, extendida)) {
@@ -1095,16 +1143,7 @@ bool modificarLogica(std::fstream& file, MBR& mbr, const QString& name,
       "Error al escribir el EBR modificado en el disco principal.\n");
     return false;
   }
-  // Actualizar RAID
-  std::fstream fileRaid = openDiskForReadWrite(raidPath);
-  if (fileRaid.is_open()) {
-    if (!writeEBRAt(fileRaid, currentEBRPos, objetivoEBR)) {
-      out->appendPlainText("Falló la escritura del EBR en RAID.");
-    }
-    fileRaid.close();
-  } else {
-    out->appendPlainText("Falló al abrir RAID para modificar EBR");
-  }
+  if (!replicarCambios(file, out)) return false;
   out->appendPlainText(
     "Partición lógica modificada correctamente.\nNuevo tamaño: " +
     QString::number(nuevoSize) + " Bytes\n...");
@@ -1113,20 +1152,17 @@ bool modificarLogica(std::fstream& file, MBR& mbr, const QString& name,
 
 bool DiskManager::addAParticion(const QString& path, const QString& name,
   long addBytes, QPlainTextEdit* out) {
-  std::fstream file = openDiskForReadWrite(path);
-  if (!file.is_open()) {
+  QString aviso;
+  auto file = abrirDiscoEscritura(path, aviso);
+  if (!file) {
     out->appendPlainText("No se pudo abrir el disco.");
     return false;
   }
   MBR mbr;
-  if (!readMBR(file, mbr)) {
+  if (!readMBR(*file, mbr)) {
     out->appendPlainText("No se pudo leer MBR.");
-    file.close();
     return false;
   }
-  QString raidPath;
-  int pos = path.lastIndexOf(".disk");
-  raidPath = path.left(pos) + "_raid.disk";
   Partition* objetivoMBR = nullptr;
 
   // Buscar en MBR y determinar tipo
@@ -1136,9 +1172,7 @@ bool DiskManager::addAParticion(const QString& path, const QString& name,
         objetivoMBR = &p;
         break;
       } else {  // Lógica
-        bool success =
-          modificarLogica(file, mbr, name, addBytes, raidPath, out);
-        file.close();
+        bool success = modificarLogica(*file, mbr, name, addBytes, out);
         return success;
       }
     }
@@ -1147,12 +1181,10 @@ bool DiskManager::addAParticion(const QString& path, const QString& name,
   if (!objetivoMBR) {
     Partition tempExt;
     if (obtenerExtendida(mbr, tempExt)) {
-      auto ebrs = leerEBRsConPos(file, tempExt);
+      auto ebrs = leerEBRsConPos(*file, tempExt);
       for (const auto& [ebr, pos] : ebrs) {
         if (ebr.status == 1 && name == QString::fromLatin1(ebr.name)) {
-          bool success =
-            modificarLogica(file, mbr, name, addBytes, raidPath, out);
-          file.close();
+          bool success = modificarLogica(*file, mbr, name, addBytes, out);
           return success;
         }
       }
@@ -1162,7 +1194,6 @@ bool DiskManager::addAParticion(const QString& path, const QString& name,
   if (!objetivoMBR) {
     out->appendPlainText(
       "No se encontró la partición con el nombre '" + name + "'.");
-    file.close();
     return false;
   }
 
@@ -1171,7 +1202,6 @@ bool DiskManager::addAParticion(const QString& path, const QString& name,
   // Validación de reducción (addBytes < 0)
   if (nuevoSize <= 0) {
     out->appendPlainText("El tamaño resultante debe ser un entero positivo.");
-    file.close();
     return false;
   }
   // Validación de expansión (addBytes > 0)
@@ -1191,45 +1221,33 @@ bool DiskManager::addAParticion(const QString& path, const QString& name,
       out->appendPlainText(
         "No hay espacio suficiente para expandir.\nMáx. disponible: " +
         QString::number(espacioDisponible) + " Bytes\n...");
-      file.close();
       return false;
     }
   }
 
   // Guardar MBR
   objetivoMBR->size = static_cast<int>(nuevoSize);
-  if (!writeMBR(file, mbr)) {
+  if (!writeMBR(*file, mbr)) {
     out->appendPlainText("Error al guardar MBR en el disco principal.");
-    file.close();
     return false;
   }
-  file.close();
-  // Lo mismo al RAID
-  std::fstream fileRaid = openDiskForReadWrite(raidPath);
-  if (fileRaid.is_open()) {
-    MBR mbrRaid;
-    if (readMBR(fileRaid, mbrRaid)) {
-      for (auto& p : mbrRaid.parts) {
-        if (p.status == 1 && name == QString::fromLatin1(p.name)) {
-          p.size = static_cast<int>(nuevoSize);
-          writeMBR(fileRaid, mbrRaid);
-          break;
-        }
-      }
-    }
-    fileRaid.close();
-  } else {
-    out->appendPlainText("No se pudo abrir el disco RAID para actualizar.");
-  }
+  if (!replicarCambios(*file, out)) return false;
   out->appendPlainText("Partición modificada correctamente.\nNuevo tamaño: " +
                        QString::number(nuevoSize) + " Bytes\n...");
   return true;
 }
 
 // MOUNT / UNMOUNT
-static std::vector<DiscoMontado> discosMontados;
+// Montajes y tablas de particiones que sobreviven al reinicio
+EstadoSesion& estadoSesion() {
+  static EstadoSesion estado(EstadoSesion::rutaPorDefecto());
+  return estado;
+}
+
+RegistroMontajes& montajes() { return estadoSesion().montajes(); }
 
-void imprimirParticionesDisco(QPlainTextEdit* out, const DiscoMontado& disco) {
+void imprimirParticionesDisco(
+  QPlainTextEdit* out, const std::vector<ParticionMontada>& parts) {
   const int largoLinea = 34;
   const int largoNombre = 20;
   const int largoId = 9;
@@ -1241,40 +1259,26 @@ void imprimirParticionesDisco(QPlainTextEdit* out, const DiscoMontado& disco) {
   encabezado += "| Nombre              | ID       |\n";
   encabezado += QString("-").repeated(largoLinea) + "\n";
 
-  for (const PartMontada& p : disco.parts) {
-    encabezado += "| " + p.name;
-    encabezado += QString(" ").repeated(largoNombre - p.name.length()) + "| ";
+  for (const ParticionMontada& p : parts) {
+    encabezado += "| " + p.nombre;
+    encabezado += QString(" ").repeated(largoNombre - p.nombre.length()) + "| ";
     encabezado += p.id + QString(" ").repeated(largoId - p.id.length()) + "|\n";
   }
   encabezado += QString("-").repeated(largoLinea) + "\n";
   out->appendPlainText(encabezado);
 }
 
-int primerNumeroDisponible(const DiscoMontado& disco) {
-  std::vector<int> usados;
-  for (const PartMontada& p : disco.parts) {
-    QString numStr = p.id.mid(3);
-    usados.push_back(numStr.toInt());
-  }
-  std::sort(usados.begin(), usados.end());
-  int numero = 1;
-  for (int u : usados) {
-    if (u == numero) numero++;
-    else break;
-  }
-  return numero;
+// Aviso de un disco leído sin toda su redundancia; vacío si no hace falta.
+// Los trabajos en segundo plano lo suman a su mensaje final.
+QString textoDegradado(bool degradado, const QString& aviso) {
+  if (!degradado) return QString();
+  return "Aviso: disco en modo degradado, datos leídos de una sola réplica" +
+         (aviso.isEmpty() ? QString() : " (" + aviso + ")") + ".\n";
 }
 
-char primeraLetraDisponible() {
-  std::vector<char> usadas;
-  for (const DiscoMontado& d : discosMontados) usadas.push_back(d.letra);
-  std::sort(usadas.begin(), usadas.end());
-  char letra = 'a';
-  for (char u : usadas) {
-    if (u == letra) letra++;
-    else break;
-  }
-  return letra;
+void avisarSiDegradado(
+  QPlainTextEdit* out, bool degradado, const QString& aviso) {
+  if (degradado) out->appendPlainText(textoDegradado(degradado, aviso));
 }
 
 void DiskManager::mount(
@@ -1304,65 +1308,32 @@ void DiskManager::mount(
     out->appendPlainText("Extensión de disco inválida.\n");
     return;
   }
-  std::fstream file = openDiskForRead(finalPath);
-  if (!file.is_open()) {
-    out->appendPlainText("No se pudo abrir el disco.\n");
-    return;
+  // La tabla guardada evita releer MBR y EBRs si el disco no cambió. Se
+  // bloquea solo la tabla (fdisk toma el disco entero), así se puede montar
+  // otra partición de un disco que tiene una servida por NBD.
+  TablaParticiones tabla;
+  QString error;
+  {
+    BloqueoDisco bloqueo(
+      finalPath, BloqueoDisco::COMPARTIDO, 0, sizeof(MBR));
+    error = bloqueo.tomado() ? estadoSesion().tabla(finalPath, tabla)
+                             : bloqueo.error();
   }
-  MBR mbr;
-  if (!readMBR(file, mbr)) {
-    out->appendPlainText("No se pudo leer MBR.\n");
-    file.close();
+  if (!error.isEmpty()) {
+    out->appendPlainText(error + "\n");
     return;
   }
-
-  bool encontrada = false;
-  bool esLogica = false;
-  Partition extendida;
-  std::vector<std::pair<EBR, long>> ebrsPos;
-  for (const Partition& p : mbr.parts) {
-    if (p.status == 1 && name == QString::fromLatin1(p.name)) {
-      encontrada = true;
-      break;
-    }
-    if (p.status == 1 && p.type == 'E') extendida = p;
-  }
-  if (!encontrada && extendida.status == 1) {
-    ebrsPos = leerEBRsConPos(file, extendida);
-    for (auto& par : ebrsPos) {
-      if (par.first.status == 1 &&
-          QString::fromLatin1(par.first.name) == name) {
-        encontrada = true;
-        esLogica = true;
-        break;
-      }
-    }
-  }
-  file.close();
-  if (!encontrada) {
+  long inicio = 0, tam = 0;
+  if (!tabla.buscar(name, inicio, tam)) {
     out->appendPlainText("No se encontró la partición.\n");
     return;
   }
-  DiscoMontado* disco = nullptr;
-  for (auto& d : discosMontados)
-    if (d.path == finalPath) {
-      disco = &d;
-      break;
-    }
-  if (!disco) {
-    char nuevaLetra = primeraLetraDisponible();
-    discosMontados.push_back({finalPath, nuevaLetra, {}});
-    disco = &discosMontados.back();
+  if (estadoSesion().montar(finalPath, name).isEmpty()) {
+    out->appendPlainText("La partición ya está montada.\n");
+    return;
   }
-  for (auto& p : disco->parts)
-    if (p.name == name) {
-      out->appendPlainText("La partición ya está montada.\n");
-      return;
-    }
-  int numLibre = primerNumeroDisponible(*disco);
-  QString id = QString("vd%1%2").arg(disco->letra).arg(numLibre);
-  disco->parts.push_back({name, id});
-  imprimirParticionesDisco(out, *disco);
+  imprimirParticionesDisco(out, montajes().particionesDe(finalPath));
+  avisarSiDegradado(out, tabla.degradado, tabla.aviso);
 }
 
 void DiskManager::unmount(const QStringList& args, QPlainTextEdit* out) {
@@ -1377,52 +1348,115 @@ void DiskManager::unmount(const QStringList& args, QPlainTextEdit* out) {
     out->appendPlainText("Falta parámetro id.\n");
     return;
   }
-  if (!id.startsWith("vd") || id.length() < 4) {
+  QString letras;
+  int numero = 0;
+  if (!RegistroMontajes::separarId(id, letras, numero)) {
     out->appendPlainText("Formato de id inválido.\n");
     return;
   }
 
-  char letra = id[2].toLatin1();
-  bool encontradoDisco = false;
-  for (int i = 0; i < (int)discosMontados.size(); ++i) {
-    DiscoMontado& disco = discosMontados[i];
-    if (disco.letra == letra) {
-      encontradoDisco = true;
-      bool encontradaParticion = false;
-      for (int j = 0; j < (int)disco.parts.size(); ++j) {
-        if (disco.parts[j].id == id) {
-          encontradaParticion = true;
-          disco.parts.erase(disco.parts.begin() + j);
-          break;
-        }
-      }
-      if (!encontradaParticion) {
-        out->appendPlainText("No existe una partición con ese id.\n");
-        return;
-      }
-      if (disco.parts.empty()) {
-        discosMontados.erase(discosMontados.begin() + i);
-        out->appendPlainText(
-          "Particion desmontada con exito.\nNo quedan particiones montadas en "
-          "el disco.\n");
-        return;
-      }
-      out->appendPlainText("Particion desmontada con exito.\n");
-      imprimirParticionesDisco(out, disco);
-      return;
-    }
+  ParticionMontada part;
+  if (!montajes().buscar(id, part)) {
+    if (!montajes().hayDisco(letras))
+      out->appendPlainText("No existe un disco con esa letra.\n");
+    else out->appendPlainText("No existe una partición con ese id.\n");
+    return;
   }
-  if (!encontradoDisco)
-    out->appendPlainText("No existe un disco con esa letra.\n");
+  montajes().desmontar(id);
+  estadoSesion().guardar();
+  // Sin montaje no hay partición que servir
+  if (servidoresNbd.erase(id))
+    out->appendPlainText("Servidor NBD de " + id + " detenido.");
+  std::vector<ParticionMontada> quedan = montajes().particionesDe(part.path);
+  if (quedan.empty()) {
+    out->appendPlainText(
+      "Particion desmontada con exito.\nNo quedan particiones montadas en "
+      "el disco.\n");
+    return;
+  }
+  out->appendPlainText("Particion desmontada con exito.\n");
+  imprimirParticionesDisco(out, quedan);
 }
 
 // -------------------------- REP (visualizar) --------------------------
-void DiskManager::rep(
-  const QStringList& args, QPlainTextEdit* out, const QDir& currentDir) {
-  QString id, path;
+// Muestra el resultado de un trabajo en segundo plano cuando termine. El
+// vigilante cuelga del editor: si la terminal se cierra antes, el mensaje
+// simplemente no se muestra.
+void avisarAlTerminar(
+  const QFuture<QString>& trabajo, QPlainTextEdit* out, Terminal* terminal) {
+  auto* vigilante = new QFutureWatcher<QString>(out);
+  QObject::connect(vigilante, &QFutureWatcher<QString>::finished, out,
+    [vigilante, out, terminal]() {
+      QString mensaje = vigilante->result();
+      if (terminal) terminal->mostrarAsincrono(mensaje);
+      else out->appendPlainText(mensaje);
+      vigilante->deleteLater();
+    });
+  vigilante->setFuture(trabajo);
+}
+
+void DiskManager::rep(const QStringList& args, QPlainTextEdit* out,
+  const QDir& currentDir, Terminal* terminal) {
+  QString id, path, dirSalida, formatoTexto, anchoTexto, filasTexto;
+  QString nombre = "disk";
+  bool todas = false;
   for (const QString& arg : args) {
+    QString low = arg.toLower();
     if (arg.startsWith("-id=")) id = arg.mid(4).trimmed();
     else if (arg.startsWith("-path=")) path = arg.mid(6).trimmed();
+    else if (arg.startsWith("-dir=")) dirSalida = arg.mid(5).trimmed();
+    else if (low.startsWith("-format=")) formatoTexto = arg.mid(8).trimmed();
+    else if (low.startsWith("-width=")) anchoTexto = arg.mid(7).trimmed();
+    else if (low.startsWith("-rows=")) filasTexto = arg.mid(6).trimmed();
+    else if (low.startsWith("-name=")) nombre = arg.mid(6).trimmed().toLower();
+    else if (low == "-all") todas = true;
+  }
+  // disk: particiones del disco; usage: cuánto de cada una tiene datos
+  if (nombre != "disk" && nombre != "usage") {
+    out->appendPlainText("Reporte desconocido: " + nombre +
+                         " (disk o usage).");
+    return;
+  }
+  bool uso = nombre == "usage";
+  // Sin -format= se deduce de la extensión, como antes
+  OpcionesReporte opciones;
+  opciones.formato =
+    todas ? FormatoReporte::PNG : formatoPorExtension(path);
+  if (!formatoTexto.isEmpty() &&
+      !leerFormatoReporte(formatoTexto, opciones.formato)) {
+    out->appendPlainText("Formato de reporte inválido: " + formatoTexto +
+                         " (png, svg, json o dot).");
+    return;
+  }
+  if (uso && opciones.formato == FormatoReporte::DOT) {
+    out->appendPlainText("El reporte usage se genera en png, svg o json.");
+    return;
+  }
+  bool ok = true;
+  if (!anchoTexto.isEmpty()) opciones.ancho = anchoTexto.toInt(&ok);
+  if (!ok || opciones.ancho < OpcionesReporte::ANCHO_MINIMO ||
+      opciones.ancho > OpcionesReporte::ANCHO_MAXIMO) {
+    out->appendPlainText(QString("El parámetro -width= debe estar entre %1 "
+                                 "y %2 píxeles.")
+                           .arg(OpcionesReporte::ANCHO_MINIMO)
+                           .arg(OpcionesReporte::ANCHO_MAXIMO));
+    return;
+  }
+  if (!filasTexto.isEmpty()) opciones.filas = filasTexto.toInt(&ok);
+  if (!ok || opciones.filas < 1 ||
+      opciones.filas > OpcionesReporte::FILAS_MAXIMAS) {
+    out->appendPlainText(
+      QString("El parámetro -rows= debe estar entre 1 y %1.")
+        .arg(OpcionesReporte::FILAS_MAXIMAS));
+    return;
+  }
+  if (todas && uso) {
+    out->appendPlainText("rep -all solo genera el reporte disk.");
+    return;
+  }
+  if (todas) {
+    repTodas(dirSalida, opciones, out, currentDir, terminal);
+    return;
   }
   if (id.isEmpty()) {
     out->appendPlainText("Falta el parámetro -id=");
@@ -1433,245 +1467,1254 @@ void DiskManager::rep(
     return;
   }
 
-  char letra = id[2].toLatin1();
-  bool encontradoDisco = false;
+  QString letras;
+  int numero = 0;
+  ParticionMontada part;
+  if (!RegistroMontajes::separarId(id, letras, numero) ||
+      !montajes().hayDisco(letras)) {
+    out->appendPlainText("No se ha montado el disco.\n");
+    return;
+  }
   QString diskFilePath;
-  for (auto& disco : discosMontados) {
-    if (disco.letra == letra) {
-      encontradoDisco = true;
-      for (auto& part : disco.parts) {
-        if (part.id == id) {
-          diskFilePath = disco.path;
-          break;
-        }
+  if (montajes().buscar(id, part)) diskFilePath = part.path;
+  if (diskFilePath.isEmpty()) {
+    out->appendPlainText("No se encontró la partición montada en ese disco.\n");
+    return;
+  }
+  QString finalPath = path;
+  QFileInfo fi(path);
+  if (!fi.isAbsolute()) finalPath = currentDir.absoluteFilePath(path);
+  if (uso) {
+    repUso(diskFilePath, id, finalPath, opciones, out, terminal);
+    return;
+  }
+
+  // En este hilo solo se validan los argumentos: la espera del bloqueo y la
+  // lectura del disco (si cambió desde el último rep) van en el pool de
+  // QtConcurrent junto con el diseño, el dibujo y la codificación
+  out->appendPlainText("Generando reporte de " + id + "...");
+
+  auto trabajo =
+    QtConcurrent::run([diskFilePath, opciones, finalPath]() -> QString {
+    InstantaneaDisco inst;
+    QString error = instantaneaEnCache(diskFilePath, inst);
+    if (!error.isEmpty()) return error;
+    return textoDegradado(inst.degradado, inst.aviso) +
+           generarReporte(inst, opciones, finalPath);
+  });
+  avisarAlTerminar(trabajo, out, terminal);
+}
+
+// rep -all: un reporte por partición montada, en dir/<id>.<formato>
+void DiskManager::repTodas(const QString& dirSalida,
+  const OpcionesReporte& opciones, QPlainTextEdit* out,
+  const QDir& currentDir, Terminal* terminal) {
+  if (dirSalida.isEmpty()) {
+    out->appendPlainText("Falta el parámetro -dir=");
+    return;
+  }
+  QDir dir(currentDir.absoluteFilePath(dirSalida));
+  if (!dir.mkpath(".")) {
+    out->appendPlainText("No se pudo crear el directorio " + dirSalida + ".\n");
+    return;
+  }
+  std::vector<PedidoReporte> pedidos;
+  std::set<QString> discos;
+  for (const ParticionMontada& p : montajes().todas()) {
+    PedidoReporte pedido;
+    pedido.id = p.id;
+    pedido.disco = p.path;
+    pedido.destino =
+      dir.absoluteFilePath(p.id + "." + extensionReporte(opciones.formato));
+    pedidos.push_back(pedido);
+    discos.insert(p.path);
+  }
+  if (pedidos.empty()) {
+    out->appendPlainText("No hay particiones montadas.\n");
+    return;
+  }
+  unsigned hilos =
+    hilosDeTrabajo(static_cast<unsigned>(std::min<size_t>(discos.size(), 8)));
+  out->appendPlainText(QString("Generando %1 reportes de %2 discos con %3 "
+                               "hilos...")
+                         .arg(pedidos.size())
+                         .arg(discos.size())
+                         .arg(hilos));
+
+  auto trabajo = QtConcurrent::run([pedidos, opciones, hilos]() mutable {
+    QElapsedTimer reloj;
+    reloj.start();
+    generarReportesEnLote(pedidos, opciones, hilos);
+    int generados = 0;
+    int largoId = 2;
+    for (const PedidoReporte& p : pedidos)
+      largoId = std::max(largoId, static_cast<int>(p.id.length()));
+    QString resumen;
+    for (const PedidoReporte& p : pedidos) {
+      resumen += "  " + p.id.leftJustified(largoId) + "  ";
+      if (!p.error.isEmpty()) {
+        resumen += "error: " + p.error + "\n";
+        continue;
+      }
+      ++generados;
+      resumen += QString("%1 ms  %2%3%4\n")
+                   .arg(p.ms, 5)
+                   .arg(p.destino)
+                   .arg(p.desdeCache ? " (caché)" : "")
+                   .arg(p.degradado ? " (disco degradado)" : "");
+    }
+    resumen += QString("%1 de %2 reportes generados en %3 ms.\n")
+                 .arg(generados)
+                 .arg(pedidos.size())
+                 .arg(reloj.elapsed());
+    return resumen;
+  });
+  avisarAlTerminar(trabajo, out, terminal);
+}
+
+// rep -name=usage: mapa de calor del uso de cada partición. Todo el recorrido
+// va en segundo plano bajo el bloqueo compartido del disco; la tabla se lee
+// ahí mismo para que coincida con lo recorrido.
+void DiskManager::repUso(const QString& disco, const QString& id,
+  const QString& destino, const OpcionesReporte& opciones,
+  QPlainTextEdit* out, Terminal* terminal) {
+  unsigned hilos = hilosDeTrabajo();
+  out->appendPlainText(QString("Midiendo el uso de %1 con %2 hilos (%3)...")
+                         .arg(id)
+                         .arg(hilos)
+                         .arg(nivelSimd()));
+
+  auto trabajo =
+    QtConcurrent::run([disco, destino, opciones, hilos]() -> QString {
+    BloqueoDisco bloqueo(disco, BloqueoDisco::COMPARTIDO);
+    if (!bloqueo.tomado()) return bloqueo.error() + "\n";
+    QElapsedTimer reloj;
+    reloj.start();
+    InstantaneaDisco inst;
+    QString error = tomarInstantanea(disco, inst);
+    UsoDisco uso;
+    if (error.isEmpty()) error = medirUso(inst, opciones.ancho, hilos, uso);
+    if (!error.isEmpty()) return error;
+    qint64 ms = std::max<qint64>(1, reloj.elapsed());
+
+    const double MiB = 1024.0 * 1024.0;
+    QString resumen = resumirUso(uso);
+    resumen += QString("%1 MiB leídos en %2 ms (%3 MiB/s), %4 MiB en huecos "
+                       "sin leer.\n")
+                 .arg(uso.bytesLeidos / MiB, 0, 'f', 1)
+                 .arg(ms)
+                 .arg(uso.bytesLeidos / MiB * 1000.0 / ms, 0, 'f', 1)
+                 .arg(uso.bytesEnHuecos / MiB, 0, 'f', 1);
+    resumen += textoDegradado(uso.degradado, uso.aviso);
+    QFile::remove(destino);
+    if (!escribirMapaUso(uso, opciones.formato, opciones.ancho, destino))
+      return resumen + "Error al intentar guardar el reporte " + destino +
+             ".\n";
+    return resumen + "Reporte de uso generado con éxito: " + destino + "\n";
+  });
+  avisarAlTerminar(trabajo, out, terminal);
+}
+
+// ------------------- SCRUB (verificar espejo) --------------------
+void DiskManager::scrub(
+  const QStringList& args, QPlainTextEdit* out, const QDir& currentDir) {
+  QString rawPath;
+  FuenteReparacion fuente = FuenteReparacion::Ninguna;
+  bool resync = false;  // Conjuntos mkdisk -raid=
+  for (const QString& a : args) {
+    QString low = a.toLower();
+    if (low.startsWith("-path=")) rawPath = a.mid(6);
+    else if (low.startsWith("-repair=")) {
+      QString val = low.mid(8);
+      if (val == "primary" || val == "principal")
+        fuente = FuenteReparacion::Principal;
+      else if (val == "raid") fuente = FuenteReparacion::Raid;
+      else if (val == "resync") resync = true;
+      else {
+        out->appendPlainText(
+          "Valor inválido para -repair (use primary, raid o resync).\n");
+        return;
       }
-      break;
     }
   }
-  if (!encontradoDisco) {
-    out->appendPlainText("No se ha montado el disco.\n");
+  if (rawPath.isEmpty()) {
+    out->appendPlainText("Falta parámetro path.\n");
     return;
   }
-  if (diskFilePath.isEmpty()) {
-    out->appendPlainText("No se encontró la partición montada en ese disco.\n");
+  QDir base = currentDir;
+  QString finalPath = base.absoluteFilePath(rawPath);
+  if (!finalPath.endsWith(".disk")) {
+    out->appendPlainText("Extensión de disco inválida.\n");
     return;
   }
-  std::fstream file = openDiskForRead(diskFilePath);
-  if (!file.is_open()) {
-    out->appendPlainText("No se pudo abrir el archivo del disco.\n");
+  bool reparar = resync || fuente != FuenteReparacion::Ninguna;
+  BloqueoDisco bloqueo(finalPath,
+    reparar ? BloqueoDisco::EXCLUSIVO : BloqueoDisco::COMPARTIDO);
+  if (!bloqueo.tomado()) {
+    out->appendPlainText(bloqueo.error() + "\n");
     return;
   }
-  MBR mbr;
-  if (!readMBR(file, mbr)) {
-    out->appendPlainText("Error leyendo MBR.\n");
-    file.close();
+  bool conjunto = esConjuntoRaid(finalPath);
+  ResultadoScrub res;
+  if (conjunto) {
+    if (fuente != FuenteReparacion::Ninguna) {
+      out->appendPlainText(
+        "En conjuntos creados con -raid= use -repair=resync.\n");
+      return;
+    }
+    res = scrubRaid(finalPath, resync);
+    if (resync) CacheBloques::global().invalidar(finalPath);
+  } else {
+    if (resync) {
+      out->appendPlainText(
+        "-repair=resync solo aplica a conjuntos creados con -raid=.\n");
+      return;
+    }
+    QString raidPath = rutaRaid(finalPath);
+    if (formatoImagen(finalPath) != "flat" ||
+        formatoImagen(raidPath) != "flat") {
+      out->appendPlainText(
+        "Scrub compara archivos planos; use convert -format=flat antes.\n");
+      return;
+    }
+    if (tieneCapas(finalPath) || tieneCapas(raidPath)) {
+      out->appendPlainText(
+        "El disco tiene snapshots por capas; bórrelos antes del scrub.\n");
+      return;
+    }
+    if (!fileExists(finalPath) || !fileExists(raidPath)) {
+      out->appendPlainText("No existe el disco o su espejo RAID.\n");
+      return;
+    }
+    res = scrubDisco(finalPath, raidPath, fuente);
+    if (res.bytesReparados > 0) CacheBloques::global().invalidar(finalPath);
+  }
+  if (!res.error.isEmpty() && res.bytesComparados == 0) {
+    QString msg = res.error + "\n";
+    for (const QString& m : res.miembros) msg += "  " + m + "\n";
+    out->appendPlainText(msg);
     return;
   }
-  int totalSize = mbr.size;
+  double mb = res.bytesComparados / (1024.0 * 1024.0);
+  QString msg;
+  msg += "Scrub de " + finalPath + "\n";
+  if (res.tamPrincipal != res.tamRaid)
+    msg += "Tamaños distintos: principal " +
+           QString::number(res.tamPrincipal) + " Bytes, RAID " +
+           QString::number(res.tamRaid) + " Bytes\n";
+  msg += "Comparados: " + QString::number(res.bytesComparados) +
+         " Bytes (huecos omitidos: " + QString::number(res.bytesOmitidos) +
+         " Bytes)\n";
+  msg += QString("Tiempo: %1 s (%2 MB/s, %3 hilos, %4)\n")
+           .arg(res.segundos, 0, 'f', 3)
+           .arg(res.segundos > 0 ? mb / res.segundos : 0.0, 0, 'f', 1)
+           .arg(res.hilos)
+           .arg(nivelSimd());
+  if (conjunto) {
+    if (res.miembros.isEmpty()) msg += "Miembros: todos vigentes\n";
+    else {
+      msg += "Miembros:\n";
+      for (const QString& m : res.miembros) msg += "  " + m + "\n";
+    }
+  } else if (res.metadatos.isEmpty()) msg += "Metadatos: sin diferencias\n";
+  else {
+    msg += "Metadatos: " + QString::number(res.metadatos.size()) +
+           " diferencias\n";
+    for (const QString& d : res.metadatos) msg += "  " + d + "\n";
+  }
+  if (res.diferencias.empty()) msg += "Datos: sin diferencias\n";
+  else {
+    long total = 0;
+    for (const auto& r : res.diferencias) total += r.tam;
+    msg += "Datos: " + QString::number(res.diferencias.size()) +
+           " rangos distintos (" + QString::number(total) + " Bytes)\n";
+    const size_t maxMostrar = 20;
+    for (size_t i = 0; i < res.diferencias.size() && i < maxMostrar; ++i) {
+      const auto& r = res.diferencias[i];
+      msg += QString("  [%1, %2) %3 Bytes\n")
+               .arg(r.inicio)
+               .arg(r.inicio + r.tam)
+               .arg(r.tam);
+    }
+    if (res.diferencias.size() > maxMostrar)
+      msg += "  ... (" +
+             QString::number(res.diferencias.size() - maxMostrar) +
+             " rangos más)\n";
+  }
+  if (resync && res.error.isEmpty())
+    msg += "Resincronizados " + QString::number(res.bytesReparados) +
+           " Bytes; todos los miembros presentes quedaron vigentes.\n";
+  else if (fuente != FuenteReparacion::Ninguna && res.error.isEmpty())
+    msg += "Reparados " + QString::number(res.bytesReparados) +
+           " Bytes desde " +
+           (fuente == FuenteReparacion::Principal ? "principal" : "RAID") +
+           ".\n";
+  if (!res.error.isEmpty()) msg += res.error + "\n";
+  out->appendPlainText(msg);
+}
 
-  long extStart = -1;
-  long extEnd = -1;
-  std::vector<PartitionInfo> blocks;
-  blocks.push_back({"MBR", 0, static_cast<int>(sizeof(MBR)), "MBR"});
-  std::vector<Partition> activeParts;
-  for (const auto& p : mbr.parts)
-    if (p.status == 1 && p.size > 0) activeParts.push_back(p);
-  std::sort(activeParts.begin(), activeParts.end(),
-    [](const Partition& a, const Partition& b) { return a.start < b.start; });
-  int lastPos = sizeof(MBR);
-  for (const auto& p : activeParts) {
-    if (p.start > lastPos)
-      blocks.push_back({"", lastPos, p.start - lastPos, "LIBRE"});
-    QString typeStr = (p.type == 'E') ? "EXTENDIDA" : "PRIMARIA";
-    blocks.push_back({QString::fromLatin1(p.name), p.start, p.size, typeStr});
-    if (p.type == 'E') {
-      extStart = p.start;
-      extEnd = p.start + p.size;
+// ------------------- SNAPSHOT (copias puntuales) --------------------
+void DiskManager::snapshot(
+  const QStringList& args, QPlainTextEdit* out, const QDir& currentDir) {
+  QString rawPath, nombre;
+  bool listar = false, revertir = false, borrar = false;
+  for (const QString& a : args) {
+    QString low = a.toLower();
+    if (low.startsWith("-path=")) rawPath = a.mid(6);
+    else if (low.startsWith("-name=")) nombre = a.mid(6);
+    else if (low == "-list") listar = true;
+    else if (low == "-rollback") revertir = true;
+    else if (low == "-delete") borrar = true;
+  }
+  if (rawPath.isEmpty()) {
+    out->appendPlainText("Falta parámetro path.\n");
+    return;
+  }
+  QDir base = currentDir;
+  QString finalPath = base.absoluteFilePath(rawPath);
+  if (!finalPath.endsWith(".disk")) {
+    out->appendPlainText("Extensión de disco inválida.\n");
+    return;
+  }
+  if (!fileExists(finalPath)) {
+    out->appendPlainText("El disco no existe.\n");
+    return;
+  }
+  BloqueoDisco bloqueo(
+    finalPath, listar ? BloqueoDisco::COMPARTIDO : BloqueoDisco::EXCLUSIVO);
+  if (!bloqueo.tomado()) {
+    out->appendPlainText(bloqueo.error() + "\n");
+    return;
+  }
+
+  if (listar) {
+    auto snaps = listarSnapshots(finalPath);
+    if (snaps.empty()) {
+      out->appendPlainText("El disco no tiene snapshots.\n");
+      return;
     }
-    lastPos = p.start + p.size;
-  }
-  if (lastPos < mbr.size)
-    blocks.push_back({"", lastPos, mbr.size - lastPos, "LIBRE"});
-
-  if (extStart != -1) {
-    auto logicalsWithPos =
-      leerEBRsConPos(file, Partition{1, 'E', 0, static_cast<int>(extStart),
-                             static_cast<int>(extEnd - extStart), {0}});
-    // Convertir EBRs
-    std::vector<EBR> logicals;
-    for (auto& p : logicalsWithPos) logicals.push_back(p.first);
-
-    if (!logicals.empty()) {
-      std::vector<PartitionInfo> newBlocks;
-      for (const auto& b : blocks) {
-        if (b.type != "EXTENDIDA") {
-          newBlocks.push_back(b);
-          continue;
-        }
-        int currentExtPos = b.start;
-        for (const auto& log : logicals) {
-          int ebrPos = log.start - static_cast<int>(sizeof(EBR));
-          if (ebrPos > currentExtPos)
-            newBlocks.push_back(
-              {"", currentExtPos, ebrPos - currentExtPos, "LIBRE"});
-          newBlocks.push_back(
-            {"EBR", ebrPos, static_cast<int>(sizeof(EBR)), "EBR"});
-          newBlocks.push_back(
-            {QString::fromLatin1(log.name), log.start, log.size, "LÓGICA"});
-          currentExtPos = log.start + log.size;
-        }
-        if (currentExtPos < (b.start + b.size)) {
-          newBlocks.push_back(
-            {"", currentExtPos, (b.start + b.size) - currentExtPos, "LIBRE"});
-        }
+    out->appendPlainText("Snapshots de " + finalPath + ":");
+    for (const auto& s : snaps)
+      out->appendPlainText(
+        QString("  %1  %2  %3")
+          .arg(s.nombre, -16)
+          .arg(s.reflink ? "reflink" : "delta  ")
+          .arg(QDateTime::fromSecsSinceEpoch(s.creado)
+                 .toString("yyyy-MM-dd hh:mm:ss")));
+    out->appendPlainText("");
+    return;
+  }
+  if (nombre.isEmpty()) {
+    out->appendPlainText("Falta parámetro name.\n");
+    return;
+  }
+  if (revertir && borrar) {
+    out->appendPlainText("Use solo uno de -rollback o -delete.\n");
+    return;
+  }
+
+  // Cada archivo del disco (principal, espejo o miembros) lleva su snapshot
+  QStringList archivos = archivosDeDisco(finalPath);
+  QString error;
+  if (revertir || borrar) {
+    // Todos los archivos se verifican antes de tocar el primero: revertir
+    // solo algunos deja réplicas distintas que se leen indistintamente
+    for (const QString& a : archivos) {
+      error = comprobarSnapshot(a, nombre, revertir);
+      if (!error.isEmpty()) {
+        out->appendPlainText(error + "\n");
+        return;
       }
-      blocks = std::move(newBlocks);
     }
+    int hechos = 0;
+    for (const QString& a : archivos) {
+      error =
+        revertir ? revertirSnapshot(a, nombre) : borrarSnapshot(a, nombre);
+      if (!error.isEmpty()) break;
+      hechos++;
+    }
+    if (revertir) CacheBloques::global().invalidar(finalPath);
+    if (!error.isEmpty() && hechos > 0 && revertir) {
+      // Ya no se puede volver atrás: las réplicas quedaron distintas
+      QString reparar = esConjuntoRaid(finalPath)
+                          ? "-repair=resync"
+                          : "-repair=primary";
+      out->appendPlainText(error + "\n" +
+                           QString("El disco quedó degradado: %1 de %2 "
+                                   "archivos se revirtieron. Ejecute scrub "
+                                   "-path=%3 %4 para igualar las réplicas.\n")
+                             .arg(hechos)
+                             .arg(archivos.size())
+                             .arg(finalPath, reparar));
+    } else if (!error.isEmpty() && hechos > 0) {
+      out->appendPlainText(
+        error + "\n" +
+        QString("El snapshot se eliminó de %1 de %2 archivos; los demás "
+                "lo conservan y los datos del disco no cambian.\n")
+          .arg(hechos)
+          .arg(archivos.size()));
+    } else if (!error.isEmpty()) out->appendPlainText(error + "\n");
+    else if (revertir)
+      out->appendPlainText("Disco restaurado al snapshot '" + nombre + "'.\n");
+    else out->appendPlainText("Snapshot '" + nombre + "' eliminado.\n");
+    return;
+  }
+
+  bool reflink = true;
+  for (int i = 0; i < archivos.size(); ++i) {
+    bool esteReflink = false;
+    error = crearSnapshot(archivos[i], nombre, esteReflink);
+    if (!error.isEmpty()) {
+      // Deshacer los ya creados para no dejar el disco a medias
+      for (int j = 0; j < i; ++j) borrarSnapshot(archivos[j], nombre);
+      out->appendPlainText(error + "\n");
+      return;
+    }
+    reflink = reflink && esteReflink;
+  }
+  out->appendPlainText("Snapshot '" + nombre + "' creado (" +
+                       (reflink ? "reflink" : "capa delta") + ").\n");
+}
+
+// ------------------- CONVERT (cambiar formato) --------------------
+// Copia el contenido lógico del disco a un disco nuevo (y su espejo) en
+// formato flat, thin o compressed
+void DiskManager::convert(
+  const QStringList& args, QPlainTextEdit* out, const QDir& currentDir) {
+  QString rawFrom, rawTo, formato = "flat";
+  for (const QString& a : args) {
+    QString low = a.toLower();
+    if (low.startsWith("-from=")) rawFrom = a.mid(6);
+    else if (low.startsWith("-to=")) rawTo = a.mid(4);
+    else if (low.startsWith("-format=")) formato = low.mid(8);
+  }
+  if (rawFrom.isEmpty() || rawTo.isEmpty()) {
+    out->appendPlainText("Faltan parámetros from y to.\n");
+    return;
+  }
+  if (formato != "flat" && formato != "thin" && formato != "compressed") {
+    out->appendPlainText("Formato inválido (use flat, thin o compressed).\n");
+    return;
   }
-  file.close();
-
-  // ----------------- Generar Imagen ---------------
-  const int IMAGE_WIDTH = 1000;
-  const int DISK_BAR_HEIGHT = 150;
-  const int PADDING = 20;  // Padding del lienzo
-  const int EXTENDED_HEADER_HEIGHT = 30;
-  const int BLOCK_UNIT_WIDTH = 100;
-  const int METADATA_UNIT_WIDTH = BLOCK_UNIT_WIDTH / 2;
-  const int INNER_MARGIN = 5;
-  const QColor BORDER_COLOR(142, 173, 196);  // Azul claro
-
-  QPixmap pixmap(IMAGE_WIDTH, DISK_BAR_HEIGHT + 2 * PADDING);
-
-  QPainter painter;
-  int requiredWidth = 0;
-  // Calcular el ancho total requerido
-  for (const auto& b : blocks) {
-    if (b.size <= 0) continue;
-    if (b.type == "MBR" || b.type == "EBR")
-      requiredWidth += METADATA_UNIT_WIDTH;
-    else requiredWidth += BLOCK_UNIT_WIDTH;
-  }
-  requiredWidth += 2 * PADDING;
-
-  pixmap = QPixmap(requiredWidth, DISK_BAR_HEIGHT + 2 * PADDING);
-  pixmap.fill(QColor(Qt::white));
-  painter.begin(&pixmap);
-  painter.setRenderHint(QPainter::Antialiasing);
-
-  painter.setPen(QPen(BORDER_COLOR, 1));
-  QFont font = painter.font();
-  font.setPointSize(8);
-  painter.setFont(font);
-
-  const int START_Y = PADDING;
-  const int START_X = PADDING;
-  int currentX = START_X;
-
-  // Calcular rango de la parte extendida en pixeles
-  int extendedStartPixel = -1;
-  int extendedEndPixel = -1;
-  bool findingExtendedRange = false;
-
-  // Calcular el rango de la zona extendida
-  for (const auto& b : blocks) {
-    if (b.size <= 0) continue;
-    int blockWidth;
-    if (b.type == "MBR" || b.type == "EBR") blockWidth = METADATA_UNIT_WIDTH;
-    else blockWidth = BLOCK_UNIT_WIDTH;
-
-    // Si el inicio del bloque está dentro de extStart/extEnd o es el bloque
-    // extendida vacío
-    bool isBlockInExtendedZone =
-      (b.start >= extStart && b.start < extEnd && extStart != -1);
-    if (b.type == "EXTENDIDA" || isBlockInExtendedZone) {
-      if (!findingExtendedRange) {
-        findingExtendedRange = true;
-        extendedStartPixel = currentX;
+  QString desde = currentDir.absoluteFilePath(rawFrom);
+  QString hacia = currentDir.absoluteFilePath(rawTo);
+  if (!desde.endsWith(".disk") || !hacia.endsWith(".disk")) {
+    out->appendPlainText("Extensión de disco inválida.\n");
+    return;
+  }
+  BloqueoDisco bloqueo(
+    desde, BloqueoDisco::COMPARTIDO, hacia, BloqueoDisco::EXCLUSIVO);
+  if (!bloqueo.tomado()) {
+    out->appendPlainText(bloqueo.error() + "\n");
+    return;
+  }
+  if (!fileExists(desde)) {
+    out->appendPlainText("El disco de origen no existe.\n");
+    return;
+  }
+  if (fileExists(hacia)) {
+    out->appendPlainText("El disco de destino ya existe.\n");
+    return;
+  }
+  if (esConjuntoRaid(desde)) {
+    out->appendPlainText("convert no aplica a conjuntos creados con -raid=.\n");
+    return;
+  }
+  QString aviso;
+  auto origen = abrirDiscoLectura(desde, aviso);
+  if (!origen) {
+    out->appendPlainText("No se pudo abrir el disco (" + aviso + ").\n");
+    return;
+  }
+  long tam = origen->tamano();
+  QString haciaRaid = rutaRaid(hacia);
+  descartarSnapshots(hacia);
+  descartarSnapshots(haciaRaid);
+  QElapsedTimer reloj;
+  reloj.start();
+
+  QString error;
+  if (formato == "compressed") {
+    // Se comprime una vez y el espejo es una copia del archivo
+    error = crearImagenComprimida(*origen, hacia, hilosDeTrabajo());
+    if (error.isEmpty()) {
+      QFile::remove(haciaRaid);
+      if (!QFile::copy(hacia, haciaRaid))
+        error = "No se pudo crear el espejo " + haciaRaid + ".";
+    }
+  } else {
+    if (formato == "thin") {
+      error = crearImagenThin(hacia, tam);
+      if (error.isEmpty()) error = crearImagenThin(haciaRaid, tam);
+    } else if (!createEmptyDisk(hacia, tam, out) ||
+               !createEmptyDisk(haciaRaid, tam, out)) {
+      error = "No se pudo crear el disco de destino.";
+    }
+    std::unique_ptr<Dispositivo> destino;
+    if (error.isEmpty()) destino = abrirDiscoEscritura(hacia, aviso);
+    if (error.isEmpty() && !destino) error = "No se pudo abrir el destino.";
+    // Solo se escriben los bloques con datos: el destino queda disperso
+    const long TROZO = 4L * 1024 * 1024;
+    const long BLOQUE = 64L * 1024;
+    std::vector<char> buf(TROZO);
+    for (long pos = 0; pos < tam && error.isEmpty(); pos += TROZO) {
+      long n = std::min(TROZO, tam - pos);
+      if (!origen->leer(pos, buf.data(), n)) {
+        error = "Error al leer el disco de origen.";
+        break;
       }
-      extendedEndPixel = currentX + blockWidth;
-    } else if (findingExtendedRange) {
-      findingExtendedRange = false;
+      for (long b = 0; b < n; b += BLOQUE) {
+        long len = std::min(BLOQUE, n - b);
+        const char* datos = buf.data() + b;
+        bool vacio = esCero(datos, static_cast<size_t>(len));
+        if (!vacio && !destino->escribir(pos + b, datos, len)) {
+          error = "Error al escribir el disco de destino.";
+          break;
+        }
+      }
+    }
+    if (error.isEmpty() && (!destino->sincronizar() || destino->degradado()))
+      error = "No se pudo completar la copia en el espejo.";
+  }
+  if (!error.isEmpty()) {
+    // No queda un destino a medio escribir que parezca válido (y que haría
+    // fallar el reintento con "ya existe")
+    for (const QString& archivo : {hacia, haciaRaid}) {
+      QFile::remove(archivo);
+      descartarSnapshots(archivo);
+    }
+    CacheBloques::global().invalidar(hacia);
+    out->appendPlainText(error + "\n");
+    return;
+  }
+  QFileInfo infoOrigen(desde), infoDestino(hacia);
+  out->appendPlainText(
+    QString("Disco convertido a %1: archivo de %2 a %3 bytes (%4 s).\n")
+      .arg(formato)
+      .arg(infoOrigen.size())
+      .arg(infoDestino.size())
+      .arg(reloj.elapsed() / 1000.0, 0, 'f', 2));
+  avisarSiDegradado(out, origen->degradado(), aviso);
+}
+
+// ------------------ EXPORT / IMPORT (respaldo en flujo) ------------------
+// Resumen de lo copiado y lo registrado como huecos
+QString resumenRespaldo(const EstadisticasRespaldo& est, qint64 ms) {
+  return QString("%1 archivo(s), %2 MiB de datos, %3 MiB en huecos (%4 s).")
+    .arg(est.archivos)
+    .arg(est.bytesDatos / (1024.0 * 1024.0), 0, 'f', 1)
+    .arg(est.bytesHuecos / (1024.0 * 1024.0), 0, 'f', 1)
+    .arg(ms / 1000.0, 0, 'f', 2);
+}
+
+void DiskManager::exportDisk(
+  const QStringList& args, QPlainTextEdit* out, const QDir& currentDir) {
+  QString rawPath, rawOut;
+  bool unaReplica = false;
+  for (const QString& a : args) {
+    QString low = a.toLower();
+    if (low.startsWith("-path=")) rawPath = a.mid(6);
+    else if (low.startsWith("-out=")) rawOut = a.mid(5);
+    else if (low == "-single") unaReplica = true;
+  }
+  if (rawPath.isEmpty() || rawOut.isEmpty()) {
+    out->appendPlainText("Faltan parámetros path y out.\n");
+    return;
+  }
+  QString finalPath = currentDir.absoluteFilePath(rawPath);
+  QString destino = currentDir.absoluteFilePath(rawOut);
+  if (!finalPath.endsWith(".disk")) {
+    out->appendPlainText("Extensión de disco inválida.\n");
+    return;
+  }
+  if (!fileExists(finalPath) && !esConjuntoRaid(finalPath)) {
+    out->appendPlainText("El disco no existe.\n");
+    return;
+  }
+  BloqueoDisco bloqueo(finalPath, BloqueoDisco::COMPARTIDO);
+  if (!bloqueo.tomado()) {
+    out->appendPlainText(bloqueo.error() + "\n");
+    return;
+  }
+  QElapsedTimer reloj;
+  reloj.start();
+  EstadisticasRespaldo est;
+  QString error = exportarDisco(finalPath, destino, unaReplica, est);
+  if (!error.isEmpty()) {
+    out->appendPlainText(error + "\n");
+    return;
+  }
+  out->appendPlainText(
+    "Respaldo escrito en " + destino + ": " +
+    resumenRespaldo(est, reloj.elapsed()) + "\n");
+}
+
+void DiskManager::importDisk(
+  const QStringList& args, QPlainTextEdit* out, const QDir& currentDir) {
+  QString rawIn, rawPath;
+  for (const QString& a : args) {
+    QString low = a.toLower();
+    if (low.startsWith("-in=")) rawIn = a.mid(4);
+    else if (low.startsWith("-path=")) rawPath = a.mid(6);
+  }
+  if (rawIn.isEmpty() || rawPath.isEmpty()) {
+    out->appendPlainText("Faltan parámetros in y path.\n");
+    return;
+  }
+  QString origen = currentDir.absoluteFilePath(rawIn);
+  QString finalPath = currentDir.absoluteFilePath(rawPath);
+  if (!finalPath.endsWith(".disk")) {
+    out->appendPlainText("Extensión de disco inválida.\n");
+    return;
+  }
+  if (!fileExists(origen)) {
+    out->appendPlainText("El respaldo no existe.\n");
+    return;
+  }
+  BloqueoDisco bloqueo(finalPath, BloqueoDisco::EXCLUSIVO);
+  if (!bloqueo.tomado()) {
+    out->appendPlainText(bloqueo.error() + "\n");
+    return;
+  }
+  QElapsedTimer reloj;
+  reloj.start();
+  EstadisticasRespaldo est;
+  QString error = importarDisco(origen, finalPath, est);
+  if (!error.isEmpty()) {
+    out->appendPlainText(error + "\n");
+    return;
+  }
+  out->appendPlainText(
+    "Disco restaurado en " + finalPath + ": " +
+    resumenRespaldo(est, reloj.elapsed()) + "\n");
+}
+
+// -------------- STORE (almacén de fragmentos deduplicados) ---------------
+// -checkin -path= [-name=]   guarda el disco (y su espejo o miembros)
+// -checkout -name= -path=    lo recrea con otra ruta
+// -delete -name=, -list, -stats
+// -dir= cambia el almacén (por defecto "almacen" en el directorio actual)
+void DiskManager::store(
+  const QStringList& args, QPlainTextEdit* out, const QDir& currentDir) {
+  QString rawPath, nombre, rawDir = "almacen", accion;
+  for (const QString& a : args) {
+    QString low = a.toLower();
+    if (low.startsWith("-path=")) rawPath = a.mid(6);
+    else if (low.startsWith("-name=")) nombre = a.mid(6);
+    else if (low.startsWith("-dir=")) rawDir = a.mid(5);
+    else if (low == "-checkin" || low == "-checkout" || low == "-delete" ||
+             low == "-list" || low == "-stats")
+      accion = low.mid(1);
+  }
+  if (accion.isEmpty()) {
+    out->appendPlainText(
+      "Indique -checkin, -checkout, -delete, -list o -stats.\n");
+    return;
+  }
+  QString finalPath = currentDir.absoluteFilePath(rawPath);
+  bool requierePath = accion == "checkin" || accion == "checkout";
+  if (requierePath && (rawPath.isEmpty() || !finalPath.endsWith(".disk"))) {
+    out->appendPlainText("Falta parámetro path (archivo .disk).\n");
+    return;
+  }
+  if (accion == "checkin" && nombre.isEmpty())
+    nombre = QFileInfo(finalPath).completeBaseName();
+  if ((accion == "checkout" || accion == "delete") && nombre.isEmpty()) {
+    out->appendPlainText("Falta parámetro name.\n");
+    return;
+  }
+
+  // checkin lee el disco y checkout lo reescribe
+  std::unique_ptr<BloqueoDisco> bloqueo;
+  if (requierePath)
+    bloqueo = std::make_unique<BloqueoDisco>(finalPath,
+      accion == "checkin" ? BloqueoDisco::COMPARTIDO : BloqueoDisco::EXCLUSIVO);
+  if (bloqueo && !bloqueo->tomado()) {
+    out->appendPlainText(bloqueo->error() + "\n");
+    return;
+  }
+  AlmacenFragmentos almacen;
+  QString error = AlmacenFragmentos::abrir(currentDir.absoluteFilePath(rawDir),
+    accion == "checkin" || accion == "delete", almacen);
+  QElapsedTimer reloj;
+  reloj.start();
+  EstadisticasAlmacen est;
+  if (error.isEmpty() && accion == "checkin")
+    error = almacen.ingresar(finalPath, nombre, hilosDeTrabajo(), est);
+  else if (error.isEmpty() && accion == "checkout")
+    error = almacen.extraer(nombre, finalPath, hilosDeTrabajo());
+  else if (error.isEmpty() && accion == "delete")
+    error = almacen.borrar(nombre);
+  else if (error.isEmpty() && accion == "stats")
+    error = almacen.estadisticas(est);
+  if (!error.isEmpty()) {
+    out->appendPlainText(error + "\n");
+    return;
+  }
+
+  const double MiB = 1024.0 * 1024.0;
+  if (accion == "checkin") {
+    out->appendPlainText(
+      QString("Imagen %1 guardada: %2 MiB, %3 fragmentos nuevos (%4 s).\n")
+        .arg(nombre)
+        .arg(est.bytesLogicos / MiB, 0, 'f', 1)
+        .arg(est.nuevos)
+        .arg(reloj.elapsed() / 1000.0, 0, 'f', 2));
+  } else if (accion == "checkout") {
+    out->appendPlainText(
+      "Imagen " + nombre + " restaurada en " + finalPath + ".\n");
+  } else if (accion == "delete") {
+    out->appendPlainText("Imagen " + nombre + " eliminada del almacén.\n");
+  } else if (accion == "list") {
+    QStringList nombres = almacen.imagenes();
+    if (nombres.isEmpty()) {
+      out->appendPlainText("El almacén está vacío.\n");
+      return;
+    }
+    out->appendPlainText("Imágenes en el almacén:");
+    for (const QString& n : nombres) out->appendPlainText("  " + n);
+    out->appendPlainText("");
+  } else {
+    double ratio = est.bytesGuardados > 0
+                     ? double(est.bytesReferenciados) / est.bytesGuardados
+                     : 1.0;
+    out->appendPlainText(
+      QString("Imágenes: %1\n"
+              "Tamaño lógico: %2 MiB\n"
+              "Datos referenciados: %3 MiB\n"
+              "Guardado: %4 MiB en %5 fragmentos\n"
+              "Deduplicación: %6x\n")
+        .arg(est.imagenes)
+        .arg(est.bytesLogicos / MiB, 0, 'f', 1)
+        .arg(est.bytesReferenciados / MiB, 0, 'f', 1)
+        .arg(est.bytesGuardados / MiB, 0, 'f', 1)
+        .arg(est.fragmentos)
+        .arg(ratio, 0, 'f', 2));
+  }
+}
+
+// ------------------- HASH / DIFF (árboles de Merkle) --------------------
+// Ruta del disco y nombre de la partición montada con ese id
+bool buscarMontada(const QString& id, QString& path, QString& nombre) {
+  ParticionMontada part;
+  if (!montajes().buscar(id, part)) return false;
+  path = part.path;
+  nombre = part.nombre;
+  return true;
+}
+
+// Rango de bytes de la partición (primaria, extendida o lógica)
+bool rangoDeParticion(
+  Dispositivo& disco, const QString& nombre, long& inicio, long& tam) {
+  TablaParticiones tabla;
+  return leerTabla(disco, tabla) && tabla.buscar(nombre, inicio, tam);
+}
+
+QString hexHash(uint64_t h) {
+  return QString("%1").arg(static_cast<qulonglong>(h), 16, 16, QChar('0'));
+}
+
+// Árbol de la partición montada; vista "disco" lee el disco lógico, "r0" y
+// "r1" cada réplica por separado
+bool arbolDeMontada(const QString& id, const QString& vista,
+  ArbolMerkle& arbol, bool& enCache, QPlainTextEdit* out) {
+  QString path, nombre;
+  if (!buscarMontada(id, path, nombre)) {
+    out->appendPlainText("No hay una partición montada con id " + id + ".\n");
+    return false;
+  }
+  BloqueoDisco bloqueo(path, BloqueoDisco::COMPARTIDO);
+  if (!bloqueo.tomado()) {
+    out->appendPlainText(bloqueo.error() + "\n");
+    return false;
+  }
+  QString aviso;
+  std::unique_ptr<Dispositivo> disco;
+  if (vista == "disco") disco = abrirDiscoLectura(path, aviso);
+  else disco = abrirMiembro(vista == "r0" ? path : rutaRaid(path), false);
+  long inicio = 0, tam = 0;
+  if (!disco) {
+    out->appendPlainText("No se pudo abrir el disco de " + id + ".\n");
+    return false;
+  }
+  if (!rangoDeParticion(*disco, nombre, inicio, tam)) {
+    out->appendPlainText("No se encontró la partición " + nombre + ".\n");
+    return false;
+  }
+  QString error = arbolDeParticion(
+    path, vista, *disco, inicio, tam, hilosDeTrabajo(), arbol, enCache);
+  if (!error.isEmpty()) {
+    out->appendPlainText(error + "\n");
+    return false;
+  }
+  if (vista == "disco") avisarSiDegradado(out, disco->degradado(), aviso);
+  return true;
+}
+
+void DiskManager::hash(const QStringList& args, QPlainTextEdit* out) {
+  QString id;
+  for (const QString& a : args)
+    if (a.toLower().startsWith("-id=")) id = a.mid(4);
+  if (id.isEmpty()) {
+    out->appendPlainText("Falta parámetro id.\n");
+    return;
+  }
+  QElapsedTimer reloj;
+  reloj.start();
+  ArbolMerkle arbol;
+  bool enCache = false;
+  if (!arbolDeMontada(id, "disco", arbol, enCache, out)) return;
+  out->appendPlainText(
+    QString("%1: raíz %2, %3 bloques de %4 KiB (%5, %6 s).\n")
+      .arg(id)
+      .arg(hexHash(arbol.raiz()))
+      .arg(arbol.hojas())
+      .arg(arbol.bloque / 1024)
+      .arg(enCache ? "guardado" : "calculado")
+      .arg(reloj.elapsed() / 1000.0, 0, 'f', 2));
+}
+
+// diff -a= -b= compara dos particiones montadas; diff -a= -mirror compara la
+// partición en el disco principal contra la del espejo
+void DiskManager::diff(const QStringList& args, QPlainTextEdit* out) {
+  QString idA, idB;
+  bool espejo = false;
+  for (const QString& a : args) {
+    QString low = a.toLower();
+    if (low.startsWith("-a=")) idA = a.mid(3);
+    else if (low.startsWith("-b=")) idB = a.mid(3);
+    else if (low == "-mirror") espejo = true;
+  }
+  if (idA.isEmpty() || (idB.isEmpty() && !espejo)) {
+    out->appendPlainText("Indique -a= y -b=, o -a= con -mirror.\n");
+    return;
+  }
+  QString path, nombre;
+  if (espejo && buscarMontada(idA, path, nombre) && esConjuntoRaid(path)) {
+    out->appendPlainText(
+      "-mirror compara X.disk con X_raid.disk; en conjuntos creados con "
+      "-raid= verifique la redundancia con scrub -path= (y repárela con "
+      "-repair=resync).\n");
+    return;
+  }
+  QElapsedTimer reloj;
+  reloj.start();
+  ArbolMerkle a, b;
+  bool cacheA = false, cacheB = false;
+  if (!arbolDeMontada(idA, espejo ? "r0" : "disco", a, cacheA, out) ||
+      !arbolDeMontada(espejo ? idA : idB, espejo ? "r1" : "disco", b, cacheB,
+        out))
+    return;
+
+  auto rangos = compararArboles(a, b);
+  QString titulo = espejo ? idA + " (principal) vs espejo" : idA + " vs " + idB;
+  if (rangos.empty()) {
+    out->appendPlainText(
+      QString("%1: idénticas (%2 s).\n")
+        .arg(titulo)
+        .arg(reloj.elapsed() / 1000.0, 0, 'f', 2));
+    return;
+  }
+  const size_t MAX_RANGOS = 20;
+  long total = 0;
+  for (const auto& r : rangos) total += r.tam;
+  out->appendPlainText(
+    QString("%1: %2 bytes distintos en %3 rango(s) (%4 s):")
+      .arg(titulo)
+      .arg(total)
+      .arg(rangos.size())
+      .arg(reloj.elapsed() / 1000.0, 0, 'f', 2));
+  for (size_t i = 0; i < rangos.size() && i < MAX_RANGOS; ++i)
+    out->appendPlainText(QString("  bytes %1 - %2")
+                           .arg(rangos[i].inicio)
+                           .arg(rangos[i].inicio + rangos[i].tam - 1));
+  if (rangos.size() > MAX_RANGOS)
+    out->appendPlainText(
+      QString("  ... y %1 rango(s) más").arg(rangos.size() - MAX_RANGOS));
+  out->appendPlainText("");
+}
+
+// ---------------- PEXPORT / PIMPORT (datos de una partición) ----------------
+// Ubica la partición montada y valida que su rango quepa en el disco
+bool ubicarParticion(const QString& id, QString& path, long& inicio,
+  long& tam, QPlainTextEdit* out) {
+  QString nombre, aviso;
+  if (!buscarMontada(id, path, nombre)) {
+    out->appendPlainText("No hay una partición montada con id " + id + ".\n");
+    return false;
+  }
+  auto disco = abrirDiscoLectura(path, aviso);
+  if (!disco) {
+    out->appendPlainText("No se pudo abrir el disco (" + aviso + ").\n");
+    return false;
+  }
+  if (!rangoDeParticion(*disco, nombre, inicio, tam)) {
+    out->appendPlainText("No se encontró la partición " + nombre + ".\n");
+    return false;
+  }
+  if (inicio < 0 || tam < 0 || inicio + tam > disco->tamano()) {
+    out->appendPlainText("La partición se sale de los límites del disco.\n");
+    return false;
+  }
+  return true;
+}
+
+// Ubica la partición y bloquea su rango (y con tabla > 0 también la tabla
+// de particiones, compartida). Si un fdisk la movió entre la búsqueda y el
+// bloqueo, se vuelve a ubicar.
+std::unique_ptr<BloqueoDisco> bloquearParticion(const QString& id,
+  BloqueoDisco::Modo modo, QString& path, long& inicio, long& tam,
+  QPlainTextEdit* out, long tabla = 0) {
+  for (;;) {
+    if (!ubicarParticion(id, path, inicio, tam, out)) return nullptr;
+    auto bloqueo =
+      std::make_unique<BloqueoDisco>(path, modo, inicio, tam, tabla);
+    if (!bloqueo->tomado()) {
+      out->appendPlainText(bloqueo->error() + "\n");
+      return nullptr;
+    }
+    QString pathAhora;
+    long inicioAhora = 0, tamAhora = 0;
+    if (!ubicarParticion(id, pathAhora, inicioAhora, tamAhora, out))
+      return nullptr;
+    if (pathAhora == path && inicioAhora == inicio && tamAhora == tam)
+      return bloqueo;
+  }
+}
+
+void DiskManager::pexport(
+  const QStringList& args, QPlainTextEdit* out, const QDir& currentDir) {
+  QString id, rawOut;
+  for (const QString& a : args) {
+    QString low = a.toLower();
+    if (low.startsWith("-id=")) id = a.mid(4);
+    else if (low.startsWith("-out=")) rawOut = a.mid(5);
+  }
+  if (id.isEmpty() || rawOut.isEmpty()) {
+    out->appendPlainText("Faltan parámetros id y out.\n");
+    return;
+  }
+  QString destino = currentDir.absoluteFilePath(rawOut);
+  if (fileExists(destino)) {
+    out->appendPlainText("El archivo " + destino + " ya existe.\n");
+    return;
+  }
+  QString path;
+  long inicio = 0, tam = 0;
+  auto bloqueo =
+    bloquearParticion(id, BloqueoDisco::COMPARTIDO, path, inicio, tam, out);
+  if (!bloqueo) return;
+  QString aviso;
+  auto disco = abrirDiscoLectura(path, aviso);
+  if (!disco) {
+    out->appendPlainText("No se pudo abrir el disco (" + aviso + ").\n");
+    return;
+  }
+
+  QElapsedTimer reloj;
+  reloj.start();
+  MetodoCopia metodo = MetodoCopia::LecturaEscritura;
+  // Con ambas réplicas sanas se copia directo desde X.disk
+  bool directo = !disco->degradado() && esArchivoPlano(path);
+  QString error = volcarRango(
+    *disco, directo ? path : QString(), inicio, tam, destino, metodo);
+  if (!error.isEmpty()) {
+    out->appendPlainText(error + "\n");
+    return;
+  }
+  out->appendPlainText(
+    QString("Partición %1 exportada a %2: %3 bytes con %4 (%5 s).\n")
+      .arg(id, destino)
+      .arg(tam)
+      .arg(nombreMetodo(metodo))
+      .arg(reloj.elapsed() / 1000.0, 0, 'f', 2));
+  avisarSiDegradado(out, disco->degradado(), aviso);
+}
+
+void DiskManager::pimport(
+  const QStringList& args, QPlainTextEdit* out, const QDir& currentDir) {
+  QString id, rawIn;
+  for (const QString& a : args) {
+    QString low = a.toLower();
+    if (low.startsWith("-id=")) id = a.mid(4);
+    else if (low.startsWith("-in=")) rawIn = a.mid(4);
+  }
+  if (id.isEmpty() || rawIn.isEmpty()) {
+    out->appendPlainText("Faltan parámetros id e in.\n");
+    return;
+  }
+  QString origen = currentDir.absoluteFilePath(rawIn);
+  auto entrada = ArchivoDisco::abrir(origen, false);
+  if (!entrada) {
+    out->appendPlainText("No se pudo abrir " + origen + ".\n");
+    return;
+  }
+  QString path;
+  long inicio = 0, tam = 0;
+  // En un disco thin, comprimido o con capas cualquier partición servida
+  // retiene la asignación de todo el disco
+  if (!ubicarParticion(id, path, inicio, tam, out) ||
+      servidoPorNbd(path, out, asignacionCompartida(path) ? QString() : id))
+    return;
+  auto bloqueo =
+    bloquearParticion(id, BloqueoDisco::EXCLUSIVO, path, inicio, tam, out);
+  if (!bloqueo) return;
+  long n = entrada->tamano();
+  if (n > tam) {
+    out->appendPlainText(
+      QString("El archivo (%1 bytes) no cabe en la partición (%2 bytes).\n")
+        .arg(n)
+        .arg(tam));
+    return;
+  }
+
+  QElapsedTimer reloj;
+  reloj.start();
+  QString aviso;
+  if (!replicasPlanas(path)) {
+    // RAID, thin, comprimido o con capas: por el dispositivo del disco, el
+    // mismo que usa un servidor NBD de otra partición
+    auto disco = abrirDiscoEscritura(path, aviso);
+    bool ok = disco &&
+              copiarEntreDispositivos(*entrada, 0, *disco, inicio, n) &&
+              disco->sincronizar();
+    if (!ok) {
+      out->appendPlainText("Error al importar en la partición.\n");
+      return;
     }
-    currentX += blockWidth;
-  }
-
-  // Marco exterior del disco
-  currentX = START_X;
-  painter.drawRect(START_X, START_Y, requiredWidth - 2 * PADDING + INNER_MARGIN,
-    DISK_BAR_HEIGHT + INNER_MARGIN);
-
-  // Bloques
-  for (const auto& b : blocks) {
-    if (b.size <= 0) continue;
-    int blockWidth;
-    if (b.type == "MBR" || b.type == "EBR") blockWidth = METADATA_UNIT_WIDTH;
-    else blockWidth = BLOCK_UNIT_WIDTH;
-    double percentage = (totalSize > 0) ? (double)b.size / totalSize : 0.0;
-    bool isInternalBlock =
-      (extStart != -1 && b.start >= extStart && (b.start + b.size) <= extEnd);
-
-    int drawX = currentX + INNER_MARGIN;
-    int drawY = START_Y + INNER_MARGIN;
-    int drawWidth = blockWidth - INNER_MARGIN;
-    int drawHeight = DISK_BAR_HEIGHT - INNER_MARGIN;
-
-    // Ajuste para bloques internos de la Extendida
-    if (isInternalBlock && b.type != "EXTENDIDA") {
-      drawY = START_Y + EXTENDED_HEADER_HEIGHT + INNER_MARGIN;
-      drawHeight = DISK_BAR_HEIGHT - EXTENDED_HEADER_HEIGHT - INNER_MARGIN;
+    out->appendPlainText(QString("Importados %1 bytes en %2 (%3 s).\n")
+                           .arg(n)
+                           .arg(id)
+                           .arg(reloj.elapsed() / 1000.0, 0, 'f', 2));
+    avisarSiDegradado(out, disco->degradado(), aviso);
+    return;
+  }
+
+  // Réplicas planas: se escribe cada una directo (sin pasar por la caché de
+  // bloques, que pierde lo cacheado del rango)
+  if (!CacheBloques::global().invalidar(path, inicio, inicio + n)) {
+    out->appendPlainText(
+      "La caché tiene escrituras pendientes en la partición.\n");
+    return;
+  }
+  const QString replicas[2] = {path, rutaRaid(path)};
+  QStringList metodos;
+  for (int i = 0; i < 2; ++i) {
+    const QString& r = replicas[i];
+    bool ok = false;
+    MetodoCopia metodo = MetodoCopia::LecturaEscritura;
+    if (fileExists(r)) {
+      auto archivo = ArchivoDisco::abrir(r, true);
+      ok = archivo &&
+           copiarRango(entrada->fd(), 0, archivo->fd(), inicio, n, metodo) &&
+           archivo->sincronizar();
     }
-    // Nota: el bloque EXTENDIDA (vacío) usa la altura completa del disco menos
-    // el margen.
-    else if (b.type == "EXTENDIDA") {
-      drawY = START_Y + INNER_MARGIN;
-      drawHeight = DISK_BAR_HEIGHT - INNER_MARGIN;
+    if (!ok && i == 0) {
+      out->appendPlainText("Error al importar en la partición.\n");
+      return;
     }
-    // Dibujar Rectángulo
-    painter.setPen(QPen(BORDER_COLOR, 1));  // Color del borde definido
-    painter.setBrush(Qt::white);
-    painter.drawRect(drawX, drawY, drawWidth, drawHeight);
-    QString typeText = b.type;
-    QString infoText;
-    if (b.type == "MBR" || b.type == "EBR") infoText = typeText;
-    else infoText = QString::asprintf("%.1f%%", percentage * 100);
-    painter.setPen(QPen(Qt::black));
-    // Tipo (arriba)
-    painter.drawText(drawX, drawY + drawHeight / 3, drawWidth, drawHeight / 4,
-      Qt::AlignCenter, typeText);
-    // Porcentaje (abajo, si no es MBR o EBR)
-    if (b.type != "MBR" && b.type != "EBR") {
-      painter.drawText(drawX, drawY + drawHeight * 2 / 3, drawWidth,
-        drawHeight / 4, Qt::AlignCenter, infoText);
+    if (!ok) aviso = "no se pudo actualizar el espejo " + r;
+    else metodos << nombreMetodo(metodo);
+  }
+  out->appendPlainText(QString("Importados %1 bytes en %2 con %3 (%4 s).\n")
+                         .arg(n)
+                         .arg(id)
+                         .arg(metodos.join(" / "))
+                         .arg(reloj.elapsed() / 1000.0, 0, 'f', 2));
+  avisarSiDegradado(out, !aviso.isEmpty(), aviso);
+}
+
+// cache -stats muestra los contadores; cache -size=<MiB> -block=<KiB>
+// cambia la capacidad y el tamaño de bloque; cache -reset pone los
+// contadores en cero
+void DiskManager::cache(const QStringList& args, QPlainTextEdit* out) {
+  CacheBloques& cache = CacheBloques::global();
+  long capacidad = cache.capacidad();
+  long bloque = cache.tamBloque();
+  bool configurar = false, reiniciar = false;
+  for (const QString& a : args) {
+    QString low = a.toLower();
+    if (low.startsWith("-size=")) {
+      capacidad = a.mid(6).toLong() * 1024 * 1024;
+      configurar = true;
+    } else if (low.startsWith("-block=")) {
+      bloque = a.mid(7).toLong() * 1024;
+      configurar = true;
+    } else if (low == "-reset") {
+      reiniciar = true;
     }
-    currentX += blockWidth;
-  }
-
-  // Dibujar encabezado si hay partición extendida
-  if (extStart != -1 && extendedStartPixel != -1) {
-    int headerWidth = extendedEndPixel - extendedStartPixel;
-    if (headerWidth > 0) {
-      painter.setPen(QPen(BORDER_COLOR, 1));
-      painter.setBrush(Qt::white);
-      // Ajuste de margen para el encabezado
-      int headerDrawX = extendedStartPixel + INNER_MARGIN;
-      int headerDrawY = START_Y + INNER_MARGIN;
-      int headerDrawWidth = headerWidth - INNER_MARGIN;
-      int headerDrawHeight = EXTENDED_HEADER_HEIGHT - INNER_MARGIN;
-      // Dibujar rectángulo y texto del encabezado
-      painter.drawRect(
-        headerDrawX, headerDrawY, headerDrawWidth, headerDrawHeight);
-      painter.setPen(QPen(Qt::black));  // Texto NEGRO
-      painter.drawText(headerDrawX, headerDrawY, headerDrawWidth,
-        headerDrawHeight, Qt::AlignCenter, "EXTENDIDA");
+  }
+  if (configurar) {
+    QString error = cache.configurar(capacidad, bloque);
+    if (!error.isEmpty()) {
+      out->appendPlainText(error + "\n");
+      return;
     }
   }
-  painter.end();
+  if (reiniciar) cache.reiniciarEstadisticas();
+  EstadisticasCache s = cache.estadisticas();
+  long accesos = s.aciertos + s.fallos;
+  QString msg;
+  msg += QString("Caché: %1 KiB en bloques de %2 KiB (%3 en uso)\n")
+           .arg(cache.capacidad() / 1024)
+           .arg(cache.tamBloque() / 1024.0)
+           .arg(cache.bloquesEnUso());
+  msg += QString("Aciertos: %1  Fallos: %2  (%3%)\n")
+           .arg(s.aciertos)
+           .arg(s.fallos)
+           .arg(accesos > 0 ? 100.0 * s.aciertos / accesos : 0.0, 0, 'f', 1);
+  msg += QString("Lectura anticipada: %1 bloques\n").arg(s.porAdelantado);
+  msg += QString("Escrituras diferidas: %1 bloques\n").arg(s.diferidos);
+  msg += QString("Expulsiones: %1  Invalidaciones: %2  Directos: %3\n")
+           .arg(s.expulsiones)
+           .arg(s.invalidaciones)
+           .arg(s.directos);
+  if (s.vaciadosFallidos > 0)
+    msg += QString("Vaciados fallidos al cerrar: %1\n").arg(s.vaciadosFallidos);
+  out->appendPlainText(msg);
+}
 
-  // Guardar la imagen
-  QString finalPath = path;
-  QFileInfo fi(path);
-  if (!fi.isAbsolute()) finalPath = currentDir.absoluteFilePath(path);
-  if (pixmap.save(finalPath))
-    out->appendPlainText("Reporte generado con éxito.\n");
-  else out->appendPlainText("Error al intentar guardar el reporte.\n");
+// nbd -id= [-socket=] sirve la partición montada por NBD en un socket Unix;
+// nbd -id= -stop lo detiene y nbd -list muestra los servidores activos
+void DiskManager::nbd(
+  const QStringList& args, QPlainTextEdit* out, const QDir& currentDir) {
+  QString id, rawSocket;
+  bool detener = false, listar = false;
+  for (const QString& a : args) {
+    QString low = a.toLower();
+    if (low.startsWith("-id=")) id = a.mid(4);
+    else if (low.startsWith("-socket=")) rawSocket = a.mid(8);
+    else if (low == "-stop") detener = true;
+    else if (low == "-list") listar = true;
+  }
+  if (listar) {
+    if (servidoresNbd.empty()) {
+      out->appendPlainText("No hay particiones servidas por NBD.\n");
+      return;
+    }
+    QString msg;
+    for (const auto& par : servidoresNbd) {
+      const ServidorNbd& s = *par.second;
+      EstadisticasNbd e = s.estadisticas();
+      msg += QString("%1: %2 (%3 bytes, %4)%5\n")
+               .arg(par.first, s.socket())
+               .arg(s.tamano())
+               .arg(s.usaSplice() ? "splice" : "copia")
+               .arg(s.degradado() ? " [degradado]" : "");
+      msg += QString("  %1 conexiones, %2 lecturas (%3 bytes), %4 escrituras "
+                     "(%5 bytes), %6 recortes\n")
+               .arg(e.conexiones)
+               .arg(e.lecturas)
+               .arg(e.bytesLeidos)
+               .arg(e.escrituras)
+               .arg(e.bytesEscritos)
+               .arg(e.recortes);
+    }
+    out->appendPlainText(msg);
+    return;
+  }
+  if (id.isEmpty()) {
+    out->appendPlainText("Falta parámetro id.\n");
+    return;
+  }
+  if (detener) {
+    if (!servidoresNbd.erase(id))
+      out->appendPlainText("La partición " + id + " no se está sirviendo.\n");
+    else out->appendPlainText("Servidor NBD de " + id + " detenido.\n");
+    return;
+  }
+  if (servidoresNbd.count(id)) {
+    out->appendPlainText("La partición " + id + " ya se sirve en " +
+                         servidoresNbd[id]->socket() + ".\n");
+    return;
+  }
+  // El servidor retiene la partición (exclusiva) y la tabla (compartida)
+  // hasta detenerse: fdisk, pimport o rmdisk no la cambian por debajo. En
+  // un disco thin, comprimido o con capas retiene además la asignación de
+  // todo el disco, así que ahí se sirve una sola partición a la vez.
+  QString path;
+  long inicio = 0, tam = 0;
+  if (!ubicarParticion(id, path, inicio, tam, out) ||
+      (asignacionCompartida(path) && servidoPorNbd(path, out)))
+    return;
+  auto bloqueo = bloquearParticion(
+    id, BloqueoDisco::EXCLUSIVO, path, inicio, tam, out, sizeof(MBR));
+  if (!bloqueo) return;
+  QString socket = currentDir.absoluteFilePath(
+    rawSocket.isEmpty() ? id + ".sock" : rawSocket);
+  QString error;
+  auto servidor = ServidorNbd::iniciar(
+    id, path, inicio, tam, socket, std::move(bloqueo), error);
+  if (!servidor) {
+    out->appendPlainText(error + "\n");
+    return;
+  }
+  out->appendPlainText(
+    QString("Partición %1 servida por NBD en %2 (%3 bytes, %4).\n"
+            "Conecte con: nbd-client -unix %2 /dev/nbd0 -N %1\n")
+      .arg(id, socket)
+      .arg(tam)
+      .arg(servidor->usaSplice() ? "lecturas con splice"
+                                 : "lecturas copiadas"));
+  servidoresNbd[id] = std::move(servidor);
+}
+
+// catalog [-name=] resume los discos del directorio actual, o busca en qué
+// discos hay una partición con ese nombre
+void DiskManager::catalog(
+  const QStringList& args, QPlainTextEdit* out, const QDir& currentDir) {
+  QString nombre;
+  for (const QString& a : args)
+    if (a.toLower().startsWith("-name=")) nombre = a.mid(6);
+  QElapsedTimer reloj;
+  reloj.start();
+  long releidos = 0;
+  std::vector<ResumenDisco> discos = CatalogoDiscos::global().escanear(
+    currentDir, hilosDeTrabajo(16), &releidos);
+
+  QString msg;
+  if (!nombre.isEmpty()) {
+    for (const ResumenDisco& r : discos)
+      for (const auto& p : r.particiones) {
+        if (p.first != nombre) continue;
+        QString tipo = p.second == 'E'   ? "extendida"
+                       : p.second == 'L' ? "lógica"
+                                         : "primaria";
+        msg += "- " + QFileInfo(r.path).fileName() + " (" + tipo + ")\n";
+      }
+    msg = msg.isEmpty()
+            ? "Ningún disco tiene una partición " + nombre + ".\n"
+            : "Partición " + nombre + " en:\n" + msg;
+  } else if (discos.empty()) {
+    msg = "No hay discos en " + currentDir.absolutePath() + ".\n";
+  } else {
+    const double MiB = 1024.0 * 1024.0;
+    msg += QString("%1 %2 %3 %4 %5 %6\n")
+             .arg("Disco", -24)
+             .arg("Tamaño", 10)
+             .arg("Part.", 6)
+             .arg("Libre", 10)
+             .arg("Formato", -11)
+             .arg("Espejo");
+    for (const ResumenDisco& r : discos) {
+      QString archivo = QFileInfo(r.path).fileName();
+      if (!r.error.isEmpty()) {
+        msg += QString("%1 ilegible: %2\n").arg(archivo, -24).arg(r.error);
+        continue;
+      }
+      msg += QString("%1 %2 %3 %4 %5 %6\n")
+               .arg(archivo, -24)
+               .arg(QString::number(r.tamano / MiB, 'f', 1) + " MiB", 10)
+               .arg(r.primarias + (r.extendida ? 1 : 0) + r.logicas, 6)
+               .arg(QString::number(r.libre / MiB, 'f', 1) + " MiB", 10)
+               .arg(r.formato, -11)
+               .arg(r.espejo);
+    }
+  }
+  msg += QString("%1 discos, %2 leídos y %3 de caché (%4 ms).\n")
+           .arg(discos.size())
+           .arg(releidos)
+           .arg(static_cast<long>(discos.size()) - releidos)
+           .arg(reloj.elapsed());
+  out->appendPlainText(msg);
 }
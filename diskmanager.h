@@ -5,6 +5,7 @@
 #include <QStringList>
 #include <cstring>
 class Terminal;
+struct OpcionesReporte;
 
 class DiskManager {
  public:
@@ -19,12 +20,44 @@ class DiskManager {
   static void mount(
     const QStringList& args, QPlainTextEdit* out, const QDir& currentDir);
   static void unmount(const QStringList& args, QPlainTextEdit* out);
-  static void rep(
+  static void rep(const QStringList& args, QPlainTextEdit* out,
+    const QDir& currentDir, Terminal* terminal);
+  static void scrub(
+    const QStringList& args, QPlainTextEdit* out, const QDir& currentDir);
+  static void snapshot(
+    const QStringList& args, QPlainTextEdit* out, const QDir& currentDir);
+  static void convert(
+    const QStringList& args, QPlainTextEdit* out, const QDir& currentDir);
+  static void exportDisk(
+    const QStringList& args, QPlainTextEdit* out, const QDir& currentDir);
+  static void importDisk(
+    const QStringList& args, QPlainTextEdit* out, const QDir& currentDir);
+  static void store(
+    const QStringList& args, QPlainTextEdit* out, const QDir& currentDir);
+  static void hash(const QStringList& args, QPlainTextEdit* out);
+  static void diff(const QStringList& args, QPlainTextEdit* out);
+  static void pexport(
+    const QStringList& args, QPlainTextEdit* out, const QDir& currentDir);
+  static void pimport(
+    const QStringList& args, QPlainTextEdit* out, const QDir& currentDir);
+  static void cache(const QStringList& args, QPlainTextEdit* out);
+  static void nbd(
+    const QStringList& args, QPlainTextEdit* out, const QDir& currentDir);
+  static void catalog(
     const QStringList& args, QPlainTextEdit* out, const QDir& currentDir);
 
  private:
   static bool mkdiskParams(const QStringList& args, long& sizeBytes, char& fit,
-    QString& path, QString& unit, QPlainTextEdit* out);
+    QString& path, QString& unit, int& raidNivel, int& miembros, long& stripe,
+    QString& formato, QString& plantilla, QPlainTextEdit* out);
+  static void repTodas(const QString& dirSalida,
+    const OpcionesReporte& opciones, QPlainTextEdit* out,
+    const QDir& currentDir, Terminal* terminal);
+  static void repUso(const QString& disco, const QString& id,
+    const QString& destino, const OpcionesReporte& opciones,
+    QPlainTextEdit* out, Terminal* terminal);
+  static void mkdiskDesdePlantilla(const QString& plantilla,
+    const QString& path, char fit, QPlainTextEdit* out);
   static bool createEmptyDisk(
     const QString& path, long sizeBytes, QPlainTextEdit* out);
   static bool writeInitialMBR(
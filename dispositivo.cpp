@@ -0,0 +1,281 @@
+#include "dispositivo.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <iterator>
+#include <map>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "comprimida.h"
+#include "discoio.h"
+#include "hash64.h"
+#include "raid.h"
+#include "snapshot.h"
+#include "thin.h"
+
+namespace {
+// Las lecturas a partir de este tamaño se balancean entre réplicas
+const long LECTURA_MASIVA = 64 * 1024;
+}  // namespace
+
+// ------------------------- ArchivoDisco -----------------------------
+std::unique_ptr<ArchivoDisco> ArchivoDisco::abrir(
+  const QString& path, bool escritura) {
+  int fd = open(path.toStdString().c_str(), escritura ? O_RDWR : O_RDONLY);
+  if (fd < 0) return nullptr;
+  return std::unique_ptr<ArchivoDisco>(new ArchivoDisco(fd));
+}
+
+ArchivoDisco::~ArchivoDisco() {
+  close(fd_);
+}
+
+bool ArchivoDisco::leer(long pos, char* buf, long n) {
+  if (pos < 0) return false;
+  return leerCompleto(fd_, pos, buf, n);
+}
+
+bool ArchivoDisco::escribir(long pos, const char* buf, long n) {
+  if (pos < 0) return false;
+  return escribirCompleto(fd_, pos, buf, n);
+}
+
+bool ArchivoDisco::sincronizar() {
+  return fdatasync(fd_) == 0;
+}
+
+long ArchivoDisco::tamano() const {
+  struct stat st;
+  if (fstat(fd_, &st) != 0) return -1;
+  return static_cast<long>(st.st_size);
+}
+
+// ------------------------- DiscoEspejado ----------------------------
+std::unique_ptr<DiscoEspejado> DiscoEspejado::abrir(
+  const QString& path, QString& aviso) {
+  std::unique_ptr<DiscoEspejado> d(new DiscoEspejado());
+  const QString rutas[2] = {path, rutaRaid(path)};
+  const char* nombres[2] = {"principal", "RAID"};
+  QStringList problemas;
+  for (int i = 0; i < 2; ++i) {
+    d->replicas_[i] = abrirMiembro(rutas[i], false);
+    if (!d->replicas_[i]) {
+      problemas << QString("réplica %1 no se pudo abrir").arg(nombres[i]);
+      continue;
+    }
+    MBR mbr;
+    QString motivo;
+    if (!readMBR(*d->replicas_[i], mbr)) motivo = "no se pudo leer el MBR";
+    else motivo = validarMBR(mbr, d->replicas_[i]->tamano());
+    if (!motivo.isEmpty()) {
+      problemas << QString("réplica %1 inválida: %2").arg(nombres[i], motivo);
+      d->replicas_[i].reset();
+      continue;
+    }
+    d->sana_[i] = true;
+  }
+  aviso = problemas.join("; ");
+  if (!d->sana_[0] && !d->sana_[1]) return nullptr;
+  return d;
+}
+
+int DiscoEspejado::elegirReplica(long n) {
+  bool s0 = sana_[0], s1 = sana_[1];
+  if (!s0 || !s1) return s0 ? 0 : (s1 ? 1 : -1);
+  if (n < LECTURA_MASIVA) return 0;
+  // Menor profundidad de cola; en empate se alterna
+  int c0 = enCurso_[0], c1 = enCurso_[1];
+  if (c0 != c1) return c0 < c1 ? 0 : 1;
+  return static_cast<int>(turno_.fetch_add(1) & 1u);
+}
+
+bool DiscoEspejado::leer(long pos, char* buf, long n) {
+  int r = elegirReplica(n);
+  if (r < 0) return false;
+  enCurso_[r]++;
+  bool ok = replicas_[r]->leer(pos, buf, n);
+  enCurso_[r]--;
+  if (ok) return true;
+  // Si la otra réplica tampoco puede, no es un fallo de esta réplica
+  // (por ejemplo, una lectura fuera del disco)
+  int otra = 1 - r;
+  if (!sana_[otra] || !replicas_[otra]->leer(pos, buf, n)) return false;
+  sana_[r] = false;
+  return true;
+}
+
+bool DiscoEspejado::escribir(long, const char*, long) {
+  return false;  // Las escrituras van por DiscoReplicado
+}
+
+long DiscoEspejado::tamano() const {
+  for (int i = 0; i < 2; ++i)
+    if (sana_[i]) return replicas_[i]->tamano();
+  return -1;
+}
+
+bool DiscoEspejado::degradado() const {
+  return !(sana_[0] && sana_[1]);
+}
+
+// ------------------------- DiscoReplicado ---------------------------
+namespace {
+// Con más bytes pendientes que esto el diario se aplica sin esperar
+const long MAX_DIARIO = 8L * 1024 * 1024;
+}  // namespace
+
+std::unique_ptr<DiscoReplicado> DiscoReplicado::abrir(
+  const QString& path, QString& aviso) {
+  std::unique_ptr<DiscoReplicado> d(new DiscoReplicado());
+  d->principal_ = abrirMiembro(path, true);
+  if (!d->principal_) {
+    aviso = "el disco principal no se pudo abrir";
+    return nullptr;
+  }
+  d->espejo_ = abrirMiembro(rutaRaid(path), true);
+  if (!d->espejo_) aviso = "el espejo RAID no se pudo abrir";
+  return d;
+}
+
+DiscoReplicado::~DiscoReplicado() {
+  replicar();
+}
+
+bool DiscoReplicado::leer(long pos, char* buf, long n) {
+  return principal_->leer(pos, buf, n);
+}
+
+bool DiscoReplicado::escribir(long pos, const char* buf, long n) {
+  if (!principal_->escribir(pos, buf, n)) return false;
+  if (!espejo_) return true;
+  diario_.push_back({pos, std::vector<char>(buf, buf + n)});
+  bytesEnDiario_ += n;
+  if (bytesEnDiario_ > MAX_DIARIO) replicar();
+  return true;
+}
+
+// Fusiona el diario en rangos disjuntos (la escritura más reciente gana donde
+// se solapan) y los escribe en el espejo en orden de desplazamiento
+bool DiscoReplicado::replicar() {
+  if (diario_.empty()) return !fallo_;
+  std::map<long, std::vector<char>> rangos;
+  for (auto& e : diario_) {
+    long ini = e.pos;
+    long fin = e.pos + static_cast<long>(e.datos.size());
+    // Primer rango que podría tocar a [ini, fin]
+    auto it = rangos.upper_bound(ini);
+    if (it != rangos.begin()) {
+      auto prev = std::prev(it);
+      long finPrev = prev->first + static_cast<long>(prev->second.size());
+      if (finPrev >= ini) it = prev;
+    }
+    long nIni = ini, nFin = fin;
+    auto primero = it;
+    for (; it != rangos.end() && it->first <= fin; ++it) {
+      nIni = std::min(nIni, it->first);
+      nFin = std::max(nFin, it->first + static_cast<long>(it->second.size()));
+    }
+    std::vector<char> unido(static_cast<size_t>(nFin - nIni));
+    for (auto r = primero; r != it; ++r)
+      std::copy(r->second.begin(), r->second.end(),
+        unido.begin() + (r->first - nIni));
+    std::copy(e.datos.begin(), e.datos.end(), unido.begin() + (ini - nIni));
+    rangos.erase(primero, it);
+    rangos.emplace(nIni, std::move(unido));
+  }
+  diario_.clear();
+  bytesEnDiario_ = 0;
+  for (const auto& [pos, datos] : rangos)
+    if (!espejo_->escribir(pos, datos.data(), static_cast<long>(datos.size())))
+      fallo_ = true;
+  return !fallo_;
+}
+
+bool DiscoReplicado::sincronizar() {
+  // Lo que no llega al espejo deja el disco degradado, no falla el cambio
+  replicar();
+  if (espejo_ && !espejo_->sincronizar()) fallo_ = true;
+  return principal_->sincronizar();
+}
+
+std::unique_ptr<Dispositivo> abrirImagen(const QString& path, bool escritura) {
+  if (esImagenThin(path)) return ImagenThin::abrir(path, escritura);
+  if (esImagenComprimida(path)) return ImagenComprimida::abrir(path, escritura);
+  return ArchivoDisco::abrir(path, escritura);
+}
+
+QString formatoImagen(const QString& path) {
+  if (esImagenThin(path)) return "thin";
+  if (esImagenComprimida(path)) return "compressed";
+  return "flat";
+}
+
+bool esArchivoPlano(const QString& archivo) {
+  return !esConjuntoRaid(archivo) && formatoImagen(archivo) == "flat" &&
+         !tieneCapas(archivo);
+}
+
+bool replicasPlanas(const QString& path) {
+  QString raid = rutaRaid(path);
+  return esArchivoPlano(path) && (!fileExists(raid) || esArchivoPlano(raid));
+}
+
+bool asignacionCompartida(const QString& path) {
+  for (const QString& archivo : archivosDeDisco(path))
+    if (formatoImagen(archivo) != "flat" || tieneCapas(archivo)) return true;
+  return false;
+}
+
+namespace {
+
+std::unique_ptr<Dispositivo> conCache(
+  const QString& path, std::unique_ptr<Dispositivo> disco) {
+  if (!disco) return nullptr;
+  return std::unique_ptr<Dispositivo>(
+    new DiscoEnCache(path, std::move(disco), false));
+}
+
+}  // namespace
+
+std::unique_ptr<Dispositivo> abrirDiscoLectura(
+  const QString& path, QString& aviso) {
+  if (esConjuntoRaid(path))
+    return conCache(path, DiscoRaid::abrir(path, false, aviso));
+  return conCache(path, DiscoEspejado::abrir(path, aviso));
+}
+
+std::unique_ptr<Dispositivo> abrirDiscoEscritura(
+  const QString& path, QString& aviso) {
+  return DiscoEnCache::abrirEscritura(
+    path,
+    [&](QString& avisoInterno) -> std::unique_ptr<Dispositivo> {
+      if (esConjuntoRaid(path))
+        return DiscoRaid::abrir(path, true, avisoInterno);
+      return DiscoReplicado::abrir(path, avisoInterno);
+    },
+    aviso);
+}
+
+unsigned long long generacionDisco(const QString& path) {
+  // Hash de (inodo, tamaño, modificación en ns) de cada archivo involucrado
+  std::vector<long long> firma;
+  for (const QString& archivo : archivosDeDisco(path)) {
+    std::vector<QString> rutas{archivo};
+    for (const QString& capa : rutasCapas(archivo)) rutas.push_back(capa);
+    for (const QString& r : rutas) {
+      struct stat st;
+      if (stat(r.toStdString().c_str(), &st) != 0) {
+        firma.push_back(-1);
+        continue;
+      }
+      firma.push_back(static_cast<long long>(st.st_ino));
+      firma.push_back(static_cast<long long>(st.st_size));
+      firma.push_back(static_cast<long long>(st.st_mtim.tv_sec));
+      firma.push_back(static_cast<long long>(st.st_mtim.tv_nsec));
+    }
+  }
+  return hash64(reinterpret_cast<const char*>(firma.data()),
+    firma.size() * sizeof(long long));
+}
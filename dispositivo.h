@@ -0,0 +1,132 @@
+#pragma once
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Interfaz de E/S por bytes sobre una imagen de disco. Todo el acceso a MBR,
+// EBR y datos pasa por aquí, así el resto del código no depende de si detrás
+// hay un archivo, un espejo u otro formato.
+class Dispositivo {
+ public:
+  virtual ~Dispositivo() = default;
+  virtual bool leer(long pos, char* buf, long n) = 0;
+  virtual bool escribir(long pos, const char* buf, long n) = 0;
+  virtual bool sincronizar() = 0;
+  virtual long tamano() const = 0;
+  // true si el dispositivo funciona sin toda su redundancia
+  virtual bool degradado() const { return false; }
+};
+
+// Un archivo .disk accedido con pread/pwrite
+class ArchivoDisco : public Dispositivo {
+ public:
+  static std::unique_ptr<ArchivoDisco> abrir(
+    const QString& path, bool escritura);
+  ~ArchivoDisco() override;
+
+  bool leer(long pos, char* buf, long n) override;
+  bool escribir(long pos, const char* buf, long n) override;
+  bool sincronizar() override;
+  long tamano() const override;
+  int fd() const { return fd_; }
+
+ private:
+  explicit ArchivoDisco(int fd) : fd_(fd) {}
+  int fd_;
+};
+
+// Disco principal más su espejo _raid.disk, solo lectura. Las lecturas
+// grandes se reparten entre las réplicas según cuántas lecturas tenga cada
+// una en curso; las pequeñas (metadatos) van a la réplica preferida. Si una
+// réplica no abre, no pasa la validación o falla al leer, se sigue con la
+// otra en modo degradado.
+class DiscoEspejado : public Dispositivo {
+ public:
+  // Devuelve nullptr si ninguna réplica es utilizable. En aviso se describe
+  // el motivo por el que una réplica quedó fuera (vacío si ambas sirven).
+  static std::unique_ptr<DiscoEspejado> abrir(
+    const QString& path, QString& aviso);
+
+  bool leer(long pos, char* buf, long n) override;
+  bool escribir(long pos, const char* buf, long n) override;
+  bool sincronizar() override { return true; }
+  long tamano() const override;
+  bool degradado() const override;
+
+ private:
+  DiscoEspejado() = default;
+  int elegirReplica(long n);
+
+  std::unique_ptr<Dispositivo> replicas_[2];  // 0 = principal, 1 = RAID
+  std::atomic<bool> sana_[2] = {{false}, {false}};
+  std::atomic<int> enCurso_[2] = {{0}, {0}};
+  std::atomic<unsigned> turno_{0};
+};
+
+// Disco principal más su espejo _raid.disk, para escritura. Cada escritura va
+// al principal y queda registrada (desplazamiento, bytes) en un diario; al
+// sincronizar (o al cerrar) el diario se fusiona por rangos y se aplica al
+// espejo en un solo lote ordenado, sin volver a interpretar MBR ni EBRs.
+class DiscoReplicado : public Dispositivo {
+ public:
+  // Devuelve nullptr si el principal no abre; sin espejo queda degradado
+  static std::unique_ptr<DiscoReplicado> abrir(
+    const QString& path, QString& aviso);
+  ~DiscoReplicado() override;
+
+  bool leer(long pos, char* buf, long n) override;
+  bool escribir(long pos, const char* buf, long n) override;
+  // Aplica el diario al espejo y vacía ambos archivos a disco. Devuelve
+  // false si falla el principal; un fallo del espejo queda en degradado()
+  bool sincronizar() override;
+  long tamano() const override { return principal_->tamano(); }
+  bool degradado() const override { return !espejo_ || fallo_; }
+
+ private:
+  struct Escritura {
+    long pos;
+    std::vector<char> datos;
+  };
+
+  DiscoReplicado() = default;
+  bool replicar();
+
+  std::unique_ptr<Dispositivo> principal_;
+  std::unique_ptr<Dispositivo> espejo_;  // nullptr si no abrió
+  std::vector<Escritura> diario_;
+  long bytesEnDiario_ = 0;
+  bool fallo_ = false;  // Alguna réplica al espejo no se completó
+};
+
+// Abre un archivo de imagen según su formato: plano (ArchivoDisco), thin o
+// comprimido
+std::unique_ptr<Dispositivo> abrirImagen(const QString& path, bool escritura);
+// "flat", "thin" o "compressed" según la cabecera del archivo
+QString formatoImagen(const QString& path);
+// Archivo que se puede leer o escribir directo con su descriptor (o copiar
+// con el kernel): plano, sin capas de snapshot y fuera de un conjunto RAID
+// con cabecera
+bool esArchivoPlano(const QString& archivo);
+// X.disk y su espejo (si existe) son archivos planos: el disco se puede
+// escribir por descriptor, réplica por réplica
+bool replicasPlanas(const QString& path);
+// Algún archivo del disco es thin, comprimido o tiene capas: escribir en
+// cualquier rango puede asignar espacio y cambiar tablas de todo el disco
+bool asignacionCompartida(const QString& path);
+
+// Abre un disco para lectura con balanceo y respaldo en el espejo (o el
+// conjunto completo si fue creado con mkdisk -raid=). Los discos abiertos
+// con estas dos funciones pasan por la caché de bloques (cache.h).
+std::unique_ptr<Dispositivo> abrirDiscoLectura(
+  const QString& path, QString& aviso);
+// Abre un disco para escritura: el conjunto RAID si tiene cabecera, si no el
+// principal replicando sus escrituras en el espejo. Lo escrito llega a los
+// archivos al sincronizar o al cerrar. Las aperturas simultáneas del mismo
+// disco comparten el dispositivo de debajo de la caché.
+std::unique_ptr<Dispositivo> abrirDiscoEscritura(
+  const QString& path, QString& aviso);
+// Generación del disco: cambia cada vez que se modifica alguno de sus
+// archivos (réplicas, miembros o capas de snapshot). Sirve de clave para
+// datos derivados guardados aparte.
+unsigned long long generacionDisco(const QString& path);
@@ -0,0 +1,358 @@
+#include "estado.h"
+
+#include <QDir>
+#include <QStringList>
+#include <QtGlobal>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+
+#include "bloqueos.h"
+#include "discoio.h"
+#include "hash64.h"
+
+// Contenido del archivo de estado ya interpretado
+struct ContenidoEstado {
+  std::vector<std::pair<QString, TablaParticiones>> tablas;
+  std::vector<ParticionMontada> partes;
+};
+
+namespace {
+
+const char MAGIC_ESTADO[8] = {'P', '2', 'E', 'S', 'T', 'A', 'D', 'O'};
+const uint32_t VERSION_ESTADO = 1;
+
+struct CabeceraEstado {
+  char magic[8];
+  uint32_t version;
+  uint32_t discos;
+  uint64_t tamCuerpo;
+  uint64_t suma;  // hash64 del cuerpo
+};
+
+// Cuerpo: por disco, path, generación, MBR, EBRs y particiones montadas
+class Escritor {
+ public:
+  template <typename T>
+  void valor(const T& v) {
+    datos_.append(reinterpret_cast<const char*>(&v), sizeof(T));
+  }
+  void texto(const QString& s) {
+    std::string utf8 = s.toStdString();
+    valor(static_cast<uint32_t>(utf8.size()));
+    datos_.append(utf8);
+  }
+  const std::string& datos() const { return datos_; }
+
+ private:
+  std::string datos_;
+};
+
+class Lector {
+ public:
+  Lector(const char* datos, size_t n) : p_(datos), fin_(datos + n) {}
+  template <typename T>
+  bool valor(T& v) {
+    if (static_cast<size_t>(fin_ - p_) < sizeof(T)) return false;
+    memcpy(&v, p_, sizeof(T));
+    p_ += sizeof(T);
+    return true;
+  }
+  bool texto(QString& s) {
+    uint32_t n = 0;
+    if (!valor(n) || static_cast<size_t>(fin_ - p_) < n) return false;
+    s = QString::fromStdString(std::string(p_, n));
+    p_ += n;
+    return true;
+  }
+  bool alFinal() const { return p_ == fin_; }
+
+ private:
+  const char* p_;
+  const char* fin_;
+};
+
+// Interpreta el archivo completo; false si falta, está dañado o es de otra
+// versión (c queda vacío)
+bool leerArchivoEstado(const QString& ruta, ContenidoEstado& c) {
+  c = ContenidoEstado();
+  std::ifstream f(ruta.toStdString(), std::ios::binary);
+  CabeceraEstado cab;
+  if (!f.read(reinterpret_cast<char*>(&cab), sizeof(cab)) ||
+      memcmp(cab.magic, MAGIC_ESTADO, sizeof(MAGIC_ESTADO)) != 0 ||
+      cab.version != VERSION_ESTADO || cab.tamCuerpo > (64u << 20))
+    return false;
+  std::string cuerpo(static_cast<size_t>(cab.tamCuerpo), '\0');
+  if (!f.read(&cuerpo[0], static_cast<std::streamsize>(cuerpo.size())) ||
+      hash64(cuerpo.data(), cuerpo.size()) != cab.suma)
+    return false;
+
+  ContenidoEstado leido;
+  Lector lector(cuerpo.data(), cuerpo.size());
+  for (uint32_t i = 0; i < cab.discos; ++i) {
+    QString path;
+    TablaParticiones t;
+    uint8_t degradado = 0;
+    uint32_t ebrs = 0, montadas = 0;
+    if (!lector.texto(path) || !lector.valor(t.generacion) ||
+        !lector.valor(degradado) || !lector.texto(t.aviso) ||
+        !lector.valor(t.mbr) || !lector.valor(ebrs))
+      return false;
+    t.degradado = degradado != 0;
+    for (uint32_t j = 0; j < ebrs; ++j) {
+      std::pair<EBR, long> par;
+      int64_t pos = 0;
+      if (!lector.valor(par.first) || !lector.valor(pos)) return false;
+      par.second = static_cast<long>(pos);
+      t.ebrs.push_back(par);
+    }
+    if (!lector.valor(montadas)) return false;
+    for (uint32_t j = 0; j < montadas; ++j) {
+      ParticionMontada p;
+      p.path = path;
+      if (!lector.texto(p.id) || !lector.texto(p.nombre)) return false;
+      leido.partes.push_back(p);
+    }
+    leido.tablas.emplace_back(path, std::move(t));
+  }
+  if (!lector.alFinal()) return false;
+  c = std::move(leido);
+  return true;
+}
+
+// Escribe en un temporal propio (mkstemp) y lo renombra sobre la ruta, así
+// dos instancias nunca comparten el archivo a medio escribir
+void escribirArchivoEstado(const QString& ruta, const ContenidoEstado& c) {
+  std::map<QString, std::vector<const ParticionMontada*>> porDisco;
+  for (const ParticionMontada& p : c.partes) porDisco[p.path].push_back(&p);
+  std::map<QString, const TablaParticiones*> tablas;
+  for (const auto& par : c.tablas) tablas[par.first] = &par.second;
+
+  Escritor esc;
+  uint32_t discos = 0;
+  for (const auto& par : porDisco) {
+    // mount siempre deja la tabla del disco; sin ella no se guarda
+    auto it = tablas.find(par.first);
+    if (it == tablas.end()) continue;
+    const TablaParticiones& t = *it->second;
+    esc.texto(par.first);
+    esc.valor(t.generacion);
+    esc.valor(static_cast<uint8_t>(t.degradado ? 1 : 0));
+    esc.texto(t.aviso);
+    esc.valor(t.mbr);
+    esc.valor(static_cast<uint32_t>(t.ebrs.size()));
+    for (const auto& ebr : t.ebrs) {
+      esc.valor(ebr.first);
+      esc.valor(static_cast<int64_t>(ebr.second));
+    }
+    esc.valor(static_cast<uint32_t>(par.second.size()));
+    for (const ParticionMontada* p : par.second) {
+      esc.texto(p->id);
+      esc.texto(p->nombre);
+    }
+    ++discos;
+  }
+
+  CabeceraEstado cab;
+  memset(&cab, 0, sizeof(cab));
+  memcpy(cab.magic, MAGIC_ESTADO, sizeof(MAGIC_ESTADO));
+  cab.version = VERSION_ESTADO;
+  cab.discos = discos;
+  cab.tamCuerpo = esc.datos().size();
+  cab.suma = hash64(esc.datos().data(), esc.datos().size());
+  std::string tmp = (ruta + ".XXXXXX").toStdString();
+  int fd = mkstemp(&tmp[0]);
+  if (fd < 0) return;
+  bool ok = escribirCompleto(fd, 0, reinterpret_cast<const char*>(&cab),
+              sizeof(cab)) &&
+            escribirCompleto(fd, sizeof(cab), esc.datos().data(),
+              static_cast<long>(esc.datos().size()));
+  ok = close(fd) == 0 && ok;
+  // Si no se puede guardar, el siguiente inicio vuelve a montar desde cero
+  if (!ok || rename(tmp.c_str(), ruta.toStdString().c_str()) != 0)
+    unlink(tmp.c_str());
+}
+
+QString claveMontaje(const ParticionMontada& p) {
+  return p.id + '\n' + p.path + '\n' + p.nombre;
+}
+
+bool particionUsada(const char* nombre, char status, const QString& buscado) {
+  return status == 1 && QString::fromLatin1(nombre) == buscado;
+}
+
+}  // namespace
+
+bool TablaParticiones::buscar(
+  const QString& nombre, long& inicio, long& tam, bool* logica) const {
+  for (const Partition& p : mbr.parts)
+    if (particionUsada(p.name, p.status, nombre)) {
+      inicio = p.start;
+      tam = p.size;
+      if (logica) *logica = false;
+      return true;
+    }
+  for (const auto& par : ebrs)
+    if (particionUsada(par.first.name, par.first.status, nombre)) {
+      inicio = par.first.start;
+      tam = par.first.size;
+      if (logica) *logica = true;
+      return true;
+    }
+  return false;
+}
+
+bool leerTabla(Dispositivo& disco, TablaParticiones& t) {
+  if (!readMBR(disco, t.mbr)) return false;
+  t.ebrs.clear();
+  Partition extendida;
+  if (obtenerExtendida(t.mbr, extendida))
+    t.ebrs = leerEBRsConPos(disco, extendida);
+  return true;
+}
+
+QString EstadoSesion::rutaPorDefecto() {
+  return QDir::homePath() + "/.estado_discos";
+}
+
+RegistroMontajes& EstadoSesion::montajes() {
+  std::call_once(cargado_, [this] { cargar(); });
+  return montajes_;
+}
+
+void EstadoSesion::cargar() {
+  ContenidoEstado c;
+  {
+    CerrojoArchivo cerrojo(ruta_, false);
+    if (!leerArchivoEstado(ruta_, c)) return;
+  }
+  // Los discos que ya no existen se descartan; la tabla de los demás se
+  // valida contra la generación cuando se pida
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& par : c.tablas)
+    if (fileExists(par.first)) tablas_[par.first] = std::move(par.second);
+  for (const ParticionMontada& p : c.partes)
+    if (tablas_.count(p.path)) {
+      montajes_.restaurar(p);
+      guardados_.insert(claveMontaje(p));
+    }
+}
+
+QString EstadoSesion::tabla(const QString& path, TablaParticiones& t) {
+  unsigned long long generacion = generacionDisco(path);
+  bool habia = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = tablas_.find(path);
+    if (it != tablas_.end()) {
+      if (it->second.generacion == generacion) {
+        t = it->second;
+        return QString();
+      }
+      habia = true;
+    }
+  }
+  // Sin tabla o con la imagen modificada: se relee del disco
+  QString aviso;
+  auto disco = abrirDiscoLectura(path, aviso);
+  if (!disco) return "No se pudo abrir el disco (" + aviso + ").";
+  TablaParticiones nueva;
+  if (!leerTabla(*disco, nueva)) return "No se pudo leer MBR.";
+  nueva.generacion = generacion;
+  nueva.degradado = disco->degradado();
+  nueva.aviso = aviso;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tablas_[path] = nueva;
+  }
+  t = std::move(nueva);
+  if (habia && !montajes().particionesDe(path).empty()) guardar();
+  return QString();
+}
+
+QString EstadoSesion::montar(const QString& path, const QString& nombre) {
+  montajes();  // Cargado antes del cerrojo exclusivo
+  CerrojoArchivo cerrojo(ruta_, true);
+  ContenidoEstado base;
+  bool leido = leerArchivoEstado(ruta_, base);
+  std::lock_guard<std::mutex> lock(mutex_);
+  mezclar(base, leido);
+  // El id sale del registro ya mezclado: no choca con el de otra instancia
+  QString id = montajes_.montar(path, nombre);
+  if (!id.isEmpty()) escribir(base);
+  return id;
+}
+
+void EstadoSesion::guardar() {
+  montajes();
+  CerrojoArchivo cerrojo(ruta_, true);
+  ContenidoEstado base;
+  bool leido = leerArchivoEstado(ruta_, base);
+  std::lock_guard<std::mutex> lock(mutex_);
+  mezclar(base, leido);
+  escribir(base);
+}
+
+void EstadoSesion::mezclar(const ContenidoEstado& base, bool leido) {
+  std::set<QString> enArchivo;
+  for (const ParticionMontada& p : base.partes) {
+    QString clave = claveMontaje(p);
+    enArchivo.insert(clave);
+    ParticionMontada actual;
+    if (guardados_.count(clave) ||
+        (montajes_.buscar(p.id, actual) && claveMontaje(actual) == clave))
+      continue;
+    // Montaje nuevo de otra instancia: se adopta con su tabla
+    if (!tablas_.count(p.path)) {
+      for (const auto& t : base.tablas)
+        if (t.first == p.path) tablas_[p.path] = t.second;
+      if (!tablas_.count(p.path) || !fileExists(p.path)) continue;
+    }
+    // Solo choca con un archivo escrito sin esta mezcla (una versión
+    // anterior): gana el montaje de esta instancia y se avisa
+    if (!montajes_.restaurar(p))
+      qWarning("El montaje %s (%s en %s) de otra instancia choca con uno de "
+               "esta y se descarta.",
+        qPrintable(p.id), qPrintable(p.nombre), qPrintable(p.path));
+  }
+  // Lo que esta instancia guardó y ya no está lo desmontó otra. Sin archivo
+  // legible no se sabe, y no se desmonta nada.
+  if (!leido) return;
+  for (const QString& clave : guardados_) {
+    if (enArchivo.count(clave)) continue;
+    QStringList partes = clave.split('\n');
+    ParticionMontada actual;
+    if (montajes_.buscar(partes[0], actual) && claveMontaje(actual) == clave)
+      montajes_.desmontar(partes[0]);
+  }
+}
+
+void EstadoSesion::escribir(const ContenidoEstado& base) {
+  // Después de mezclar, el registro es el estado de todas las instancias.
+  // Las tablas propias son más recientes que las del archivo.
+  ContenidoEstado nuevo;
+  nuevo.partes = montajes_.todas();
+  std::set<QString> discos;
+  std::set<QString> claves;
+  for (const ParticionMontada& p : nuevo.partes) {
+    discos.insert(p.path);
+    claves.insert(claveMontaje(p));
+  }
+  for (const QString& path : discos) {
+    auto it = tablas_.find(path);
+    if (it != tablas_.end()) {
+      nuevo.tablas.emplace_back(path, it->second);
+      continue;
+    }
+    for (const auto& t : base.tablas)
+      if (t.first == path) nuevo.tablas.push_back(t);
+  }
+  escribirArchivoEstado(ruta_, nuevo);
+  guardados_ = std::move(claves);
+}
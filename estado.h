@@ -0,0 +1,74 @@
+#pragma once
+#include <QString>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "dispositivo.h"
+#include "estructuras.h"
+#include "montajes.h"
+
+// MBR y cadena de EBRs ya interpretados, con la generación del disco de la
+// que salieron
+struct TablaParticiones {
+  unsigned long long generacion = 0;
+  MBR mbr;
+  std::vector<std::pair<EBR, long>> ebrs;  // EBR y su posición
+  bool degradado = false;                  // Se leyó de una sola réplica
+  QString aviso;
+
+  // Rango de la partición (primaria, extendida o lógica) con ese nombre
+  bool buscar(const QString& nombre, long& inicio, long& tam,
+    bool* logica = nullptr) const;
+};
+
+// Lee el MBR y los EBRs del dispositivo; false si no hay MBR
+bool leerTabla(Dispositivo& disco, TablaParticiones& t);
+
+struct ContenidoEstado;
+
+// Estado de la sesión que sobrevive al cierre: los montajes y las tablas de
+// particiones de los discos montados, en un archivo binario con suma de
+// verificación. El archivo se carga la primera vez que se pide el registro;
+// cada tabla guardada se usa mientras la generación del disco (inodo, tamaño
+// y fecha de modificación de sus archivos) no cambie y si no se relee.
+class EstadoSesion {
+ public:
+  explicit EstadoSesion(const QString& ruta) : ruta_(ruta) {}
+
+  // Registro de montajes, cargado del archivo en el primer uso
+  RegistroMontajes& montajes();
+  // Tabla de particiones del disco. Devuelve el motivo del fallo o una
+  // cadena vacía si se pudo obtener.
+  QString tabla(const QString& path, TablaParticiones& t);
+  // El archivo lo comparten todas las instancias. Antes de escribirlo, bajo
+  // un flock, se adopta lo que las otras montaron o desmontaron desde el
+  // último guardado de esta, así el registro queda igual al archivo.
+  //
+  // Monta la partición con un id libre en todas las instancias y guarda;
+  // devuelve el id o vacío si ya estaba montada.
+  QString montar(const QString& path, const QString& nombre);
+  // Escribe el archivo; se llama después de cada unmount
+  void guardar();
+
+  // ~/.estado_discos
+  static QString rutaPorDefecto();
+
+ private:
+  void cargar();
+  // Con el cerrojo y mutex_ tomados: aplica al registro los cambios de las
+  // otras instancias (leido: el archivo se pudo interpretar)
+  void mezclar(const ContenidoEstado& base, bool leido);
+  void escribir(const ContenidoEstado& base);
+
+  QString ruta_;
+  std::once_flag cargado_;
+  RegistroMontajes montajes_;
+  std::mutex mutex_;  // Protege tablas_, guardados_ y el archivo
+  std::unordered_map<QString, TablaParticiones> tablas_;
+  // Montajes (id, disco, partición) tal como esta instancia los dejó en el
+  // archivo la última vez
+  std::set<QString> guardados_;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+// ----------------- Estructuras en disco ------------------
+struct Partition {
+  char status;    // 0 = libre, 1 = usada
+  char type;      // P, E
+  char fit;       // B, F, W
+  int start;      // byte donde inicia
+  int size;       // tamaño en bytes
+  char name[16];  // nombre
+};
+
+struct MBR {
+  int size;  // tamaño total del disco
+  char fit;  // BF, FF, WF
+  Partition parts[4];
+};
+
+struct EBR {
+  char status;
+  char fit;
+  int start;
+  int size;
+  int next;  // siguiente EBR (posición física)
+  char name[16];
+};
@@ -0,0 +1,86 @@
+#include "hash64.h"
+
+#include <cstring>
+
+namespace {
+
+const uint64_t P1 = 11400714785074694791ULL;
+const uint64_t P2 = 14029467366897019727ULL;
+const uint64_t P3 = 1609587929392839161ULL;
+const uint64_t P4 = 9650029242287828579ULL;
+const uint64_t P5 = 2870177450012600261ULL;
+
+inline uint64_t rotar(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t leer64(const char* p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+inline uint32_t leer32(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+inline uint64_t ronda(uint64_t acc, uint64_t dato) {
+  acc += dato * P2;
+  acc = rotar(acc, 31);
+  return acc * P1;
+}
+
+inline uint64_t mezclar(uint64_t acc, uint64_t v) {
+  acc ^= ronda(0, v);
+  return acc * P1 + P4;
+}
+
+}  // namespace
+
+uint64_t hash64(const char* datos, size_t n, uint64_t semilla) {
+  const char* p = datos;
+  const char* fin = datos + n;
+  uint64_t h;
+  if (n >= 32) {
+    // Cuatro acumuladores independientes sobre bloques de 32 bytes
+    uint64_t v1 = semilla + P1 + P2;
+    uint64_t v2 = semilla + P2;
+    uint64_t v3 = semilla;
+    uint64_t v4 = semilla - P1;
+    const char* limite = fin - 32;
+    do {
+      v1 = ronda(v1, leer64(p));
+      v2 = ronda(v2, leer64(p + 8));
+      v3 = ronda(v3, leer64(p + 16));
+      v4 = ronda(v4, leer64(p + 24));
+      p += 32;
+    } while (p <= limite);
+    h = rotar(v1, 1) + rotar(v2, 7) + rotar(v3, 12) + rotar(v4, 18);
+    h = mezclar(h, v1);
+    h = mezclar(h, v2);
+    h = mezclar(h, v3);
+    h = mezclar(h, v4);
+  } else {
+    h = semilla + P5;
+  }
+  h += static_cast<uint64_t>(n);
+  for (; p + 8 <= fin; p += 8) {
+    h ^= ronda(0, leer64(p));
+    h = rotar(h, 27) * P1 + P4;
+  }
+  if (p + 4 <= fin) {
+    h ^= static_cast<uint64_t>(leer32(p)) * P1;
+    h = rotar(h, 23) * P2 + P3;
+    p += 4;
+  }
+  for (; p < fin; ++p) {
+    h ^= static_cast<uint64_t>(static_cast<unsigned char>(*p)) * P5;
+    h = rotar(h, 11) * P1;
+  }
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  h ^= h >> 32;
+  return h;
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Hash no criptográfico de 64 bits (algoritmo XXH64). Sirve para detectar
+// corrupción y para identificar bloques por contenido, no como firma segura.
+uint64_t hash64(const char* datos, size_t n, uint64_t semilla = 0);
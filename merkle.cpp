@@ -0,0 +1,197 @@
+#include "merkle.h"
+
+#include <QDir>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+#include "hash64.h"
+#include "paralelo.h"
+
+namespace {
+
+const long TAM_BLOQUE = 64L * 1024;
+const long BLOQUES_POR_LOTE = 256;  // 16 MiB por lectura
+const char MAGIC_MERKLE[8] = {'P', '2', 'M', 'E', 'R', 'K', 'L', 'E'};
+
+struct CabeceraMerkle {
+  char magic[8];
+  int version;
+  int niveles;
+  long long inicio;
+  long long tam;
+  long long bloque;
+  unsigned long long generacion;
+};
+
+QString dirArboles(const QString& path) {
+  return path + ".merkle";
+}
+
+QString rutaArbol(
+  const QString& path, const QString& vista, long inicio, long tam) {
+  return dirArboles(path) +
+         QString("/%1_%2_%3").arg(vista).arg(inicio).arg(tam);
+}
+
+// Arma los niveles superiores a partir de las hojas
+void construirNiveles(ArbolMerkle& arbol) {
+  if (arbol.niveles[0].empty()) arbol.niveles[0].push_back(hash64("", 0));
+  while (arbol.niveles.back().size() > 1) {
+    const auto& abajo = arbol.niveles.back();
+    std::vector<uint64_t> arriba((abajo.size() + 1) / 2);
+    for (size_t i = 0; i < arriba.size(); ++i) {
+      size_t hijos = std::min<size_t>(2, abajo.size() - 2 * i);
+      arriba[i] = hash64(reinterpret_cast<const char*>(&abajo[2 * i]),
+        hijos * sizeof(uint64_t));
+    }
+    arbol.niveles.push_back(std::move(arriba));
+  }
+}
+
+bool leerArbol(const QString& ruta, unsigned long long generacion,
+  ArbolMerkle& arbol) {
+  std::ifstream f(ruta.toStdString(), std::ios::binary);
+  CabeceraMerkle cab;
+  if (!f.read(reinterpret_cast<char*>(&cab), sizeof(cab)) ||
+      memcmp(cab.magic, MAGIC_MERKLE, sizeof(MAGIC_MERKLE)) != 0 ||
+      cab.generacion != generacion || cab.bloque != TAM_BLOQUE ||
+      cab.inicio != arbol.inicio || cab.tam != arbol.tam)
+    return false;
+  long hojas = (arbol.tam + TAM_BLOQUE - 1) / TAM_BLOQUE;
+  std::vector<uint64_t> nivel0(static_cast<size_t>(std::max(1L, hojas)));
+  if (!f.read(reinterpret_cast<char*>(nivel0.data()),
+        static_cast<std::streamsize>(nivel0.size() * sizeof(uint64_t))))
+    return false;
+  // Solo se guardan las hojas; los niveles superiores son baratos de rehacer
+  arbol.bloque = TAM_BLOQUE;
+  arbol.niveles.assign(1, std::move(nivel0));
+  construirNiveles(arbol);
+  return true;
+}
+
+void guardarArbol(const QString& ruta, unsigned long long generacion,
+  const ArbolMerkle& arbol) {
+  CabeceraMerkle cab;
+  memset(&cab, 0, sizeof(cab));
+  memcpy(cab.magic, MAGIC_MERKLE, sizeof(MAGIC_MERKLE));
+  cab.version = 1;
+  cab.niveles = static_cast<int>(arbol.niveles.size());
+  cab.inicio = arbol.inicio;
+  cab.tam = arbol.tam;
+  cab.bloque = arbol.bloque;
+  cab.generacion = generacion;
+  QString tmp = ruta + ".tmp";
+  {
+    std::ofstream f(tmp.toStdString(), std::ios::binary | std::ios::trunc);
+    const auto& hojas = arbol.niveles[0];
+    f.write(reinterpret_cast<const char*>(&cab), sizeof(cab));
+    f.write(reinterpret_cast<const char*>(hojas.data()),
+      static_cast<std::streamsize>(hojas.size() * sizeof(uint64_t)));
+    if (!f.good()) {
+      unlink(tmp.toStdString().c_str());
+      return;
+    }
+  }
+  // Si no se puede guardar, solo se pierde la caché
+  if (rename(tmp.toStdString().c_str(), ruta.toStdString().c_str()) != 0)
+    unlink(tmp.toStdString().c_str());
+}
+
+}  // namespace
+
+bool calcularArbol(Dispositivo& disco, long inicio, long tam, unsigned hilos,
+  ArbolMerkle& arbol) {
+  arbol.inicio = inicio;
+  arbol.tam = tam;
+  arbol.bloque = TAM_BLOQUE;
+  long hojas = (tam + TAM_BLOQUE - 1) / TAM_BLOQUE;
+  arbol.niveles.assign(1, std::vector<uint64_t>(static_cast<size_t>(hojas)));
+  std::vector<char> lote(static_cast<size_t>(BLOQUES_POR_LOTE * TAM_BLOQUE));
+  for (long h0 = 0; h0 < hojas; h0 += BLOQUES_POR_LOTE) {
+    long pos = h0 * TAM_BLOQUE;
+    long n = std::min(BLOQUES_POR_LOTE * TAM_BLOQUE, tam - pos);
+    // Una lectura grande por lote; los hashes se reparten entre hilos
+    if (!disco.leer(inicio + pos, lote.data(), n)) return false;
+    long bloques = (n + TAM_BLOQUE - 1) / TAM_BLOQUE;
+    ejecutarEnParalelo(static_cast<size_t>(bloques), hilos, [&](size_t i) {
+      long off = static_cast<long>(i) * TAM_BLOQUE;
+      long len = std::min(TAM_BLOQUE, n - off);
+      arbol.niveles[0][h0 + i] =
+        hash64(lote.data() + off, static_cast<size_t>(len));
+    });
+  }
+  construirNiveles(arbol);
+  return true;
+}
+
+QString arbolDeParticion(const QString& path, const QString& vista,
+  Dispositivo& disco, long inicio, long tam, unsigned hilos,
+  ArbolMerkle& arbol, bool& enCache) {
+  unsigned long long generacion = generacionDisco(path);
+  QString ruta = rutaArbol(path, vista, inicio, tam);
+  arbol.inicio = inicio;
+  arbol.tam = tam;
+  enCache = leerArbol(ruta, generacion, arbol);
+  if (enCache) return QString();
+  if (!calcularArbol(disco, inicio, tam, hilos, arbol))
+    return "Error al leer la partición.";
+  if (QDir().mkpath(dirArboles(path))) guardarArbol(ruta, generacion, arbol);
+  return QString();
+}
+
+std::vector<Extension> compararArboles(
+  const ArbolMerkle& a, const ArbolMerkle& b) {
+  std::vector<long> hojas;  // hojas distintas, en orden
+  long comunes = std::min(a.hojas(), b.hojas());
+  if (a.hojas() == b.hojas() && a.tam == b.tam) {
+    // Misma forma: se baja desde la raíz solo por los nodos distintos
+    std::vector<std::pair<size_t, size_t>> pendientes;  // (nivel, índice)
+    pendientes.push_back({a.niveles.size() - 1, 0});
+    while (!pendientes.empty()) {
+      auto [nivel, i] = pendientes.back();
+      pendientes.pop_back();
+      if (a.niveles[nivel][i] == b.niveles[nivel][i]) continue;
+      if (nivel == 0) {
+        hojas.push_back(static_cast<long>(i));
+        continue;
+      }
+      // El hijo derecho se apila primero para salir en orden
+      size_t abajo = a.niveles[nivel - 1].size();
+      if (2 * i + 1 < abajo) pendientes.push_back({nivel - 1, 2 * i + 1});
+      pendientes.push_back({nivel - 1, 2 * i});
+    }
+  } else {
+    // Formas distintas: se comparan las hojas comunes una por una
+    for (long i = 0; i < comunes; ++i)
+      if (a.niveles[0][i] != b.niveles[0][i]) hojas.push_back(i);
+  }
+
+  std::vector<Extension> rangos;
+  long bloque = a.bloque ? a.bloque : b.bloque;
+  long tamComun = std::min(a.tam, b.tam);
+  for (long h : hojas) {
+    long ini = h * bloque;
+    long len = std::min(bloque, tamComun - ini);
+    if (len <= 0) continue;
+    if (!rangos.empty() && rangos.back().inicio + rangos.back().tam == ini)
+      rangos.back().tam += len;
+    else
+      rangos.push_back({ini, len});
+  }
+  long tamMayor = std::max(a.tam, b.tam);
+  if (tamMayor > tamComun) {
+    if (!rangos.empty() &&
+        rangos.back().inicio + rangos.back().tam == tamComun)
+      rangos.back().tam += tamMayor - tamComun;
+    else
+      rangos.push_back({tamComun, tamMayor - tamComun});
+  }
+  return rangos;
+}
+
+void descartarArboles(const QString& path) {
+  QDir(dirArboles(path)).removeRecursively();
+}
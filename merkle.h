@@ -0,0 +1,38 @@
+#pragma once
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+#include "discoio.h"
+#include "dispositivo.h"
+
+// Árbol de Merkle sobre un rango del disco (una partición), en bloques fijos
+// de 64 KiB. Cada hoja es el hash64 de un bloque y cada nodo el de sus dos
+// hijos. Dos rangos son iguales si sus raíces coinciden, y las diferencias
+// se ubican bajando solo por los nodos distintos.
+struct ArbolMerkle {
+  long inicio = 0;  // byte del disco donde empieza el rango
+  long tam = 0;
+  long bloque = 0;
+  // niveles[0] son las hojas; el último nivel tiene solo la raíz
+  std::vector<std::vector<uint64_t>> niveles;
+
+  uint64_t raiz() const { return niveles.empty() ? 0 : niveles.back()[0]; }
+  long hojas() const { return niveles.empty() ? 0 : niveles[0].size(); }
+};
+
+// Lee el rango por lotes y calcula los hashes de las hojas en paralelo
+bool calcularArbol(Dispositivo& disco, long inicio, long tam, unsigned hilos,
+  ArbolMerkle& arbol);
+// Igual que calcularArbol, pero reutiliza el árbol guardado junto al disco
+// ("<path>.merkle/") si se calculó con la misma generación del disco.
+// vista distingue árboles del mismo rango leídos de réplicas distintas.
+QString arbolDeParticion(const QString& path, const QString& vista,
+  Dispositivo& disco, long inicio, long tam, unsigned hilos,
+  ArbolMerkle& arbol, bool& enCache);
+// Rangos distintos entre dos árboles, relativos al inicio de cada rango. Si
+// los tamaños difieren, lo que sobra del mayor cuenta como distinto.
+std::vector<Extension> compararArboles(
+  const ArbolMerkle& a, const ArbolMerkle& b);
+// Borra los árboles guardados del disco
+void descartarArboles(const QString& path);
@@ -0,0 +1,185 @@
+#include "montajes.h"
+
+#include <iterator>
+#include <mutex>
+
+namespace {
+
+const int MAX_LETRAS = 6;  // Hasta ~320 millones de discos
+
+}  // namespace
+
+QString RegistroMontajes::letrasDe(int indice) {
+  // Numeración biyectiva en base 26: a..z, aa..az, ba..
+  QString letras;
+  for (long n = static_cast<long>(indice) + 1; n > 0; n = (n - 1) / 26)
+    letras.prepend(QChar('a' + static_cast<int>((n - 1) % 26)));
+  return letras;
+}
+
+int RegistroMontajes::indiceDe(const QString& letras) {
+  long n = 0;
+  for (QChar c : letras) n = n * 26 + (c.toLatin1() - 'a' + 1);
+  return static_cast<int>(n - 1);
+}
+
+QString RegistroMontajes::armarId(int letra, int numero) {
+  return "vd" + letrasDe(letra) + QString::number(numero);
+}
+
+bool RegistroMontajes::separarId(
+  const QString& id, QString& letras, int& numero) {
+  if (!id.startsWith("vd")) return false;
+  int i = 2;
+  while (i < id.length() && id[i].unicode() >= 'a' && id[i].unicode() <= 'z')
+    ++i;
+  letras = id.mid(2, i - 2);
+  if (letras.isEmpty() || letras.length() > MAX_LETRAS) return false;
+  QString digitos = id.mid(i);
+  bool ok = !digitos.isEmpty();
+  for (QChar c : digitos)
+    if (!c.isDigit()) ok = false;
+  numero = ok ? digitos.toInt(&ok) : 0;
+  return ok && numero > 0;
+}
+
+int RegistroMontajes::tomar(std::set<int>& libres, int& siguiente) {
+  if (libres.empty()) return siguiente++;
+  int valor = *libres.begin();
+  libres.erase(libres.begin());
+  return valor;
+}
+
+bool RegistroMontajes::reservar(
+  std::set<int>& libres, int& siguiente, int valor) {
+  if (valor < siguiente) return libres.erase(valor) > 0;
+  for (int v = siguiente; v < valor; ++v) libres.insert(v);
+  siguiente = valor + 1;
+  return true;
+}
+
+void RegistroMontajes::devolver(
+  std::set<int>& libres, int& siguiente, int valor) {
+  libres.insert(valor);
+  // Los libres al final se descartan: el conjunto no crece sin límite
+  while (!libres.empty() && *libres.rbegin() == siguiente - 1) {
+    libres.erase(std::prev(libres.end()));
+    --siguiente;
+  }
+}
+
+QString RegistroMontajes::montar(const QString& path, const QString& nombre) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  auto it = porPath_.find(path);
+  if (it == porPath_.end()) {
+    Disco d;
+    d.letra = tomar(letrasLibres_, siguienteLetra_);
+    pathPorLetra_[d.letra] = path;
+    it = porPath_.emplace(path, std::move(d)).first;
+  }
+  Disco& d = it->second;
+  if (d.porNombre.count(nombre)) return QString();
+  int numero = tomar(d.numerosLibres, d.siguiente);
+  d.parts[numero] = nombre;
+  d.porNombre[nombre] = numero;
+  QString id = armarId(d.letra, numero);
+  porId_[id] = {id, path, nombre};
+  return id;
+}
+
+bool RegistroMontajes::restaurar(const ParticionMontada& p) {
+  QString letras;
+  int numero = 0;
+  if (!separarId(p.id, letras, numero)) return false;
+  int letra = indiceDe(letras);
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (porId_.count(p.id)) return false;
+  auto it = porPath_.find(p.path);
+  if (it == porPath_.end()) {
+    if (!reservar(letrasLibres_, siguienteLetra_, letra)) return false;
+    Disco d;
+    d.letra = letra;
+    pathPorLetra_[letra] = p.path;
+    it = porPath_.emplace(p.path, std::move(d)).first;
+  }
+  Disco& d = it->second;
+  if (d.letra != letra || d.porNombre.count(p.nombre) ||
+      !reservar(d.numerosLibres, d.siguiente, numero))
+    return false;
+  d.parts[numero] = p.nombre;
+  d.porNombre[p.nombre] = numero;
+  porId_[p.id] = p;
+  return true;
+}
+
+bool RegistroMontajes::desmontar(const QString& id) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  auto it = porId_.find(id);
+  if (it == porId_.end()) return false;
+  QString letras;
+  int numero = 0;
+  separarId(id, letras, numero);
+  Disco& d = porPath_[it->second.path];
+  d.parts.erase(numero);
+  d.porNombre.erase(it->second.nombre);
+  devolver(d.numerosLibres, d.siguiente, numero);
+  if (d.parts.empty()) {
+    // Sin particiones montadas el disco libera su letra
+    pathPorLetra_.erase(d.letra);
+    devolver(letrasLibres_, siguienteLetra_, d.letra);
+    porPath_.erase(it->second.path);
+  }
+  porId_.erase(it);
+  return true;
+}
+
+void RegistroMontajes::vaciar() {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  porId_.clear();
+  porPath_.clear();
+  pathPorLetra_.clear();
+  letrasLibres_.clear();
+  siguienteLetra_ = 0;
+}
+
+bool RegistroMontajes::buscar(const QString& id, ParticionMontada& p) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto it = porId_.find(id);
+  if (it == porId_.end()) return false;
+  p = it->second;
+  return true;
+}
+
+std::vector<ParticionMontada> RegistroMontajes::particionesDe(
+  const QString& path) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  std::vector<ParticionMontada> res;
+  auto it = porPath_.find(path);
+  if (it == porPath_.end()) return res;
+  const Disco& d = it->second;
+  for (const auto& par : d.parts)
+    res.push_back({armarId(d.letra, par.first), path, par.second});
+  return res;
+}
+
+std::vector<ParticionMontada> RegistroMontajes::todas() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  // Por letra de disco y número de partición
+  std::map<int, QString> discos;
+  for (const auto& par : pathPorLetra_) discos[par.first] = par.second;
+  std::vector<ParticionMontada> res;
+  for (const auto& disco : discos) {
+    const Disco& d = porPath_.at(disco.second);
+    for (const auto& par : d.parts)
+      res.push_back({armarId(d.letra, par.first), disco.second, par.second});
+  }
+  return res;
+}
+
+bool RegistroMontajes::hayDisco(const QString& letras) const {
+  if (letras.isEmpty() || letras.length() > MAX_LETRAS) return false;
+  for (QChar c : letras)
+    if (c.unicode() < 'a' || c.unicode() > 'z') return false;
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return pathPorLetra_.count(indiceDe(letras)) > 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <QString>
+#include <map>
+#include <set>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+// Partición montada: id "vd" + letras del disco + número, p. ej. vda1. Los
+// primeros 26 discos usan una letra (a..z); después siguen aa, ab, ...
+struct ParticionMontada {
+  QString id;
+  QString path;    // Disco
+  QString nombre;  // Partición dentro del disco
+};
+
+// Registro de montajes con búsqueda por id y por disco en tablas hash. Las
+// letras de disco y los números de partición liberados se reutilizan, de
+// menor a mayor, como hacía el montaje original. Se puede consultar desde
+// varios hilos: las lecturas no se bloquean entre sí.
+class RegistroMontajes {
+ public:
+  // Monta la partición y devuelve su id; vacío si ya estaba montada
+  QString montar(const QString& path, const QString& nombre);
+  // Quita el montaje; false si el id no está montado
+  bool desmontar(const QString& id);
+  // Vuelve a montar con un id ya asignado (al restaurar el estado); false si
+  // el id, la letra o la partición ya están en uso
+  bool restaurar(const ParticionMontada& p);
+  void vaciar();
+
+  bool buscar(const QString& id, ParticionMontada& p) const;
+  // Particiones del disco ordenadas por número
+  std::vector<ParticionMontada> particionesDe(const QString& path) const;
+  std::vector<ParticionMontada> todas() const;
+  // Hay un disco montado con estas letras
+  bool hayDisco(const QString& letras) const;
+
+  // Separa un id en letras y número; false si no tiene la forma vd<a-z+><n>
+  static bool separarId(const QString& id, QString& letras, int& numero);
+
+ private:
+  struct Disco {
+    int letra = 0;                   // Índice de las letras (0 = a)
+    std::map<int, QString> parts;    // Número -> nombre de la partición
+    std::unordered_map<QString, int> porNombre;
+    std::set<int> numerosLibres;     // Liberados por debajo de siguiente
+    int siguiente = 1;
+  };
+
+  static QString letrasDe(int indice);
+  static int indiceDe(const QString& letras);
+  static QString armarId(int letra, int numero);
+  // Toma el menor valor libre (reutilizado o nuevo) y lo devuelve
+  static int tomar(std::set<int>& libres, int& siguiente);
+  // Toma un valor concreto; false si ya está en uso
+  static bool reservar(std::set<int>& libres, int& siguiente, int valor);
+  static void devolver(std::set<int>& libres, int& siguiente, int valor);
+
+  mutable std::shared_mutex mutex_;
+  std::unordered_map<QString, ParticionMontada> porId_;
+  std::unordered_map<QString, Disco> porPath_;
+  std::unordered_map<int, QString> pathPorLetra_;
+  std::set<int> letrasLibres_;
+  int siguienteLetra_ = 0;
+};
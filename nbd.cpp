@@ -0,0 +1,618 @@
+#include "nbd.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "discoio.h"
+
+namespace {
+
+const uint64_t MAGIA_NBD = 0x4e42444d41474943ULL;     // "NBDMAGIC"
+const uint64_t MAGIA_OPCION = 0x49484156454f5054ULL;  // "IHAVEOPT"
+const uint64_t MAGIA_RESPUESTA_OPCION = 0x0003e889045565a9ULL;
+const uint32_t MAGIA_PEDIDO = 0x25609513;
+const uint32_t MAGIA_RESPUESTA = 0x67446698;
+
+// Saludo
+const uint16_t FLAG_FIXED_NEWSTYLE = 1 << 0;
+const uint16_t FLAG_NO_ZEROES = 1 << 1;
+// Transmisión
+const uint16_t FLAG_HAS_FLAGS = 1 << 0;
+const uint16_t FLAG_SEND_FLUSH = 1 << 2;
+const uint16_t FLAG_SEND_FUA = 1 << 3;
+const uint16_t FLAG_SEND_TRIM = 1 << 5;
+const uint16_t FLAG_SEND_WRITE_ZEROES = 1 << 6;
+const uint16_t FLAG_CAN_MULTI_CONN = 1 << 8;
+
+const uint32_t OPT_EXPORT_NAME = 1;
+const uint32_t OPT_ABORT = 2;
+const uint32_t OPT_LIST = 3;
+const uint32_t OPT_INFO = 6;
+const uint32_t OPT_GO = 7;
+const uint32_t REP_ACK = 1;
+const uint32_t REP_SERVER = 2;
+const uint32_t REP_INFO = 3;
+const uint32_t REP_ERR_UNSUP = 0x80000001;
+const uint32_t REP_ERR_INVALID = 0x80000003;
+const uint32_t REP_ERR_UNKNOWN = 0x80000006;
+const uint16_t INFO_EXPORT = 0;
+
+const uint16_t CMD_READ = 0;
+const uint16_t CMD_WRITE = 1;
+const uint16_t CMD_DISC = 2;
+const uint16_t CMD_FLUSH = 3;
+const uint16_t CMD_TRIM = 4;
+const uint16_t CMD_WRITE_ZEROES = 6;
+const uint16_t CMD_FLAG_FUA = 1 << 0;
+const uint16_t CMD_FLAG_NO_HOLE = 1 << 1;
+
+// Códigos de error de la respuesta (valores de errno de Linux)
+const unsigned NBD_EIO = 5;
+const unsigned NBD_EINVAL = 22;
+const unsigned NBD_ENOSPC = 28;
+const unsigned NBD_ENOTSUP = 95;
+
+const uint32_t MAX_PEDIDO = 32 * 1024 * 1024;
+const uint32_t MAX_OPCION = 64 * 1024;
+const long TAM_TROZO = 1024 * 1024;
+
+uint16_t flagsTransmision() {
+  return FLAG_HAS_FLAGS | FLAG_SEND_FLUSH | FLAG_SEND_FUA | FLAG_SEND_TRIM |
+         FLAG_SEND_WRITE_ZEROES | FLAG_CAN_MULTI_CONN;
+}
+
+void poner16(char* p, uint16_t v) {
+  v = htobe16(v);
+  memcpy(p, &v, 2);
+}
+void poner32(char* p, uint32_t v) {
+  v = htobe32(v);
+  memcpy(p, &v, 4);
+}
+void poner64(char* p, uint64_t v) {
+  v = htobe64(v);
+  memcpy(p, &v, 8);
+}
+uint16_t tomar16(const char* p) {
+  uint16_t v;
+  memcpy(&v, p, 2);
+  return be16toh(v);
+}
+uint32_t tomar32(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return be32toh(v);
+}
+uint64_t tomar64(const char* p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return be64toh(v);
+}
+
+bool recibir(int fd, char* buf, long n) {
+  while (n > 0) {
+    ssize_t r = recv(fd, buf, static_cast<size_t>(n), 0);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    buf += r;
+    n -= r;
+  }
+  return true;
+}
+
+bool enviar(int fd, const char* buf, long n, bool mas = false) {
+  int flags = MSG_NOSIGNAL | (mas ? MSG_MORE : 0);
+  while (n > 0) {
+    ssize_t r = send(fd, buf, static_cast<size_t>(n), flags);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    buf += r;
+    n -= r;
+  }
+  return true;
+}
+
+bool responderOpcion(
+  int fd, uint32_t opcion, uint32_t tipo, const char* datos, uint32_t n) {
+  char cab[20];
+  poner64(cab, MAGIA_RESPUESTA_OPCION);
+  poner32(cab + 8, opcion);
+  poner32(cab + 12, tipo);
+  poner32(cab + 16, n);
+  return enviar(fd, cab, sizeof(cab), n > 0) &&
+         (n == 0 || enviar(fd, datos, n));
+}
+
+// Tubería por hilo para splice (archivo -> tubería -> socket)
+struct Tuberia {
+  int fd[2] = {-1, -1};
+  Tuberia() { abrir(); }
+  ~Tuberia() { cerrar(); }
+  Tuberia(const Tuberia&) = delete;
+  Tuberia& operator=(const Tuberia&) = delete;
+  void abrir() {
+    if (pipe2(fd, O_CLOEXEC) != 0) fd[0] = fd[1] = -1;
+  }
+  void cerrar() {
+    if (fd[0] >= 0) close(fd[0]);
+    if (fd[1] >= 0) close(fd[1]);
+    fd[0] = fd[1] = -1;
+  }
+  bool valida() const { return fd[0] >= 0; }
+};
+
+// Mueve n bytes de fdArchivo (desde pos) al socket sin copiarlos a memoria
+// del proceso. Si falla a mitad, la tubería puede quedar con datos y se
+// descarta.
+bool enviarConSplice(int fdArchivo, long pos, long n, int sock) {
+  thread_local Tuberia t;
+  if (!t.valida()) t.abrir();
+  if (!t.valida()) return false;
+  loff_t off = pos;
+  while (n > 0) {
+    ssize_t entra = splice(fdArchivo, &off, t.fd[1], nullptr,
+      static_cast<size_t>(std::min(n, TAM_TROZO)), SPLICE_F_MOVE);
+    if (entra < 0 && errno == EINTR) continue;
+    if (entra <= 0) {
+      t.cerrar();
+      return false;
+    }
+    for (ssize_t resta = entra; resta > 0;) {
+      ssize_t sale = splice(t.fd[0], nullptr, sock, nullptr,
+        static_cast<size_t>(resta), SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (sale < 0 && errno == EINTR) continue;
+      if (sale <= 0) {
+        t.cerrar();
+        return false;
+      }
+      resta -= sale;
+    }
+    n -= entra;
+  }
+  return true;
+}
+
+// splice desde el archivo funciona en este sistema de archivos
+bool probarSplice(int fd) {
+  Tuberia t;
+  if (!t.valida()) return false;
+  loff_t off = 0;
+  return splice(fd, &off, t.fd[1], nullptr, 1, SPLICE_F_NONBLOCK) == 1;
+}
+
+// Deja [pos, pos + n) en ceros; con hueco = true perfora el rango en lugar
+// de escribirlo
+bool ceros(int fd, long pos, long n, bool hueco) {
+  if (hueco &&
+      fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pos, n) == 0)
+    return true;
+  std::vector<char> buf(static_cast<size_t>(std::min(n, TAM_TROZO)), 0);
+  for (long hecho = 0; hecho < n;) {
+    long len = std::min(n - hecho, TAM_TROZO);
+    if (!escribirCompleto(fd, pos + hecho, buf.data(), len)) return false;
+    hecho += len;
+  }
+  return true;
+}
+
+}  // namespace
+
+struct ServidorNbd::Conexion {
+  int fd;
+  std::mutex envio;  // Una respuesta completa a la vez
+  std::mutex mutex;
+  std::condition_variable libre;
+  int pendientes = 0;
+};
+
+struct ServidorNbd::Pedido {
+  uint16_t flags = 0;
+  uint16_t tipo = 0;
+  char handle[8];
+  uint64_t off = 0;
+  uint32_t len = 0;
+  std::vector<char> datos;  // Solo en WRITE
+};
+
+std::unique_ptr<ServidorNbd> ServidorNbd::iniciar(const QString& nombre,
+  const QString& path, long inicio, long tam, const QString& rutaSocket,
+  std::unique_ptr<BloqueoDisco> bloqueo, QString& error) {
+  std::unique_ptr<ServidorNbd> s(new ServidorNbd());
+  s->bloqueo_ = std::move(bloqueo);
+  s->nombre_ = nombre;
+  s->path_ = path;
+  s->inicio_ = inicio;
+  s->tam_ = tam;
+  s->rutaSocket_ = rutaSocket;
+
+  QString raid = rutaRaid(path);
+  s->plano_ = replicasPlanas(path);
+  if (s->plano_) {
+    s->fdPrincipal_ = open(path.toStdString().c_str(), O_RDWR | O_CLOEXEC);
+    if (s->fdPrincipal_ < 0) {
+      error = "No se pudo abrir " + path + ".";
+      return nullptr;
+    }
+    s->fdEspejo_ = open(raid.toStdString().c_str(), O_RDWR | O_CLOEXEC);
+    s->falloEspejo_ = s->fdEspejo_ < 0;
+    s->splice_ = probarSplice(s->fdPrincipal_);
+  } else {
+    QString aviso;
+    s->disco_ = abrirDiscoEscritura(path, aviso);
+    if (!s->disco_) {
+      error = "No se pudo abrir el disco " + path + ".";
+      return nullptr;
+    }
+  }
+
+  sockaddr_un dir;
+  memset(&dir, 0, sizeof(dir));
+  dir.sun_family = AF_UNIX;
+  std::string ruta = rutaSocket.toStdString();
+  if (ruta.size() >= sizeof(dir.sun_path)) {
+    error = "La ruta del socket es demasiado larga.";
+    return nullptr;
+  }
+  memcpy(dir.sun_path, ruta.c_str(), ruta.size());
+  // Un socket viejo de una sesión anterior impide el bind
+  struct stat st;
+  if (stat(ruta.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(ruta.c_str());
+  s->fdEscucha_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (s->fdEscucha_ < 0 ||
+      bind(s->fdEscucha_, reinterpret_cast<sockaddr*>(&dir), sizeof(dir)) !=
+        0 ||
+      listen(s->fdEscucha_, 16) != 0) {
+    error = "No se pudo escuchar en " + rutaSocket + ": " +
+            QString(strerror(errno)) + ".";
+    if (s->fdEscucha_ >= 0) close(s->fdEscucha_);
+    s->fdEscucha_ = -1;  // Que el destructor no borre una ruta ajena
+    return nullptr;
+  }
+  // Un cliente que se va a mitad de una respuesta no debe matar al programa
+  signal(SIGPIPE, SIG_IGN);
+  s->pool_.reset(new PoolDeHilos(hilosDeTrabajo()));
+  s->aceptador_ = std::thread([p = s.get()]() { p->aceptar(); });
+  return s;
+}
+
+ServidorNbd::~ServidorNbd() {
+  parar_ = true;
+  if (fdEscucha_ >= 0) shutdown(fdEscucha_, SHUT_RDWR);
+  if (aceptador_.joinable()) aceptador_.join();
+  {
+    std::lock_guard<std::mutex> lock(mutexConexiones_);
+    for (int fd : conexiones_) shutdown(fd, SHUT_RDWR);
+  }
+  for (auto& t : lectores_) t.join();
+  pool_.reset();
+  if (fdEscucha_ >= 0) {
+    close(fdEscucha_);
+    unlink(rutaSocket_.toStdString().c_str());
+  }
+  if (plano_ ? fdPrincipal_ >= 0 : disco_ != nullptr) vaciar();
+  if (fdPrincipal_ >= 0) close(fdPrincipal_);
+  if (fdEspejo_ >= 0) close(fdEspejo_);
+  disco_.reset();
+}
+
+bool ServidorNbd::degradado() const {
+  return plano_ ? falloEspejo_.load() : disco_->degradado();
+}
+
+EstadisticasNbd ServidorNbd::estadisticas() const {
+  EstadisticasNbd e;
+  e.conexiones = conexionesTotales_;
+  e.lecturas = lecturas_;
+  e.escrituras = escrituras_;
+  e.recortes = recortes_;
+  e.bytesLeidos = bytesLeidos_;
+  e.bytesEscritos = bytesEscritos_;
+  return e;
+}
+
+void ServidorNbd::aceptar() {
+  while (!parar_) {
+    int fd = accept4(fdEscucha_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      break;  // El socket de escucha se cerró
+    }
+    // Los hilos de conexiones cerradas se unen fuera del mutex, que es lo
+    // último que toman antes de salir
+    std::vector<std::thread> listos;
+    {
+      std::lock_guard<std::mutex> lock(mutexConexiones_);
+      if (parar_) {
+        close(fd);
+        break;
+      }
+      for (std::thread::id id : terminados_)
+        for (auto it = lectores_.begin(); it != lectores_.end(); ++it)
+          if (it->get_id() == id) {
+            listos.push_back(std::move(*it));
+            lectores_.erase(it);
+            break;
+          }
+      terminados_.clear();
+      conexiones_.push_back(fd);
+      ++conexionesTotales_;
+      lectores_.emplace_back([this, fd]() { atender(fd); });
+    }
+    for (auto& t : listos) t.join();
+  }
+}
+
+bool ServidorNbd::negociar(int fd) {
+  char saludo[18];
+  poner64(saludo, MAGIA_NBD);
+  poner64(saludo + 8, MAGIA_OPCION);
+  poner16(saludo + 16, FLAG_FIXED_NEWSTYLE | FLAG_NO_ZEROES);
+  char flagsCliente[4];
+  if (!enviar(fd, saludo, sizeof(saludo)) ||
+      !recibir(fd, flagsCliente, sizeof(flagsCliente)))
+    return false;
+  bool sinCeros = tomar32(flagsCliente) & FLAG_NO_ZEROES;
+  std::string nombre = nombre_.toStdString();
+  // Vale el id de la partición o el nombre vacío (export por defecto)
+  auto nombreValido = [&](const std::string& n) {
+    return n.empty() || n == nombre;
+  };
+
+  for (;;) {
+    char cab[16];
+    if (!recibir(fd, cab, sizeof(cab)) || tomar64(cab) != MAGIA_OPCION)
+      return false;
+    uint32_t opcion = tomar32(cab + 8);
+    uint32_t len = tomar32(cab + 12);
+    if (len > MAX_OPCION) return false;
+    std::vector<char> datos(len);
+    if (len > 0 && !recibir(fd, datos.data(), len)) return false;
+
+    if (opcion == OPT_EXPORT_NAME) {
+      // Esta opción no admite respuesta de error: se corta la conexión
+      if (!nombreValido(std::string(datos.begin(), datos.end()))) return false;
+      char r[10 + 124] = {};
+      poner64(r, static_cast<uint64_t>(tam_));
+      poner16(r + 8, flagsTransmision());
+      return enviar(fd, r, sinCeros ? 10 : sizeof(r));
+    }
+    if (opcion == OPT_ABORT) {
+      responderOpcion(fd, opcion, REP_ACK, nullptr, 0);
+      return false;
+    }
+    if (opcion == OPT_LIST) {
+      std::vector<char> r(4 + nombre.size());
+      poner32(r.data(), static_cast<uint32_t>(nombre.size()));
+      memcpy(r.data() + 4, nombre.data(), nombre.size());
+      if (!responderOpcion(fd, opcion, REP_SERVER, r.data(),
+            static_cast<uint32_t>(r.size())) ||
+          !responderOpcion(fd, opcion, REP_ACK, nullptr, 0))
+        return false;
+      continue;
+    }
+    if (opcion == OPT_INFO || opcion == OPT_GO) {
+      uint32_t largo = len >= 4 ? tomar32(datos.data()) : 0;
+      if (len < 6 || 4 + static_cast<uint64_t>(largo) + 2 > len) {
+        if (!responderOpcion(fd, opcion, REP_ERR_INVALID, nullptr, 0))
+          return false;
+        continue;
+      }
+      if (!nombreValido(std::string(datos.data() + 4, largo))) {
+        if (!responderOpcion(fd, opcion, REP_ERR_UNKNOWN, nullptr, 0))
+          return false;
+        continue;
+      }
+      char info[12];
+      poner16(info, INFO_EXPORT);
+      poner64(info + 2, static_cast<uint64_t>(tam_));
+      poner16(info + 10, flagsTransmision());
+      if (!responderOpcion(fd, opcion, REP_INFO, info, sizeof(info)) ||
+          !responderOpcion(fd, opcion, REP_ACK, nullptr, 0))
+        return false;
+      if (opcion == OPT_GO) return true;
+      continue;
+    }
+    if (!responderOpcion(fd, opcion, REP_ERR_UNSUP, nullptr, 0)) return false;
+  }
+}
+
+void ServidorNbd::atender(int fd) {
+  auto c = std::make_shared<Conexion>();
+  c->fd = fd;
+  if (negociar(fd)) {
+    char cab[28];
+    while (!parar_ && recibir(fd, cab, sizeof(cab))) {
+      if (tomar32(cab) != MAGIA_PEDIDO) break;
+      auto p = std::make_shared<Pedido>();
+      p->flags = tomar16(cab + 4);
+      p->tipo = tomar16(cab + 6);
+      memcpy(p->handle, cab + 8, 8);
+      p->off = tomar64(cab + 16);
+      p->len = tomar32(cab + 24);
+      if (p->tipo == CMD_DISC) break;
+      if (p->tipo == CMD_WRITE) {
+        if (p->len > MAX_PEDIDO) break;
+        p->datos.resize(p->len);
+        if (!recibir(fd, p->datos.data(), p->len)) break;
+      }
+      {
+        std::lock_guard<std::mutex> lock(c->mutex);
+        ++c->pendientes;
+      }
+      pool_->encolar([this, c, p]() {
+        procesar(*c, *p);
+        std::lock_guard<std::mutex> lock(c->mutex);
+        if (--c->pendientes == 0) c->libre.notify_all();
+      });
+    }
+  }
+  // Las respuestas en curso usan el socket: se cierra cuando terminan
+  {
+    std::unique_lock<std::mutex> lock(c->mutex);
+    c->libre.wait(lock, [&]() { return c->pendientes == 0; });
+  }
+  std::lock_guard<std::mutex> lock(mutexConexiones_);
+  conexiones_.erase(
+    std::remove(conexiones_.begin(), conexiones_.end(), fd), conexiones_.end());
+  close(fd);
+  terminados_.push_back(std::this_thread::get_id());
+}
+
+void ServidorNbd::procesar(Conexion& c, const Pedido& p) {
+  bool dentro = p.off <= static_cast<uint64_t>(tam_) &&
+                p.len <= static_cast<uint64_t>(tam_) - p.off;
+  unsigned error = 0;
+  switch (p.tipo) {
+    case CMD_READ:
+      if (!dentro || p.len > MAX_PEDIDO) error = NBD_EINVAL;
+      else if (leer(c, p) == 0) return;  // Ya respondió con los datos
+      else error = NBD_EIO;
+      break;
+    case CMD_WRITE:
+      error = dentro ? escribir(p) : NBD_ENOSPC;
+      break;
+    case CMD_FLUSH:
+      error = vaciar();
+      break;
+    case CMD_TRIM:
+    case CMD_WRITE_ZEROES:
+      error = dentro ? ponerEnCeros(p, p.tipo == CMD_TRIM) : NBD_ENOSPC;
+      break;
+    default:
+      error = NBD_ENOTSUP;
+  }
+  responder(c, p, error, nullptr, 0);
+}
+
+bool ServidorNbd::responder(
+  Conexion& c, const Pedido& p, unsigned error, const char* datos, long n) {
+  char cab[16];
+  poner32(cab, MAGIA_RESPUESTA);
+  poner32(cab + 4, error);
+  memcpy(cab + 8, p.handle, 8);
+  std::lock_guard<std::mutex> lock(c.envio);
+  return enviar(c.fd, cab, sizeof(cab), n > 0) &&
+         (n == 0 || enviar(c.fd, datos, n));
+}
+
+unsigned ServidorNbd::leer(Conexion& c, const Pedido& p) {
+  long pos = inicio_ + static_cast<long>(p.off);
+  long n = p.len;
+  ++lecturas_;
+  bytesLeidos_ += n;
+  if (plano_ && splice_ && n > 0) {
+    // La cabecera sale antes que los datos: si splice falla a mitad, el
+    // cliente ya no puede resincronizar y se corta la conexión
+    char cab[16];
+    poner32(cab, MAGIA_RESPUESTA);
+    poner32(cab + 4, 0);
+    memcpy(cab + 8, p.handle, 8);
+    std::lock_guard<std::mutex> lock(c.envio);
+    if (!enviar(c.fd, cab, sizeof(cab), true) ||
+        !enviarConSplice(fdPrincipal_, pos, n, c.fd))
+      shutdown(c.fd, SHUT_RDWR);
+    return 0;
+  }
+  std::vector<char> buf(static_cast<size_t>(n));
+  bool ok;
+  if (plano_) {
+    ok = leerCompleto(fdPrincipal_, pos, buf.data(), n);
+  } else {
+    std::shared_lock<std::shared_mutex> lock(mutexDisco_);
+    ok = disco_->leer(pos, buf.data(), n);
+  }
+  if (!ok) return NBD_EIO;
+  responder(c, p, 0, buf.data(), n);
+  return 0;
+}
+
+unsigned ServidorNbd::escribir(const Pedido& p) {
+  long pos = inicio_ + static_cast<long>(p.off);
+  long n = p.len;
+  ++escrituras_;
+  bytesEscritos_ += n;
+  if (!plano_) {
+    std::unique_lock<std::shared_mutex> lock(mutexDisco_);
+    if (!disco_->escribir(pos, p.datos.data(), n)) return NBD_EIO;
+    if ((p.flags & CMD_FLAG_FUA) && !disco_->sincronizar()) return NBD_EIO;
+    return 0;
+  }
+  {
+    // Ambas réplicas; si el espejo falla el disco sigue, degradado. Las
+    // escrituras van de a una: dos pedidos que se solapan deben quedar en
+    // el mismo orden en las dos réplicas
+    std::unique_lock<std::shared_mutex> lock(mutexDisco_);
+    if (!escribirCompleto(fdPrincipal_, pos, p.datos.data(), n))
+      return NBD_EIO;
+    if (fdEspejo_ >= 0 &&
+        !escribirCompleto(fdEspejo_, pos, p.datos.data(), n))
+      falloEspejo_ = true;
+    // Un bloque sucio del rango pisaría lo escrito al bajarse: no debería
+    // haberlo (la partición está bloqueada), pero si lo hay se informa
+    if (!CacheBloques::global().invalidar(path_, pos, pos + n))
+      return NBD_EIO;
+  }
+  if (p.flags & CMD_FLAG_FUA) return vaciar();
+  return 0;
+}
+
+unsigned ServidorNbd::ponerEnCeros(const Pedido& p, bool recorte) {
+  long pos = inicio_ + static_cast<long>(p.off);
+  long n = p.len;
+  ++recortes_;
+  if (n == 0) return 0;
+  if (!plano_) {
+    // TRIM es solo una sugerencia: sin huecos que perforar no se hace nada
+    if (recorte) return 0;
+    std::vector<char> buf(static_cast<size_t>(std::min(n, TAM_TROZO)), 0);
+    std::unique_lock<std::shared_mutex> lock(mutexDisco_);
+    for (long hecho = 0; hecho < n;) {
+      long len = std::min(n - hecho, TAM_TROZO);
+      if (!disco_->escribir(pos + hecho, buf.data(), len)) return NBD_EIO;
+      hecho += len;
+    }
+    if ((p.flags & CMD_FLAG_FUA) && !disco_->sincronizar()) return NBD_EIO;
+    return 0;
+  }
+  bool hueco = !(p.flags & CMD_FLAG_NO_HOLE);
+  {
+    // En orden con las escrituras, igual que en escribir()
+    std::unique_lock<std::shared_mutex> lock(mutexDisco_);
+    if (recorte) {
+      // Si el principal no admite huecos el TRIM se ignora en ambas
+      // réplicas; si los admite, el espejo debe quedar igual (en ceros)
+      if (fallocate(fdPrincipal_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+            pos, n) != 0)
+        return 0;
+    } else if (!ceros(fdPrincipal_, pos, n, hueco)) {
+      return NBD_EIO;
+    }
+    if (fdEspejo_ >= 0 && !ceros(fdEspejo_, pos, n, hueco))
+      falloEspejo_ = true;
+    if (!CacheBloques::global().invalidar(path_, pos, pos + n))
+      return NBD_EIO;
+  }
+  if (p.flags & CMD_FLAG_FUA) return vaciar();
+  return 0;
+}
+
+unsigned ServidorNbd::vaciar() {
+  if (!plano_) {
+    std::unique_lock<std::shared_mutex> lock(mutexDisco_);
+    return disco_->sincronizar() ? 0 : NBD_EIO;
+  }
+  if (fdatasync(fdPrincipal_) != 0) return NBD_EIO;
+  if (fdEspejo_ >= 0 && fdatasync(fdEspejo_) != 0) falloEspejo_ = true;
+  return 0;
+}
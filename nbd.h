@@ -0,0 +1,95 @@
+#pragma once
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "bloqueos.h"
+#include "dispositivo.h"
+#include "paralelo.h"
+
+struct EstadisticasNbd {
+  long conexiones = 0;
+  long lecturas = 0;
+  long escrituras = 0;
+  long recortes = 0;  // TRIM y WRITE_ZEROES
+  long bytesLeidos = 0;
+  long bytesEscritos = 0;
+};
+
+// Servidor NBD (negociación "fixed newstyle") en un socket Unix que expone
+// el rango de bytes de una partición montada, para usarla desde el host con
+// nbd-client o qemu-nbd sin dispositivos loop.
+//
+// Cada conexión tiene un hilo que lee pedidos; los pedidos se atienden en un
+// pool compartido y se responden en el orden en que terminan. Si el disco es
+// el formato clásico con réplicas planas, las lecturas salen del archivo al
+// socket con splice, las escrituras van a ambas réplicas y TRIM perfora
+// huecos. Los demás formatos (thin, comprimido, RAID, capas) pasan por el
+// Dispositivo de escritura del disco.
+class ServidorNbd {
+ public:
+  // Empieza a escuchar en rutaSocket; nullptr y error si no se pudo. El
+  // servidor se queda con el bloqueo de la partición hasta detenerse.
+  static std::unique_ptr<ServidorNbd> iniciar(const QString& nombre,
+    const QString& path, long inicio, long tam, const QString& rutaSocket,
+    std::unique_ptr<BloqueoDisco> bloqueo, QString& error);
+  // Corta las conexiones, termina los pedidos en curso y vacía el disco
+  ~ServidorNbd();
+
+  const QString& path() const { return path_; }
+  const QString& socket() const { return rutaSocket_; }
+  long tamano() const { return tam_; }
+  bool usaSplice() const { return splice_; }
+  bool degradado() const;
+  EstadisticasNbd estadisticas() const;
+
+ private:
+  struct Conexion;
+  struct Pedido;
+
+  ServidorNbd() = default;
+  void aceptar();
+  void atender(int fd);
+  bool negociar(int fd);
+  void procesar(Conexion& c, const Pedido& p);
+  // Cada operación devuelve el código de error NBD (0 si salió bien)
+  unsigned leer(Conexion& c, const Pedido& p);
+  unsigned escribir(const Pedido& p);
+  unsigned ponerEnCeros(const Pedido& p, bool recorte);
+  unsigned vaciar();
+  bool responder(Conexion& c, const Pedido& p, unsigned error,
+    const char* datos, long n);
+
+  std::unique_ptr<BloqueoDisco> bloqueo_;  // Se suelta después de vaciar
+  QString nombre_, path_, rutaSocket_;
+  long inicio_ = 0;
+  long tam_ = 0;
+  // Réplicas planas accedidas directo (plano_) o el disco completo (disco_)
+  bool plano_ = false;
+  bool splice_ = false;
+  int fdPrincipal_ = -1;
+  int fdEspejo_ = -1;
+  std::atomic<bool> falloEspejo_{false};
+  std::unique_ptr<Dispositivo> disco_;
+  // Lecturas compartidas, escrituras solas. En las réplicas planas ordena
+  // solo las escrituras (las lecturas van directo al principal).
+  std::shared_mutex mutexDisco_;
+
+  int fdEscucha_ = -1;
+  std::atomic<bool> parar_{false};
+  std::thread aceptador_;
+  std::mutex mutexConexiones_;
+  std::vector<int> conexiones_;  // Sockets abiertos, para cortarlos al parar
+  std::vector<std::thread> lectores_;
+  // Lectores que ya terminaron; aceptar() los une en la siguiente conexión
+  std::vector<std::thread::id> terminados_;
+  std::unique_ptr<PoolDeHilos> pool_;
+
+  std::atomic<long> conexionesTotales_{0};
+  std::atomic<long> lecturas_{0}, escrituras_{0}, recortes_{0};
+  std::atomic<long> bytesLeidos_{0}, bytesEscritos_{0};
+};
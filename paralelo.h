@@ -0,0 +1,86 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Cantidad de hilos de trabajo a usar: los núcleos disponibles, hasta maximo
+inline unsigned hilosDeTrabajo(unsigned maximo = 8) {
+  unsigned n = std::thread::hardware_concurrency();
+  if (n == 0) n = 2;
+  return std::max(1u, std::min(n, maximo));
+}
+
+// Ejecuta tarea(i) para cada i en [0, total) repartiendo los índices entre
+// varios hilos. Cada hilo toma el siguiente índice libre, así los trozos
+// lentos (por ejemplo, con más datos) no dejan a los demás hilos esperando.
+template <typename F>
+void ejecutarEnParalelo(size_t total, unsigned hilos, F tarea) {
+  if (total == 0) return;
+  hilos = static_cast<unsigned>(
+    std::max<size_t>(1, std::min<size_t>(hilos, total)));
+  std::atomic<size_t> siguiente{0};
+  auto trabajador = [&]() {
+    for (size_t i = siguiente.fetch_add(1); i < total;
+         i = siguiente.fetch_add(1))
+      tarea(i);
+  };
+  std::vector<std::thread> pool;
+  for (unsigned h = 1; h < hilos; ++h) pool.emplace_back(trabajador);
+  trabajador();
+  for (auto& t : pool) t.join();
+}
+
+// Hilos fijos que ejecutan tareas de una cola, para servicios que reciben
+// trabajo de a poco (a diferencia de ejecutarEnParalelo, que reparte un
+// total conocido). Al destruirse termina las tareas pendientes.
+class PoolDeHilos {
+ public:
+  explicit PoolDeHilos(unsigned hilos) {
+    for (unsigned h = 0; h < std::max(1u, hilos); ++h)
+      hilos_.emplace_back([this]() { trabajar(); });
+  }
+  ~PoolDeHilos() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cerrado_ = true;
+    }
+    hay_.notify_all();
+    for (auto& t : hilos_) t.join();
+  }
+  PoolDeHilos(const PoolDeHilos&) = delete;
+  PoolDeHilos& operator=(const PoolDeHilos&) = delete;
+
+  void encolar(std::function<void()> tarea) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cola_.push_back(std::move(tarea));
+    }
+    hay_.notify_one();
+  }
+
+ private:
+  void trabajar() {
+    for (;;) {
+      std::function<void()> tarea;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        hay_.wait(lock, [this]() { return cerrado_ || !cola_.empty(); });
+        if (cola_.empty()) return;
+        tarea = std::move(cola_.front());
+        cola_.pop_front();
+      }
+      tarea();
+    }
+  }
+
+  std::vector<std::thread> hilos_;
+  std::deque<std::function<void()>> cola_;
+  std::mutex mutex_;
+  std::condition_variable hay_;
+  bool cerrado_ = false;
+};
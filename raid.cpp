@@ -0,0 +1,612 @@
+#include "raid.h"
+
+#include <QStringList>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "discoio.h"
+#include "paralelo.h"
+#include "simd.h"
+#include "snapshot.h"
+
+namespace {
+
+const char MAGIC_RAID[8] = {'P', '2', 'R', 'A', 'I', 'D', 0, 0};
+// Las operaciones a partir de este tamaño se reparten entre hilos
+const long OPERACION_MASIVA = 64 * 1024;
+
+// Unidades de datos (sin contar paridad ni copias) por fila de stripes
+long unidadesPorFila(const CabeceraRaid& c) {
+  switch (c.nivel) {
+    case 0: return c.miembros;
+    case 5: return c.miembros - 1;
+    case 10: return c.miembros / 2;
+    default: return 1;
+  }
+}
+
+// Bytes de datos que guarda cada miembro (sin la cabecera)
+long tamDatosMiembro(const CabeceraRaid& c) {
+  if (c.nivel == 1) return static_cast<long>(c.tamLogico);
+  long porFila = unidadesPorFila(c) * c.stripe;
+  long filas = (static_cast<long>(c.tamLogico) + porFila - 1) / porFila;
+  return filas * c.stripe;
+}
+
+bool leerCabeceraMiembro(const QString& path, CabeceraRaid& cab) {
+  int fd = open(path.toStdString().c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  bool ok = leerCompleto(fd, 0, reinterpret_cast<char*>(&cab), sizeof(cab));
+  close(fd);
+  return ok && memcmp(cab.magic, MAGIC_RAID, sizeof(MAGIC_RAID)) == 0;
+}
+
+}  // namespace
+
+// ----------------------- Funciones de conjunto -----------------------
+QString rutaMiembro(const QString& path, int i) {
+  if (i == 0) return path;
+  if (i == 1) return rutaRaid(path);
+  int pos = path.lastIndexOf(".disk");
+  return path.left(pos) + "_raid" + QString::number(i) + ".disk";
+}
+
+bool leerCabeceraRaid(const QString& path, CabeceraRaid& cab) {
+  // Si falta el primer miembro, el espejo también tiene la cabecera
+  return leerCabeceraMiembro(rutaMiembro(path, 0), cab) ||
+         leerCabeceraMiembro(rutaMiembro(path, 1), cab);
+}
+
+bool esConjuntoRaid(const QString& path) {
+  CabeceraRaid cab;
+  return leerCabeceraRaid(path, cab);
+}
+
+QStringList archivosDeDisco(const QString& path) {
+  QStringList archivos;
+  CabeceraRaid cab;
+  if (leerCabeceraRaid(path, cab)) {
+    for (int i = 0; i < cab.miembros; ++i) archivos << rutaMiembro(path, i);
+    return archivos;
+  }
+  archivos << path;
+  if (fileExists(rutaRaid(path))) archivos << rutaRaid(path);
+  return archivos;
+}
+
+QString describirRaid(const CabeceraRaid& cab) {
+  return QString("RAID %1, %2 miembros, stripe %3 KiB")
+    .arg(cab.nivel)
+    .arg(cab.miembros)
+    .arg(cab.stripe / 1024);
+}
+
+QString nombreEstadoMiembro(EstadoMiembroRaid::Estado estado) {
+  switch (estado) {
+    case EstadoMiembroRaid::VIGENTE: return "vigente";
+    case EstadoMiembroRaid::FALTANTE: return "faltante";
+    case EstadoMiembroRaid::INVALIDO: return "inválido";
+    case EstadoMiembroRaid::DESACTUALIZADO: return "desactualizado";
+  }
+  return QString();
+}
+
+QString validarParametrosRaid(int nivel, int miembros, long stripe) {
+  switch (nivel) {
+    case 0:
+    case 1:
+      if (miembros < 2) return "RAID 0 y 1 necesitan al menos 2 miembros.";
+      break;
+    case 5:
+      if (miembros < 3) return "RAID 5 necesita al menos 3 miembros.";
+      break;
+    case 10:
+      if (miembros < 4 || miembros % 2 != 0)
+        return "RAID 10 necesita un número par de miembros (mínimo 4).";
+      break;
+    default: return "Nivel RAID inválido (use 0, 1, 5 o 10).";
+  }
+  if (miembros > 32) return "Máximo 32 miembros.";
+  if (stripe < 4096 || stripe > 1024 * 1024 || (stripe & (stripe - 1)) != 0)
+    return "Stripe inválido (potencia de 2 entre 4 y 1024 KiB).";
+  return QString();
+}
+
+bool crearConjuntoRaid(const QString& path, int nivel, int miembros,
+  long stripe, long tamLogico, QString& error) {
+  CabeceraRaid cab;
+  memset(&cab, 0, sizeof(cab));
+  memcpy(cab.magic, MAGIC_RAID, sizeof(MAGIC_RAID));
+  cab.version = 1;
+  cab.nivel = nivel;
+  cab.miembros = miembros;
+  cab.stripe = static_cast<int>(stripe);
+  cab.tamLogico = tamLogico;
+  long tamArchivo = TAM_CABECERA_RAID + tamDatosMiembro(cab);
+  for (int i = 0; i < miembros; ++i) {
+    QString ruta = rutaMiembro(path, i);
+    descartarSnapshots(ruta);
+    int fd = open(ruta.toStdString().c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      error = "No se pudo crear el miembro " + ruta + ".";
+      return false;
+    }
+    cab.indice = i;
+    bool ok = ftruncate(fd, tamArchivo) == 0 &&
+              escribirCompleto(
+                fd, 0, reinterpret_cast<const char*>(&cab), sizeof(cab));
+    close(fd);
+    if (!ok) {
+      error = "No se pudo escribir la cabecera de " + ruta + ".";
+      return false;
+    }
+  }
+  return true;
+}
+
+// ------------------------------ DiscoRaid ------------------------------
+std::unique_ptr<DiscoRaid> DiscoRaid::abrir(
+  const QString& path, bool escritura, QString& aviso) {
+  CabeceraRaid base;
+  if (!leerCabeceraRaid(path, base)) {
+    aviso = "no es un conjunto RAID";
+    return nullptr;
+  }
+  std::unique_ptr<DiscoRaid> d(new DiscoRaid());
+  d->cab_ = base;
+  d->miembros_.resize(base.miembros);
+  d->enCurso_.reset(new std::atomic<int>[base.miembros]);
+  QStringList problemas;
+  std::vector<int> epocas(base.miembros, -1);
+  d->estados_.resize(base.miembros);
+  for (int i = 0; i < base.miembros; ++i) {
+    d->enCurso_[i] = 0;
+    auto f = abrirMiembro(rutaMiembro(path, i), escritura);
+    if (!f) {
+      problemas << QString("miembro %1 no se pudo abrir").arg(i);
+      continue;
+    }
+    CabeceraRaid c;
+    bool valida = f->leer(0, reinterpret_cast<char*>(&c), sizeof(c)) &&
+                  memcmp(c.magic, MAGIC_RAID, sizeof(MAGIC_RAID)) == 0 &&
+                  c.nivel == base.nivel && c.miembros == base.miembros &&
+                  c.stripe == base.stripe && c.tamLogico == base.tamLogico &&
+                  c.indice == i &&
+                  f->tamano() >= TAM_CABECERA_RAID + tamDatosMiembro(base);
+    if (!valida) {
+      problemas << QString("miembro %1 con cabecera inválida").arg(i);
+      d->estados_[i].estado = EstadoMiembroRaid::INVALIDO;
+      continue;
+    }
+    epocas[i] = c.epoca;
+    d->estados_[i] = {EstadoMiembroRaid::VIGENTE, c.epoca};
+    d->miembros_[i] = std::move(f);
+  }
+  // La época más alta es la del conjunto: un miembro con una menor faltó
+  // mientras se escribía y sus datos no son confiables
+  d->cab_.epoca = std::max(0, *std::max_element(epocas.begin(), epocas.end()));
+  d->viejos_.resize(base.miembros);
+  for (int i = 0; i < base.miembros; ++i) {
+    if (!d->miembros_[i] || epocas[i] >= d->cab_.epoca) continue;
+    problemas << QString("miembro %1 desactualizado (época %2 de %3)")
+                   .arg(i)
+                   .arg(epocas[i])
+                   .arg(d->cab_.epoca);
+    d->viejos_[i] = std::move(d->miembros_[i]);
+    d->estados_[i].estado = EstadoMiembroRaid::DESACTUALIZADO;
+  }
+  aviso = problemas.join("; ");
+
+  // Tolerancia a fallos de cada nivel
+  int faltan = 0;
+  for (const auto& m : d->miembros_)
+    if (!m) faltan++;
+  bool utilizable = true;
+  switch (base.nivel) {
+    case 0: utilizable = (faltan == 0); break;
+    case 1: utilizable = (faltan < base.miembros); break;
+    case 5: utilizable = (faltan <= 1); break;
+    case 10:
+      for (int p = 0; p < base.miembros; p += 2)
+        if (!d->miembros_[p] && !d->miembros_[p + 1]) utilizable = false;
+      break;
+  }
+  if (!utilizable) return nullptr;
+  return d;
+}
+
+std::vector<DiscoRaid::Segmento> DiscoRaid::segmentar(long pos, long n) const {
+  std::vector<Segmento> segs;
+  long s = cab_.stripe;
+  for (long off = 0; off < n;) {
+    long p = pos + off;
+    long enUnidad = p % s;
+    long len = std::min(n - off, s - enUnidad);
+    segs.push_back({p / s, enUnidad, off, len});
+    off += len;
+  }
+  return segs;
+}
+
+long DiscoRaid::posFisica(long fila, long enUnidad) const {
+  return TAM_CABECERA_RAID + fila * cab_.stripe + enUnidad;
+}
+
+int DiscoRaid::miembroParidad(long fila) const {
+  return (cab_.miembros - 1) - static_cast<int>(fila % cab_.miembros);
+}
+
+int DiscoRaid::miembroDato(long fila, int d) const {
+  int p = miembroParidad(fila);
+  return d < p ? d : d + 1;
+}
+
+// Elige la copia con menos lecturas en curso; en empate, la preferida
+int DiscoRaid::elegirDeEspejo(int a, int b) {
+  if (!miembros_[a]) return b;
+  if (!miembros_[b]) return a;
+  return enCurso_[b] < enCurso_[a] ? b : a;
+}
+
+bool DiscoRaid::leerMiembro(int m, long pos, char* buf, long n) {
+  if (!miembros_[m]) return false;
+  enCurso_[m]++;
+  bool ok = miembros_[m]->leer(pos, buf, n);
+  enCurso_[m]--;
+  return ok;
+}
+
+bool DiscoRaid::leerSegmento(const Segmento& s, char* buf) {
+  char* dst = buf + s.off;
+  switch (cab_.nivel) {
+    case 0: {
+      int m = static_cast<int>(s.unidad % cab_.miembros);
+      long fila = s.unidad / cab_.miembros;
+      return leerMiembro(m, posFisica(fila, s.enUnidad), dst, s.len);
+    }
+    case 1: {
+      // Unidades consecutivas van a copias distintas para leer en paralelo
+      long pos = posFisica(s.unidad, s.enUnidad);
+      int inicio = static_cast<int>(s.unidad % cab_.miembros);
+      for (int k = 0; k < cab_.miembros; ++k) {
+        int m = (inicio + k) % cab_.miembros;
+        if (leerMiembro(m, pos, dst, s.len)) return true;
+      }
+      return false;
+    }
+    case 10: {
+      long pares = cab_.miembros / 2;
+      long fila = s.unidad / pares;
+      int a = static_cast<int>(s.unidad % pares) * 2;
+      // En empate se alterna la copia por fila para repartir lecturas
+      // secuenciales entre ambos miembros del par
+      int m = (fila % 2 == 0) ? elegirDeEspejo(a, a + 1)
+                              : elegirDeEspejo(a + 1, a);
+      long pos = posFisica(fila, s.enUnidad);
+      if (leerMiembro(m, pos, dst, s.len)) return true;
+      return leerMiembro(m == a ? a + 1 : a, pos, dst, s.len);
+    }
+    case 5: {
+      int datos = cab_.miembros - 1;
+      long fila = s.unidad / datos;
+      int m = miembroDato(fila, static_cast<int>(s.unidad % datos));
+      long pos = posFisica(fila, s.enUnidad);
+      if (miembros_[m]) return leerMiembro(m, pos, dst, s.len);
+      // Miembro faltante: XOR del resto de la fila (datos y paridad)
+      std::vector<char> tmp(static_cast<size_t>(s.len));
+      memset(dst, 0, static_cast<size_t>(s.len));
+      for (int k = 0; k < cab_.miembros; ++k) {
+        if (k == m) continue;
+        if (!leerMiembro(k, pos, tmp.data(), s.len)) return false;
+        xorBloque(dst, tmp.data(), static_cast<size_t>(s.len));
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DiscoRaid::leer(long pos, char* buf, long n) {
+  if (pos < 0 || n < 0 || pos + n > cab_.tamLogico) return false;
+  auto segs = segmentar(pos, n);
+  if (segs.size() == 1 || n < OPERACION_MASIVA) {
+    for (const auto& s : segs)
+      if (!leerSegmento(s, buf)) return false;
+    return true;
+  }
+  std::atomic<bool> ok{true};
+  unsigned hilos = std::min<unsigned>(hilosDeTrabajo(), cab_.miembros);
+  ejecutarEnParalelo(segs.size(), hilos, [&](size_t i) {
+    if (!leerSegmento(segs[i], buf)) ok = false;
+  });
+  return ok;
+}
+
+// Lee todas las unidades de datos de una fila RAID 5, reconstruyendo la del
+// miembro faltante si lo hay
+bool DiscoRaid::leerFila5(long fila, std::vector<char>& datos) {
+  long s = cab_.stripe;
+  int nDatos = cab_.miembros - 1;
+  datos.assign(static_cast<size_t>(nDatos * s), 0);
+  int faltante = -1;
+  for (int d = 0; d < nDatos; ++d) {
+    int m = miembroDato(fila, d);
+    if (!miembros_[m]) {
+      faltante = d;
+      continue;
+    }
+    if (!leerMiembro(m, posFisica(fila, 0), datos.data() + d * s, s))
+      return false;
+  }
+  if (faltante < 0) return true;
+  char* dst = datos.data() + faltante * s;
+  if (!leerMiembro(miembroParidad(fila), posFisica(fila, 0), dst, s))
+    return false;
+  for (int d = 0; d < nDatos; ++d)
+    if (d != faltante) xorBloque(dst, datos.data() + d * s, s);
+  return true;
+}
+
+// Escribe los segmentos de una misma fila RAID 5 y actualiza su paridad:
+//  - fila completa: la paridad sale solo de los datos nuevos
+//  - todos los miembros presentes: lectura-modificación-escritura del rango
+//    tocado (paridad ^= viejo ^ nuevo)
+//  - modo degradado: se reconstruye la fila entera y se recalcula
+bool DiscoRaid::escribirFila5(
+  long fila, const std::vector<Segmento>& segs, const char* buf) {
+  long s = cab_.stripe;
+  int nDatos = cab_.miembros - 1;
+  int p = miembroParidad(fila);
+  long total = 0;
+  long lo = s, hi = 0;
+  bool todosPresentes = static_cast<bool>(miembros_[p]);
+  for (const auto& seg : segs) {
+    total += seg.len;
+    lo = std::min(lo, seg.enUnidad);
+    hi = std::max(hi, seg.enUnidad + seg.len);
+    int m = miembroDato(fila, static_cast<int>(seg.unidad % nDatos));
+    if (!miembros_[m]) todosPresentes = false;
+  }
+  bool completa = (total == nDatos * s);
+
+  if (!completa && todosPresentes) {
+    std::vector<char> paridad(static_cast<size_t>(hi - lo));
+    if (!leerMiembro(p, posFisica(fila, lo), paridad.data(), hi - lo))
+      return false;
+    std::vector<char> viejo;
+    for (const auto& seg : segs) {
+      int m = miembroDato(fila, static_cast<int>(seg.unidad % nDatos));
+      long pos = posFisica(fila, seg.enUnidad);
+      viejo.resize(static_cast<size_t>(seg.len));
+      if (!leerMiembro(m, pos, viejo.data(), seg.len)) return false;
+      char* par = paridad.data() + (seg.enUnidad - lo);
+      xorBloque(par, viejo.data(), seg.len);
+      xorBloque(par, buf + seg.off, seg.len);
+      if (!miembros_[m]->escribir(pos, buf + seg.off, seg.len)) return false;
+    }
+    return miembros_[p]->escribir(
+      posFisica(fila, lo), paridad.data(), hi - lo);
+  }
+
+  std::vector<char> datos;
+  if (completa) datos.assign(static_cast<size_t>(nDatos * s), 0);
+  else if (!leerFila5(fila, datos)) return false;
+  for (const auto& seg : segs) {
+    long d = seg.unidad % nDatos;
+    memcpy(datos.data() + d * s + seg.enUnidad, buf + seg.off,
+      static_cast<size_t>(seg.len));
+  }
+  std::vector<char> paridad(static_cast<size_t>(s), 0);
+  for (int d = 0; d < nDatos; ++d)
+    xorBloque(paridad.data(), datos.data() + d * s, s);
+  for (const auto& seg : segs) {
+    int m = miembroDato(fila, static_cast<int>(seg.unidad % nDatos));
+    if (miembros_[m] &&
+        !miembros_[m]->escribir(
+          posFisica(fila, seg.enUnidad), buf + seg.off, seg.len))
+      return false;
+  }
+  if (!miembros_[p]) return true;
+  return miembros_[p]->escribir(
+    posFisica(fila, lo), paridad.data() + lo, hi - lo);
+}
+
+// Escribe la época en la cabecera de cada miembro presente
+bool DiscoRaid::escribirEpoca(int epoca) {
+  for (int i = 0; i < cab_.miembros; ++i) {
+    if (!miembros_[i]) continue;
+    CabeceraRaid c = cab_;
+    c.indice = i;
+    c.epoca = epoca;
+    if (!miembros_[i]->escribir(0, reinterpret_cast<const char*>(&c),
+          sizeof(c)) ||
+        !miembros_[i]->sincronizar())
+      return false;
+  }
+  return true;
+}
+
+// Antes de la primera escritura con miembros ausentes, los presentes pasan a
+// una época nueva: si un ausente vuelve, queda marcado como desactualizado.
+// Otro proceso puede estar subiéndola a la vez: se adopta la mayor que se
+// vea hasta que todos los presentes tengan la misma.
+bool DiscoRaid::subirEpoca() {
+  std::lock_guard<std::mutex> lock(mutexEpoca_);
+  if (epocaSubida_) return true;
+  int epoca = cab_.epoca + 1;
+  for (int intento = 0; intento < 8; ++intento) {
+    if (!escribirEpoca(epoca)) return false;
+    bool iguales = true;
+    int maxima = epoca;
+    for (int i = 0; i < cab_.miembros; ++i) {
+      CabeceraRaid c;
+      if (!miembros_[i]) continue;
+      if (!miembros_[i]->leer(0, reinterpret_cast<char*>(&c), sizeof(c)))
+        return false;
+      if (c.epoca != epoca) iguales = false;
+      maxima = std::max(maxima, c.epoca);
+    }
+    if (iguales) {
+      cab_.epoca = epoca;
+      epocaSubida_ = true;
+      return true;
+    }
+    epoca = maxima;
+  }
+  return false;
+}
+
+bool DiscoRaid::escribir(long pos, const char* buf, long n) {
+  if (pos < 0 || n < 0 || pos + n > cab_.tamLogico) return false;
+  if (!epocaSubida_ && degradado() && !subirEpoca()) return false;
+  auto segs = segmentar(pos, n);
+
+  if (cab_.nivel == 5) {
+    std::lock_guard<std::mutex> lock(mutexParidad_);
+    long nDatos = cab_.miembros - 1;
+    // Los segmentos vienen en orden: agrupar los de la misma fila
+    size_t i = 0;
+    while (i < segs.size()) {
+      long fila = segs[i].unidad / nDatos;
+      size_t j = i;
+      while (j < segs.size() && segs[j].unidad / nDatos == fila) ++j;
+      std::vector<Segmento> grupo(segs.begin() + i, segs.begin() + j);
+      if (!escribirFila5(fila, grupo, buf)) return false;
+      i = j;
+    }
+    return true;
+  }
+
+  auto escribirSegmento = [&](const Segmento& s) -> bool {
+    const char* src = buf + s.off;
+    switch (cab_.nivel) {
+      case 0: {
+        int m = static_cast<int>(s.unidad % cab_.miembros);
+        long fila = s.unidad / cab_.miembros;
+        return miembros_[m]->escribir(posFisica(fila, s.enUnidad), src, s.len);
+      }
+      case 1: {
+        long pos = posFisica(s.unidad, s.enUnidad);
+        for (auto& m : miembros_)
+          if (m && !m->escribir(pos, src, s.len)) return false;
+        return true;
+      }
+      case 10: {
+        long pares = cab_.miembros / 2;
+        long fila = s.unidad / pares;
+        int a = static_cast<int>(s.unidad % pares) * 2;
+        long pos = posFisica(fila, s.enUnidad);
+        for (int m = a; m <= a + 1; ++m)
+          if (miembros_[m] && !miembros_[m]->escribir(pos, src, s.len))
+            return false;
+        return true;
+      }
+    }
+    return false;
+  };
+  if (segs.size() == 1 || n < OPERACION_MASIVA) {
+    for (const auto& s : segs)
+      if (!escribirSegmento(s)) return false;
+    return true;
+  }
+  std::atomic<bool> ok{true};
+  unsigned hilos = std::min<unsigned>(hilosDeTrabajo(), cab_.miembros);
+  ejecutarEnParalelo(segs.size(), hilos, [&](size_t i) {
+    if (!escribirSegmento(segs[i])) ok = false;
+  });
+  return ok;
+}
+
+bool DiscoRaid::sincronizar() {
+  bool ok = true;
+  for (auto& m : miembros_)
+    if (m && !m->sincronizar()) ok = false;
+  return ok;
+}
+
+bool DiscoRaid::degradado() const {
+  for (const auto& m : miembros_)
+    if (!m) return true;
+  return false;
+}
+
+std::vector<int> DiscoRaid::desactualizados() const {
+  std::vector<int> res;
+  for (int i = 0; i < cab_.miembros; ++i)
+    if (viejos_[i]) res.push_back(i);
+  return res;
+}
+
+// ------------------------- Resincronización -------------------------
+long DiscoRaid::filas() const {
+  return (tamDatosMiembro(cab_) + cab_.stripe - 1) / cab_.stripe;
+}
+
+long DiscoRaid::bytesPorFila() const {
+  return unidadesPorFila(cab_) * cab_.stripe;
+}
+
+bool DiscoRaid::verificarFila(long fila, bool reparar, bool& distinta) {
+  distinta = false;
+  long s = std::min<long>(
+    cab_.stripe, tamDatosMiembro(cab_) - fila * cab_.stripe);
+  long pos = posFisica(fila, 0);
+  // Compara lo que guarda el miembro m con lo esperado y, si difiere y se
+  // pidió reparar, lo reescribe
+  std::vector<char> actual(static_cast<size_t>(s));
+  auto comparar = [&](int m, const char* esperado) -> bool {
+    Dispositivo* d = miembros_[m] ? miembros_[m].get() : viejos_[m].get();
+    if (!d) return true;
+    if (!d->leer(pos, actual.data(), s)) return false;
+    if (memcmp(actual.data(), esperado, static_cast<size_t>(s)) == 0)
+      return true;
+    distinta = true;
+    return !reparar || d->escribir(pos, esperado, s);
+  };
+
+  switch (cab_.nivel) {
+    case 1:
+    case 10: {
+      // Grupos de copias: todos los miembros en RAID 1, pares en RAID 10.
+      // Manda la primera copia vigente de cada grupo.
+      int porGrupo = (cab_.nivel == 1) ? cab_.miembros : 2;
+      std::vector<char> fuente(static_cast<size_t>(s));
+      for (int g = 0; g < cab_.miembros; g += porGrupo) {
+        int f = g;
+        while (f < g + porGrupo && !miembros_[f]) ++f;
+        if (f == g + porGrupo) continue;
+        if (!leerMiembro(f, pos, fuente.data(), s)) return false;
+        for (int m = g; m < g + porGrupo; ++m)
+          if (m != f && !comparar(m, fuente.data())) return false;
+      }
+      return true;
+    }
+    case 5: {
+      // El XOR de todos los miembros menos uno es lo que ese debe guardar.
+      // Con todos vigentes se verifica la paridad; si falta uno, es el que
+      // se reconstruye.
+      int objetivo = miembroParidad(fila);
+      for (int m = 0; m < cab_.miembros; ++m)
+        if (!miembros_[m]) objetivo = m;
+      std::vector<char> esperado(static_cast<size_t>(s), 0);
+      for (int m = 0; m < cab_.miembros; ++m) {
+        if (m == objetivo) continue;
+        if (!leerMiembro(m, pos, actual.data(), s)) return false;
+        xorBloque(esperado.data(), actual.data(), static_cast<size_t>(s));
+      }
+      return comparar(objetivo, esperado.data());
+    }
+  }
+  return true;  // RAID 0 no tiene redundancia
+}
+
+bool DiscoRaid::terminarResincronizacion() {
+  for (int i = 0; i < cab_.miembros; ++i)
+    if (viejos_[i]) miembros_[i] = std::move(viejos_[i]);
+  if (!sincronizar() || !escribirEpoca(cab_.epoca)) return false;
+  for (int i = 0; i < cab_.miembros; ++i)
+    if (miembros_[i]) estados_[i] = {EstadoMiembroRaid::VIGENTE, cab_.epoca};
+  return true;
+}
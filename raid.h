@@ -0,0 +1,125 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "dispositivo.h"
+
+// Cabecera al inicio de cada miembro de un conjunto RAID creado con
+// mkdisk -raid=. Los discos sin cabecera son el formato clásico: X.disk más
+// su espejo X_raid.disk con el MBR en el byte 0 de cada uno.
+struct CabeceraRaid {
+  char magic[8];       // "P2RAID"
+  int version;         // 1
+  int nivel;           // 0, 1, 5 o 10
+  int miembros;        // cantidad de archivos del conjunto
+  int indice;          // posición de este archivo dentro del conjunto
+  int stripe;          // bytes por unidad de stripe
+  // Sube cada vez que se escribe con miembros ausentes; un miembro con época
+  // menor que la del resto se perdió esas escrituras. Ocupa el relleno que
+  // había antes de tamLogico, así que los conjuntos viejos tienen 0.
+  int epoca;
+  long long tamLogico; // tamaño visible del disco (el que ve el MBR)
+};
+
+// Los datos de cada miembro empiezan después de la cabecera, alineados
+const long TAM_CABECERA_RAID = 4096;
+
+// Cómo quedó cada miembro al abrir el conjunto
+struct EstadoMiembroRaid {
+  enum Estado { VIGENTE, FALTANTE, INVALIDO, DESACTUALIZADO };
+  Estado estado = FALTANTE;
+  int epoca = -1;  // -1 si no se pudo leer su cabecera
+};
+
+// Ruta del miembro i: 0 = X.disk, 1 = X_raid.disk, i >= 2 = X_raid<i>.disk
+QString rutaMiembro(const QString& path, int i);
+// Lee la cabecera del conjunto desde el primer miembro que la tenga
+bool leerCabeceraRaid(const QString& path, CabeceraRaid& cab);
+bool esConjuntoRaid(const QString& path);
+// Archivos que forman el disco: los miembros del conjunto, o X.disk y su
+// espejo si existe
+QStringList archivosDeDisco(const QString& path);
+QString describirRaid(const CabeceraRaid& cab);
+// "vigente", "faltante", "inválido" o "desactualizado"
+QString nombreEstadoMiembro(EstadoMiembroRaid::Estado estado);
+// Valida nivel/miembros/stripe; devuelve el error o cadena vacía
+QString validarParametrosRaid(int nivel, int miembros, long stripe);
+// Crea los archivos miembro (dispersos) con su cabecera
+bool crearConjuntoRaid(const QString& path, int nivel, int miembros,
+  long stripe, long tamLogico, QString& error);
+
+// Disco lógico repartido sobre varios archivos miembro. Traduce cada rango
+// lógico a (miembro, desplazamiento) según el nivel:
+//   0  stripes repartidos entre todos los miembros, sin redundancia
+//   1  todos los miembros guardan la misma copia
+//   5  stripes con paridad rotativa (XOR) en un miembro distinto por fila
+//   10 stripes repartidos entre pares de miembros espejados
+// Las operaciones grandes se reparten entre miembros en paralelo.
+//
+// Un miembro con época menor que la más alta del conjunto se trata como
+// faltante hasta que scrub -repair=resync lo reconstruye.
+class DiscoRaid : public Dispositivo {
+ public:
+  // Devuelve nullptr si faltan más miembros de los que el nivel tolera
+  static std::unique_ptr<DiscoRaid> abrir(
+    const QString& path, bool escritura, QString& aviso);
+
+  bool leer(long pos, char* buf, long n) override;
+  bool escribir(long pos, const char* buf, long n) override;
+  bool sincronizar() override;
+  long tamano() const override { return cab_.tamLogico; }
+  bool degradado() const override;
+  const CabeceraRaid& cabecera() const { return cab_; }
+  // Miembros que quedaron fuera por tener una época vieja
+  std::vector<int> desactualizados() const;
+  const std::vector<EstadoMiembroRaid>& estadoMiembros() const {
+    return estados_;
+  }
+
+  // Resincronización (scrub). Las filas se cuentan en unidades de stripe de
+  // cada miembro. verificarFila compara las copias (niveles 1 y 10) o la
+  // paridad (nivel 5) de la fila, incluyendo los miembros desactualizados,
+  // y si reparar las reescribe desde los miembros vigentes.
+  long filas() const;
+  long bytesPorFila() const;  // Del disco lógico
+  bool verificarFila(long fila, bool reparar, bool& distinta);
+  // Tras reparar todas las filas: los desactualizados vuelven al conjunto
+  bool terminarResincronizacion();
+
+ private:
+  // Trozo de una operación que cae dentro de una sola unidad de stripe
+  struct Segmento {
+    long unidad;  // número de unidad lógica de datos
+    long enUnidad;
+    long off;  // desplazamiento dentro del buffer del llamador
+    long len;
+  };
+
+  DiscoRaid() = default;
+  std::vector<Segmento> segmentar(long pos, long n) const;
+  long posFisica(long fila, long enUnidad) const;
+  int miembroDato(long fila, int d) const;
+  int miembroParidad(long fila) const;
+  int elegirDeEspejo(int a, int b);
+  bool leerMiembro(int m, long pos, char* buf, long n);
+  bool leerSegmento(const Segmento& s, char* buf);
+  bool leerFila5(long fila, std::vector<char>& datos);
+  bool escribirFila5(long fila, const std::vector<Segmento>& segs,
+    const char* buf);
+  bool escribirEpoca(int epoca);
+  bool subirEpoca();
+
+  CabeceraRaid cab_{};
+  std::vector<std::unique_ptr<Dispositivo>> miembros_;  // nullptr si falta
+  // Miembros abiertos pero con época vieja; solo los usa la resincronización
+  std::vector<std::unique_ptr<Dispositivo>> viejos_;
+  std::vector<EstadoMiembroRaid> estados_;
+  std::unique_ptr<std::atomic<int>[]> enCurso_;
+  std::mutex mutexParidad_;
+  std::mutex mutexEpoca_;
+  std::atomic<bool> epocaSubida_{false};  // Ya se marcó la escritura degradada
+};
@@ -0,0 +1,755 @@
+#include "reporte.h"
+
+#include <QColor>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QPainter>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "bloqueos.h"
+#include "discoio.h"
+#include "dispositivo.h"
+#include "hash64.h"
+#include "paralelo.h"
+#include "raid.h"
+
+namespace {
+
+const int DISK_BAR_HEIGHT = 150;
+const int PADDING = 20;  // Padding del lienzo
+const int EXTENDED_HEADER_HEIGHT = 30;
+const int MIN_BLOCK_WIDTH = 50;  // Ancho mínimo legible de una caja
+const int INNER_MARGIN = 5;
+
+bool esMetadato(const PartitionInfo& b) {
+  return b.type == "MBR" || b.type == "EBR";
+}
+
+// Cómo reparte el nivel los datos entre los miembros
+QString distribucionRaid(int nivel) {
+  switch (nivel) {
+    case 0: return "stripes sin redundancia";
+    case 1: return "copias completas";
+    case 5: return "paridad rotativa";
+    case 10: return "stripes sobre pares espejados";
+  }
+  return QString();
+}
+
+}  // namespace
+
+QString tomarInstantanea(const QString& path, InstantaneaDisco& inst) {
+  inst = InstantaneaDisco();
+  inst.path = path;
+  auto file = abrirDiscoLectura(path, inst.aviso);
+  if (!file)
+    return "No se pudo abrir el archivo del disco (" + inst.aviso + ").\n";
+  MBR mbr;
+  if (!readMBR(*file, mbr)) return "Error leyendo MBR.\n";
+  inst.tamano = mbr.size;
+
+  std::vector<PartitionInfo>& blocks = inst.bloques;
+  blocks.push_back({"MBR", 0, static_cast<int>(sizeof(MBR)), "MBR"});
+  std::vector<Partition> activeParts;
+  for (const auto& p : mbr.parts)
+    if (p.status == 1 && p.size > 0) activeParts.push_back(p);
+  std::sort(activeParts.begin(), activeParts.end(),
+    [](const Partition& a, const Partition& b) { return a.start < b.start; });
+  int lastPos = sizeof(MBR);
+  for (const auto& p : activeParts) {
+    if (p.start > lastPos)
+      blocks.push_back({"", lastPos, p.start - lastPos, "LIBRE"});
+    QString typeStr = (p.type == 'E') ? "EXTENDIDA" : "PRIMARIA";
+    blocks.push_back({QString::fromLatin1(p.name), p.start, p.size, typeStr});
+    if (p.type == 'E') {
+      inst.extInicio = p.start;
+      inst.extFin = p.start + p.size;
+    }
+    lastPos = p.start + p.size;
+  }
+  if (lastPos < mbr.size)
+    blocks.push_back({"", lastPos, mbr.size - lastPos, "LIBRE"});
+
+  if (inst.extInicio != -1) {
+    auto logicalsWithPos = leerEBRsConPos(*file,
+      Partition{1, 'E', 0, static_cast<int>(inst.extInicio),
+        static_cast<int>(inst.extFin - inst.extInicio), {0}});
+    // Convertir EBRs
+    std::vector<EBR> logicals;
+    for (auto& p : logicalsWithPos) logicals.push_back(p.first);
+
+    if (!logicals.empty()) {
+      std::vector<PartitionInfo> newBlocks;
+      for (const auto& b : blocks) {
+        if (b.type != "EXTENDIDA") {
+          newBlocks.push_back(b);
+          continue;
+        }
+        int currentExtPos = b.start;
+        for (const auto& log : logicals) {
+          int ebrPos = log.start - static_cast<int>(sizeof(EBR));
+          if (ebrPos > currentExtPos)
+            newBlocks.push_back(
+              {"", currentExtPos, ebrPos - currentExtPos, "LIBRE"});
+          newBlocks.push_back(
+            {"EBR", ebrPos, static_cast<int>(sizeof(EBR)), "EBR"});
+          newBlocks.push_back(
+            {QString::fromLatin1(log.name), log.start, log.size, "LÓGICA"});
+          currentExtPos = log.start + log.size;
+        }
+        if (currentExtPos < (b.start + b.size)) {
+          newBlocks.push_back(
+            {"", currentExtPos, (b.start + b.size) - currentExtPos, "LIBRE"});
+        }
+      }
+      blocks = std::move(newBlocks);
+    }
+  }
+  inst.degradado = file->degradado();
+  file.reset();
+  // Conjuntos creados con -raid=: distribución y estado de cada miembro,
+  // con el mismo criterio de época que usa el disco al abrirse
+  QString avisoRaid;
+  auto raid = esConjuntoRaid(path) ? DiscoRaid::abrir(path, false, avisoRaid)
+                                   : nullptr;
+  if (raid) {
+    inst.esRaid = true;
+    inst.cabRaid = raid->cabecera();
+    inst.bytesPorFilaRaid = raid->bytesPorFila();
+    inst.miembrosRaid = raid->estadoMiembros();
+    inst.leyendaRaid = describirRaid(inst.cabRaid) + ", " +
+                       distribucionRaid(inst.cabRaid.nivel) +
+                       QString(", época %1").arg(inst.cabRaid.epoca);
+    QStringList problemas;
+    for (size_t i = 0; i < inst.miembrosRaid.size(); ++i) {
+      const EstadoMiembroRaid& m = inst.miembrosRaid[i];
+      if (m.estado == EstadoMiembroRaid::VIGENTE) continue;
+      QString txt = QString("%1 %2").arg(i).arg(
+        nombreEstadoMiembro(m.estado));
+      if (m.estado == EstadoMiembroRaid::DESACTUALIZADO)
+        txt += QString(" (época %1)").arg(m.epoca);
+      problemas << txt;
+    }
+    inst.leyendaRaid += problemas.isEmpty()
+                          ? QString(" | miembros vigentes")
+                          : " | miembros: " + problemas.join(", ");
+  }
+  return QString();
+}
+
+namespace {
+
+// Bloques seguidos que se dibujan en una sola caja
+struct Unidad {
+  int primero;
+  int cantidad;
+  long tamano;
+  bool enExtendida;
+};
+
+bool esParticion(const PartitionInfo& b) {
+  return b.type == "PRIMARIA" || b.type == "EXTENDIDA" || b.type == "LÓGICA";
+}
+
+// Junta los bloques cuyo ancho proporcional (px por byte) no llega a umbral
+// con los chicos que los siguen, hasta llegar a umbral; los grandes quedan
+// solos. No se mezclan bloques de dentro y de fuera de la extendida.
+std::vector<Unidad> agrupar(const std::vector<PartitionInfo>& bloques,
+  const std::vector<int>& visibles, long extInicio, long extFin,
+  double pxPorByte, double umbral) {
+  std::vector<Unidad> unidades;
+  bool abierta = false;  // La última unidad es un grupo que sigue creciendo
+  for (int i : visibles) {
+    const PartitionInfo& b = bloques[i];
+    bool enExt = extInicio != -1 && b.type != "EXTENDIDA" &&
+                 b.start >= extInicio && b.start + b.size <= extFin;
+    bool chico = b.size * pxPorByte < umbral;
+    if (chico && abierta && unidades.back().enExtendida == enExt) {
+      Unidad& u = unidades.back();
+      u.cantidad = i - u.primero + 1;
+      u.tamano += b.size;
+      abierta = u.tamano * pxPorByte < umbral;
+      continue;
+    }
+    unidades.push_back({i, 1, b.size, enExt});
+    abierta = chico;
+  }
+  return unidades;
+}
+
+}  // namespace
+
+DisenoReporte disenarReporte(
+  const InstantaneaDisco& inst, const OpcionesReporte& opciones) {
+  DisenoReporte d;
+  const int filas = std::max(1, opciones.filas);
+  const int START_X = PADDING;
+  const int ALTO_FILA = DISK_BAR_HEIGHT + PADDING;
+  const int anchoFila = std::max(2 * MIN_BLOCK_WIDTH,
+    opciones.ancho - 2 * PADDING - INNER_MARGIN);
+  d.ancho = anchoFila + 2 * PADDING + INNER_MARGIN;
+  d.alto = PADDING + filas * ALTO_FILA;
+  d.leyenda = inst.leyendaRaid;
+  d.rectLeyenda = QRect(START_X, 0, anchoFila, PADDING);
+  for (int f = 0; f < filas; ++f)
+    d.marcos.push_back(QRect(START_X, PADDING + f * ALTO_FILA,
+      anchoFila + INNER_MARGIN, DISK_BAR_HEIGHT + INNER_MARGIN));
+
+  // La barra del disco es una tira de anchoFila * filas píxeles
+  std::vector<int> visibles;
+  long total = 0;
+  for (size_t i = 0; i < inst.bloques.size(); ++i)
+    if (inst.bloques[i].size > 0) {
+      visibles.push_back(static_cast<int>(i));
+      total += inst.bloques[i].size;
+    }
+  if (visibles.empty()) return d;
+  const double largo = static_cast<double>(anchoFila) * filas;
+  const double pxPorByte = largo / total;
+
+  // Cada caja mide al menos MIN_BLOCK_WIDTH; si no entran todas se agrupan
+  // los bloques chicos con un umbral cada vez mayor. Cada pasada es lineal
+  // y el umbral se duplica, así que son pocas.
+  const int minimo = MIN_BLOCK_WIDTH;
+  const size_t maxUnidades = static_cast<size_t>(largo / minimo);
+  std::vector<Unidad> unidades;
+  double umbral = 0;  // Con umbral 0 cada bloque va en su propia caja
+  for (;;) {
+    unidades = agrupar(inst.bloques, visibles, inst.extInicio, inst.extFin,
+      pxPorByte, umbral);
+    if (unidades.size() <= maxUnidades) break;
+    umbral = umbral > 0 ? umbral * 2 : minimo;
+  }
+
+  // Anchos: proporcionales, con el mínimo; lo que el mínimo agrega a las
+  // cajas chicas se descuenta de lo que sobra del mínimo en las grandes
+  std::vector<double> anchos;
+  double suma = 0, reducible = 0;
+  for (const Unidad& u : unidades) {
+    anchos.push_back(std::max<double>(minimo, u.tamano * pxPorByte));
+    suma += anchos.back();
+    reducible += anchos.back() - minimo;
+  }
+  if (suma > largo && reducible > 0) {
+    double factor = std::max(0.0, (reducible - (suma - largo)) / reducible);
+    for (double& a : anchos) a = minimo + (a - minimo) * factor;
+  }
+
+  // Se recorre la tira; una caja que cruza el final de una fila sigue en la
+  // siguiente
+  std::vector<int> extDesde(filas, -1), extHasta(filas, -1);
+  double pos = 0;
+  for (size_t k = 0; k < unidades.size(); ++k) {
+    const Unidad& u = unidades[k];
+    const PartitionInfo& b = inst.bloques[u.primero];
+    int desde = static_cast<int>(pos + 0.5);
+    pos += anchos[k];
+    int hasta = std::min(static_cast<int>(pos + 0.5), anchoFila * filas);
+
+    CajaReporte caja;
+    caja.primero = u.primero;
+    caja.cantidad = u.cantidad;
+    caja.inicio = b.start;
+    caja.tamano = u.tamano;
+    caja.enExtendida = u.enExtendida;
+    // Un grupo con una sola partición (más sus EBR o el MBR) lleva el
+    // nombre de la partición; los demás, cuántas juntan
+    int particiones = 0;
+    const PartitionInfo* unica = &b;
+    for (int i = u.primero; i < u.primero + u.cantidad; ++i)
+      if (esParticion(inst.bloques[i])) {
+        ++particiones;
+        unica = &inst.bloques[i];
+      }
+    if (u.cantidad == 1 || particiones == 1) {
+      caja.tipo = unica->type;
+      caja.nombre = unica->name;
+    } else if (particiones > 0) {
+      caja.tipo = QString("%1 part.").arg(particiones);
+    } else {
+      caja.tipo = QString("%1 bloques").arg(u.cantidad);
+    }
+    if (u.cantidad > 1 || !esMetadato(b)) {
+      double percentage =
+        (inst.tamano > 0) ? (double)u.tamano / inst.tamano : 0.0;
+      caja.info = QString::asprintf("%.1f%%", percentage * 100);
+    }
+
+    while (desde < hasta) {
+      int fila = desde / anchoFila;
+      int fin = std::min(hasta, (fila + 1) * anchoFila);
+      int x = START_X + desde - fila * anchoFila;
+      int top = PADDING + fila * ALTO_FILA;
+      // Un pedazo más angosto que el margen no se ve
+      if (fin - desde > INNER_MARGIN) {
+        int drawY = top + INNER_MARGIN;
+        int drawHeight = DISK_BAR_HEIGHT - INNER_MARGIN;
+        // Los bloques internos de la extendida quedan bajo su encabezado
+        if (u.enExtendida) {
+          drawY = top + EXTENDED_HEADER_HEIGHT + INNER_MARGIN;
+          drawHeight = DISK_BAR_HEIGHT - EXTENDED_HEADER_HEIGHT - INNER_MARGIN;
+          if (extDesde[fila] < 0) extDesde[fila] = x;
+          extHasta[fila] = x + (fin - desde);
+        }
+        caja.rect = QRect(
+          x + INNER_MARGIN, drawY, fin - desde - INNER_MARGIN, drawHeight);
+        d.cajas.push_back(caja);
+        caja.continuacion = true;
+      }
+      desde = fin;
+    }
+  }
+
+  // Encabezado EXTENDIDA sobre los bloques internos, en cada fila
+  for (int f = 0; f < filas; ++f) {
+    if (extDesde[f] < 0 || extHasta[f] - extDesde[f] <= INNER_MARGIN) continue;
+    int top = PADDING + f * ALTO_FILA;
+    d.encabezadosExtendida.push_back(QRect(extDesde[f] + INNER_MARGIN,
+      top + INNER_MARGIN, extHasta[f] - extDesde[f] - INNER_MARGIN,
+      EXTENDED_HEADER_HEIGHT - INNER_MARGIN));
+  }
+  return d;
+}
+
+QImage rasterizarReporte(const DisenoReporte& d) {
+  const QColor BORDER_COLOR(142, 173, 196);  // Azul claro
+
+  QImage image(d.ancho, d.alto, QImage::Format_ARGB32_Premultiplied);
+  image.fill(QColor(Qt::white));
+  QPainter painter;
+  painter.begin(&image);
+  painter.setRenderHint(QPainter::Antialiasing);
+  QFont font = painter.font();
+  font.setPointSize(8);
+  painter.setFont(font);
+
+  if (!d.leyenda.isEmpty()) {
+    painter.setPen(QPen(Qt::black));
+    painter.drawText(d.rectLeyenda, Qt::AlignLeft | Qt::AlignVCenter,
+      d.leyenda);
+  }
+  // Marco exterior del disco
+  painter.setPen(QPen(BORDER_COLOR, 1));
+  for (const QRect& marco : d.marcos) painter.drawRect(marco);
+
+  for (const CajaReporte& c : d.cajas) {
+    const QRect& r = c.rect;
+    painter.setPen(QPen(BORDER_COLOR, 1));
+    painter.setBrush(Qt::white);
+    painter.drawRect(r);
+    painter.setPen(QPen(Qt::black));
+    // Tipo (arriba) y porcentaje (abajo, si no es MBR o EBR), recortados a
+    // la caja para que el texto de una caja angosta no pise la siguiente
+    painter.setClipRect(r);
+    painter.drawText(r.x(), r.y() + r.height() / 3, r.width(), r.height() / 4,
+      Qt::AlignCenter | Qt::TextWordWrap, c.tipo);
+    if (!c.info.isEmpty())
+      painter.drawText(r.x(), r.y() + r.height() * 2 / 3, r.width(),
+        r.height() / 4, Qt::AlignCenter, c.info);
+    painter.setClipping(false);
+  }
+
+  for (const QRect& r : d.encabezadosExtendida) {
+    painter.setPen(QPen(BORDER_COLOR, 1));
+    painter.setBrush(Qt::white);
+    painter.drawRect(r);
+    painter.setPen(QPen(Qt::black));
+    painter.drawText(r, Qt::AlignCenter, "EXTENDIDA");
+  }
+  painter.end();
+  return image;
+}
+
+std::string escaparXml(const QString& s) {
+  std::string r;
+  for (char c : s.toStdString()) {
+    if (c == '<') r += "&lt;";
+    else if (c == '>') r += "&gt;";
+    else if (c == '&') r += "&amp;";
+    else if (c == '"') r += "&quot;";
+    else r += c;
+  }
+  return r;
+}
+
+std::string escaparJson(const QString& s) {
+  std::string r = "\"";
+  for (char c : s.toStdString()) {
+    if (c == '"' || c == '\\') {
+      r += '\\';
+      r += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+      r += esc;
+    } else r += c;
+  }
+  return r + "\"";
+}
+
+namespace {
+
+// Texto de un campo de un nodo record de Graphviz
+std::string escaparDot(const QString& s) {
+  std::string r;
+  for (char c : s.toStdString()) {
+    if (std::string("{}|<>\"\\ ").find(c) != std::string::npos) r += '\\';
+    r += c;
+  }
+  return r;
+}
+
+void escribirSvg(std::ostream& f, const DisenoReporte& d) {
+  const char* BORDE = "#8eadc4";  // Azul claro, igual que el PNG
+  auto rect = [&](const QRect& r) {
+    f << "<rect x=\"" << r.x() << "\" y=\"" << r.y() << "\" width=\""
+      << r.width() << "\" height=\"" << r.height()
+      << "\" fill=\"white\" stroke=\"" << BORDE << "\"/>";
+  };
+  auto texto = [&](int x, int y, const QString& t) {
+    f << "<text x=\"" << x << "\" y=\"" << y
+      << "\" text-anchor=\"middle\" dominant-baseline=\"middle\">"
+      << escaparXml(t) << "</text>";
+  };
+  f << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << d.ancho
+    << "\" height=\"" << d.alto
+    << "\" font-family=\"sans-serif\" font-size=\"11\">\n"
+    << "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n";
+  if (!d.leyenda.isEmpty())
+    f << "<text x=\"" << d.rectLeyenda.x() << "\" y=\""
+      << d.rectLeyenda.y() + d.rectLeyenda.height() / 2
+      << "\" dominant-baseline=\"middle\">" << escaparXml(d.leyenda)
+      << "</text>\n";
+  for (const QRect& marco : d.marcos) {
+    rect(marco);
+    f << "\n";
+  }
+  for (const CajaReporte& c : d.cajas) {
+    const QRect& r = c.rect;
+    int centro = r.x() + r.width() / 2;
+    f << "<g><title>" << escaparXml(c.nombre.isEmpty() ? c.tipo : c.nombre)
+      << " (" << c.inicio << ", " << c.tamano << " bytes)</title>";
+    rect(r);
+    texto(centro, r.y() + r.height() / 3 + r.height() / 8, c.tipo);
+    if (!c.info.isEmpty())
+      texto(centro, r.y() + r.height() * 2 / 3 + r.height() / 8, c.info);
+    f << "</g>\n";
+  }
+  for (const QRect& r : d.encabezadosExtendida) {
+    rect(r);
+    texto(r.x() + r.width() / 2, r.y() + r.height() / 2, "EXTENDIDA");
+    f << "\n";
+  }
+  f << "</svg>\n";
+}
+
+void escribirJson(
+  std::ostream& f, const InstantaneaDisco& inst, const DisenoReporte& d) {
+  f << "{\n  \"disco\": " << escaparJson(inst.path)
+    << ",\n  \"tamano\": " << inst.tamano
+    << ",\n  \"degradado\": " << (inst.degradado ? "true" : "false")
+    << ",\n  \"raid\": ";
+  if (inst.esRaid) {
+    const CabeceraRaid& c = inst.cabRaid;
+    f << "{\"nivel\": " << c.nivel << ", \"stripe\": " << c.stripe
+      << ", \"bytesPorFila\": " << inst.bytesPorFilaRaid
+      << ", \"tamLogico\": " << c.tamLogico
+      << ", \"distribucion\": " << escaparJson(distribucionRaid(c.nivel))
+      << ", \"epoca\": " << c.epoca << ", \"miembros\": [";
+    for (size_t i = 0; i < inst.miembrosRaid.size(); ++i) {
+      const EstadoMiembroRaid& m = inst.miembrosRaid[i];
+      f << (i ? ", " : "") << "\n    {\"indice\": " << i
+        << ", \"archivo\": "
+        << escaparJson(QFileInfo(rutaMiembro(inst.path, static_cast<int>(i)))
+                         .fileName())
+        << ", \"estado\": " << escaparJson(nombreEstadoMiembro(m.estado))
+        << ", \"epoca\": ";
+      if (m.epoca < 0) f << "null";
+      else f << m.epoca;
+      f << "}";
+    }
+    f << "]}";
+  } else f << "null";
+  f << ",\n  \"extendida\": ";
+  if (inst.extInicio != -1)
+    f << "{\"inicio\": " << inst.extInicio << ", \"fin\": " << inst.extFin
+      << "}";
+  else f << "null";
+  // Todos los bloques con sus valores exactos, aunque el dibujo los agrupe
+  f << ",\n  \"bloques\": [";
+  bool primero = true;
+  for (const PartitionInfo& b : inst.bloques) {
+    if (b.size <= 0) continue;
+    char porcentaje[32];
+    snprintf(porcentaje, sizeof(porcentaje), "%.6f",
+      inst.tamano > 0 ? 100.0 * b.size / inst.tamano : 0.0);
+    f << (primero ? "\n" : ",\n") << "    {\"tipo\": " << escaparJson(b.type)
+      << ", \"nombre\": " << escaparJson(b.name)
+      << ", \"inicio\": " << b.start << ", \"tamano\": " << b.size
+      << ", \"porcentaje\": " << porcentaje << "}";
+    primero = false;
+  }
+  // Las cajas del dibujo; primero y cantidad indexan el arreglo de bloques
+  // completo (incluidos los de tamaño 0, que no se listan arriba)
+  f << "\n  ],\n  \"ancho\": " << d.ancho << ",\n  \"alto\": " << d.alto
+    << ",\n  \"cajas\": [";
+  for (size_t i = 0; i < d.cajas.size(); ++i) {
+    const CajaReporte& c = d.cajas[i];
+    f << (i ? ",\n" : "\n") << "    {\"tipo\": " << escaparJson(c.tipo)
+      << ", \"primero\": " << c.primero << ", \"cantidad\": " << c.cantidad
+      << ", \"inicio\": " << c.inicio << ", \"tamano\": " << c.tamano
+      << ", \"enExtendida\": " << (c.enExtendida ? "true" : "false")
+      << ", \"continuacion\": " << (c.continuacion ? "true" : "false")
+      << ", \"x\": " << c.rect.x() << ", \"y\": " << c.rect.y()
+      << ", \"ancho\": " << c.rect.width()
+      << ", \"alto\": " << c.rect.height() << "}";
+  }
+  f << "\n  ]\n}\n";
+}
+
+// Un nodo record: los bloques de izquierda a derecha y los de la extendida
+// agrupados bajo su encabezado
+void escribirDot(
+  std::ostream& f, const InstantaneaDisco& inst, const DisenoReporte& d) {
+  f << "digraph disco {\n  node [shape=record, fontname=\"sans-serif\", "
+       "fontsize=10];\n  disco [label=\"{"
+    << escaparDot(QFileInfo(inst.path).fileName());
+  if (!d.leyenda.isEmpty()) f << "\\n" << escaparDot(d.leyenda);
+  f << "|{";
+  bool dentro = false;
+  bool primero = true;
+  for (const CajaReporte& c : d.cajas) {
+    // Las filas del dibujo no cuentan en el grafo: cada caja va una vez
+    if (c.continuacion) continue;
+    if (c.enExtendida && !dentro) {
+      f << (primero ? "" : "|") << "{EXTENDIDA|{";
+      dentro = true;
+    } else if (!c.enExtendida && dentro) {
+      f << "}}|";
+      dentro = false;
+    } else if (!primero) f << "|";
+    primero = false;
+    f << escaparDot(c.tipo);
+    if (!c.nombre.isEmpty() && c.nombre != c.tipo)
+      f << "\\n" << escaparDot(c.nombre);
+    if (!c.info.isEmpty()) f << "\\n" << escaparDot(c.info);
+  }
+  if (dentro) f << "}}";
+  f << "}}\"];\n}\n";
+}
+
+}  // namespace
+
+bool escribirReporte(const InstantaneaDisco& inst, const DisenoReporte& d,
+  FormatoReporte formato, const QString& destino) {
+  if (formato == FormatoReporte::PNG) {
+    QImage image = rasterizarReporte(d);
+    return !image.isNull() && image.save(destino, "PNG");
+  }
+  std::ofstream f(destino.toStdString(), std::ios::trunc);
+  if (!f) return false;
+  if (formato == FormatoReporte::SVG) escribirSvg(f, d);
+  else if (formato == FormatoReporte::JSON) escribirJson(f, inst, d);
+  else escribirDot(f, inst, d);
+  f.flush();
+  return f.good();
+}
+
+namespace {
+
+struct InstantaneaGuardada {
+  unsigned long long generacion;
+  InstantaneaDisco inst;
+};
+
+std::mutex mutexInstantaneas;
+std::unordered_map<QString, InstantaneaGuardada> instantaneas;
+
+QString dirReportes(const QString& path) {
+  return path + ".reportes";
+}
+
+// Cambia solo si cambia algo de lo que se dibuja o se escribe
+uint64_t firmaReporte(
+  const InstantaneaDisco& inst, const OpcionesReporte& opciones) {
+  std::string datos = inst.path.toStdString();
+  auto agregar = [&](long v) {
+    datos.append(reinterpret_cast<const char*>(&v), sizeof(v));
+  };
+  agregar(opciones.ancho);
+  agregar(opciones.filas);
+  agregar(inst.tamano);
+  agregar(inst.extInicio);
+  agregar(inst.extFin);
+  agregar(inst.degradado ? 1 : 0);
+  datos += inst.leyendaRaid.toStdString();
+  for (const EstadoMiembroRaid& m : inst.miembrosRaid) {
+    agregar(m.estado);
+    agregar(m.epoca);
+  }
+  for (const PartitionInfo& b : inst.bloques) {
+    agregar(b.start);
+    agregar(b.size);
+    datos += '\0' + b.type.toStdString() + '\0' + b.name.toStdString();
+  }
+  return hash64(datos.data(), datos.size());
+}
+
+// Deja en destino el archivo guardado: un enlace duro si se puede, una copia
+// si no (otro sistema de archivos). El destino se borra antes, así nunca se
+// escribe a través de un enlace que comparta datos con la caché.
+bool publicar(const QString& guardado, const QString& destino) {
+  QFile::remove(destino);
+  if (link(guardado.toStdString().c_str(), destino.toStdString().c_str()) == 0)
+    return true;
+  return QFile::copy(guardado, destino);
+}
+
+}  // namespace
+
+QString instantaneaEnCache(const QString& path, InstantaneaDisco& inst) {
+  unsigned long long generacion = generacionDisco(path);
+  {
+    std::lock_guard<std::mutex> lock(mutexInstantaneas);
+    auto it = instantaneas.find(path);
+    if (it != instantaneas.end() && it->second.generacion == generacion) {
+      inst = it->second.inst;
+      return QString();
+    }
+  }
+  BloqueoDisco bloqueo(path, BloqueoDisco::COMPARTIDO);
+  if (!bloqueo.tomado()) return bloqueo.error() + "\n";
+  QString error = tomarInstantanea(path, inst);
+  if (!error.isEmpty()) return error;
+  std::lock_guard<std::mutex> lock(mutexInstantaneas);
+  instantaneas[path] = {generacion, inst};
+  return QString();
+}
+
+QString generarReporte(const InstantaneaDisco& inst,
+  const OpcionesReporte& opciones, const QString& destino, bool* desdeCache) {
+  if (desdeCache) *desdeCache = false;
+  QString dir = dirReportes(inst.path);
+  QString ext = extensionReporte(opciones.formato);
+  QString guardado = QString("%1/%2.%3")
+                       .arg(dir)
+                       .arg(firmaReporte(inst, opciones), 16, 16, QChar('0'))
+                       .arg(ext);
+  // Publicar y limpiar versiones viejas van bajo un cerrojo del directorio:
+  // otro rep del mismo disco (de este u otro proceso) borraría el guardado
+  // entre que se comprueba y se enlaza
+  bool enCache = QDir().mkpath(dir);
+  QString cerrojo = dir + "/publicar";
+  if (enCache) {
+    CerrojoArchivo publicando(cerrojo, true);
+    if (fileExists(guardado) && publicar(guardado, destino)) {
+      if (desdeCache) *desdeCache = true;
+      return "Reporte sin cambios (desde caché): " + destino + "\n";
+    }
+  }
+
+  // Se dibuja en la caché, fuera del cerrojo, y se publica desde ahí; el
+  // archivo temporal es propio del proceso y del hilo
+  size_t hilo = std::hash<std::thread::id>()(std::this_thread::get_id());
+  QString tmp =
+    QString("%1.%2.%3.tmp").arg(guardado).arg(getpid()).arg(hilo);
+  bool publicado = false;
+  if (enCache && escribirReporte(inst, disenarReporte(inst, opciones),
+                   opciones.formato, tmp)) {
+    CerrojoArchivo publicando(cerrojo, true);
+    if (rename(tmp.toStdString().c_str(), guardado.toStdString().c_str()) ==
+        0) {
+      // Solo se conserva la última versión de cada formato
+      for (const QString& viejo :
+           QDir(dir).entryList(QStringList{"*." + ext}, QDir::Files))
+        if (dir + "/" + viejo != guardado) QFile::remove(dir + "/" + viejo);
+      publicado = publicar(guardado, destino);
+    }
+  }
+  QFile::remove(tmp);
+  if (publicado) return "Reporte generado con éxito: " + destino + "\n";
+
+  // Sin caché, o si no se pudo publicar desde ella, se escribe directo
+  QFile::remove(destino);
+  if (!escribirReporte(
+        inst, disenarReporte(inst, opciones), opciones.formato, destino))
+    return "Error al intentar guardar el reporte " + destino + ".\n";
+  return "Reporte generado con éxito: " + destino + "\n";
+}
+
+void descartarReportes(const QString& path) {
+  {
+    std::lock_guard<std::mutex> lock(mutexInstantaneas);
+    instantaneas.erase(path);
+  }
+  QDir(dirReportes(path)).removeRecursively();
+}
+
+bool leerFormatoReporte(const QString& texto, FormatoReporte& formato) {
+  QString t = texto.toLower();
+  if (t == "png") formato = FormatoReporte::PNG;
+  else if (t == "svg") formato = FormatoReporte::SVG;
+  else if (t == "json") formato = FormatoReporte::JSON;
+  else if (t == "dot") formato = FormatoReporte::DOT;
+  else return false;
+  return true;
+}
+
+FormatoReporte formatoPorExtension(const QString& path) {
+  FormatoReporte formato = FormatoReporte::PNG;
+  leerFormatoReporte(QFileInfo(path).suffix(), formato);
+  return formato;
+}
+
+QString extensionReporte(FormatoReporte formato) {
+  switch (formato) {
+    case FormatoReporte::SVG: return "svg";
+    case FormatoReporte::JSON: return "json";
+    case FormatoReporte::DOT: return "dot";
+    default: return "png";
+  }
+}
+
+void generarReportesEnLote(std::vector<PedidoReporte>& pedidos,
+  const OpcionesReporte& opciones, unsigned hilos) {
+  std::map<QString, std::vector<PedidoReporte*>> porDisco;
+  for (PedidoReporte& p : pedidos) porDisco[p.disco].push_back(&p);
+  std::vector<std::vector<PedidoReporte*>*> grupos;
+  for (auto& par : porDisco) grupos.push_back(&par.second);
+
+  ejecutarEnParalelo(grupos.size(), hilos, [&](size_t i) {
+    std::vector<PedidoReporte*>& grupo = *grupos[i];
+    QElapsedTimer reloj;
+    reloj.start();
+    InstantaneaDisco inst;
+    QString error =
+      instantaneaEnCache(grupo.front()->disco, inst).trimmed();
+    if (!error.isEmpty()) {
+      for (PedidoReporte* p : grupo) p->error = error;
+      return;
+    }
+    // El dibujo es del disco completo: el primero lo genera (o lo encuentra
+    // en la caché) y los demás lo toman de ahí
+    qint64 lectura = reloj.elapsed();
+    for (PedidoReporte* p : grupo) {
+      QElapsedTimer propio;
+      propio.start();
+      p->degradado = inst.degradado;
+      QString mensaje =
+        generarReporte(inst, opciones, p->destino, &p->desdeCache);
+      if (mensaje.startsWith("Error"))
+        p->error = "no se pudo guardar " + p->destino;
+      p->ms = propio.elapsed() + (p == grupo.front() ? lectura : 0);
+    }
+  });
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QtGlobal>
+#include <string>
+#include <vector>
+
+#include "raid.h"
+
+struct PartitionInfo {  // para el reporte
+  QString name;         // "MBR", "LIBRE", "PRIMARIA", etc.
+  int start;
+  int size;
+  QString type;
+};
+
+// rep se arma en tres fases para que solo la primera toque el disco y el
+// dibujo pueda correr fuera del hilo de la interfaz:
+//   1. tomarInstantanea: copia la tabla de particiones, bajo el bloqueo
+//      compartido del disco.
+//   2. disenarReporte: calcula la posición de cada caja a partir de la copia.
+//      El ancho de cada caja es proporcional a su tamaño, con un mínimo
+//      legible; los bloques muy chicos y seguidos se juntan en una caja
+//      "N particiones", así la cantidad de cajas (y el tamaño de la imagen)
+//      no depende de cuántas particiones tenga el disco.
+//   3. rasterizarReporte: pinta el diseño en un QImage (no en un QPixmap,
+//      que solo puede usarse en el hilo de la interfaz).
+
+// Fase 1: todo lo que el reporte necesita del disco
+struct InstantaneaDisco {
+  QString path;
+  int tamano = 0;  // El que indica el MBR
+  std::vector<PartitionInfo> bloques;
+  long extInicio = -1;  // Rango de la extendida; -1 si no hay
+  long extFin = -1;
+  // Solo en conjuntos creados con -raid=: la cabecera (con la época del
+  // conjunto), el estado de cada miembro y la leyenda que se dibuja
+  bool esRaid = false;
+  CabeceraRaid cabRaid{};
+  long bytesPorFilaRaid = 0;
+  std::vector<EstadoMiembroRaid> miembrosRaid;
+  QString leyendaRaid;
+  bool degradado = false;
+  QString aviso;
+};
+
+// Fase 2: cajas en píxeles, en el orden en que se dibujan
+struct CajaReporte {
+  QRect rect;
+  QString tipo;  // Texto de arriba
+  QString info;  // Porcentaje del disco; vacío en MBR y EBR
+  // Bloques del disco que representa: bloques[primero, primero + cantidad)
+  QString nombre;  // Vacío si junta varios bloques
+  int primero = 0;
+  int cantidad = 1;
+  long inicio = 0;
+  long tamano = 0;
+  bool enExtendida = false;  // Dibujada bajo el encabezado EXTENDIDA
+  bool continuacion = false;  // Resto de una caja partida entre dos filas
+};
+
+struct DisenoReporte {
+  int ancho = 0;
+  int alto = 0;
+  std::vector<QRect> marcos;  // Contorno del disco, uno por fila
+  QString leyenda;
+  QRect rectLeyenda;
+  std::vector<QRect> encabezadosExtendida;  // Uno por fila que la cruce
+  std::vector<CajaReporte> cajas;
+};
+
+enum class FormatoReporte { PNG, SVG, JSON, DOT };
+
+struct OpcionesReporte {
+  static constexpr int ANCHO_MINIMO = 400;
+  static constexpr int ANCHO_MAXIMO = 4000;
+  static constexpr int FILAS_MAXIMAS = 16;
+
+  FormatoReporte formato = FormatoReporte::PNG;
+  int ancho = 1000;  // Ancho de la imagen en píxeles
+  int filas = 1;     // Filas en las que se parte la barra del disco
+};
+
+// Lee el disco (el llamador tiene el bloqueo). Devuelve el error listo para
+// mostrar o vacío.
+QString tomarInstantanea(const QString& path, InstantaneaDisco& inst);
+DisenoReporte disenarReporte(
+  const InstantaneaDisco& inst, const OpcionesReporte& opciones);
+QImage rasterizarReporte(const DisenoReporte& diseno);
+// Guarda el diseño en destino. PNG pasa por rasterizarReporte; SVG, JSON y
+// DOT se escriben caja por caja directo al archivo, sin imagen intermedia.
+// JSON lleva además el inicio y el tamaño exactos de cada bloque, aunque en
+// el dibujo esté agrupado.
+bool escribirReporte(const InstantaneaDisco& inst, const DisenoReporte& diseno,
+  FormatoReporte formato, const QString& destino);
+
+// Caché de rep. En memoria queda la última instantánea de cada disco con su
+// generación, así un disco sin cambios no se vuelve a leer. En disco, junto
+// a la imagen (X.disk.reportes/), queda la salida ya codificada de cada
+// formato, con nombre según la firma de la instantánea: si el disco cambió
+// pero su tabla de particiones no, el reporte se sirve desde ahí sin volver
+// a dibujarlo.
+
+// Instantánea del disco, leída bajo su bloqueo compartido solo si cambió su
+// generación desde la última vez. Devuelve el error listo para mostrar.
+QString instantaneaEnCache(const QString& path, InstantaneaDisco& inst);
+// Fases 2 y 3 más la codificación, o el archivo guardado si ya existe para
+// la misma tabla y opciones: se enlaza (o copia) en destino. Seguro en
+// cualquier hilo. Devuelve el mensaje final del comando.
+QString generarReporte(const InstantaneaDisco& inst,
+  const OpcionesReporte& opciones, const QString& destino,
+  bool* desdeCache = nullptr);
+// Olvida los reportes guardados del disco (al borrarlo o reemplazarlo)
+void descartarReportes(const QString& path);
+
+// "png", "svg", "json" o "dot", sin distinguir mayúsculas
+bool leerFormatoReporte(const QString& texto, FormatoReporte& formato);
+// Formato que corresponde a la extensión del archivo; PNG si no se conoce
+FormatoReporte formatoPorExtension(const QString& path);
+QString extensionReporte(FormatoReporte formato);
+// Texto listo para un atributo SVG y cadena JSON con sus comillas
+std::string escaparXml(const QString& s);
+std::string escaparJson(const QString& s);
+
+// Un reporte de rep -all: id montado, disco y archivo de salida. Al terminar
+// el lote quedan el error (vacío si se generó) y lo que tardó.
+struct PedidoReporte {
+  QString id;
+  QString disco;
+  QString destino;
+  QString error;
+  bool degradado = false;
+  bool desdeCache = false;
+  qint64 ms = 0;
+};
+
+// Agrupa los pedidos por disco: cada disco se lee a lo sumo una vez bajo su
+// bloqueo compartido y se dibuja y codifica a lo sumo una vez; las demás
+// particiones del mismo disco salen de la caché. Los discos se reparten
+// entre hilos.
+void generarReportesEnLote(std::vector<PedidoReporte>& pedidos,
+  const OpcionesReporte& opciones, unsigned hilos);
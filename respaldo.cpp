@@ -0,0 +1,249 @@
+#include "respaldo.h"
+
+#include <QStringList>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "discoio.h"
+#include "hash64.h"
+#include "raid.h"
+#include "simd.h"
+#include "snapshot.h"
+
+namespace {
+
+const char MAGIC_RESPALDO[8] = {'P', '2', 'E', 'X', 'P', 'O', 'R', 'T'};
+const long TAM_TROZO = 1L << 20;    // Datos por registro
+const long TAM_BLOQUE = 64L * 1024;  // Bloques en ceros -> huecos
+
+// Lectura/escritura secuencial completa (funciona también con pipes)
+bool escribirFlujo(int fd, const void* buf, long n) {
+  const char* p = static_cast<const char*>(buf);
+  while (n > 0) {
+    ssize_t w = write(fd, p, static_cast<size_t>(n));
+    if (w < 0 && errno == EINTR) continue;
+    if (w <= 0) return false;
+    p += w;
+    n -= w;
+  }
+  return true;
+}
+
+bool leerFlujo(int fd, void* buf, long n) {
+  char* p = static_cast<char*>(buf);
+  while (n > 0) {
+    ssize_t r = read(fd, p, static_cast<size_t>(n));
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+bool bloqueEnCeros(const char* datos, long n) {
+  return esCero(datos, static_cast<size_t>(n));
+}
+
+bool escribirRegistro(
+  int fd, int tipo, long pos, long len, unsigned long long suma = 0) {
+  RegistroRespaldo r{tipo, 0, pos, len, suma};
+  return escribirFlujo(fd, &r, sizeof(r));
+}
+
+// Recorre el archivo por sus extensiones con datos. Lo que cae fuera de ellas
+// y los bloques de 64 KiB en ceros dentro de ellas se registran como huecos.
+QString exportarArchivo(
+  int salida, const QString& ruta, int rol, EstadisticasRespaldo& est) {
+  int fd = open(ruta.toStdString().c_str(), O_RDONLY);
+  if (fd < 0) return "No se pudo abrir " + ruta + ".";
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return "No se pudo leer el tamaño de " + ruta + ".";
+  }
+  long tam = static_cast<long>(st.st_size);
+  CabeceraArchivoRespaldo cab{rol, 0, tam};
+  bool ok = escribirFlujo(salida, &cab, sizeof(cab));
+
+  long inicioHueco = 0;  // Hueco pendiente: [inicioHueco, pos)
+  auto cerrarHueco = [&](long hasta) {
+    if (hasta > inicioHueco) {
+      ok = ok && escribirRegistro(salida, HUECO, inicioHueco,
+                   hasta - inicioHueco);
+      est.bytesHuecos += hasta - inicioHueco;
+    }
+  };
+  std::vector<char> buf(TAM_TROZO);
+  for (const Extension& e : extensionesDeDatos(fd, tam)) {
+    for (long p = e.inicio; ok && p < e.inicio + e.tam; p += TAM_TROZO) {
+      long n = std::min(TAM_TROZO, e.inicio + e.tam - p);
+      if (!leerCompleto(fd, p, buf.data(), n)) {
+        close(fd);
+        return "Error al leer " + ruta + ".";
+      }
+      // Separar el trozo en tramos de datos y de ceros
+      for (long b = 0; ok && b < n;) {
+        long fin = b;
+        bool ceros = bloqueEnCeros(buf.data() + b, std::min(TAM_BLOQUE, n - b));
+        while (fin < n && bloqueEnCeros(buf.data() + fin,
+                            std::min(TAM_BLOQUE, n - fin)) == ceros)
+          fin += std::min(TAM_BLOQUE, n - fin);
+        if (!ceros) {
+          cerrarHueco(p + b);
+          const char* datos = buf.data() + b;
+          ok = ok &&
+               escribirRegistro(salida, DATOS, p + b, fin - b,
+                 hash64(datos, static_cast<size_t>(fin - b))) &&
+               escribirFlujo(salida, datos, fin - b);
+          est.bytesDatos += fin - b;
+          inicioHueco = p + fin;
+        }
+        b = fin;
+      }
+    }
+  }
+  close(fd);
+  cerrarHueco(tam);
+  ok = ok && escribirRegistro(salida, FIN_ARCHIVO, tam, 0);
+  est.archivos++;
+  return ok ? QString() : "Error al escribir el respaldo.";
+}
+
+}  // namespace
+
+QString exportarDisco(const QString& path, const QString& destino,
+  bool unaReplica, EstadisticasRespaldo& est) {
+  if (unaReplica && esConjuntoRaid(path))
+    return "Un conjunto RAID necesita todos sus miembros en el respaldo.";
+  QStringList archivos = archivosDeDisco(path);
+  if (unaReplica) archivos = QStringList() << path;
+  for (const QString& a : archivos)
+    if (tieneCapas(a))
+      return a + " tiene snapshots con capas delta; bórrelos antes.";
+
+  int salida = open(destino.toStdString().c_str(),
+    O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (salida < 0) return "No se pudo crear " + destino + ".";
+  // El destino puede ser un FIFO o un dispositivo (export a un pipe o a
+  // /dev/stdout): ahí no se sincroniza ni se borra si algo falla
+  struct stat st;
+  bool regular = fstat(salida, &st) == 0 && S_ISREG(st.st_mode);
+  CabeceraRespaldo cab;
+  memset(&cab, 0, sizeof(cab));
+  memcpy(cab.magic, MAGIC_RESPALDO, sizeof(MAGIC_RESPALDO));
+  cab.version = 1;
+  cab.archivos = archivos.size();
+  cab.unaReplica = unaReplica ? 1 : 0;
+  QString error;
+  if (!escribirFlujo(salida, &cab, sizeof(cab)))
+    error = "Error al escribir el respaldo.";
+  for (int i = 0; i < archivos.size() && error.isEmpty(); ++i)
+    error = exportarArchivo(salida, archivos[i], i, est);
+  if (error.isEmpty() && (!escribirRegistro(salida, FIN_RESPALDO, 0, 0) ||
+                           (regular && fdatasync(salida) != 0)))
+    error = "Error al escribir el respaldo.";
+  close(salida);
+  if (!error.isEmpty() && regular) unlink(destino.toStdString().c_str());
+  return error;
+}
+
+QString importarDisco(
+  const QString& origen, const QString& path, EstadisticasRespaldo& est) {
+  int entrada = open(origen.toStdString().c_str(), O_RDONLY);
+  if (entrada < 0) return "No se pudo abrir " + origen + ".";
+  CabeceraRespaldo cab;
+  if (!leerFlujo(entrada, &cab, sizeof(cab)) ||
+      memcmp(cab.magic, MAGIC_RESPALDO, sizeof(MAGIC_RESPALDO)) != 0 ||
+      cab.version != 1 || cab.archivos < 1) {
+    close(entrada);
+    return origen + " no es un respaldo válido.";
+  }
+
+  QStringList creados;
+  std::vector<char> buf(TAM_TROZO);
+  QString error;
+  for (int i = 0; i < cab.archivos && error.isEmpty(); ++i) {
+    CabeceraArchivoRespaldo arch;
+    if (!leerFlujo(entrada, &arch, sizeof(arch)) || arch.rol < 0 ||
+        arch.tam < 0) {
+      error = "Respaldo truncado o dañado.";
+      break;
+    }
+    // Con una sola réplica cada registro se escribe también en el espejo
+    QStringList rutas;
+    rutas << rutaMiembro(path, arch.rol);
+    if (cab.unaReplica) rutas << rutaRaid(path);
+    std::vector<int> fds;
+    for (const QString& r : rutas) {
+      if (fileExists(r)) {
+        error = "Ya existe " + r + ".";
+        break;
+      }
+      descartarSnapshots(r);
+      int fd = open(r.toStdString().c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+      if (fd < 0 || ftruncate(fd, static_cast<off_t>(arch.tam)) != 0) {
+        if (fd >= 0) close(fd);
+        error = "No se pudo crear " + r + ".";
+        break;
+      }
+      creados << r;
+      fds.push_back(fd);
+    }
+    while (error.isEmpty()) {
+      RegistroRespaldo reg;
+      if (!leerFlujo(entrada, &reg, sizeof(reg))) {
+        error = "Respaldo truncado o dañado.";
+        break;
+      }
+      if (reg.tipo == FIN_ARCHIVO) break;
+      if (reg.pos < 0 || reg.len < 0 || reg.pos + reg.len > arch.tam ||
+          (reg.tipo != DATOS && reg.tipo != HUECO) ||
+          (reg.tipo == DATOS && reg.len > TAM_TROZO)) {
+        error = "Registro inválido en el respaldo.";
+        break;
+      }
+      // Los huecos ya están en ceros: el archivo se creó disperso
+      if (reg.tipo == HUECO) {
+        est.bytesHuecos += reg.len;
+        continue;
+      }
+      if (!leerFlujo(entrada, buf.data(), reg.len)) {
+        error = "Respaldo truncado o dañado.";
+        break;
+      }
+      if (hash64(buf.data(), static_cast<size_t>(reg.len)) != reg.suma) {
+        error = QString("Checksum incorrecto en el byte %1 de %2.")
+                  .arg(reg.pos)
+                  .arg(rutas[0]);
+        break;
+      }
+      for (int fd : fds)
+        if (!escribirCompleto(fd, reg.pos, buf.data(), reg.len)) {
+          error = "Error al escribir " + rutas[0] + ".";
+          break;
+        }
+      est.bytesDatos += reg.len;
+    }
+    for (int fd : fds) {
+      if (error.isEmpty() && fdatasync(fd) != 0)
+        error = "Error al escribir " + rutas[0] + ".";
+      close(fd);
+    }
+    if (error.isEmpty()) est.archivos++;
+  }
+  RegistroRespaldo fin;
+  if (error.isEmpty() &&
+      (!leerFlujo(entrada, &fin, sizeof(fin)) || fin.tipo != FIN_RESPALDO))
+    error = "Respaldo truncado o dañado.";
+  close(entrada);
+  // Un import a medias no deja discos incompletos
+  if (!error.isEmpty())
+    for (const QString& r : creados) unlink(r.toStdString().c_str());
+  return error;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <QString>
+
+// Archivo de respaldo en flujo (export/import). Se escribe y se lee de forma
+// secuencial, así puede ir por un pipe:
+//   [CabeceraRespaldo]
+//   por cada archivo: [CabeceraArchivoRespaldo] [registros...] [FIN_ARCHIVO]
+//   [FIN_RESPALDO]
+// Cada registro describe un rango del archivo: DATOS va seguido de los bytes
+// y su hash64; HUECO solo indica que el rango está en ceros.
+struct CabeceraRespaldo {
+  char magic[8];   // "P2EXPORT"
+  int version;     // 1
+  int archivos;    // cantidad de archivos incluidos
+  int unaReplica;  // 1 si se omitió el espejo (se rehace al importar)
+  int reservado;
+};
+
+struct CabeceraArchivoRespaldo {
+  int rol;  // 0 = X.disk, 1 = X_raid.disk, i >= 2 = miembro i del conjunto
+  int reservado;
+  long long tam;
+};
+
+enum TipoRegistro { DATOS = 1, HUECO = 2, FIN_ARCHIVO = 3, FIN_RESPALDO = 4 };
+
+struct RegistroRespaldo {
+  int tipo;
+  int reservado;
+  long long pos;
+  long long len;
+  unsigned long long suma;  // hash64 de los datos (solo en DATOS)
+};
+
+struct EstadisticasRespaldo {
+  int archivos = 0;
+  long long bytesDatos = 0;   // bytes copiados
+  long long bytesHuecos = 0;  // bytes registrados como huecos
+};
+
+// Escribe el respaldo del disco en destino. Con unaReplica solo se guarda
+// X.disk (no aplica a conjuntos con cabecera RAID). Devuelve el error o
+// cadena vacía.
+QString exportarDisco(const QString& path, const QString& destino,
+  bool unaReplica, EstadisticasRespaldo& est);
+// Recrea el disco (y su espejo o miembros) en path desde el respaldo. Los
+// archivos se crean dispersos y solo se escriben los rangos con datos.
+QString importarDisco(
+  const QString& origen, const QString& path, EstadisticasRespaldo& est);
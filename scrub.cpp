@@ -0,0 +1,304 @@
+#include "scrub.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "paralelo.h"
+#include "raid.h"
+#include "simd.h"
+
+namespace {
+
+const long TAM_TROZO = 4L * 1024 * 1024;  // Lectura por tarea
+const long TAM_PAGINA = 4096;             // Granularidad de los rangos
+
+QString describirParticion(const Partition& p) {
+  if (p.status != 1) return "libre";
+  return QString("'%1' tipo %2 inicio %3 tamaño %4 fit %5")
+    .arg(QString::fromLatin1(p.name, strnlen(p.name, sizeof(p.name))))
+    .arg(QChar(p.type))
+    .arg(p.start)
+    .arg(p.size)
+    .arg(QChar(p.fit));
+}
+
+QString describirEBR(const EBR& e) {
+  return QString("'%1' inicio %2 tamaño %3 next %4")
+    .arg(QString::fromLatin1(e.name, strnlen(e.name, sizeof(e.name))))
+    .arg(e.start)
+    .arg(e.size)
+    .arg(e.next);
+}
+
+bool mismaParticion(const Partition& a, const Partition& b) {
+  if (a.status != b.status) return false;
+  if (a.status != 1) return true;  // Slots libres: el resto no importa
+  return a.type == b.type && a.fit == b.fit && a.start == b.start &&
+         a.size == b.size && strncmp(a.name, b.name, sizeof(a.name)) == 0;
+}
+
+bool mismoEBR(const EBR& a, const EBR& b) {
+  return a.status == b.status && a.fit == b.fit && a.start == b.start &&
+         a.size == b.size && a.next == b.next &&
+         strncmp(a.name, b.name, sizeof(a.name)) == 0;
+}
+
+// Compara MBR y cadena de EBRs de ambas réplicas y describe las diferencias
+QStringList compararMetadatos(const QString& principal, const QString& raid) {
+  QStringList difs;
+  auto fp = ArchivoDisco::abrir(principal, false);
+  auto fr = ArchivoDisco::abrir(raid, false);
+  MBR mp, mr;
+  if (!fp || !readMBR(*fp, mp)) difs << "No se pudo leer el MBR principal.";
+  if (!fr || !readMBR(*fr, mr)) difs << "No se pudo leer el MBR del RAID.";
+  if (!difs.isEmpty()) return difs;
+
+  if (mp.size != mr.size)
+    difs << QString("MBR: tamaño %1 vs %2").arg(mp.size).arg(mr.size);
+  if (mp.fit != mr.fit)
+    difs << QString("MBR: fit %1 vs %2").arg(QChar(mp.fit)).arg(QChar(mr.fit));
+  for (int i = 0; i < 4; ++i) {
+    if (!mismaParticion(mp.parts[i], mr.parts[i]))
+      difs << QString("Slot %1: %2 vs %3")
+                .arg(i + 1)
+                .arg(describirParticion(mp.parts[i]))
+                .arg(describirParticion(mr.parts[i]));
+  }
+
+  Partition extP, extR;
+  bool hayP = obtenerExtendida(mp, extP);
+  bool hayR = obtenerExtendida(mr, extR);
+  if (!hayP || !hayR) return difs;  // Ya reportado en los slots
+  std::map<long, EBR> ebrsP, ebrsR;
+  for (const auto& [ebr, pos] : leerEBRsConPos(*fp, extP)) ebrsP[pos] = ebr;
+  for (const auto& [ebr, pos] : leerEBRsConPos(*fr, extR)) ebrsR[pos] = ebr;
+  for (const auto& [pos, ebr] : ebrsP) {
+    auto it = ebrsR.find(pos);
+    if (it == ebrsR.end())
+      difs << QString("EBR en %1: %2 solo en principal")
+                .arg(pos)
+                .arg(describirEBR(ebr));
+    else if (!mismoEBR(ebr, it->second))
+      difs << QString("EBR en %1: %2 vs %3")
+                .arg(pos)
+                .arg(describirEBR(ebr))
+                .arg(describirEBR(it->second));
+  }
+  for (const auto& [pos, ebr] : ebrsR)
+    if (!ebrsP.count(pos))
+      difs << QString("EBR en %1: %2 solo en RAID")
+                .arg(pos)
+                .arg(describirEBR(ebr));
+  return difs;
+}
+
+// Busca los rangos distintos dentro de un trozo ya leído de ambas réplicas.
+// Por cada página con diferencias se guarda desde el primer hasta el último
+// byte distinto.
+void buscarDiferencias(const char* a, const char* b, long base, long n,
+  std::vector<Extension>& rangos) {
+  for (long off = 0; off < n; off += TAM_PAGINA) {
+    long len = std::min(TAM_PAGINA, n - off);
+    size_t d = primerDiferente(a + off, b + off, static_cast<size_t>(len));
+    if (static_cast<long>(d) == len) continue;
+    long ultimo = len - 1;
+    while (a[off + ultimo] == b[off + ultimo]) --ultimo;
+    rangos.push_back({base + off + static_cast<long>(d),
+      ultimo - static_cast<long>(d) + 1});
+  }
+}
+
+// Fusiona rangos separados por menos de una página para que el reporte sea
+// legible; copiar unos bytes iguales de más al reparar no afecta.
+std::vector<Extension> fusionarRangos(const std::vector<Extension>& rangos) {
+  std::vector<Extension> fusion;
+  for (const auto& r : rangos) {
+    if (!fusion.empty()) {
+      long finPrev = fusion.back().inicio + fusion.back().tam;
+      if (r.inicio - finPrev < TAM_PAGINA) {
+        fusion.back().tam = r.inicio + r.tam - fusion.back().inicio;
+        continue;
+      }
+    }
+    fusion.push_back(r);
+  }
+  return fusion;
+}
+
+bool copiarRango(int origen, int destino, long inicio, long tam) {
+  std::vector<char> buf(static_cast<size_t>(std::min(tam, TAM_TROZO)));
+  while (tam > 0) {
+    long n = std::min(tam, TAM_TROZO);
+    if (!leerCompleto(origen, inicio, buf.data(), n)) return false;
+    if (!escribirCompleto(destino, inicio, buf.data(), n)) return false;
+    inicio += n;
+    tam -= n;
+  }
+  return true;
+}
+
+}  // namespace
+
+ResultadoScrub scrubDisco(
+  const QString& principal, const QString& raid, FuenteReparacion fuente) {
+  ResultadoScrub res;
+  auto t0 = std::chrono::steady_clock::now();
+
+  int flagsP = (fuente == FuenteReparacion::Raid) ? O_RDWR : O_RDONLY;
+  int flagsR = (fuente == FuenteReparacion::Principal) ? O_RDWR : O_RDONLY;
+  int fdP = open(principal.toStdString().c_str(), flagsP);
+  if (fdP < 0) {
+    res.error = "No se pudo abrir el disco principal.";
+    return res;
+  }
+  int fdR = open(raid.toStdString().c_str(), flagsR);
+  if (fdR < 0) {
+    close(fdP);
+    res.error = "No se pudo abrir el disco RAID.";
+    return res;
+  }
+  struct stat stP, stR;
+  if (fstat(fdP, &stP) != 0 || fstat(fdR, &stR) != 0) {
+    close(fdP);
+    close(fdR);
+    res.error = "No se pudo leer el tamaño de las réplicas.";
+    return res;
+  }
+  res.tamPrincipal = static_cast<long>(stP.st_size);
+  res.tamRaid = static_cast<long>(stR.st_size);
+  long tamComun = std::min(res.tamPrincipal, res.tamRaid);
+
+  res.metadatos = compararMetadatos(principal, raid);
+
+  // Zonas a comparar: donde al menos una réplica tiene datos
+  auto extensiones = unirExtensiones(
+    extensionesDeDatos(fdP, tamComun), extensionesDeDatos(fdR, tamComun));
+  std::vector<Extension> trozos;
+  for (const auto& e : extensiones) {
+    for (long off = 0; off < e.tam; off += TAM_TROZO)
+      trozos.push_back({e.inicio + off, std::min(TAM_TROZO, e.tam - off)});
+    res.bytesComparados += e.tam;
+  }
+  res.bytesOmitidos = tamComun - res.bytesComparados;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fdP, 0, 0, POSIX_FADV_SEQUENTIAL);
+  posix_fadvise(fdR, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  res.hilos = hilosDeTrabajo();
+  std::vector<std::vector<Extension>> porTrozo(trozos.size());
+  std::atomic<bool> errorLectura{false};
+  ejecutarEnParalelo(trozos.size(), res.hilos, [&](size_t i) {
+    thread_local std::vector<char> bufP, bufR;
+    bufP.resize(TAM_TROZO);
+    bufR.resize(TAM_TROZO);
+    const Extension& t = trozos[i];
+    if (!leerCompleto(fdP, t.inicio, bufP.data(), t.tam) ||
+        !leerCompleto(fdR, t.inicio, bufR.data(), t.tam)) {
+      errorLectura = true;
+      return;
+    }
+    buscarDiferencias(bufP.data(), bufR.data(), t.inicio, t.tam, porTrozo[i]);
+  });
+  if (errorLectura) res.error = "Error de lectura durante el scrub.";
+
+  std::vector<Extension> rangos;
+  for (const auto& v : porTrozo)
+    rangos.insert(rangos.end(), v.begin(), v.end());
+  res.diferencias = fusionarRangos(rangos);
+
+  // Reparación: la réplica fuente sobrescribe los rangos distintos
+  if (fuente != FuenteReparacion::Ninguna && res.error.isEmpty()) {
+    bool desdePrincipal = (fuente == FuenteReparacion::Principal);
+    int origen = desdePrincipal ? fdP : fdR;
+    int destino = desdePrincipal ? fdR : fdP;
+    long tamOrigen = desdePrincipal ? res.tamPrincipal : res.tamRaid;
+    long tamDestino = desdePrincipal ? res.tamRaid : res.tamPrincipal;
+    std::vector<Extension> aCopiar = res.diferencias;
+    if (tamOrigen != tamDestino) {
+      if (ftruncate(destino, tamOrigen) != 0)
+        res.error = "No se pudo ajustar el tamaño de la réplica destino.";
+      // La cola que solo existe en la fuente se copia tal cual
+      for (const auto& e : extensionesDeDatos(origen, tamOrigen))
+        if (e.inicio + e.tam > tamComun) {
+          long ini = std::max(e.inicio, tamComun);
+          aCopiar.push_back({ini, e.inicio + e.tam - ini});
+        }
+    }
+    for (const auto& r : aCopiar) {
+      if (!res.error.isEmpty()) break;
+      if (!copiarRango(origen, destino, r.inicio, r.tam))
+        res.error = "Error al copiar durante la reparación.";
+      else res.bytesReparados += r.tam;
+    }
+    // Si no llegó al disco no se informa como reparado
+    if (fsync(destino) != 0 && res.error.isEmpty())
+      res.error = "No se pudo sincronizar la réplica reparada.";
+  }
+  close(fdP);
+  close(fdR);
+  res.segundos = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - t0)
+                   .count();
+  return res;
+}
+
+ResultadoScrub scrubRaid(const QString& path, bool reparar) {
+  ResultadoScrub res;
+  auto t0 = std::chrono::steady_clock::now();
+  QString aviso;
+  auto disco = DiscoRaid::abrir(path, reparar, aviso);
+  if (!aviso.isEmpty()) res.miembros = aviso.split("; ");
+  if (!disco) {
+    res.error = "No se pudo abrir el conjunto RAID.";
+    return res;
+  }
+  long tamLogico = static_cast<long>(disco->cabecera().tamLogico);
+  res.tamPrincipal = res.tamRaid = tamLogico;
+
+  // Cada tarea verifica filas consecutivas por unos TAM_TROZO bytes
+  long porFila = disco->bytesPorFila();
+  long filasPorTarea = std::max(1L, TAM_TROZO / porFila);
+  long filas = disco->filas();
+  size_t tareas = static_cast<size_t>(
+    (filas + filasPorTarea - 1) / filasPorTarea);
+  res.hilos = hilosDeTrabajo();
+  std::vector<std::vector<Extension>> porTarea(tareas);
+  std::atomic<bool> errorIO{false};
+  ejecutarEnParalelo(tareas, res.hilos, [&](size_t t) {
+    long desde = static_cast<long>(t) * filasPorTarea;
+    long hasta = std::min(filas, desde + filasPorTarea);
+    for (long f = desde; f < hasta && !errorIO; ++f) {
+      bool distinta = false;
+      if (!disco->verificarFila(f, reparar, distinta)) errorIO = true;
+      long inicio = f * porFila;
+      if (distinta && inicio < tamLogico)
+        porTarea[t].push_back(
+          {inicio, std::min(porFila, tamLogico - inicio)});
+    }
+  });
+  if (errorIO)
+    res.error = reparar ? "Error de lectura o escritura durante la "
+                          "resincronización."
+                        : "Error de lectura durante el scrub.";
+
+  std::vector<Extension> rangos;
+  for (const auto& v : porTarea)
+    rangos.insert(rangos.end(), v.begin(), v.end());
+  res.diferencias = fusionarRangos(rangos);
+  res.bytesComparados = res.error.isEmpty() ? tamLogico : 0;
+  if (reparar && res.error.isEmpty()) {
+    for (const auto& r : res.diferencias) res.bytesReparados += r.tam;
+    if (!disco->terminarResincronizacion())
+      res.error = "No se pudo actualizar la época de los miembros.";
+  }
+  res.segundos = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - t0)
+                   .count();
+  return res;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+#include "discoio.h"
+
+// Réplica que se toma como correcta al reparar
+enum class FuenteReparacion { Ninguna, Principal, Raid };
+
+struct ResultadoScrub {
+  QString error;  // vacío si el scrub pudo completarse
+  long tamPrincipal = 0;
+  long tamRaid = 0;
+  long bytesComparados = 0;
+  long bytesOmitidos = 0;  // huecos en ambas réplicas, no se leen
+  long bytesReparados = 0;
+  double segundos = 0;
+  unsigned hilos = 0;
+  std::vector<Extension> diferencias;  // rangos de bytes distintos
+  QStringList metadatos;               // diferencias en MBR/EBR
+  QStringList miembros;  // miembros ausentes o desactualizados (RAID)
+};
+
+// Compara byte a byte el disco principal contra su espejo. Lee ambas réplicas
+// en trozos grandes repartidos entre varios hilos y salta las zonas que son
+// hueco en las dos. Si se indica una fuente, copia sobre la otra réplica los
+// rangos distintos.
+ResultadoScrub scrubDisco(
+  const QString& principal, const QString& raid, FuenteReparacion fuente);
+
+// Resincroniza un conjunto creado con mkdisk -raid=: verifica fila por fila
+// las copias (niveles 1 y 10) o la paridad (nivel 5), incluyendo los
+// miembros desactualizados. Si se pide reparar, los reescribe desde los
+// miembros vigentes y al terminar les devuelve la época del conjunto. Las
+// diferencias se informan como rangos del disco lógico.
+ResultadoScrub scrubRaid(const QString& path, bool reparar);
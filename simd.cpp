@@ -0,0 +1,183 @@
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86 1
+#endif
+
+namespace {
+
+size_t primerDiferenteEscalar(
+  const char* a, const char* b, size_t desde, size_t n) {
+  for (size_t i = desde; i < n; ++i)
+    if (a[i] != b[i]) return i;
+  return n;
+}
+
+#ifdef SIMD_X86
+__attribute__((target("sse2"))) size_t primerDiferenteSSE2(
+  const char* a, const char* b, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    unsigned mask =
+      static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)));
+    if (mask != 0xFFFFu) return i + __builtin_ctz(~mask & 0xFFFFu);
+  }
+  return primerDiferenteEscalar(a, b, i, n);
+}
+
+__attribute__((target("avx2"))) size_t primerDiferenteAVX2(
+  const char* a, const char* b, size_t n) {
+  size_t i = 0;
+  // Camino rápido: 64 bytes por iteración, solo se comprueba si hay algún bit
+  // distinto; la posición exacta se busca después en bloques de 32.
+  for (; i + 64 <= n; i += 64) {
+    __m256i x0 = _mm256_xor_si256(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+    __m256i x1 = _mm256_xor_si256(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i + 32)),
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i + 32)));
+    __m256i o = _mm256_or_si256(x0, x1);
+    if (!_mm256_testz_si256(o, o)) break;
+  }
+  for (; i + 32 <= n; i += 32) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    unsigned mask =
+      static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+    if (mask != 0xFFFFFFFFu) return i + __builtin_ctz(~mask);
+  }
+  return primerDiferenteEscalar(a, b, i, n);
+}
+#endif
+
+void xorBloqueEscalar(char* dst, const char* src, size_t desde, size_t n) {
+  for (size_t i = desde; i < n; ++i) dst[i] ^= src[i];
+}
+
+#ifdef SIMD_X86
+__attribute__((target("sse2"))) void xorBloqueSSE2(
+  char* dst, const char* src, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(d, s));
+  }
+  xorBloqueEscalar(dst, src, i, n);
+}
+
+__attribute__((target("avx2"))) void xorBloqueAVX2(
+  char* dst, const char* src, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+    __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(
+      reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(d, s));
+  }
+  xorBloqueEscalar(dst, src, i, n);
+}
+#endif
+
+bool esCeroEscalar(const char* p, size_t desde, size_t n) {
+  for (size_t i = desde; i < n; ++i)
+    if (p[i] != 0) return false;
+  return true;
+}
+
+#ifdef SIMD_X86
+__attribute__((target("sse2"))) bool esCeroSSE2(const char* p, size_t n) {
+  size_t i = 0;
+  const __m128i cero = _mm_setzero_si128();
+  for (; i + 64 <= n; i += 64) {
+    __m128i o = _mm_or_si128(
+      _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 16))),
+      _mm_or_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 32)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 48))));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(o, cero)) != 0xFFFF) return false;
+  }
+  return esCeroEscalar(p, i, n);
+}
+
+__attribute__((target("avx2"))) bool esCeroAVX2(const char* p, size_t n) {
+  size_t i = 0;
+  // 128 bytes por iteración: se juntan con OR y se prueba una sola vez
+  for (; i + 128 <= n; i += 128) {
+    __m256i o = _mm256_or_si256(
+      _mm256_or_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 32))),
+      _mm256_or_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 64)),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 96))));
+    if (!_mm256_testz_si256(o, o)) return false;
+  }
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+    if (!_mm256_testz_si256(v, v)) return false;
+  }
+  return esCeroEscalar(p, i, n);
+}
+#endif
+
+enum class Nivel { Escalar, SSE2, AVX2 };
+
+Nivel detectarNivel() {
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return Nivel::AVX2;
+  if (__builtin_cpu_supports("sse2")) return Nivel::SSE2;
+#endif
+  return Nivel::Escalar;
+}
+
+Nivel nivelActual() {
+  static const Nivel nivel = detectarNivel();
+  return nivel;
+}
+
+}  // namespace
+
+size_t primerDiferente(const char* a, const char* b, size_t n) {
+  switch (nivelActual()) {
+#ifdef SIMD_X86
+    case Nivel::AVX2: return primerDiferenteAVX2(a, b, n);
+    case Nivel::SSE2: return primerDiferenteSSE2(a, b, n);
+#endif
+    default: return primerDiferenteEscalar(a, b, 0, n);
+  }
+}
+
+void xorBloque(char* dst, const char* src, size_t n) {
+  switch (nivelActual()) {
+#ifdef SIMD_X86
+    case Nivel::AVX2: xorBloqueAVX2(dst, src, n); return;
+    case Nivel::SSE2: xorBloqueSSE2(dst, src, n); return;
+#endif
+    default: xorBloqueEscalar(dst, src, 0, n);
+  }
+}
+
+bool esCero(const char* p, size_t n) {
+  switch (nivelActual()) {
+#ifdef SIMD_X86
+    case Nivel::AVX2: return esCeroAVX2(p, n);
+    case Nivel::SSE2: return esCeroSSE2(p, n);
+#endif
+    default: return esCeroEscalar(p, 0, n);
+  }
+}
+
+const char* nivelSimd() {
+  switch (nivelActual()) {
+    case Nivel::AVX2: return "AVX2";
+    case Nivel::SSE2: return "SSE2";
+    default: return "escalar";
+  }
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+
+// Kernels vectorizados (AVX2/SSE2 con selección en tiempo de ejecución y
+// respaldo escalar en otras arquitecturas).
+
+// Índice del primer byte en que a y b difieren, o n si son iguales
+size_t primerDiferente(const char* a, const char* b, size_t n);
+
+// dst[i] ^= src[i] para i en [0, n) (paridad de RAID 5)
+void xorBloque(char* dst, const char* src, size_t n);
+
+// true si los n bytes de p son cero (detección de bloques sin usar)
+bool esCero(const char* p, size_t n);
+
+// Nombre del conjunto de instrucciones elegido ("AVX2", "SSE2", "escalar")
+const char* nivelSimd();
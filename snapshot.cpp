@@ -0,0 +1,433 @@
+#include "snapshot.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include "discoio.h"
+
+namespace {
+
+const long TAM_BLOQUE = 4096;
+// Registro en un .delta: número de bloque (8 bytes) + datos del bloque
+const long TAM_REGISTRO = 8 + TAM_BLOQUE;
+
+QString dirSnapshots(const QString& archivo) {
+  return archivo + ".snap";
+}
+
+QString rutaIndice(const QString& archivo) {
+  return dirSnapshots(archivo) + "/indice";
+}
+
+QString rutaDatos(const QString& archivo, const InfoSnapshot& s) {
+  QString ext = s.reflink ? ".img" : ".delta";
+  return dirSnapshots(archivo) + "/" + s.nombre + ext;
+}
+
+bool guardarIndice(
+  const QString& archivo, const std::vector<InfoSnapshot>& snaps) {
+  if (snaps.empty()) {
+    QDir(dirSnapshots(archivo)).removeRecursively();
+    return true;
+  }
+  // Se escribe aparte y se renombra para no dejar un índice a medias
+  QString tmp = rutaIndice(archivo) + ".tmp";
+  {
+    std::ofstream f(tmp.toStdString(), std::ios::trunc);
+    if (!f.is_open()) return false;
+    for (const auto& s : snaps)
+      f << s.nombre.toStdString() << ' ' << (s.reflink ? "reflink" : "delta")
+        << ' ' << s.creado << '\n';
+    if (!f.good()) return false;
+  }
+  return rename(tmp.toStdString().c_str(),
+           rutaIndice(archivo).toStdString().c_str()) == 0;
+}
+
+int buscar(const std::vector<InfoSnapshot>& snaps, const QString& nombre) {
+  for (size_t i = 0; i < snaps.size(); ++i)
+    if (snaps[i].nombre == nombre) return static_cast<int>(i);
+  return -1;
+}
+
+// Clona el contenido completo de origen en destino, que no debe existir
+bool clonar(const QString& origen, const QString& destino) {
+#ifdef FICLONE
+  int fdO = open(origen.toStdString().c_str(), O_RDONLY);
+  if (fdO < 0) return false;
+  int fdD = open(
+    destino.toStdString().c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fdD < 0) {
+    close(fdO);
+    return false;
+  }
+  bool ok = ioctl(fdD, FICLONE, fdO) == 0 && fsync(fdD) == 0;
+  close(fdO);
+  close(fdD);
+  if (!ok) unlink(destino.toStdString().c_str());
+  return ok;
+#else
+  (void)origen;
+  (void)destino;
+  return false;
+#endif
+}
+
+// Un archivo .delta con su mapa bloque -> posición del dato
+class Delta {
+ public:
+  bool abrir(const QString& path, bool escritura) {
+    archivo_ = ArchivoDisco::abrir(path, escritura);
+    if (!archivo_) return false;
+    fin_ = archivo_->tamano();
+    fin_ -= fin_ % TAM_REGISTRO;  // Ignorar un registro final incompleto
+    // Leer los encabezados por lotes
+    const long POR_LOTE = 256;
+    std::vector<char> lote(static_cast<size_t>(POR_LOTE * TAM_REGISTRO));
+    for (long pos = 0; pos < fin_; pos += POR_LOTE * TAM_REGISTRO) {
+      long n = std::min(POR_LOTE * TAM_REGISTRO, fin_ - pos);
+      if (!archivo_->leer(pos, lote.data(), n)) return false;
+      for (long r = 0; r < n; r += TAM_REGISTRO) {
+        long long bloque;
+        memcpy(&bloque, lote.data() + r, sizeof(bloque));
+        mapa_[static_cast<long>(bloque)] = pos + r + 8;
+      }
+    }
+    return true;
+  }
+
+  const std::unordered_map<long, long>& mapa() const { return mapa_; }
+
+  bool leerDato(long off, char* buf, long desde, long n) {
+    return archivo_->leer(off + desde, buf, n);
+  }
+
+  // Sobrescribe el bloque si ya está en el delta, si no lo agrega al final
+  bool escribirBloque(long bloque, long desde, const char* buf, long n) {
+    auto it = mapa_.find(bloque);
+    if (it != mapa_.end())
+      return archivo_->escribir(it->second + desde, buf, n);
+    if (desde != 0 || n != TAM_BLOQUE) return false;
+    std::vector<char> reg(static_cast<size_t>(TAM_REGISTRO));
+    long long b = bloque;
+    memcpy(reg.data(), &b, sizeof(b));
+    memcpy(reg.data() + 8, buf, static_cast<size_t>(TAM_BLOQUE));
+    if (!archivo_->escribir(fin_, reg.data(), TAM_REGISTRO)) return false;
+    mapa_[bloque] = fin_ + 8;
+    fin_ += TAM_REGISTRO;
+    return true;
+  }
+
+  bool sincronizar() { return archivo_->sincronizar(); }
+
+ private:
+  std::unique_ptr<ArchivoDisco> archivo_;
+  std::unordered_map<long, long> mapa_;
+  long fin_ = 0;
+};
+
+// Vista actual de un archivo con deltas: el mapa combinado indica, por
+// bloque, qué delta tiene la versión más reciente. Lo que no está en el mapa
+// se lee de la base. Solo el delta superior recibe escrituras.
+class DiscoConCapas : public Dispositivo {
+ public:
+  static std::unique_ptr<DiscoConCapas> abrir(
+    const QString& path, const std::vector<QString>& deltas, bool escritura) {
+    std::unique_ptr<DiscoConCapas> d(new DiscoConCapas());
+    d->base_ = abrirImagen(path, false);
+    if (!d->base_) return nullptr;
+    d->tam_ = d->base_->tamano();
+    d->capas_.resize(deltas.size());
+    for (size_t i = 0; i < deltas.size(); ++i) {
+      bool superior = (i + 1 == deltas.size());
+      if (!d->capas_[i].abrir(deltas[i], escritura && superior))
+        return nullptr;
+      for (const auto& [bloque, off] : d->capas_[i].mapa())
+        d->mapa_[bloque] = static_cast<int>(i);
+    }
+    return d;
+  }
+
+  bool leer(long pos, char* buf, long n) override {
+    if (pos < 0 || n < 0 || pos + n > tam_) return false;
+    long fin = pos + n;
+    long p = pos;
+    while (p < fin) {
+      long bloque = p / TAM_BLOQUE;
+      auto it = mapa_.find(bloque);
+      if (it == mapa_.end()) {
+        // Juntar bloques consecutivos que están en la base en una lectura
+        long q = (bloque + 1) * TAM_BLOQUE;
+        while (q < fin && !mapa_.count(q / TAM_BLOQUE)) q += TAM_BLOQUE;
+        q = std::min(q, fin);
+        if (!base_->leer(p, buf + (p - pos), q - p)) return false;
+        p = q;
+        continue;
+      }
+      long desde = p - bloque * TAM_BLOQUE;
+      long len = std::min(TAM_BLOQUE - desde, fin - p);
+      Delta& capa = capas_[it->second];
+      if (!capa.leerDato(capa.mapa().at(bloque), buf + (p - pos), desde, len))
+        return false;
+      p += len;
+    }
+    return true;
+  }
+
+  bool escribir(long pos, const char* buf, long n) override {
+    if (pos < 0 || n < 0 || pos + n > tam_ || capas_.empty()) return false;
+    Delta& sup = capas_.back();
+    int iSup = static_cast<int>(capas_.size()) - 1;
+    std::vector<char> bloqueCompleto(static_cast<size_t>(TAM_BLOQUE));
+    long fin = pos + n;
+    for (long p = pos; p < fin;) {
+      long bloque = p / TAM_BLOQUE;
+      long desde = p - bloque * TAM_BLOQUE;
+      long len = std::min(TAM_BLOQUE - desde, fin - p);
+      auto it = mapa_.find(bloque);
+      if (it != mapa_.end() && it->second == iSup) {
+        if (!sup.escribirBloque(bloque, desde, buf + (p - pos), len))
+          return false;
+      } else {
+        // Copia al escribir: se completa el bloque con su versión actual
+        long inicioBloque = bloque * TAM_BLOQUE;
+        long validos = std::min(TAM_BLOQUE, tam_ - inicioBloque);
+        std::fill(bloqueCompleto.begin(), bloqueCompleto.end(), 0);
+        if (len != TAM_BLOQUE &&
+            !leer(inicioBloque, bloqueCompleto.data(), validos))
+          return false;
+        memcpy(bloqueCompleto.data() + desde, buf + (p - pos),
+          static_cast<size_t>(len));
+        if (!sup.escribirBloque(bloque, 0, bloqueCompleto.data(), TAM_BLOQUE))
+          return false;
+        mapa_[bloque] = iSup;
+      }
+      p += len;
+    }
+    return true;
+  }
+
+  bool sincronizar() override {
+    return capas_.empty() || capas_.back().sincronizar();
+  }
+  long tamano() const override { return tam_; }
+
+ private:
+  DiscoConCapas() = default;
+
+  std::unique_ptr<Dispositivo> base_;
+  std::vector<Delta> capas_;
+  std::unordered_map<long, int> mapa_;  // bloque -> capa más reciente
+  long tam_ = 0;
+};
+
+std::vector<QString> rutasDeltas(
+  const QString& archivo, const std::vector<InfoSnapshot>& snaps) {
+  std::vector<QString> rutas;
+  for (const auto& s : snaps)
+    if (!s.reflink) rutas.push_back(rutaDatos(archivo, s));
+  return rutas;
+}
+
+}  // namespace
+
+std::vector<InfoSnapshot> listarSnapshots(const QString& archivo) {
+  std::vector<InfoSnapshot> snaps;
+  std::ifstream f(rutaIndice(archivo).toStdString());
+  std::string linea;
+  while (std::getline(f, linea)) {
+    std::istringstream ss(linea);
+    std::string nombre, modo;
+    long long creado = 0;
+    if (!(ss >> nombre >> modo >> creado)) continue;
+    snaps.push_back(
+      {QString::fromStdString(nombre), modo == "reflink", creado});
+  }
+  return snaps;
+}
+
+std::vector<QString> rutasCapas(const QString& archivo) {
+  return rutasDeltas(archivo, listarSnapshots(archivo));
+}
+
+bool tieneCapas(const QString& archivo) {
+  for (const auto& s : listarSnapshots(archivo))
+    if (!s.reflink) return true;
+  return false;
+}
+
+bool nombreSnapshotValido(const QString& nombre) {
+  if (nombre.isEmpty() || nombre.length() > 64) return false;
+  for (QChar c : nombre)
+    if (!c.isLetterOrNumber() && c != '_' && c != '-') return false;
+  return true;
+}
+
+std::unique_ptr<Dispositivo> abrirMiembro(const QString& path, bool escritura) {
+  auto snaps = listarSnapshots(path);
+  auto deltas = rutasDeltas(path, snaps);
+  if (deltas.empty()) return abrirImagen(path, escritura);
+  return DiscoConCapas::abrir(path, deltas, escritura);
+}
+
+QString crearSnapshot(
+  const QString& archivo, const QString& nombre, bool& reflink) {
+  if (!nombreSnapshotValido(nombre))
+    return "Nombre de snapshot inválido (letras, números, _ y -).";
+  if (!fileExists(archivo)) return "No existe " + archivo + ".";
+  auto snaps = listarSnapshots(archivo);
+  if (buscar(snaps, nombre) >= 0)
+    return "Ya existe el snapshot " + nombre + ".";
+  if (!QDir().mkpath(dirSnapshots(archivo)))
+    return "No se pudo crear " + dirSnapshots(archivo) + ".";
+
+  InfoSnapshot s{nombre, false, static_cast<long long>(time(nullptr))};
+  // Con deltas el archivo base ya está congelado: un clon no reflejaría el
+  // estado actual, así que se apila otro delta
+  s.reflink = !tieneCapas(archivo) &&
+              clonar(archivo, rutaDatos(archivo, {nombre, true, 0}));
+  if (!s.reflink) {
+    // Delta vacío: crearlo no depende del tamaño del disco
+    int fd = open(rutaDatos(archivo, s).toStdString().c_str(),
+      O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) return "No se pudo crear el delta del snapshot.";
+    close(fd);
+  }
+  snaps.push_back(s);
+  if (!guardarIndice(archivo, snaps)) {
+    unlink(rutaDatos(archivo, s).toStdString().c_str());
+    return "No se pudo actualizar el índice de snapshots.";
+  }
+  reflink = s.reflink;
+  return QString();
+}
+
+QString comprobarSnapshot(
+  const QString& archivo, const QString& nombre, bool revertir) {
+  auto snaps = listarSnapshots(archivo);
+  int k = buscar(snaps, nombre);
+  if (k < 0) return "No existe el snapshot " + nombre + " en " + archivo + ".";
+  const InfoSnapshot& s = snaps[k];
+  // El clon se lee y se restaura a un temporal junto al archivo; un delta se
+  // vacía al revertir y se fusiona (se lee) al borrar
+  int modo = (s.reflink || !revertir) ? R_OK : W_OK;
+  if (access(rutaDatos(archivo, s).toStdString().c_str(), modo) != 0)
+    return "No se puede usar " + rutaDatos(archivo, s) + ".";
+  QString dir = QFileInfo(archivo).absolutePath();
+  if (revertir && s.reflink && access(dir.toStdString().c_str(), W_OK) != 0)
+    return "No se puede escribir en " + dir + ".";
+  if (!revertir && !s.reflink && access(archivo.toStdString().c_str(), W_OK) != 0)
+    return "No se puede escribir en " + archivo + ".";
+  return QString();
+}
+
+QString revertirSnapshot(const QString& archivo, const QString& nombre) {
+  auto snaps = listarSnapshots(archivo);
+  int k = buscar(snaps, nombre);
+  if (k < 0) return "No existe el snapshot " + nombre + ".";
+  const InfoSnapshot s = snaps[k];
+  // Nada se descarta hasta tener el estado del snapshot: el clon va a un
+  // temporal que reemplaza al archivo con rename, y el delta se abre antes
+  // de tocar el índice
+  std::vector<InfoSnapshot> posteriores(snaps.begin() + k + 1, snaps.end());
+  snaps.resize(k + 1);
+  if (s.reflink) {
+    QString tmp = archivo + ".tmp";
+    unlink(tmp.toStdString().c_str());
+    if (!clonar(rutaDatos(archivo, s), tmp))
+      return "No se pudo restaurar el clon del snapshot.";
+    if (rename(tmp.toStdString().c_str(), archivo.toStdString().c_str()) !=
+        0) {
+      unlink(tmp.toStdString().c_str());
+      return "No se pudo reemplazar " + archivo + " por el clon.";
+    }
+    // Si el índice no se guarda, los posteriores siguen siendo válidos
+    if (!guardarIndice(archivo, snaps))
+      return "Disco restaurado, pero no se pudo actualizar el índice de "
+             "snapshots.";
+    for (const auto& p : posteriores)
+      unlink(rutaDatos(archivo, p).toStdString().c_str());
+    return QString();
+  }
+
+  int fd = open(rutaDatos(archivo, s).toStdString().c_str(), O_WRONLY);
+  if (fd < 0) return "No se pudo abrir el delta del snapshot.";
+  // Los posteriores se apilan sobre este delta: salen del índice antes de
+  // vaciarlo
+  if (!guardarIndice(archivo, snaps)) {
+    close(fd);
+    return "No se pudo actualizar el índice de snapshots.";
+  }
+  for (const auto& p : posteriores)
+    unlink(rutaDatos(archivo, p).toStdString().c_str());
+  // Vaciar el delta devuelve la vista al estado en que se creó
+  bool ok = ftruncate(fd, 0) == 0 && fsync(fd) == 0;
+  close(fd);
+  return ok ? QString() : "No se pudo vaciar el delta del snapshot.";
+}
+
+QString borrarSnapshot(const QString& archivo, const QString& nombre) {
+  auto snaps = listarSnapshots(archivo);
+  int k = buscar(snaps, nombre);
+  if (k < 0) return "No existe el snapshot " + nombre + ".";
+  const InfoSnapshot s = snaps[k];
+  QString datos = rutaDatos(archivo, s);
+  if (!s.reflink) {
+    // El delta tiene los cambios hechos después del snapshot: pasan a la
+    // capa de abajo (el delta anterior o el archivo base)
+    int abajo = -1;
+    for (int i = k - 1; i >= 0; --i)
+      if (!snaps[i].reflink) {
+        abajo = i;
+        break;
+      }
+    Delta delta;
+    if (!delta.abrir(datos, false)) return "No se pudo leer el delta.";
+    std::vector<char> buf(static_cast<size_t>(TAM_BLOQUE));
+    if (abajo >= 0) {
+      Delta destino;
+      if (!destino.abrir(rutaDatos(archivo, snaps[abajo]), true))
+        return "No se pudo abrir el delta anterior.";
+      for (const auto& [bloque, off] : delta.mapa())
+        if (!delta.leerDato(off, buf.data(), 0, TAM_BLOQUE) ||
+            !destino.escribirBloque(bloque, 0, buf.data(), TAM_BLOQUE))
+          return "Error al fusionar el delta.";
+      destino.sincronizar();
+    } else {
+      auto base = abrirImagen(archivo, true);
+      if (!base) return "No se pudo abrir " + archivo + ".";
+      long tam = base->tamano();
+      for (const auto& [bloque, off] : delta.mapa()) {
+        long inicio = bloque * TAM_BLOQUE;
+        long n = std::min(TAM_BLOQUE, tam - inicio);
+        if (n <= 0) continue;
+        if (!delta.leerDato(off, buf.data(), 0, n) ||
+            !base->escribir(inicio, buf.data(), n))
+          return "Error al fusionar el delta.";
+      }
+      base->sincronizar();
+    }
+  }
+  snaps.erase(snaps.begin() + k);
+  if (!guardarIndice(archivo, snaps))
+    return "No se pudo actualizar el índice de snapshots.";
+  unlink(datos.toStdString().c_str());
+  return QString();
+}
+
+void descartarSnapshots(const QString& archivo) {
+  QDir(dirSnapshots(archivo)).removeRecursively();
+}
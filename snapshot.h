@@ -0,0 +1,44 @@
+#pragma once
+#include <QString>
+#include <memory>
+#include <vector>
+
+#include "dispositivo.h"
+
+// Snapshots de un archivo de disco, guardados en "<archivo>.snap/":
+//  - reflink: <nombre>.img es un clon FICLONE del archivo (sin copiar datos)
+//  - delta:   el archivo queda congelado y las escrituras posteriores van a
+//             <nombre>.delta, por bloques de 4 KiB. Los deltas se apilan en
+//             el orden de creación y la vista actual es base + deltas.
+// El orden y modo de cada snapshot se guarda en "<archivo>.snap/indice".
+struct InfoSnapshot {
+  QString nombre;
+  bool reflink;
+  long long creado;  // segundos desde epoch
+};
+
+// Abre un archivo de disco; si tiene deltas devuelve la vista actual con un
+// mapa de bloques en memoria, si no el archivo directo
+std::unique_ptr<Dispositivo> abrirMiembro(const QString& path, bool escritura);
+bool tieneCapas(const QString& archivo);
+// Archivos .delta del disco, de la capa más vieja a la más nueva
+std::vector<QString> rutasCapas(const QString& archivo);
+std::vector<InfoSnapshot> listarSnapshots(const QString& archivo);
+bool nombreSnapshotValido(const QString& nombre);
+
+// Devuelven el error o cadena vacía. crearSnapshot usa reflink si el sistema
+// de archivos lo soporta y el archivo no tiene deltas; si no, un delta nuevo.
+QString crearSnapshot(
+  const QString& archivo, const QString& nombre, bool& reflink);
+// Verifica, sin tocar nada, que el snapshot existe en el archivo y que se
+// puede revertir (revertir) o borrar; así un disco de varios archivos no
+// queda revertido a medias por un problema que se podía ver antes
+QString comprobarSnapshot(
+  const QString& archivo, const QString& nombre, bool revertir);
+// Vuelve al estado del snapshot y descarta los snapshots posteriores. Si no
+// puede restaurarlo, el archivo y sus snapshots quedan como estaban.
+QString revertirSnapshot(const QString& archivo, const QString& nombre);
+// Olvida el snapshot; un delta se fusiona con la capa de abajo
+QString borrarSnapshot(const QString& archivo, const QString& nombre);
+// Elimina todos los snapshots (al crear o borrar el disco)
+void descartarSnapshots(const QString& archivo);
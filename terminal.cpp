@@ -1,6 +1,11 @@
 #include "terminal.h"
 #include "ui_terminal.h"
 
+#include <map>
+
+#include "catalogo.h"
+#include "paralelo.h"
+
 Terminal::Terminal(QWidget* parent)
     : QWidget(parent),
       ui(new Ui::Terminal),
@@ -59,7 +64,7 @@ void Terminal::processCommand(const QString& linea) {
   } else if (cmd == "cd") {
     processCd(args);
   } else if (cmd == "ls") {
-    processLs();
+    processLs(args);
   } else if (cmd.toLower() == "mkdisk") {
     DiskManager::mkdisk(args, editor, currentDir);
   } else if (cmd.toLower() == "rmdisk") {
@@ -71,7 +76,33 @@ void Terminal::processCommand(const QString& linea) {
   } else if (cmd.toLower() == "unmount") {
     DiskManager::unmount(args, editor);
   } else if (cmd.toLower() == "rep") {
-    DiskManager::rep(args, editor, currentDir);
+    DiskManager::rep(args, editor, currentDir, this);
+  } else if (cmd.toLower() == "scrub") {
+    DiskManager::scrub(args, editor, currentDir);
+  } else if (cmd.toLower() == "snapshot") {
+    DiskManager::snapshot(args, editor, currentDir);
+  } else if (cmd.toLower() == "convert") {
+    DiskManager::convert(args, editor, currentDir);
+  } else if (cmd.toLower() == "export") {
+    DiskManager::exportDisk(args, editor, currentDir);
+  } else if (cmd.toLower() == "import") {
+    DiskManager::importDisk(args, editor, currentDir);
+  } else if (cmd.toLower() == "store") {
+    DiskManager::store(args, editor, currentDir);
+  } else if (cmd.toLower() == "hash") {
+    DiskManager::hash(args, editor);
+  } else if (cmd.toLower() == "diff") {
+    DiskManager::diff(args, editor);
+  } else if (cmd.toLower() == "pexport") {
+    DiskManager::pexport(args, editor, currentDir);
+  } else if (cmd.toLower() == "pimport") {
+    DiskManager::pimport(args, editor, currentDir);
+  } else if (cmd.toLower() == "cache") {
+    DiskManager::cache(args, editor);
+  } else if (cmd.toLower() == "nbd") {
+    DiskManager::nbd(args, editor, currentDir);
+  } else if (cmd.toLower() == "catalog") {
+    DiskManager::catalog(args, editor, currentDir);
   }
 
   else {
@@ -111,7 +142,8 @@ void Terminal::processCd(const QStringList& args) {
     "Directorio actual actualizado a: " + currentDir.path() + "\n");
 }
 
-void Terminal::processLs() {
+void Terminal::processLs(const QStringList& args) {
+  bool largo = args.contains("-l");
   // Obtener lista de archivos y carpetas del directorio actual
   QFileInfoList entries = currentDir.entryInfoList(
       QDir::NoDotAndDotDot | QDir::AllEntries,
@@ -122,9 +154,24 @@ void Terminal::processLs() {
     editor->appendPlainText("");
     return;
   }
+  // Con -l los discos se resumen con el mismo escaneo que catalog
+  std::map<QString, ResumenDisco> discos;
+  if (largo)
+    for (ResumenDisco& r :
+         CatalogoDiscos::global().escanear(currentDir, hilosDeTrabajo(16)))
+      discos[QFileInfo(r.path).fileName()] = std::move(r);
   QStringList output;
-  for (const QFileInfo& info : entries)
-    output << "- " + info.fileName();
+  for (const QFileInfo& info : entries) {
+    QString linea = "- " + info.fileName();
+    if (largo && info.isDir()) {
+      linea += "/";
+    } else if (largo) {
+      linea += QString("  %1 bytes").arg(info.size());
+      auto it = discos.find(info.fileName());
+      if (it != discos.end()) linea += "  " + describirResumen(it->second);
+    }
+    output << linea;
+  }
 
   editor->appendPlainText(output.join('\n'));
   editor->appendPlainText("");
@@ -179,6 +226,27 @@ void Terminal::printPrompt() {
   editor->setTextCursor(c);
 }
 
+// Muestra la salida de un comando que terminó en segundo plano sin perder lo
+// que el usuario lleva escrito: el mensaje ocupa el lugar del prompt y la
+// línea a medias se vuelve a escribir debajo
+void Terminal::mostrarAsincrono(const QString& texto) {
+  QString escrito = editor->toPlainText().mid(lineStartPos);
+  int posCursor = editor->textCursor().position() - lineStartPos;
+  QTextCursor c = editor->textCursor();
+  c.setPosition(lineStartPos - prompt.length());
+  c.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
+  c.removeSelectedText();
+  c.insertText(texto);
+  editor->setTextCursor(c);
+  printPrompt();
+  setLineText(escrito);
+  if (posCursor >= 0 && posCursor < escrito.length()) {
+    c = editor->textCursor();
+    c.setPosition(lineStartPos + posCursor);
+    editor->setTextCursor(c);
+  }
+}
+
 // -------------------- Manejo de input de teclas ---------------
 void Terminal::onBackspace() {
   QTextCursor c = editor->textCursor();
@@ -22,6 +22,8 @@ class Terminal : public QWidget {
   bool esperandoConfirmacion = false;
   QString prompt;
   void printPrompt();
+  // Para comandos que terminan después de devolver el prompt (rep)
+  void mostrarAsincrono(const QString& texto);
 
  signals:
   void confirmacionRecibida(char r);
@@ -48,6 +50,6 @@ class Terminal : public QWidget {
   void setLineText(const QString& text);
   void processCommand(const QString& cmd);
   void processCd(const QStringList& args);
-  void processLs();
+  void processLs(const QStringList& args);
   void printEncabezado() const;
 };
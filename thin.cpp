@@ -0,0 +1,195 @@
+#include "thin.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "discoio.h"
+
+namespace {
+
+const char MAGIC_THIN[8] = {'P', '2', 'T', 'H', 'I', 'N', 0, 0};
+const int BITS_CLUSTER = 16;  // 64 KiB
+const long OFF_L1 = 4096;
+const size_t MAX_TABLAS_L2 = 256;
+
+long redondearArriba(long v, long multiplo) {
+  return (v + multiplo - 1) / multiplo * multiplo;
+}
+
+}  // namespace
+
+bool esImagenThin(const QString& path) {
+  int fd = open(path.toStdString().c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  char magic[8];
+  bool ok = leerCompleto(fd, 0, magic, sizeof(magic)) &&
+            memcmp(magic, MAGIC_THIN, sizeof(magic)) == 0;
+  close(fd);
+  return ok;
+}
+
+QString crearImagenThin(const QString& path, long tamVirtual) {
+  CabeceraThin cab;
+  memset(&cab, 0, sizeof(cab));
+  memcpy(cab.magic, MAGIC_THIN, sizeof(MAGIC_THIN));
+  cab.version = 1;
+  cab.bitsCluster = BITS_CLUSTER;
+  cab.tamVirtual = tamVirtual;
+  cab.offL1 = OFF_L1;
+  long tamCluster = 1L << BITS_CLUSTER;
+  long entradasL2 = tamCluster / 8;
+  long clusters = (tamVirtual + tamCluster - 1) / tamCluster;
+  cab.entradasL1 = static_cast<int>((clusters + entradasL2 - 1) / entradasL2);
+  long fin = redondearArriba(OFF_L1 + cab.entradasL1 * 8L, tamCluster);
+
+  int fd = open(path.toStdString().c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return "No se pudo crear " + path + ".";
+  // La tabla L1 empieza en ceros: se escribe explícita para que la imagen
+  // no tenga huecos
+  std::vector<char> inicio(static_cast<size_t>(fin), 0);
+  memcpy(inicio.data(), &cab, sizeof(cab));
+  bool ok = escribirCompleto(fd, 0, inicio.data(), fin);
+  close(fd);
+  if (!ok) return "No se pudo escribir la cabecera de " + path + ".";
+  return QString();
+}
+
+std::unique_ptr<ImagenThin> ImagenThin::abrir(
+  const QString& path, bool escritura) {
+  std::unique_ptr<ImagenThin> img(new ImagenThin());
+  img->archivo_ = ArchivoDisco::abrir(path, escritura);
+  if (!img->archivo_) return nullptr;
+  CabeceraThin& c = img->cab_;
+  if (!img->archivo_->leer(0, reinterpret_cast<char*>(&c), sizeof(c)) ||
+      memcmp(c.magic, MAGIC_THIN, sizeof(MAGIC_THIN)) != 0 ||
+      c.bitsCluster < 12 || c.bitsCluster > 24 || c.tamVirtual < 0)
+    return nullptr;
+  img->tamCluster_ = 1L << c.bitsCluster;
+  img->entradasL2_ = img->tamCluster_ / 8;
+  // La L1 tiene que caber en el archivo y cubrir todo el tamaño virtual: si
+  // no, tablaL2 indexaría fuera de ella
+  long tam = img->archivo_->tamano();
+  long clusters = static_cast<long>(c.tamVirtual / img->tamCluster_) +
+                  (c.tamVirtual % img->tamCluster_ != 0 ? 1 : 0);
+  long necesarias = (clusters + img->entradasL2_ - 1) / img->entradasL2_;
+  if (c.offL1 < static_cast<long long>(sizeof(c)) || c.offL1 > tam ||
+      c.entradasL1 < necesarias || c.entradasL1 > (tam - c.offL1) / 8)
+    return nullptr;
+  img->l1_.resize(static_cast<size_t>(c.entradasL1));
+  if (!img->archivo_->leer(static_cast<long>(c.offL1),
+        reinterpret_cast<char*>(img->l1_.data()), c.entradasL1 * 8L))
+    return nullptr;
+  img->fin_ = redondearArriba(tam, img->tamCluster_);
+  return img;
+}
+
+std::vector<long long>* ImagenThin::tablaL2(long i, bool crear) {
+  auto it = l2_.find(i);
+  if (it != l2_.end()) {
+    usoL2_.remove(i);
+    usoL2_.push_front(i);
+    return &it->second;
+  }
+  bool nueva = (l1_[i] == 0);
+  if (nueva) {
+    if (!crear) return nullptr;
+    // Tabla nueva en ceros al final del archivo
+    long pos = fin_;
+    std::vector<char> ceros(static_cast<size_t>(tamCluster_), 0);
+    if (!archivo_->escribir(pos, ceros.data(), tamCluster_)) return nullptr;
+    fin_ += tamCluster_;
+    long long entrada = pos;
+    long posL1 = static_cast<long>(cab_.offL1) + i * 8;
+    if (!archivo_->escribir(posL1, reinterpret_cast<char*>(&entrada), 8))
+      return nullptr;
+    l1_[i] = entrada;
+  }
+  if (l2_.size() >= MAX_TABLAS_L2) {
+    l2_.erase(usoL2_.back());
+    usoL2_.pop_back();
+  }
+  std::vector<long long> tabla(static_cast<size_t>(entradasL2_), 0);
+  if (!nueva && !archivo_->leer(static_cast<long>(l1_[i]),
+                 reinterpret_cast<char*>(tabla.data()), tamCluster_))
+    return nullptr;
+  usoL2_.push_front(i);
+  return &(l2_[i] = std::move(tabla));
+}
+
+long ImagenThin::buscarCluster(long c) {
+  auto* tabla = tablaL2(c / entradasL2_, false);
+  return tabla ? static_cast<long>((*tabla)[c % entradasL2_]) : 0;
+}
+
+long ImagenThin::asignarCluster(long c, const char* contenido) {
+  auto* tabla = tablaL2(c / entradasL2_, true);
+  if (!tabla) return 0;
+  long long& entrada = (*tabla)[c % entradasL2_];
+  // El cluster se escribe completo (datos o ceros) antes de publicarlo en la
+  // L2, así nunca apunta a una zona sin escribir
+  long pos = fin_;
+  std::vector<char> ceros;
+  if (!contenido) {
+    ceros.assign(static_cast<size_t>(tamCluster_), 0);
+    contenido = ceros.data();
+  }
+  if (!archivo_->escribir(pos, contenido, tamCluster_)) return 0;
+  fin_ += tamCluster_;
+  long long nueva = pos;
+  long posL2 = static_cast<long>(l1_[c / entradasL2_]) + (c % entradasL2_) * 8;
+  if (!archivo_->escribir(posL2, reinterpret_cast<char*>(&nueva), 8)) return 0;
+  entrada = nueva;
+  return pos;
+}
+
+bool ImagenThin::leer(long pos, char* buf, long n) {
+  if (pos < 0 || n < 0 || pos + n > cab_.tamVirtual) return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  long fin = pos + n;
+  long p = pos;
+  while (p < fin) {
+    long c = p / tamCluster_;
+    long desde = p - c * tamCluster_;
+    long fisico = buscarCluster(c);
+    // Juntar clusters contiguos en el archivo (o todos sin asignar)
+    long q = std::min((c + 1) * tamCluster_, fin);
+    while (q < fin) {
+      long sig = buscarCluster(q / tamCluster_);
+      bool contiguo = fisico == 0 ? sig == 0
+                                  : sig == fisico + (q - p) + desde;
+      if (!contiguo) break;
+      q = std::min(q + tamCluster_, fin);
+    }
+    if (fisico == 0) memset(buf + (p - pos), 0, static_cast<size_t>(q - p));
+    else if (!archivo_->leer(fisico + desde, buf + (p - pos), q - p))
+      return false;
+    p = q;
+  }
+  return true;
+}
+
+bool ImagenThin::escribir(long pos, const char* buf, long n) {
+  if (pos < 0 || n < 0 || pos + n > cab_.tamVirtual) return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  long fin = pos + n;
+  for (long p = pos; p < fin;) {
+    long c = p / tamCluster_;
+    long desde = p - c * tamCluster_;
+    long len = std::min(tamCluster_ - desde, fin - p);
+    long fisico = buscarCluster(c);
+    if (fisico == 0 && len == tamCluster_) {
+      // Cluster nuevo escrito entero: basta con asignarlo con los datos
+      if (asignarCluster(c, buf + (p - pos)) == 0) return false;
+      p += len;
+      continue;
+    }
+    if (fisico == 0) fisico = asignarCluster(c, nullptr);
+    if (fisico == 0) return false;
+    if (!archivo_->escribir(fisico + desde, buf + (p - pos), len))
+      return false;
+    p += len;
+  }
+  return true;
+}
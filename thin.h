@@ -0,0 +1,58 @@
+#pragma once
+#include <QString>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "dispositivo.h"
+
+// Formato de imagen "thin" (mkdisk -format=thin). El archivo solo crece con
+// los clusters escritos, sin depender de que el sistema de archivos guarde
+// huecos:
+//   [cabecera][tabla L1][tablas L2 y clusters de datos, en orden de uso]
+// L1 apunta a tablas L2 de un cluster; cada entrada L2 apunta a un cluster
+// de datos. Una entrada en 0 significa "no asignado" y se lee como ceros.
+struct CabeceraThin {
+  char magic[8];        // "P2THIN"
+  int version;          // 1
+  int bitsCluster;      // log2 del tamaño de cluster
+  long long tamVirtual; // tamaño del disco que ve el MBR
+  long long offL1;      // posición de la tabla L1
+  int entradasL1;
+  int reservado;
+};
+
+bool esImagenThin(const QString& path);
+// Crea la imagen vacía; devuelve el error o cadena vacía
+QString crearImagenThin(const QString& path, long tamVirtual);
+
+class ImagenThin : public Dispositivo {
+ public:
+  static std::unique_ptr<ImagenThin> abrir(const QString& path, bool escritura);
+
+  bool leer(long pos, char* buf, long n) override;
+  bool escribir(long pos, const char* buf, long n) override;
+  bool sincronizar() override { return archivo_->sincronizar(); }
+  long tamano() const override { return cab_.tamVirtual; }
+
+ private:
+  ImagenThin() = default;
+  // Posición física del cluster c (0 si no está asignado)
+  long buscarCluster(long c);
+  // Asigna el cluster c al final del archivo con el contenido dado (o ceros)
+  long asignarCluster(long c, const char* contenido);
+  std::vector<long long>* tablaL2(long i, bool crear);
+
+  std::unique_ptr<ArchivoDisco> archivo_;
+  CabeceraThin cab_{};
+  long tamCluster_ = 0;
+  long entradasL2_ = 0;
+  long fin_ = 0;  // Próxima posición libre (alineada a cluster)
+  std::vector<long long> l1_;
+  // Tablas L2 leídas, con expulsión de la menos usada
+  std::unordered_map<long, std::vector<long long>> l2_;
+  std::list<long> usoL2_;
+  std::mutex mutex_;
+};
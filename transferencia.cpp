@@ -0,0 +1,245 @@
+#include "transferencia.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "discoio.h"
+
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+namespace {
+
+const long TAM_TROZO = 4L * 1024 * 1024;
+const long ALINEACION_REFLINK = 4096;
+
+bool intentarReflink(int fdO, long posO, int fdD, long posD, long n) {
+#ifdef FICLONERANGE
+  if (posO % ALINEACION_REFLINK || posD % ALINEACION_REFLINK ||
+      n % ALINEACION_REFLINK)
+    return false;
+  file_clone_range r;
+  r.src_fd = fdO;
+  r.src_offset = static_cast<__u64>(posO);
+  r.src_length = static_cast<__u64>(n);
+  r.dest_offset = static_cast<__u64>(posD);
+  return ioctl(fdD, FICLONERANGE, &r) == 0;
+#else
+  (void)fdO;
+  (void)posO;
+  (void)fdD;
+  (void)posD;
+  (void)n;
+  return false;
+#endif
+}
+
+// copy_file_range; devuelve los bytes copiados (puede quedar corto si el
+// sistema de archivos no lo soporta en medio de la copia)
+long intentarCopyFileRange(int fdO, long posO, int fdD, long posD, long n) {
+  long hecho = 0;
+#ifdef __linux__
+  loff_t o = posO, d = posD;
+  while (hecho < n) {
+    ssize_t r = copy_file_range(
+      fdO, &o, fdD, &d, static_cast<size_t>(n - hecho), 0);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) break;
+    hecho += r;
+  }
+#else
+  (void)fdO;
+  (void)posO;
+  (void)fdD;
+  (void)posD;
+  (void)n;
+#endif
+  return hecho;
+}
+
+long intentarSendfile(int fdO, long posO, int fdD, long posD, long n) {
+  if (lseek(fdD, posD, SEEK_SET) != posD) return 0;
+  off_t o = posO;
+  long hecho = 0;
+  while (hecho < n) {
+    ssize_t r = sendfile(fdD, fdO, &o, static_cast<size_t>(n - hecho));
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) break;
+    hecho += r;
+  }
+  return hecho;
+}
+
+}  // namespace
+
+const char* nombreMetodo(MetodoCopia m) {
+  switch (m) {
+    case MetodoCopia::Reflink: return "reflink";
+    case MetodoCopia::CopyFileRange: return "copy_file_range";
+    case MetodoCopia::Sendfile: return "sendfile";
+    default: return "lectura/escritura";
+  }
+}
+
+bool copiarRango(int fdOrigen, long posOrigen, int fdDestino, long posDestino,
+  long n, MetodoCopia& metodo) {
+  metodo = MetodoCopia::Reflink;
+  if (n == 0 || intentarReflink(fdOrigen, posOrigen, fdDestino, posDestino, n))
+    return true;
+  // Cada mecanismo sigue desde donde quedó el anterior
+  long hecho = 0;
+  metodo = MetodoCopia::CopyFileRange;
+  hecho += intentarCopyFileRange(
+    fdOrigen, posOrigen, fdDestino, posDestino, n);
+  if (hecho == n) return true;
+  metodo = MetodoCopia::Sendfile;
+  hecho += intentarSendfile(fdOrigen, posOrigen + hecho, fdDestino,
+    posDestino + hecho, n - hecho);
+  if (hecho == n) return true;
+  metodo = MetodoCopia::LecturaEscritura;
+  std::vector<char> buf(static_cast<size_t>(std::min(TAM_TROZO, n - hecho)));
+  while (hecho < n) {
+    long len = std::min(static_cast<long>(buf.size()), n - hecho);
+    if (!leerCompleto(fdOrigen, posOrigen + hecho, buf.data(), len) ||
+        !escribirCompleto(fdDestino, posDestino + hecho, buf.data(), len))
+      return false;
+    hecho += len;
+  }
+  return true;
+}
+
+bool copiarEntreDispositivos(Dispositivo& origen, long posOrigen,
+  Dispositivo& destino, long posDestino, long n) {
+  if (n <= 0) return true;
+  // Un solo hilo lector durante toda la copia; lector y escritor se pasan
+  // los dos búferes por turno
+  std::vector<char> bufs[2] = {
+    std::vector<char>(static_cast<size_t>(std::min(TAM_TROZO, n))),
+    std::vector<char>(static_cast<size_t>(std::min(TAM_TROZO, n)))};
+  long largo[2] = {0, 0};
+  bool lleno[2] = {false, false};
+  bool falloLectura = false;
+  bool parar = false;  // El escritor abandonó la copia
+  std::mutex mutex;
+  std::condition_variable cambio;
+
+  std::thread lector([&]() {
+    int i = 0;
+    for (long hecho = 0; hecho < n; hecho += TAM_TROZO, i = 1 - i) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cambio.wait(lock, [&]() { return !lleno[i] || parar; });
+        if (parar) return;
+      }
+      long len = std::min(TAM_TROZO, n - hecho);
+      bool ok = origen.leer(posOrigen + hecho, bufs[i].data(), len);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        largo[i] = len;
+        lleno[i] = ok;
+        falloLectura = !ok;
+      }
+      cambio.notify_all();
+      if (!ok) return;
+    }
+  });
+
+  bool ok = true;
+  int i = 0;
+  for (long hecho = 0; hecho < n && ok; hecho += TAM_TROZO, i = 1 - i) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cambio.wait(lock, [&]() { return lleno[i] || falloLectura; });
+      if (!lleno[i]) {
+        ok = false;
+        break;
+      }
+    }
+    ok = destino.escribir(posDestino + hecho, bufs[i].data(), largo[i]);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      lleno[i] = false;
+      parar = !ok;
+    }
+    cambio.notify_all();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    parar = true;
+  }
+  cambio.notify_all();
+  lector.join();
+  return ok;
+}
+
+QString volcarRango(Dispositivo& disco, const QString& archivoPlano,
+  long inicio, long tam, const QString& destino, MetodoCopia& metodo) {
+  int fd = open(destino.toStdString().c_str(), O_RDWR | O_CREAT | O_EXCL,
+    0644);
+  if (fd < 0) return "No se pudo crear " + destino + ".";
+  bool ok = ftruncate(fd, tam) == 0;
+  std::unique_ptr<ArchivoDisco> origen;
+  if (ok && !archivoPlano.isEmpty())
+    origen = ArchivoDisco::abrir(archivoPlano, false);
+  if (ok && origen) {
+    ok = copiarRango(origen->fd(), inicio, fd, 0, tam, metodo);
+  } else if (ok) {
+    metodo = MetodoCopia::LecturaEscritura;
+    auto salida = ArchivoDisco::abrir(destino, true);
+    ok = salida && copiarEntreDispositivos(disco, inicio, *salida, 0, tam);
+  }
+  ok = ok && fdatasync(fd) == 0;
+  close(fd);
+  if (ok) return QString();
+  unlink(destino.toStdString().c_str());
+  return "Error al exportar la partición a " + destino + ".";
+}
+
+QString clonarArchivo(
+  const QString& origen, const QString& destino, MetodoCopia& metodo) {
+  int fdO = open(origen.toStdString().c_str(), O_RDONLY);
+  if (fdO < 0) return "No se pudo abrir " + origen + ".";
+  struct stat st;
+  int fdD = fstat(fdO, &st) == 0
+              ? open(destino.toStdString().c_str(),
+                  O_WRONLY | O_CREAT | O_EXCL, 0644)
+              : -1;
+  if (fdD < 0) {
+    close(fdO);
+    return "No se pudo crear " + destino + ".";
+  }
+  bool ok = true;
+  metodo = MetodoCopia::Reflink;
+#ifdef FICLONE
+  bool clonado = ioctl(fdD, FICLONE, fdO) == 0;
+#else
+  bool clonado = false;
+#endif
+  if (!clonado) {
+    long tam = static_cast<long>(st.st_size);
+    ok = ftruncate(fdD, tam) == 0;
+    for (const Extension& e : extensionesDeDatos(fdO, tam)) {
+      MetodoCopia usado;
+      if (!ok) break;
+      ok = copiarRango(fdO, e.inicio, fdD, e.inicio, e.tam, usado);
+      // Se informa el mecanismo más lento que hizo falta
+      if (static_cast<int>(usado) > static_cast<int>(metodo)) metodo = usado;
+    }
+  }
+  ok = ok && fdatasync(fdD) == 0;
+  close(fdO);
+  close(fdD);
+  if (ok) return QString();
+  unlink(destino.toStdString().c_str());
+  return "Error al copiar " + origen + ".";
+}
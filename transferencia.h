@@ -0,0 +1,34 @@
+#pragma once
+#include <QString>
+
+#include "dispositivo.h"
+
+// Copias de rangos para pexport/pimport.
+
+enum class MetodoCopia { Reflink, CopyFileRange, Sendfile, LecturaEscritura };
+const char* nombreMetodo(MetodoCopia m);
+
+// Copia n bytes entre descriptores sin pasar por el espacio de usuario
+// cuando el kernel lo permite: reflink (FICLONERANGE, solo con rangos
+// alineados a 4 KiB), luego copy_file_range, luego sendfile y, si nada de
+// eso aplica, pread/pwrite. En metodo queda el mecanismo que terminó la
+// copia.
+bool copiarRango(int fdOrigen, long posOrigen, int fdDestino, long posDestino,
+  long n, MetodoCopia& metodo);
+
+// Copia entre dispositivos (imágenes thin, comprimidas, RAID o con capas).
+// Un hilo lector va un trozo adelante mientras se escribe el actual.
+bool copiarEntreDispositivos(Dispositivo& origen, long posOrigen,
+  Dispositivo& destino, long posDestino, long n);
+
+// Crea destino (que no debe existir) con el rango [inicio, inicio + tam) del
+// disco. Si archivoPlano no está vacío se copia directo desde ese archivo;
+// si no, se lee a través del dispositivo. Devuelve el error o cadena vacía.
+QString volcarRango(Dispositivo& disco, const QString& archivoPlano,
+  long inicio, long tam, const QString& destino, MetodoCopia& metodo);
+
+// Crea destino (que no debe existir) como copia de origen: reflink del
+// archivo completo (FICLONE) si el sistema de archivos lo permite; si no,
+// copia solo sus extensiones con datos y deja los huecos como huecos.
+QString clonarArchivo(
+  const QString& origen, const QString& destino, MetodoCopia& metodo);
@@ -0,0 +1,316 @@
+#include "uso.h"
+
+#include <QColor>
+#include <QImage>
+#include <QPainter>
+#include <fcntl.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+
+#include "discoio.h"
+#include "dispositivo.h"
+#include "paralelo.h"
+#include "simd.h"
+
+namespace {
+
+// Cada hilo toma trozos de este tamaño (múltiplo del bloque), alineados al
+// inicio de su partición
+const long TAM_TROZO_USO = 64 * TAM_BLOQUE_USO;  // 4 MiB
+
+const int PADDING = 20;
+const int ALTO_ETIQUETA = 18;
+const int ALTO_FRANJA = 24;
+const int SEPARACION = 10;
+const int ALTO_PARTICION = ALTO_ETIQUETA + ALTO_FRANJA + SEPARACION;
+
+struct TrozoUso {
+  size_t particion;
+  long desde;  // Relativo al inicio de la partición
+  long tam;
+};
+
+// Color de una celda: de casi blanco (vacía) a azul oscuro (llena)
+QColor colorCelda(float f) {
+  auto mezclar = [f](int vacio, int lleno) {
+    return vacio + static_cast<int>((lleno - vacio) * f + 0.5f);
+  };
+  return QColor(mezclar(245, 31), mezclar(247, 78), mezclar(250, 121));
+}
+
+double porcentaje(long parte, long total) {
+  return total > 0 ? 100.0 * parte / total : 0.0;
+}
+
+QString etiqueta(const UsoParticion& p) {
+  const double MiB = 1024.0 * 1024.0;
+  return QString("%1 (%2)  %3 / %4 MiB  %5%")
+    .arg(p.nombre)
+    .arg(p.tipo)
+    .arg(p.usado / MiB, 0, 'f', 1)
+    .arg(p.tamano / MiB, 0, 'f', 1)
+    .arg(porcentaje(p.usado, p.tamano), 0, 'f', 1);
+}
+
+// Posición horizontal del borde izquierdo de la celda k de n
+int bordeCelda(int k, int n, int ancho) {
+  return PADDING + static_cast<int>(
+                     static_cast<long long>(ancho - 2 * PADDING) * k / n);
+}
+
+int altoMapa(const UsoDisco& uso) {
+  return 2 * PADDING +
+         std::max<int>(1, static_cast<int>(uso.particiones.size())) *
+           ALTO_PARTICION;
+}
+
+bool escribirPng(const UsoDisco& uso, int ancho, const QString& destino) {
+  QImage image(ancho, altoMapa(uso), QImage::Format_ARGB32_Premultiplied);
+  image.fill(QColor(Qt::white));
+  QPainter painter;
+  painter.begin(&image);
+  QFont font = painter.font();
+  font.setPointSize(8);
+  painter.setFont(font);
+  if (uso.particiones.empty()) {
+    painter.setPen(QPen(Qt::black));
+    painter.drawText(PADDING, PADDING, ancho - 2 * PADDING, ALTO_ETIQUETA,
+      Qt::AlignLeft | Qt::AlignVCenter, "El disco no tiene particiones.");
+  }
+  for (size_t i = 0; i < uso.particiones.size(); ++i) {
+    const UsoParticion& p = uso.particiones[i];
+    int top = PADDING + static_cast<int>(i) * ALTO_PARTICION;
+    painter.setPen(QPen(Qt::black));
+    painter.drawText(PADDING, top, ancho - 2 * PADDING, ALTO_ETIQUETA,
+      Qt::AlignLeft | Qt::AlignVCenter, etiqueta(p));
+    int n = static_cast<int>(p.celdas.size());
+    painter.setPen(Qt::NoPen);
+    for (int k = 0; k < n; ++k) {
+      int x0 = bordeCelda(k, n, ancho);
+      painter.fillRect(QRect(x0, top + ALTO_ETIQUETA,
+                         bordeCelda(k + 1, n, ancho) - x0, ALTO_FRANJA),
+        colorCelda(p.celdas[k]));
+    }
+    painter.setPen(QPen(QColor(142, 173, 196), 1));
+    painter.setBrush(Qt::NoBrush);
+    painter.drawRect(QRect(PADDING, top + ALTO_ETIQUETA, ancho - 2 * PADDING,
+      ALTO_FRANJA));
+  }
+  painter.end();
+  return !image.isNull() && image.save(destino, "PNG");
+}
+
+// Las celdas seguidas del mismo color salen en un solo rect
+void escribirSvg(std::ostream& f, const UsoDisco& uso, int ancho) {
+  f << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << ancho
+    << "\" height=\"" << altoMapa(uso)
+    << "\" font-family=\"sans-serif\" font-size=\"11\">\n"
+    << "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n";
+  for (size_t i = 0; i < uso.particiones.size(); ++i) {
+    const UsoParticion& p = uso.particiones[i];
+    int top = PADDING + static_cast<int>(i) * ALTO_PARTICION;
+    f << "<g><text x=\"" << PADDING << "\" y=\"" << top + ALTO_ETIQUETA / 2
+      << "\" dominant-baseline=\"middle\">" << escaparXml(etiqueta(p))
+      << "</text>\n";
+    int n = static_cast<int>(p.celdas.size());
+    for (int k = 0; k < n;) {
+      QColor color = colorCelda(p.celdas[k]);
+      int fin = k + 1;
+      while (fin < n && colorCelda(p.celdas[fin]) == color) ++fin;
+      int x0 = bordeCelda(k, n, ancho);
+      f << "<rect x=\"" << x0 << "\" y=\"" << top + ALTO_ETIQUETA
+        << "\" width=\"" << bordeCelda(fin, n, ancho) - x0 << "\" height=\""
+        << ALTO_FRANJA << "\" fill=\""
+        << color.name().toStdString() << "\"/>";
+      k = fin;
+    }
+    f << "\n<rect x=\"" << PADDING << "\" y=\"" << top + ALTO_ETIQUETA
+      << "\" width=\"" << ancho - 2 * PADDING << "\" height=\""
+      << ALTO_FRANJA << "\" fill=\"none\" stroke=\"#8eadc4\"/></g>\n";
+  }
+  f << "</svg>\n";
+}
+
+void escribirJson(std::ostream& f, const UsoDisco& uso) {
+  f << "{\n  \"disco\": " << escaparJson(uso.path)
+    << ",\n  \"bloque\": " << TAM_BLOQUE_USO
+    << ",\n  \"degradado\": " << (uso.degradado ? "true" : "false")
+    << ",\n  \"particiones\": [";
+  for (size_t i = 0; i < uso.particiones.size(); ++i) {
+    const UsoParticion& p = uso.particiones[i];
+    f << (i ? ",\n" : "\n") << "    {\"nombre\": " << escaparJson(p.nombre)
+      << ", \"tipo\": " << escaparJson(p.tipo) << ", \"inicio\": " << p.inicio
+      << ", \"tamano\": " << p.tamano << ", \"usado\": " << p.usado
+      << ", \"celdas\": [";
+    for (size_t k = 0; k < p.celdas.size(); ++k) {
+      char celda[16];
+      snprintf(celda, sizeof(celda), "%.3f", p.celdas[k]);
+      f << (k ? ", " : "") << celda;
+    }
+    f << "]}";
+  }
+  f << "\n  ]\n}\n";
+}
+
+}  // namespace
+
+QString medirUso(
+  const InstantaneaDisco& inst, int ancho, unsigned hilos, UsoDisco& uso) {
+  uso = UsoDisco();
+  uso.path = inst.path;
+  uso.degradado = inst.degradado;
+  uso.aviso = inst.aviso;
+  const int celdas = std::max(1, ancho - 2 * PADDING);
+  for (const PartitionInfo& b : inst.bloques)
+    if ((b.type == "PRIMARIA" || b.type == "LÓGICA") && b.size > 0) {
+      UsoParticion p;
+      p.nombre = b.name;
+      p.tipo = b.type;
+      p.inicio = b.start;
+      p.tamano = b.size;
+      uso.particiones.push_back(p);
+    }
+
+  // Una imagen plana se lee directo del archivo y sus huecos no se leen.
+  // RAID, thin, comprimidas y discos con snapshots (cuya base está
+  // congelada) pasan por su dispositivo, sin huecos que
+  // saltar (las lecturas grandes no pasan por la caché de bloques).
+  std::unique_ptr<ArchivoDisco> archivo;
+  std::unique_ptr<Dispositivo> disco;
+  std::vector<Extension> datos;
+  if (esArchivoPlano(inst.path))
+    archivo = ArchivoDisco::abrir(inst.path, false);
+  if (archivo) {
+    datos = extensionesDeDatos(archivo->fd(), archivo->tamano());
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(archivo->fd(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  } else {
+    disco = abrirDiscoLectura(inst.path, uso.aviso);
+    if (!disco)
+      return "No se pudo abrir el archivo del disco (" + uso.aviso + ").\n";
+    uso.degradado = uso.degradado || disco->degradado();
+    datos.push_back({0, disco->tamano()});
+  }
+
+  std::vector<TrozoUso> trozos;
+  std::vector<std::vector<char>> usados(uso.particiones.size());
+  for (size_t i = 0; i < uso.particiones.size(); ++i) {
+    const UsoParticion& p = uso.particiones[i];
+    usados[i].assign((p.tamano + TAM_BLOQUE_USO - 1) / TAM_BLOQUE_USO, 0);
+    for (long d = 0; d < p.tamano; d += TAM_TROZO_USO)
+      trozos.push_back({i, d, std::min(TAM_TROZO_USO, p.tamano - d)});
+  }
+
+  uso.hilos = hilos;
+  std::atomic<long> leidos{0};
+  std::atomic<bool> errorLectura{false};
+  ejecutarEnParalelo(trozos.size(), hilos, [&](size_t t) {
+    thread_local std::vector<char> buf;
+    buf.resize(TAM_TROZO_USO);
+    const TrozoUso& trozo = trozos[t];
+    long base = uso.particiones[trozo.particion].inicio;
+    long ini = base + trozo.desde;
+    long fin = ini + trozo.tam;
+    // Primera extensión que termina después del inicio del trozo
+    auto e = std::upper_bound(datos.begin(), datos.end(), ini,
+      [](long pos, const Extension& x) { return pos < x.inicio + x.tam; });
+    // Lee [desde, hasta) y marca sus bloques con algún byte distinto de 0
+    auto revisar = [&](long desde, long hasta) {
+      char* p = buf.data();
+      bool ok = archivo ? leerCompleto(archivo->fd(), desde, p, hasta - desde)
+                        : disco->leer(desde, p, hasta - desde);
+      if (!ok) return false;
+      leidos.fetch_add(hasta - desde);
+      for (long x = desde; x < hasta; x += TAM_BLOQUE_USO) {
+        long n = std::min(TAM_BLOQUE_USO, hasta - x);
+        if (!esCero(p + (x - desde), static_cast<size_t>(n)))
+          usados[trozo.particion][(x - base) / TAM_BLOQUE_USO] = 1;
+      }
+      return true;
+    };
+    // Los bloques que tocan extensiones seguidas se leen en una sola corrida
+    long desde = -1, hasta = -1;
+    for (; e != datos.end() && e->inicio < fin; ++e) {
+      long a = ini + std::max(0L, e->inicio - ini) / TAM_BLOQUE_USO *
+                       TAM_BLOQUE_USO;
+      long z = std::min(fin, ini + (e->inicio + e->tam - ini +
+                                     TAM_BLOQUE_USO - 1) /
+                                    TAM_BLOQUE_USO * TAM_BLOQUE_USO);
+      if (desde >= 0 && a <= hasta) {
+        hasta = std::max(hasta, z);
+        continue;
+      }
+      if (desde >= 0 && !revisar(desde, hasta)) {
+        errorLectura = true;
+        return;
+      }
+      desde = a;
+      hasta = z;
+    }
+    if (desde >= 0 && !revisar(desde, hasta)) errorLectura = true;
+  });
+  if (errorLectura) return "Error de lectura al medir el uso del disco.\n";
+  uso.bytesLeidos = leidos.load();
+
+  long total = 0;
+  for (size_t i = 0; i < uso.particiones.size(); ++i) {
+    UsoParticion& p = uso.particiones[i];
+    const std::vector<char>& u = usados[i];
+    long n = static_cast<long>(u.size());
+    for (long k = 0; k < n; ++k)
+      if (u[k])
+        p.usado += std::min(TAM_BLOQUE_USO, p.tamano - k * TAM_BLOQUE_USO);
+    long c = std::max(1L, std::min<long>(celdas, n));
+    p.celdas.assign(c, 0.0f);
+    for (long k = 0; k < c; ++k) {
+      long de = k * n / c, a = (k + 1) * n / c;
+      long llenos = std::count(u.begin() + de, u.begin() + a, 1);
+      p.celdas[k] = a > de ? static_cast<float>(llenos) / (a - de) : 0.0f;
+    }
+    total += p.tamano;
+  }
+  uso.bytesEnHuecos = std::max(0L, total - uso.bytesLeidos);
+  return QString();
+}
+
+bool escribirMapaUso(const UsoDisco& uso, FormatoReporte formato, int ancho,
+  const QString& destino) {
+  if (formato == FormatoReporte::PNG) return escribirPng(uso, ancho, destino);
+  std::ofstream f(destino.toStdString(), std::ios::trunc);
+  if (!f) return false;
+  if (formato == FormatoReporte::SVG) escribirSvg(f, uso, ancho);
+  else escribirJson(f, uso);
+  f.flush();
+  return f.good();
+}
+
+QString resumirUso(const UsoDisco& uso) {
+  const double MiB = 1024.0 * 1024.0;
+  int largo = 6;
+  for (const UsoParticion& p : uso.particiones)
+    largo = std::max(largo, static_cast<int>(p.nombre.length()));
+  QString r;
+  long usado = 0, total = 0;
+  for (const UsoParticion& p : uso.particiones) {
+    r += QString("  %1  %2  %3 / %4 MiB (%5%)\n")
+           .arg(p.nombre.leftJustified(largo))
+           .arg(p.tipo.leftJustified(8))
+           .arg(p.usado / MiB, 8, 'f', 1)
+           .arg(p.tamano / MiB, 0, 'f', 1)
+           .arg(porcentaje(p.usado, p.tamano), 0, 'f', 1);
+    usado += p.usado;
+    total += p.tamano;
+  }
+  if (uso.particiones.empty()) r += "  El disco no tiene particiones.\n";
+  r += QString("Total: %1 / %2 MiB usados (%3%), bloques de %4 KiB.\n")
+         .arg(usado / MiB, 0, 'f', 1)
+         .arg(total / MiB, 0, 'f', 1)
+         .arg(porcentaje(usado, total), 0, 'f', 1)
+         .arg(TAM_BLOQUE_USO / 1024);
+  return r;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <QString>
+#include <vector>
+
+#include "reporte.h"
+
+// rep -name=usage: cuánto de cada partición tiene datos. La partición se
+// recorre en bloques fijos de TAM_BLOQUE_USO bytes; un bloque está usado si
+// tiene algún byte distinto de cero. En imágenes planas los huecos del
+// archivo (SEEK_DATA/SEEK_HOLE) cuentan como vacíos sin leerse; el resto se
+// lee en trozos grandes repartidos entre varios hilos.
+const long TAM_BLOQUE_USO = 64 * 1024;
+
+struct UsoParticion {
+  QString nombre;
+  QString tipo;  // "PRIMARIA" o "LÓGICA"
+  long inicio = 0;
+  long tamano = 0;
+  long usado = 0;  // Bytes de los bloques usados
+  // Fracción de bloques usados en cada celda del mapa, en orden
+  std::vector<float> celdas;
+};
+
+struct UsoDisco {
+  QString path;
+  std::vector<UsoParticion> particiones;
+  long bytesLeidos = 0;
+  long bytesEnHuecos = 0;  // Saltados por SEEK_DATA, sin leer
+  unsigned hilos = 0;
+  bool degradado = false;
+  QString aviso;
+};
+
+// Mide el uso de las particiones de inst (el llamador tiene el bloqueo
+// compartido del disco). Cada partición queda con a lo sumo una celda por
+// píxel de la franja en un mapa de ancho píxeles. Devuelve el error listo
+// para mostrar o vacío.
+QString medirUso(
+  const InstantaneaDisco& inst, int ancho, unsigned hilos, UsoDisco& uso);
+// Una franja de calor por partición: PNG, SVG o JSON
+bool escribirMapaUso(const UsoDisco& uso, FormatoReporte formato, int ancho,
+  const QString& destino);
+// Una línea por partición con usado/total y el total del disco
+QString resumirUso(const UsoDisco& uso);